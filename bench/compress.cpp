@@ -0,0 +1,621 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+
+// mango-bench-compress: measures every codec of core/compress.hpp over a
+// corpus and writes the results as CSV or JSON. The corpus is either the
+// files given on the command line or built-in synthetic data.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <mango/core/configure.hpp>
+#include <mango/core/compress.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/thread.hpp>
+#include <mango/core/timer.hpp>
+#include <mango/filesystem/file.hpp>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using namespace mango;
+
+namespace
+{
+
+    // ----------------------------------------------------------------------------
+    // codecs
+    // ----------------------------------------------------------------------------
+
+    struct Codec
+    {
+        const char* name;
+        size_t (*bound)(size_t size);
+        size_t (*compress)(Memory dest, Memory source, int level);
+        void (*decompress)(Memory dest, Memory source);
+
+        // the parallel block compression; null when the codec doesn't have one
+        size_t (*bound_parallel)(size_t size);
+        size_t (*compress_parallel)(ThreadPool& pool, Memory dest, Memory source, int level);
+        void (*decompress_parallel)(ThreadPool& pool, Memory dest, Memory source);
+    };
+
+    // deflate has no index of the segments; the stream is decompressed serially
+    void miniz_decompress_parallel(ThreadPool& pool, Memory dest, Memory source)
+    {
+        MANGO_UNREFERENCED_PARAMETER(pool);
+        miniz::decompress(dest, source);
+    }
+
+    const Codec g_codecs[] =
+    {
+        { "miniz", miniz::bound, miniz::compress, miniz::decompress,
+          miniz::bound_parallel, miniz::compress_parallel, miniz_decompress_parallel },
+#ifdef MANGO_ENABLE_LICENSE_BSD
+        { "lz4", lz4::bound, lz4::compress, lz4::decompress,
+          lz4::bound_parallel, lz4::compress_parallel, lz4::decompress_parallel },
+        { "lzo", lzo::bound, lzo::compress, lzo::decompress,
+          lzo::bound_parallel, lzo::compress_parallel, lzo::decompress_parallel },
+        { "zstd", zstd::bound, zstd::compress, zstd::decompress,
+          zstd::bound_parallel, zstd::compress_parallel, zstd::decompress_parallel },
+#endif
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+        { "bzip2", bzip2::bound, bzip2::compress, bzip2::decompress,
+          nullptr, nullptr, nullptr },
+        { "lzfse", lzfse::bound, lzfse::compress, lzfse::decompress,
+          lzfse::bound_parallel, lzfse::compress_parallel, lzfse::decompress_parallel },
+#endif
+    };
+
+    // ----------------------------------------------------------------------------
+    // corpora
+    // ----------------------------------------------------------------------------
+
+    struct Corpus
+    {
+        std::string name;
+        std::vector<uint8> data;
+    };
+
+    std::vector<uint8> generateText(size_t size)
+    {
+        const char* words[] =
+        {
+            "the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "with", "was",
+            "on", "be", "by", "this", "are", "from", "or", "at", "which", "texture", "buffer",
+            "memory", "thread", "image", "vertex", "compression", "stream", "surface", "format",
+            "decoder", "encoder", "block", "pixel", "header", "archive", "allocation", "queue"
+        };
+        const int count = int(sizeof(words) / sizeof(words[0]));
+
+        std::mt19937 rng(1);
+        std::vector<uint8> data;
+        data.reserve(size + 32);
+
+        int column = 0;
+
+        while (data.size() < size)
+        {
+            // the common words are more likely
+            const int range = int(rng() % count) + 1;
+            const char* word = words[rng() % range];
+
+            const size_t length = std::strlen(word);
+            data.insert(data.end(), word, word + length);
+            column += int(length) + 1;
+
+            const uint32 x = rng() % 16;
+            if (x == 0)
+            {
+                data.push_back('.');
+            }
+            else if (x == 1)
+            {
+                data.push_back(',');
+            }
+
+            if (column > 72)
+            {
+                data.push_back('\n');
+                column = 0;
+            }
+            else
+            {
+                data.push_back(' ');
+            }
+        }
+
+        data.resize(size);
+        return data;
+    }
+
+    std::vector<uint8> generateImage(size_t size)
+    {
+        // RGBA gradients with a little noise
+        const int width = 1024;
+        const int height = int((size / 4 + width - 1) / width);
+
+        std::mt19937 rng(2);
+        std::vector<uint8> data(size_t(width) * height * 4);
+        uint8* p = data.data();
+
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                const int noise = int(rng() % 5) - 2;
+                p[0] = uint8(clamp((x * 255) / width + noise, 0, 255));
+                p[1] = uint8(clamp(((y % 512) * 255) / 512 + noise, 0, 255));
+                p[2] = uint8(clamp(((x + y) % 256) + noise, 0, 255));
+                p[3] = 0xff;
+                p += 4;
+            }
+        }
+
+        data.resize(size);
+        return data;
+    }
+
+    std::vector<uint8> generateCompressed(size_t size)
+    {
+        // already compressed data is practically random
+        std::mt19937 rng(3);
+        std::vector<uint8> data(size);
+
+        for (auto& value : data)
+        {
+            value = uint8(rng());
+        }
+
+        return data;
+    }
+
+    // ----------------------------------------------------------------------------
+    // memory
+    // ----------------------------------------------------------------------------
+
+    // The peak memory is the resident set high-water mark of the process during
+    // the measurement minus the resident set before it; it includes the source
+    // and destination buffers. The high-water mark can only be reset on Linux;
+    // elsewhere the peak is reported as zero.
+
+    size_t readProcessStatus(const char* field)
+    {
+        size_t value = 0;
+
+#if defined(MANGO_PLATFORM_LINUX)
+        FILE* file = std::fopen("/proc/self/status", "r");
+        if (file)
+        {
+            const size_t length = std::strlen(field);
+            char line[256];
+
+            while (std::fgets(line, sizeof(line), file))
+            {
+                if (!std::strncmp(line, field, length) && line[length] == ':')
+                {
+                    value = size_t(std::strtoull(line + length + 1, nullptr, 10)) * 1024;
+                    break;
+                }
+            }
+
+            std::fclose(file);
+        }
+#else
+        MANGO_UNREFERENCED_PARAMETER(field);
+#endif
+
+        return value;
+    }
+
+    size_t resetPeakMemory()
+    {
+#if defined(__GLIBC__)
+        // return the memory freed by the previous measurements to the system
+        malloc_trim(0);
+#endif
+
+#if defined(MANGO_PLATFORM_LINUX)
+        FILE* file = std::fopen("/proc/self/clear_refs", "w");
+        if (file)
+        {
+            std::fputs("5", file);
+            std::fclose(file);
+        }
+#endif
+        return readProcessStatus("VmRSS");
+    }
+
+    size_t getPeakMemory(size_t baseline)
+    {
+        const size_t peak = readProcessStatus("VmHWM");
+        return peak > baseline ? peak - baseline : 0;
+    }
+
+    // ----------------------------------------------------------------------------
+    // measurement
+    // ----------------------------------------------------------------------------
+
+    struct Options
+    {
+        std::vector<std::string> codecs;
+        std::vector<int> levels;
+        std::vector<int> threads; // pool sizes of the parallel runs
+        std::vector<std::string> files;
+        size_t size { 8 * 1024 * 1024 };
+        int repeat { 3 };
+        bool json { false };
+    };
+
+    struct Result
+    {
+        std::string corpus;
+        std::string codec;
+        int level;
+        int threads; // zero for the serial functions
+        size_t size;
+        size_t compressed;
+        double compress_time;
+        double decompress_time;
+        size_t peak;
+
+        // throughput relative to the serial functions
+        double compress_speedup;
+        double decompress_speedup;
+    };
+
+    // The parallel runs use the compress_parallel() and decompress_parallel()
+    // functions of the codec on the given pool; the serial runs have no pool.
+
+    bool measure(Result& result, const Codec& codec, const std::vector<uint8>& data, int level, ThreadPool* pool, int repeat)
+    {
+        const bool parallel = pool != nullptr;
+        const size_t baseline = resetPeakMemory();
+
+        const size_t bound = parallel ? codec.bound_parallel(data.size()) : codec.bound(data.size());
+        std::vector<uint8> buffer(bound);
+        std::vector<uint8> output(data.size() + 1);
+
+        Memory source(const_cast<uint8*>(data.data()), data.size());
+        size_t compressed = 0;
+
+        auto run = [&] (bool decompress)
+        {
+            if (decompress)
+            {
+                Memory dest(output.data(), data.size());
+                Memory input(buffer.data(), compressed);
+                if (parallel)
+                    codec.decompress_parallel(*pool, dest, input);
+                else
+                    codec.decompress(dest, input);
+            }
+            else
+            {
+                Memory dest(buffer.data(), buffer.size());
+                compressed = parallel ? codec.compress_parallel(*pool, dest, source, level)
+                                      : codec.compress(dest, source, level);
+            }
+        };
+
+        result.compress_time = 1e30;
+        result.decompress_time = 1e30;
+
+        for (int i = 0; i < repeat; ++i)
+        {
+            Timer timer;
+            run(false);
+            result.compress_time = std::min(result.compress_time, timer.time());
+
+            timer.reset();
+            run(true);
+            result.decompress_time = std::min(result.decompress_time, timer.time());
+        }
+
+        result.peak = getPeakMemory(baseline);
+        result.codec = codec.name;
+        result.level = level;
+        result.threads = parallel ? pool->size() : 0;
+        result.size = data.size();
+        result.compressed = compressed;
+
+        return std::memcmp(output.data(), data.data(), data.size()) == 0;
+    }
+
+    // ----------------------------------------------------------------------------
+    // output
+    // ----------------------------------------------------------------------------
+
+    double throughput(size_t size, double time)
+    {
+        return time > 0 ? double(size) / (time * 1024.0 * 1024.0) : 0.0;
+    }
+
+    void printHeader(const Options& options)
+    {
+        if (options.json)
+        {
+            std::printf("[\n");
+        }
+        else
+        {
+            std::printf("corpus,codec,level,threads,size,compressed,ratio,compress_mbs,decompress_mbs,"
+                        "compress_speedup,decompress_speedup,peak_kb\n");
+        }
+    }
+
+    void printResult(const Options& options, const Result& result, bool first)
+    {
+        const double ratio = result.compressed ? double(result.size) / double(result.compressed) : 0.0;
+        const double compress = throughput(result.size, result.compress_time);
+        const double decompress = throughput(result.size, result.decompress_time);
+
+        if (options.json)
+        {
+            std::printf("%s  { \"corpus\": \"%s\", \"codec\": \"%s\", \"level\": %d, \"threads\": %d, "
+                        "\"size\": %zu, \"compressed\": %zu, \"ratio\": %.3f, \"compress_mbs\": %.1f, "
+                        "\"decompress_mbs\": %.1f, \"compress_speedup\": %.2f, \"decompress_speedup\": %.2f, "
+                        "\"peak_kb\": %zu }",
+                        first ? "" : ",\n", result.corpus.c_str(), result.codec.c_str(), result.level,
+                        result.threads, result.size, result.compressed, ratio, compress, decompress,
+                        result.compress_speedup, result.decompress_speedup, result.peak / 1024);
+        }
+        else
+        {
+            std::printf("%s,%s,%d,%d,%zu,%zu,%.3f,%.1f,%.1f,%.2f,%.2f,%zu\n",
+                        result.corpus.c_str(), result.codec.c_str(), result.level, result.threads,
+                        result.size, result.compressed, ratio, compress, decompress,
+                        result.compress_speedup, result.decompress_speedup, result.peak / 1024);
+        }
+
+        std::fflush(stdout);
+    }
+
+    void printFooter(const Options& options)
+    {
+        if (options.json)
+        {
+            std::printf("\n]\n");
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // command line
+    // ----------------------------------------------------------------------------
+
+    void printUsage()
+    {
+        std::printf("usage: mango-bench-compress [options] [files]\n"
+                    "\n"
+                    "Without files the synthetic text, image and compressed corpora are used.\n"
+                    "\n"
+                    "  --codecs <list>    codecs to measure (default: all)\n"
+                    "  --levels <list>    compression levels 0..10 (default: all)\n"
+                    "  --threads <list>   pool sizes of the parallel runs; 0 measures only the\n"
+                    "                     serial functions (default: the number of processors)\n"
+                    "  --size <MB>        size of the synthetic corpora (default: 8)\n"
+                    "  --repeat <count>   the best of count runs is reported (default: 3)\n"
+                    "  --json             JSON output instead of CSV\n"
+                    "\n"
+                    "The serial functions are reported with 0 threads and compress_parallel() on a\n"
+                    "ThreadPool of each size; the speedups are relative to the serial functions.\n"
+                    "The peak memory is measured only on Linux.\n");
+    }
+
+    std::vector<std::string> split(const std::string& text)
+    {
+        std::vector<std::string> items;
+        size_t start = 0;
+
+        for (;;)
+        {
+            const size_t end = text.find(',', start);
+            const std::string item = text.substr(start, end - start);
+            if (!item.empty())
+            {
+                items.push_back(item);
+            }
+
+            if (end == std::string::npos)
+                break;
+
+            start = end + 1;
+        }
+
+        return items;
+    }
+
+    std::vector<int> splitNumbers(const std::string& text)
+    {
+        std::vector<int> numbers;
+        for (auto& item : split(text))
+        {
+            numbers.push_back(std::atoi(item.c_str()));
+        }
+        return numbers;
+    }
+
+    bool parseOptions(Options& options, int argc, const char* argv[])
+    {
+        options.threads = { std::max(1, int(std::thread::hardware_concurrency())) };
+
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool value = i + 1 < argc;
+
+            if (arg == "--codecs" && value)
+            {
+                options.codecs = split(argv[++i]);
+            }
+            else if (arg == "--levels" && value)
+            {
+                options.levels = splitNumbers(argv[++i]);
+            }
+            else if (arg == "--threads" && value)
+            {
+                options.threads.clear();
+                for (int count : splitNumbers(argv[++i]))
+                {
+                    if (count > 0)
+                    {
+                        options.threads.push_back(count);
+                    }
+                }
+            }
+            else if (arg == "--size" && value)
+            {
+                options.size = size_t(std::max(1, std::atoi(argv[++i]))) * 1024 * 1024;
+            }
+            else if (arg == "--repeat" && value)
+            {
+                options.repeat = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (arg == "--json")
+            {
+                options.json = true;
+            }
+            else if (arg.size() > 1 && arg[0] == '-')
+            {
+                return false;
+            }
+            else
+            {
+                options.files.push_back(arg);
+            }
+        }
+
+        if (options.levels.empty())
+        {
+            for (int level = 0; level <= 10; ++level)
+            {
+                options.levels.push_back(level);
+            }
+        }
+
+        return true;
+    }
+
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+    Options options;
+
+    if (!parseOptions(options, argc, argv))
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<Corpus> corpora;
+
+    if (options.files.empty())
+    {
+        corpora.push_back({ "text", generateText(options.size) });
+        corpora.push_back({ "image", generateImage(options.size) });
+        corpora.push_back({ "compressed", generateCompressed(options.size) });
+    }
+    else
+    {
+        for (auto& filename : options.files)
+        {
+            try
+            {
+                File file(filename);
+                Memory memory = file;
+                corpora.push_back({ filename, std::vector<uint8>(memory.address, memory.address + memory.size) });
+            }
+            catch (Exception& e)
+            {
+                std::fprintf(stderr, "%s: %s\n", filename.c_str(), e.what());
+                return 1;
+            }
+        }
+    }
+
+    int status = 0;
+    bool first = true;
+
+    printHeader(options);
+
+    for (auto& corpus : corpora)
+    {
+        for (auto& codec : g_codecs)
+        {
+            if (!options.codecs.empty() &&
+                std::find(options.codecs.begin(), options.codecs.end(), codec.name) == options.codecs.end())
+                continue;
+
+            for (int level : options.levels)
+            {
+                double serial_compress = 0.0;
+                double serial_decompress = 0.0;
+
+                // the serial functions first, then the parallel runs on each pool size
+                for (size_t run = 0; run <= options.threads.size(); ++run)
+                {
+                    const int threads = run ? options.threads[run - 1] : 0;
+                    if (threads && !codec.compress_parallel)
+                        continue;
+
+                    Result result;
+                    result.corpus = corpus.name;
+
+                    try
+                    {
+                        bool match;
+
+                        if (threads)
+                        {
+                            // the workers are started before the measurement
+                            ThreadPool pool(static_cast<size_t>(threads));
+                            match = measure(result, codec, corpus.data, level, &pool, options.repeat);
+                        }
+                        else
+                        {
+                            match = measure(result, codec, corpus.data, level, nullptr, options.repeat);
+                        }
+
+                        if (!match)
+                        {
+                            std::fprintf(stderr, "%s: %s level %d: decompressed data does not match.\n",
+                                         corpus.name.c_str(), codec.name, level);
+                            status = 1;
+                        }
+                    }
+                    catch (Exception& e)
+                    {
+                        std::fprintf(stderr, "%s: %s level %d: %s\n", corpus.name.c_str(), codec.name, level, e.what());
+                        status = 1;
+                        continue;
+                    }
+
+                    if (!threads)
+                    {
+                        serial_compress = result.compress_time;
+                        serial_decompress = result.decompress_time;
+                    }
+
+                    result.compress_speedup = result.compress_time > 0 ? serial_compress / result.compress_time : 0.0;
+                    result.decompress_speedup = result.decompress_time > 0 ? serial_decompress / result.decompress_time : 0.0;
+
+                    printResult(options, result, first);
+                    first = false;
+                }
+            }
+        }
+    }
+
+    printFooter(options);
+
+    return status;
+}
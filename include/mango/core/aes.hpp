@@ -29,11 +29,23 @@ namespace mango
     // - the mac_length must be 4, 6, 8, 10, 12, 14, or 16
     // - output.size must be input.size + mac_length
     //
+    // gcm_encrypt() requirements:
+    // - the tag_length must be 4 .. 16 (12 .. 16 are recommended)
+    // - output.size must be input.size + tag_length
+    // - the iv can be any size but 12 bytes is the most efficient
+    // - the input does not have to be a multiple of 16 bytes
+    //
+    // gcm_decrypt() returns false and clears the output when the tag doesn't match.
+    //
+    // The _parallel() variants split large buffers into segments which are
+    // processed on the ThreadPool; the results are identical.
+    //
     // Hardware acceleration support:
     // ECB: Intel AES-NI
     // CBC: Intel AES-NI
-    // CTR: none
+    // CTR: Intel AES-NI
     // CCM: none
+    // GCM: Intel AES-NI, PCLMULQDQ
 
     class AES
     {
@@ -53,9 +65,16 @@ namespace mango
 
         void ctr_encrypt(u8* output, const u8* input, size_t length, const u8* iv);
         void ctr_decrypt(u8* output, const u8* input, size_t length, const u8* iv);
+        void ctr_encrypt_parallel(u8* output, const u8* input, size_t length, const u8* iv);
+        void ctr_decrypt_parallel(u8* output, const u8* input, size_t length, const u8* iv);
 
         void ccm_encrypt(Memory output, Memory input, Memory associated, Memory nonce, int mac_length);
         void ccm_decrypt(Memory output, Memory input, Memory associated, Memory nonce, int mac_length);
+
+        void gcm_encrypt(Memory output, Memory input, Memory associated, Memory iv, int tag_length);
+        bool gcm_decrypt(Memory output, Memory input, Memory associated, Memory iv, int tag_length);
+        void gcm_encrypt_parallel(Memory output, Memory input, Memory associated, Memory iv, int tag_length);
+        bool gcm_decrypt_parallel(Memory output, Memory input, Memory associated, Memory iv, int tag_length);
     };
 
 } // namespace mango
@@ -4,13 +4,17 @@
 */
 #pragma once
 
+#include <vector>
 #include "configure.hpp"
 #include "memory.hpp"
 #include "object.hpp"
+#include "stream.hpp"
 
 namespace mango
 {
 
+    class ThreadPool;
+
     // -----------------------------------------------------------------------
     // stream compression
     // -----------------------------------------------------------------------
@@ -64,6 +68,163 @@ namespace mango
         StreamDecoder* createStreamDecoder();
     }
 
+#endif
+
+    // -----------------------------------------------------------------------
+    // incremental compression
+    // -----------------------------------------------------------------------
+
+    // The incremental interface compresses a stream which doesn't have to fit
+    // into memory: the caller pushes input and pulls output in chunks of any size.
+    // The memory blocks are advanced past the consumed input and the produced
+    // output, the call returns true when the operation is complete:
+    //
+    // PROCESS: all input has been consumed (the codec can buffer some of it)
+    // FLUSH:   all input has been consumed and can be decoded from the output
+    //          (except bzip2, which ends the block but keeps its last bits)
+    // FINISH:  all input has been consumed and the stream has been terminated
+    //
+    // The caller must provide more output space and call again when false is
+    // returned. No more input can be pushed after FINISH. The decompressor returns
+    // true when the end of the stream has been decoded and all output produced.
+    //
+    // The miniz (zlib), zstd and bzip2 streams are compatible with their
+    // respective decompress() functions. The lz4, lzo and lzfse streams are
+    // sequences of blocks which are compressed with the codec.
+
+    class Compressor : private NonCopyable
+    {
+    public:
+        enum Operation
+        {
+            PROCESS,
+            FLUSH,
+            FINISH
+        };
+
+        Compressor() = default;
+        virtual ~Compressor() = default;
+
+        virtual bool compress(Memory& dest, Memory& source, Operation operation) = 0;
+    };
+
+    class Decompressor : private NonCopyable
+    {
+    public:
+        Decompressor() = default;
+        virtual ~Decompressor() = default;
+
+        virtual bool decompress(Memory& dest, Memory& source) = 0;
+    };
+
+    // Stream adapters which compress the data written into them into the output
+    // stream, or decompress the data read from them from the input stream. The
+    // adapters own the (de)compressor and use a fixed amount of memory.
+
+    class CompressStream : public Stream
+    {
+    protected:
+        Stream& m_stream;
+        Compressor* m_compressor;
+        std::vector<uint8> m_buffer;
+        uint64 m_offset;
+        bool m_finished;
+
+        void process(Memory source, Compressor::Operation operation);
+
+    public:
+        CompressStream(Stream& output, Compressor* compressor);
+        ~CompressStream();
+
+        // makes the data written so far decodable from the output stream
+        void flush();
+
+        // terminates the compressed stream; called by the destructor but the
+        // errors are lost there
+        void finish();
+
+        // uncompressed bytes written
+        uint64 size() const;
+        uint64 offset() const;
+
+        void seek(uint64 distance, SeekMode mode);
+        void read(void* dest, size_t size);
+        void write(const void* data, size_t size);
+    };
+
+    class DecompressStream : public Stream
+    {
+    protected:
+        Stream& m_stream;
+        Decompressor* m_decompressor;
+        std::vector<uint8> m_buffer;
+        Memory m_input; // unconsumed input in the buffer
+        uint64 m_remain; // unread bytes in the input stream
+        uint64 m_offset;
+        bool m_end;
+
+    public:
+        DecompressStream(Stream& input, Decompressor* decompressor);
+        ~DecompressStream();
+
+        // reads up to size bytes, less only at the end of the stream
+        size_t readSome(void* dest, size_t size);
+
+        bool end() const;
+
+        // the decompressed size is not known before the end; size() is the
+        // number of bytes decompressed so far
+        uint64 size() const;
+        uint64 offset() const;
+
+        // only forward seeking is supported
+        void seek(uint64 distance, SeekMode mode);
+        void read(void* dest, size_t size);
+        void write(const void* data, size_t size);
+    };
+
+    namespace miniz
+    {
+        Compressor* createCompressor(int level = 6);
+        Decompressor* createDecompressor();
+    }
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    namespace lz4
+    {
+        Compressor* createCompressor(int level = 6);
+        Decompressor* createDecompressor();
+    }
+
+    namespace lzo
+    {
+        Compressor* createCompressor(int level = 6);
+        Decompressor* createDecompressor();
+    }
+
+    namespace zstd
+    {
+        Compressor* createCompressor(int level = 6);
+        Decompressor* createDecompressor();
+    }
+
+#endif
+
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+
+    namespace bzip2
+    {
+        Compressor* createCompressor(int level = 6);
+        Decompressor* createDecompressor();
+    }
+
+    namespace lzfse
+    {
+        Compressor* createCompressor(int level = 6);
+        Decompressor* createDecompressor();
+    }
+
 #endif
 
     // -----------------------------------------------------------------------
@@ -129,4 +290,169 @@ namespace mango
 
 #endif
 
+    // -----------------------------------------------------------------------
+    // parallel block compression
+    // -----------------------------------------------------------------------
+
+    // The source is split into fixed size segments which are compressed
+    // independently on the ThreadPool; the output doesn't depend on the number of
+    // threads. Only miniz and zstd produce a standard stream of the codec:
+    //
+    // miniz: zlib stream of byte aligned deflate segments (pigz style); each
+    //        segment is primed with the last 32 KB of the previous one
+    // zstd:  concatenated frames, decodable with decompress()
+    // lz4, lzo, lzfse: mango's own block stream of createCompressor(), decodable
+    //        only with createDecompressor(); lz4 does not write LZ4 frames
+    //
+    // The destination must have room for bound_parallel() bytes. The parallel
+    // decompressors locate the frames and blocks from their headers; streams with
+    // dependent blocks are decompressed serially. Deflate has no index of the
+    // segments so the miniz stream is decompressed with miniz::decompress().
+    //
+    // The functions without a ThreadPool use ThreadPool::getInstance().
+
+    namespace miniz
+    {
+        size_t bound_parallel(size_t size);
+        size_t compress_parallel(Memory dest, Memory source, int level = 6);
+        size_t compress_parallel(ThreadPool& pool, Memory dest, Memory source, int level = 6);
+    }
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    namespace lz4
+    {
+        size_t bound_parallel(size_t size);
+        size_t compress_parallel(Memory dest, Memory source, int level = 6);
+        size_t compress_parallel(ThreadPool& pool, Memory dest, Memory source, int level = 6);
+        void decompress_parallel(Memory dest, Memory source);
+        void decompress_parallel(ThreadPool& pool, Memory dest, Memory source);
+    }
+
+    namespace lzo
+    {
+        size_t bound_parallel(size_t size);
+        size_t compress_parallel(Memory dest, Memory source, int level = 6);
+        size_t compress_parallel(ThreadPool& pool, Memory dest, Memory source, int level = 6);
+        void decompress_parallel(Memory dest, Memory source);
+        void decompress_parallel(ThreadPool& pool, Memory dest, Memory source);
+    }
+
+    namespace zstd
+    {
+        size_t bound_parallel(size_t size);
+        size_t compress_parallel(Memory dest, Memory source, int level = 6);
+        size_t compress_parallel(ThreadPool& pool, Memory dest, Memory source, int level = 6);
+        void decompress_parallel(Memory dest, Memory source);
+        void decompress_parallel(ThreadPool& pool, Memory dest, Memory source);
+    }
+
+#endif
+
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+
+    namespace lzfse
+    {
+        size_t bound_parallel(size_t size);
+        size_t compress_parallel(Memory dest, Memory source, int level = 6);
+        size_t compress_parallel(ThreadPool& pool, Memory dest, Memory source, int level = 6);
+        void decompress_parallel(Memory dest, Memory source);
+        void decompress_parallel(ThreadPool& pool, Memory dest, Memory source);
+    }
+
+#endif
+
+    // -----------------------------------------------------------------------
+    // dictionary compression
+    // -----------------------------------------------------------------------
+
+    // Small inputs which resemble each other (records, messages, assets) compress
+    // poorly alone because the codec has no history to refer to. A dictionary is
+    // content which is shared by the compressor and the decompressor; the same
+    // dictionary MUST be used on both ends.
+    //
+    // zstd::train() builds a raw content dictionary from the most common segments
+    // of the samples; the size must be at least 256 bytes. The digested
+    // dictionaries are prepared once and are read-only after that: they can be
+    // used by any number of threads at the same time and must outlive the
+    // encoders and decoders which use them.
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    namespace zstd
+    {
+        std::vector<uint8> train(const std::vector<Memory>& samples, size_t size = 64 * 1024);
+
+        class CompressDictionary : private NonCopyable
+        {
+        protected:
+            void* m_cdict; // ZSTD_CDict
+
+        public:
+            CompressDictionary(Memory dictionary, int level = 6);
+            ~CompressDictionary();
+
+            void* handle() const;
+        };
+
+        class DecompressDictionary : private NonCopyable
+        {
+        protected:
+            void* m_ddict; // ZSTD_DDict
+
+        public:
+            DecompressDictionary(Memory dictionary);
+            ~DecompressDictionary();
+
+            void* handle() const;
+        };
+
+        size_t compress(Memory dest, Memory source, const CompressDictionary& dictionary);
+        void decompress(Memory dest, Memory source, const DecompressDictionary& dictionary);
+
+        StreamEncoder* createStreamEncoder(const CompressDictionary& dictionary);
+        StreamDecoder* createStreamDecoder(const DecompressDictionary& dictionary);
+
+        Compressor* createCompressor(const CompressDictionary& dictionary);
+        Decompressor* createDecompressor(const DecompressDictionary& dictionary);
+    }
+
+    namespace lz4
+    {
+        // the last 64 KB of the dictionary are copied into the encoder / decoder
+        StreamEncoder* createStreamEncoder(int level, Memory dictionary);
+        StreamDecoder* createStreamDecoder(Memory dictionary);
+    }
+
+#endif
+
+    // -----------------------------------------------------------------------
+    // automatic codec selection
+    // -----------------------------------------------------------------------
+
+    // The source is split into 1 MB blocks and the codec is selected for each
+    // block separately, so that bundles of mixed content (images which are
+    // already compressed, geometry, text) get a suitable codec for each part.
+    // A 16 KB sample of the block is trial compressed with the candidate codecs
+    // which meet the throughput targets of the policy and the best ratio is
+    // selected; incompressible blocks and blocks for which no codec meets the
+    // targets are stored. The targets are compared with the nominal single
+    // core throughput of the codecs so the output is the same on every machine
+    // regardless of the load or the number of threads.
+    //
+    // The output is self-describing; decompress_auto() needs no side information
+    // and size_auto() returns the decompressed size from the header.
+
+    struct CompressPolicy
+    {
+        // minimum throughput in MB/s of uncompressed data; zero is no limit
+        float encode { 0 };
+        float decode { 0 };
+    };
+
+    size_t bound_auto(size_t size);
+    size_t compress_auto(Memory dest, Memory source, const CompressPolicy& policy = CompressPolicy());
+    size_t size_auto(Memory source);
+    void decompress_auto(Memory dest, Memory source);
+
 } // namespace mango
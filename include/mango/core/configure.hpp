@@ -494,6 +494,16 @@
         #include <wmmintrin.h>
     #endif
 
+    #ifdef __PCLMUL__
+        #define MANGO_ENABLE_CLMUL
+        #include <wmmintrin.h>
+    #endif
+
+    #ifdef __VPCLMULQDQ__
+        #define MANGO_ENABLE_VPCLMULQDQ
+        #include <immintrin.h>
+    #endif
+
     #ifdef __SHA__
         #define MANGO_ENABLE_SHA
         #include <immintrin.h>
@@ -18,10 +18,12 @@
 #include "system.hpp"
 #include "exception.hpp"
 #include "object.hpp"
+#include "object_pool.hpp"
 #include "stream.hpp"
 #include "timer.hpp"
 #include "buffer.hpp"
 #include "memory.hpp"
 #include "string.hpp"
 #include "thread.hpp"
+#include "parallel.hpp"
 #include "dynamic_library.hpp"
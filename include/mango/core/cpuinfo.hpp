@@ -4,6 +4,8 @@
 */
 #pragma once
 
+#include <string>
+#include <vector>
 #include "configure.hpp"
 
 namespace mango
@@ -52,6 +54,7 @@ namespace mango
         CPU_AVX512DQ   = 0x0000000200000000,
         CPU_AVX512IFMA = 0x0000000400000000,
         CPU_AVX512VBMI = 0x0000000800000000,
+        CPU_VPCLMULQDQ = 0x0000001000000000,
         // ARM
         CPU_NEON       = 0x0001000000000000,
         CPU_ARM_AES    = 0x0002000000000000,
@@ -62,4 +65,35 @@ namespace mango
 
 	uint64 getCPUFlags();
 
+	// ----------------------------------------------------------------------------
+	// getCPUTopology()
+	// ----------------------------------------------------------------------------
+
+    struct CPUTopology
+    {
+        struct Processor
+        {
+            int id;      // logical processor
+            int core;    // physical core; SMT siblings have the same value
+            int package;
+            int cache;   // last level cache domain; lowest processor id sharing the cache
+            int node;    // NUMA node
+        };
+
+        std::vector<Processor> processors;
+        int nodes;
+
+        const Processor* find(int id) const;
+    };
+
+    // detected from sysfs on Linux; elsewhere every processor is reported
+    // as a separate core in a single node
+    const CPUTopology& getCPUTopology();
+
+    // parse Linux-style processor list, eg. "0-3,8,10-11"
+    std::vector<int> parseCPUList(const std::string& list);
+
+    // NUMA node owning the page at the address, -1 if not known
+    int getMemoryNode(const void* address);
+
 } // namespace mango
@@ -13,4 +13,14 @@ namespace mango
     uint32 crc32(uint32 crc, Memory memory);
     uint32 crc32c(uint32 crc, Memory memory);
 
+    // crc of two consecutive blocks from their crcs; size is the size of the
+    // second block in bytes
+    uint32 crc32_combine(uint32 crc0, uint32 crc1, uint64 size);
+    uint32 crc32c_combine(uint32 crc0, uint32 crc1, uint64 size);
+
+    // the large buffers are split into segments which are processed on the
+    // ThreadPool; the result is the same as with crc32() and crc32c()
+    uint32 crc32_parallel(uint32 crc, Memory memory);
+    uint32 crc32c_parallel(uint32 crc, Memory memory);
+
 } // namespace mango
@@ -17,4 +17,88 @@ namespace mango
     uint32 xxhash32(Memory memory);
     uint64 xxhash64(Memory memory);
 
+    // Hashes many independent messages at once, one message per SIMD lane
+    // (4, 8 or 16 lanes depending on the build target); hash[i] is the hash of
+    // messages[i]. This is much faster than hashing the small messages one at a
+    // time. sha2_batch() hashes the large messages with the SHA instructions
+    // when the CPU has them.
+    void md5_batch(uint32 (*hash)[4], const Memory* messages, size_t count);
+    void sha2_batch(uint32 (*hash)[8], const Memory* messages, size_t count);
+
+    // ----------------------------------------------------------------------------
+    // incremental hashing
+    // ----------------------------------------------------------------------------
+
+    // The contexts hash data which arrives in chunks of any size; the result is
+    // the same as with the one-shot functions. reset() prepares the context for
+    // a new message after final().
+
+    class BlockHashContext
+    {
+    public:
+        using Transform = void (*)(uint32* state, const uint8* data, int count);
+
+    protected:
+        Transform m_transform;
+        alignas(16) uint32 m_state[8]; // the SHA-NI transform stores aligned
+        uint8 m_buffer[64];
+        uint64 m_size;
+
+        BlockHashContext(Transform transform);
+
+        // padding and the message size in bits (big or little endian)
+        void finish(bool bigendian);
+
+    public:
+        void update(Memory memory);
+    };
+
+    class MD5Context : public BlockHashContext
+    {
+    public:
+        MD5Context();
+        void reset();
+        void final(uint32 hash[4]);
+    };
+
+    class SHA1Context : public BlockHashContext
+    {
+    public:
+        SHA1Context();
+        void reset();
+        void final(uint32 hash[5]);
+    };
+
+    class SHA2Context : public BlockHashContext
+    {
+    public:
+        SHA2Context();
+        void reset();
+        void final(uint32 hash[8]);
+    };
+
+    class XXHash32Context
+    {
+    protected:
+        alignas(8) uint8 m_state[48];
+
+    public:
+        XXHash32Context(uint32 seed = 0);
+        void reset(uint32 seed = 0);
+        void update(Memory memory);
+        uint32 final() const;
+    };
+
+    class XXHash64Context
+    {
+    protected:
+        alignas(8) uint8 m_state[88];
+
+    public:
+        XXHash64Context(uint64 seed = 0);
+        void reset(uint64 seed = 0);
+        void update(Memory memory);
+        uint64 final() const;
+    };
+
 } // namespace mango
@@ -7,8 +7,10 @@
 #include <memory>
 #include <limits>
 #include <algorithm>
+#include <vector>
 #include "configure.hpp"
 #include "object.hpp"
+#include "atomic.hpp"
 
 namespace mango
 {
@@ -67,11 +69,40 @@ namespace mango
         }
     };
 
+    // -----------------------------------------------------------------------
+    // allocation policy
+    // -----------------------------------------------------------------------
+
+    // Backing for large allocations. Allocations of at least threshold bytes are
+    // mapped directly from the system so that they can use huge pages and be bound
+    // to a NUMA node; explicit huge pages fall back to transparent huge pages and
+    // those to normal pages when the system doesn't have them. Implemented on
+    // Linux; elsewhere the heap is always used.
+
+    struct AllocationPolicy
+    {
+        enum Pages
+        {
+            PAGES_DEFAULT,     // heap
+            PAGES_TRANSPARENT, // huge page aligned mapping advised for transparent huge pages
+            PAGES_HUGE         // explicit huge pages (MAP_HUGETLB)
+        };
+
+        Pages pages { PAGES_DEFAULT };
+        int node { -1 }; // preferred NUMA node, -1 for no preference
+        size_t threshold { 4 * 1024 * 1024 };
+    };
+
+    // the policy used by aligned_malloc() when no policy is given
+    void setAllocationPolicy(const AllocationPolicy& policy);
+    AllocationPolicy getAllocationPolicy();
+
     // -----------------------------------------------------------------------
     // aligned malloc/free
     // -----------------------------------------------------------------------
 
     void* aligned_malloc(size_t size, size_t alignment = MANGO_DEFAULT_ALIGNMENT);
+    void* aligned_malloc(size_t size, size_t alignment, const AllocationPolicy& policy);
     void aligned_free(void* aligned);
 
     // -----------------------------------------------------------------------
@@ -177,4 +208,142 @@ namespace mango
         }
     };
 
+    // -----------------------------------------------------------------------
+    // Arena
+    // -----------------------------------------------------------------------
+
+    // Bump allocator for transient memory: the allocations are released all at
+    // once with reset() or when the arena is destroyed. The chunks are kept for
+    // reuse by reset() and recycled through a process wide cache when the arena
+    // is destroyed so that repeated decoding doesn't keep faulting in new pages.
+    // allocate() can be called from multiple threads; rewind() and reset() can't.
+
+    class Arena : private NonCopyable
+    {
+    protected:
+        struct Chunk
+        {
+            uint8* address;
+            size_t size;
+        };
+
+        std::vector<Chunk> m_chunks;
+        size_t m_chunk_size;
+        size_t m_current;
+        size_t m_offset;
+        SpinLock m_lock;
+
+    public:
+        struct Marker
+        {
+            size_t chunk;
+            size_t offset;
+        };
+
+        Arena(size_t chunk_size = 256 * 1024);
+        ~Arena();
+
+        void* allocate(size_t size, size_t alignment = MANGO_DEFAULT_ALIGNMENT);
+
+        template <typename T>
+        T* allocate(size_t count)
+        {
+            const size_t alignment = std::max(alignof(T), size_t(MANGO_DEFAULT_ALIGNMENT));
+            return reinterpret_cast<T*>(allocate(count * sizeof(T), alignment));
+        }
+
+        // release the allocations made after the marker
+        Marker marker() const;
+        void rewind(const Marker& marker);
+
+        // release all allocations; the chunks are kept for reuse
+        void reset();
+
+        // bytes reserved from the system
+        size_t capacity() const;
+    };
+
+    // The chunks of the destroyed arenas are cached for reuse by the other
+    // arenas up to the limit (8 MB by default); trimArenaCache() releases
+    // the cached chunks to the system.
+    void setArenaCacheLimit(size_t bytes);
+    size_t getArenaCacheLimit();
+    void trimArenaCache();
+
+    // releases the allocations made during the scope
+    class ArenaScope : private NonCopyable
+    {
+    protected:
+        Arena& m_arena;
+        Arena::Marker m_marker;
+
+    public:
+        ArenaScope(Arena& arena)
+            : m_arena(arena)
+            , m_marker(arena.marker())
+        {
+        }
+
+        ~ArenaScope()
+        {
+            m_arena.rewind(m_marker);
+        }
+    };
+
+    // -----------------------------------------------------------------------
+    // arena allocator
+    // -----------------------------------------------------------------------
+
+    // STL allocator adaptor; deallocate() is a no-op and the memory is released
+    // with the arena.
+
+    template <typename T>
+    class ArenaAllocator
+    {
+    public:
+        typedef T value_type;
+
+        Arena* arena;
+
+        ArenaAllocator(Arena& arena)
+            : arena(&arena)
+        {
+        }
+
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U>& allocator)
+            : arena(allocator.arena)
+        {
+        }
+
+        T* allocate(size_t n)
+        {
+            return arena->allocate<T>(n);
+        }
+
+        void deallocate(T* p, size_t n)
+        {
+            MANGO_UNREFERENCED_PARAMETER(p);
+            MANGO_UNREFERENCED_PARAMETER(n);
+        }
+
+        template <typename U>
+        struct rebind
+        {
+            typedef ArenaAllocator<U> other;
+        };
+
+        template <typename U>
+        bool operator == (const ArenaAllocator<U>& allocator) const
+        {
+            return arena == allocator.arena;
+        }
+
+        template <typename U>
+        bool operator != (const ArenaAllocator<U>& allocator) const
+        {
+            return arena != allocator.arena;
+        }
+    };
+
 } // namespace mango
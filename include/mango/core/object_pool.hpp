@@ -0,0 +1,155 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "configure.hpp"
+#include "object.hpp"
+#include "atomic.hpp"
+
+namespace mango
+{
+
+    // ----------------------------------------------------------------------------
+    // ObjectPoolBase
+    // ----------------------------------------------------------------------------
+
+    // Recycles object pointers through per-thread magazines. Each thread keeps two
+    // magazines per pool so that acquire/discard don't touch shared memory until a
+    // magazine runs empty or full; then whole magazines are exchanged with the
+    // depot, which is a pair of lock-free stacks. The objects are allocated in
+    // blocks which are never moved or released before the pool.
+
+    struct ObjectPoolThreadCache;
+
+    class ObjectPoolBase : private NonCopyable
+    {
+    public:
+        enum { MAGAZINE_SIZE = 32 };
+
+        struct Magazine
+        {
+            std::atomic<uint32> next;
+            uint32 index;
+            uint32 count;
+            void* objects[MAGAZINE_SIZE];
+        };
+
+        struct ThreadEntry
+        {
+            uint64 id;
+            ObjectPoolBase* pool;
+            Magazine* loaded;
+            Magazine* previous;
+        };
+
+    protected:
+        friend struct ObjectPoolThreadCache;
+
+        enum { MAX_CHUNKS = 27 };
+
+        // tagged (tag << 32 | index) stack heads; the tag defeats ABA
+        alignas(64) std::atomic<uint64> m_full;
+        alignas(64) std::atomic<uint64> m_empty;
+
+        // magazine chunk k holds (16 << k) magazines; chunks are never moved
+        std::atomic<Magazine*> m_chunks[MAX_CHUNKS];
+        uint32 m_magazine_count;
+
+        SpinLock m_grow_lock;
+        uint64 m_id;
+
+        // magazines for the threads whose thread cache has already been destroyed
+        SpinLock m_shared_lock;
+        ThreadEntry m_shared;
+
+        Magazine* magazine(uint32 index) const;
+        Magazine* createMagazine();
+        Magazine* emptyMagazine();
+        void push(std::atomic<uint64>& head, Magazine* magazine);
+        Magazine* pop(std::atomic<uint64>& head);
+        Magazine* refill();
+
+        ThreadEntry* registerThread();
+        void restock(ThreadEntry& entry);
+        void* acquireFrom(ThreadEntry& entry);
+        void discardTo(ThreadEntry& entry, void* object);
+
+        // allocate a block of objects; called without holding any of the pool's
+        // locks so the constructors can use the pools, including this one
+        virtual void grow(std::vector<void*>& objects) = 0;
+
+    public:
+        ObjectPoolBase();
+        virtual ~ObjectPoolBase();
+
+        void* acquireObject();
+        void discardObject(void* object);
+
+        // returns the calling thread's magazines to the depot
+        void flush();
+    };
+
+    // ----------------------------------------------------------------------------
+    // ObjectPool
+    // ----------------------------------------------------------------------------
+
+    // The objects are default constructed when the pool grows and destroyed with
+    // the pool; acquire() returns a recycled object as it was discarded.
+
+    template <typename T>
+    class ObjectPool : public ObjectPoolBase
+    {
+    protected:
+        int m_block_size;
+        std::vector<T*> m_blocks;
+        SpinLock m_block_lock;
+
+        void grow(std::vector<void*>& objects) override
+        {
+            T* block = new T[m_block_size];
+
+            {
+                SpinLockGuard guard(m_block_lock);
+                m_blocks.push_back(block);
+            }
+
+            for (int i = 0; i < m_block_size; ++i)
+            {
+                objects.push_back(block + i);
+            }
+        }
+
+    public:
+        ObjectPool(int block_size = 64)
+            : m_block_size(std::max(block_size, 1))
+        {
+        }
+
+        ~ObjectPool()
+        {
+            for (auto block : m_blocks)
+            {
+                delete[] block;
+            }
+        }
+
+        T* acquire()
+        {
+            return reinterpret_cast<T*>(acquireObject());
+        }
+
+        void discard(T* object)
+        {
+            discardObject(object);
+        }
+    };
+
+    // previous name of the ObjectPool
+    template <typename T>
+    using ObjectCache = ObjectPool<T>;
+
+} // namespace mango
@@ -0,0 +1,326 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <exception>
+#include <memory>
+#include "thread.hpp"
+
+namespace mango
+{
+
+    // ----------------------------------------------------------------------------
+    // BlockRange
+    // ----------------------------------------------------------------------------
+
+    // Half-open range [begin, end) which is split in halves down to the grain size.
+    // The grain is the cut-off: ranges which are not larger than the grain are
+    // never split. The parallel algorithms raise the grain so that each worker
+    // gets a handful of blocks to balance the load with; the caller's grain is
+    // the minimum block size which is still worth a task (zero for no minimum).
+
+    struct BlockRange
+    {
+        int begin;
+        int end;
+        int grain;
+
+        BlockRange(int begin, int end, int grain = 0)
+            : begin(begin)
+            , end(end)
+            , grain(grain)
+        {
+        }
+
+        int size() const
+        {
+            return end - begin;
+        }
+
+        bool divisible() const
+        {
+            return size() > std::max(grain, 1);
+        }
+
+        // this keeps the first half and the second half is returned
+        BlockRange split()
+        {
+            const int middle = begin + size() / 2;
+            BlockRange second(middle, end, grain);
+            end = middle;
+            return second;
+        }
+
+        void resolve(int workers)
+        {
+            grain = std::max(grain, size() / (std::max(workers, 1) * 8));
+            grain = std::max(grain, 1);
+        }
+    };
+
+    struct BlockRange2D
+    {
+        BlockRange rows;
+        BlockRange cols;
+
+        BlockRange2D(const BlockRange& rows, const BlockRange& cols)
+            : rows(rows)
+            , cols(cols)
+        {
+        }
+
+        bool divisible() const
+        {
+            return rows.divisible() || cols.divisible();
+        }
+
+        // split the dimension which has the most grains in it
+        BlockRange2D split()
+        {
+            BlockRange2D second = *this;
+
+            const int r = rows.size() / std::max(rows.grain, 1);
+            const int c = cols.size() / std::max(cols.grain, 1);
+
+            if (rows.divisible() && (r >= c || !cols.divisible()))
+            {
+                second.rows = rows.split();
+            }
+            else
+            {
+                second.cols = cols.split();
+            }
+
+            return second;
+        }
+
+        void resolve(int workers)
+        {
+            // only the rows are split by default; columns are split when the
+            // caller gives them a grain
+            rows.resolve(workers);
+            if (!cols.grain)
+            {
+                cols.grain = std::max(cols.size(), 1);
+            }
+        }
+    };
+
+    namespace detail
+    {
+
+        template <typename Range, typename F>
+        void parallel_for_split(ConcurrentQueue& queue, Range range, const F& func)
+        {
+            // keep the first half and hand the rest over to the pool; idle workers
+            // steal the second halves and keep splitting them
+            while (range.divisible())
+            {
+                Range second = range.split();
+                queue.enqueue([&queue, second, &func] {
+                    parallel_for_split(queue, second, func);
+                });
+            }
+
+            func(range);
+        }
+
+        // the blocks in range order; the range is split once up front so
+        // that the results can be stored in the same order
+        template <typename Range>
+        void collect_blocks(Range range, std::vector<Range>& blocks)
+        {
+            if (!range.divisible())
+            {
+                blocks.push_back(range);
+                return;
+            }
+
+            Range second = range.split();
+            collect_blocks(range, blocks);
+            collect_blocks(second, blocks);
+        }
+
+    } // namespace detail
+
+    // ----------------------------------------------------------------------------
+    // parallel_for
+    // ----------------------------------------------------------------------------
+
+    // Calls func(const Range&) for blocks covering the range and returns when
+    // all of them have been processed. A range which can't be split is
+    // processed on the calling thread without touching the ThreadPool. An
+    // exception thrown on the calling thread is rethrown after the queued
+    // blocks have been processed.
+
+    template <typename Range, typename F>
+    void parallel_for(ThreadPool& pool, Range range, const F& func)
+    {
+        range.resolve(int(pool.size()));
+
+        if (!range.divisible() || pool.size() < 2)
+        {
+            func(range);
+            return;
+        }
+
+        ConcurrentQueue queue(pool, "parallel_for", Priority::HIGH);
+
+        try
+        {
+            detail::parallel_for_split(queue, range, func);
+        }
+        catch (...)
+        {
+            // the queued tasks refer to queue and func
+            queue.wait();
+            throw;
+        }
+
+        queue.wait();
+    }
+
+    template <typename Range, typename F>
+    void parallel_for(Range range, const F& func)
+    {
+        parallel_for(ThreadPool::getInstance(), range, func);
+    }
+
+    // Non-blocking variant; the blocks are enqueued into the queue which must be
+    // waited for before the data func works on goes away. The tasks share a copy
+    // of func and the range is split up front so that they don't refer to the
+    // caller's func or queue objects: an exception which unwinds the caller before
+    // the wait leaves nothing dangling behind. The queue can be bound to a NUMA
+    // node with ConcurrentQueue::setNode() before the call.
+
+    template <typename Range, typename F>
+    void parallel_for(ConcurrentQueue& queue, Range range, const F& func)
+    {
+        range.resolve(int(queue.pool().size()));
+
+        std::vector<Range> blocks;
+        detail::collect_blocks(range, blocks);
+
+        auto shared = std::make_shared<const F>(func);
+
+        for (const Range& block : blocks)
+        {
+            queue.enqueue([shared, block] {
+                (*shared)(block);
+            });
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // parallel_each
+    // ----------------------------------------------------------------------------
+
+    // Calls func(size_t index) for [0, count) on the ThreadPool; the first
+    // exception thrown by func is rethrown on the calling thread after all of
+    // the indices have been processed.
+
+    template <typename F>
+    void parallel_each(ThreadPool& pool, size_t count, const F& func)
+    {
+        std::vector<std::exception_ptr> errors(count);
+
+        parallel_for(pool, BlockRange(0, int(count)), [&] (const BlockRange& range)
+        {
+            for (int i = range.begin; i < range.end; ++i)
+            {
+                try
+                {
+                    func(size_t(i));
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            }
+        });
+
+        for (auto& error : errors)
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+
+    template <typename F>
+    void parallel_each(size_t count, const F& func)
+    {
+        parallel_each(ThreadPool::getInstance(), count, func);
+    }
+
+    // ----------------------------------------------------------------------------
+    // parallel_reduce
+    // ----------------------------------------------------------------------------
+
+    // func(const Range&, const T& identity) computes the value of a block and
+    // reduce(const T&, const T&) combines the values. The blocks are combined in
+    // range order so reduce only needs to be associative.
+
+    template <typename Range, typename T, typename F, typename R>
+    T parallel_reduce(ThreadPool& pool, Range range, const T& identity, const F& func, const R& reduce)
+    {
+        range.resolve(int(pool.size()));
+
+        if (!range.divisible() || pool.size() < 2)
+        {
+            return func(range, identity);
+        }
+
+        std::vector<Range> blocks;
+        detail::collect_blocks(range, blocks);
+
+        // each result has its own slot; std::vector<bool> would pack them
+        struct Slot
+        {
+            T value;
+        };
+
+        std::vector<Slot> results(blocks.size(), Slot { identity });
+
+        auto compute = [&] (const BlockRange& r)
+        {
+            for (int i = r.begin; i < r.end; ++i)
+            {
+                results[i].value = func(blocks[i], identity);
+            }
+        };
+
+        ConcurrentQueue queue(pool, "parallel_reduce", Priority::HIGH);
+
+        try
+        {
+            detail::parallel_for_split(queue, BlockRange(0, int(blocks.size()), 1), compute);
+        }
+        catch (...)
+        {
+            // the queued tasks refer to queue, compute and results
+            queue.wait();
+            throw;
+        }
+
+        queue.wait();
+
+        T value = results[0].value;
+        for (size_t i = 1; i < results.size(); ++i)
+        {
+            value = reduce(value, results[i].value);
+        }
+
+        return value;
+    }
+
+    template <typename Range, typename T, typename F, typename R>
+    T parallel_reduce(Range range, const T& identity, const F& func, const R& reduce)
+    {
+        return parallel_reduce(ThreadPool::getInstance(), range, identity, func, reduce);
+    }
+
+} // namespace mango
@@ -4,6 +4,7 @@
 */
 #pragma once
 
+#include <cstddef>
 #include <vector>
 #include <memory>
 #include <thread>
@@ -11,80 +12,402 @@
 #include <functional>
 #include <condition_variable>
 #include <future>
+#include <type_traits>
+#include <exception>
+#include <tuple>
+#include <utility>
 #include "exception.hpp"
 #include "object.hpp"
 #include "atomic.hpp"
+#include "object_pool.hpp"
 
 namespace mango
 {
 
-    // TODO: use lock-free MPMC queue for free objects and only lock
-    //       when running out of objects im the queue
-    template <typename T>
-    class ObjectCache
+    // ----------------------------------------------------------------------------
+    // EventCount
+    // ----------------------------------------------------------------------------
+
+    // Lock-free condition for parking threads: notify() is a fence and a load when
+    // nobody is waiting. A waiter must re-check its condition between prepareWait()
+    // and wait() and call cancelWait() instead if the condition was satisfied.
+    // Linux uses futex directly, other platforms a mutex/condition_variable pair.
+
+    class EventCount : private NonCopyable
     {
     protected:
-        int m_block_size;
-        std::vector<T*> m_blocks;
-        T** m_stack { nullptr };
-        int m_stack_capacity { 0 };
-        int m_stack_size { 0 };
-        SpinLock m_lock;
+        std::atomic<uint32> m_epoch { 0 };
+        std::atomic<uint32> m_waiters { 0 };
+
+#if !defined(MANGO_PLATFORM_LINUX)
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+#endif
+
+        void wake(bool all);
+
+    public:
+        using Key = uint32;
+
+        EventCount() = default;
+
+        Key prepareWait();
+        void cancelWait();
+        void wait(Key key);
+
+        void notify();
+        void notifyAll();
+    };
+
+    // ----------------------------------------------------------------------------
+    // TaskFunction
+    // ----------------------------------------------------------------------------
+
+    // Storage for callables which don't fit into TaskFunction; blocks up to
+    // TASK_STORAGE_BLOCK_SIZE bytes are recycled through an ObjectPool. The
+    // blocks are aligned to max_align_t; the over-aligned callables get their
+    // own aligned allocation.
+    enum { TASK_STORAGE_BLOCK_SIZE = 256 };
+
+    void* allocateTaskStorage(size_t size, size_t alignment);
+    void freeTaskStorage(void* storage, size_t size, size_t alignment);
+
+    // Move-only type-erased "void()" callable with in-place storage; the common
+    // case of a lambda capturing a few pointers and integers is stored without
+    // dynamic memory allocation unlike std::function.
+
+    class TaskFunction
+    {
+    public:
+        enum { CAPACITY = 64 };
+
+    private:
+        struct Operations
+        {
+            void (*invoke)(void* storage);
+            void (*move)(void* dest, void* source);
+            void (*destroy)(void* storage);
+        };
+
+        template <typename F>
+        struct InlineOperations
+        {
+            static void invoke(void* storage)
+            {
+                (*reinterpret_cast<F*>(storage))();
+            }
+
+            static void move(void* dest, void* source)
+            {
+                F* f = reinterpret_cast<F*>(source);
+                new (dest) F(std::move(*f));
+                f->~F();
+            }
+
+            static void destroy(void* storage)
+            {
+                reinterpret_cast<F*>(storage)->~F();
+            }
+        };
+
+        template <typename F>
+        struct ExternalOperations
+        {
+            static F*& pointer(void* storage)
+            {
+                return *reinterpret_cast<F**>(storage);
+            }
+
+            static void invoke(void* storage)
+            {
+                (*pointer(storage))();
+            }
+
+            static void move(void* dest, void* source)
+            {
+                *reinterpret_cast<F**>(dest) = pointer(source);
+            }
+
+            static void destroy(void* storage)
+            {
+                F* f = pointer(storage);
+                f->~F();
+                freeTaskStorage(f, sizeof(F), alignof(F));
+            }
+        };
+
+        template <typename F>
+        struct IsInline
+        {
+            static constexpr bool value = sizeof(F) <= CAPACITY &&
+                alignof(F) <= alignof(std::max_align_t) &&
+                std::is_nothrow_move_constructible<F>::value;
+        };
+
+        template <typename F>
+        static const Operations* getOperations(std::true_type)
+        {
+            static const Operations ops = { InlineOperations<F>::invoke, InlineOperations<F>::move, InlineOperations<F>::destroy };
+            return &ops;
+        }
+
+        template <typename F>
+        static const Operations* getOperations(std::false_type)
+        {
+            static const Operations ops = { ExternalOperations<F>::invoke, ExternalOperations<F>::move, ExternalOperations<F>::destroy };
+            return &ops;
+        }
+
+        template <typename F>
+        void construct(F&& func, std::true_type)
+        {
+            using Type = typename std::decay<F>::type;
+            new (m_storage) Type(std::forward<F>(func));
+        }
+
+        template <typename F>
+        void construct(F&& func, std::false_type)
+        {
+            using Type = typename std::decay<F>::type;
+            void* memory = allocateTaskStorage(sizeof(Type), alignof(Type));
+            *reinterpret_cast<Type**>(m_storage) = new (memory) Type(std::forward<F>(func));
+        }
+
+        alignas(std::max_align_t) unsigned char m_storage[CAPACITY];
+        const Operations* m_ops { nullptr };
 
     public:
-        ObjectCache(int block_size)
-            : m_block_size(block_size)
+        TaskFunction() = default;
+
+        template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, TaskFunction>::value>::type>
+        TaskFunction(F&& func)
         {
+            using Type = typename std::decay<F>::type;
+            using Inline = std::integral_constant<bool, IsInline<Type>::value>;
+            construct(std::forward<F>(func), Inline());
+            m_ops = getOperations<Type>(Inline());
         }
 
-        ~ObjectCache()
+        TaskFunction(TaskFunction&& other)
+            : m_ops(other.m_ops)
         {
-            for (auto block : m_blocks) {
-                delete[] block;
+            if (m_ops)
+            {
+                m_ops->move(m_storage, other.m_storage);
+                other.m_ops = nullptr;
             }
+        }
 
-            delete[] m_stack;
+        ~TaskFunction()
+        {
+            reset();
         }
 
-        T* acquire()
+        TaskFunction& operator = (TaskFunction&& other)
         {
-            SpinLockGuard guard(m_lock);
-            if (!m_stack_size)
+            if (this != &other)
             {
-                T* block = new T[m_block_size];
-                m_blocks.push_back(block);
+                reset();
+                m_ops = other.m_ops;
+                if (m_ops)
+                {
+                    m_ops->move(m_storage, other.m_storage);
+                    other.m_ops = nullptr;
+                }
+            }
+            return *this;
+        }
+
+        TaskFunction(const TaskFunction&) = delete;
+        TaskFunction& operator = (const TaskFunction&) = delete;
+
+        explicit operator bool () const
+        {
+            return m_ops != nullptr;
+        }
+
+        void operator () ()
+        {
+            m_ops->invoke(m_storage);
+        }
 
-                m_stack_capacity += m_block_size;
+        void reset()
+        {
+            if (m_ops)
+            {
+                m_ops->destroy(m_storage);
+                m_ops = nullptr;
+            }
+        }
+    };
 
-                delete[] m_stack;
-                m_stack = new T*[m_stack_capacity];
+    namespace detail
+    {
+
+        // Stores the arguments of a task by value like std::bind but without the
+        // placeholder machinery; a callable without arguments is forwarded as-is.
 
-                for (int i = 0; i < m_block_size; ++i)
-                    m_stack[i] = block + i;
+        template <typename F, typename... Args>
+        class TaskBinder
+        {
+        protected:
+            F m_func;
+            std::tuple<Args...> m_args;
 
-                m_stack_size = m_block_size;
+            template <size_t... I>
+            decltype(auto) call(std::index_sequence<I...>)
+            {
+                return m_func(std::get<I>(m_args)...);
             }
 
-            T* object = m_stack[--m_stack_size];
-            return object;
+        public:
+            TaskBinder(F func, Args... args)
+                : m_func(std::move(func))
+                , m_args(std::move(args)...)
+            {
+            }
+
+            decltype(auto) operator () ()
+            {
+                return call(std::index_sequence_for<Args...>());
+            }
+        };
+
+        template <typename F>
+        F&& bind_task(F&& func)
+        {
+            return std::forward<F>(func);
         }
 
-        void discard(T* object)
+        template <typename F, typename Arg, typename... Args>
+        TaskBinder<typename std::decay<F>::type, typename std::decay<Arg>::type, typename std::decay<Args>::type...>
+        bind_task(F&& func, Arg&& arg, Args&&... args)
         {
-            SpinLockGuard guard(m_lock);
-            m_stack[m_stack_size++] = object;
+            return TaskBinder<typename std::decay<F>::type, typename std::decay<Arg>::type, typename std::decay<Args>::type...>(
+                std::forward<F>(func), std::forward<Arg>(arg), std::forward<Args>(args)...);
         }
+
+    } // namespace detail
+
+    // ----------------------------------------------------------------------------
+    // ThreadPoolConfig
+    // ----------------------------------------------------------------------------
+
+    struct ThreadPoolConfig
+    {
+        // number of worker threads; zero selects one less than the number of processors
+        size_t threads { 0 };
+
+        // processors the workers may run on; empty selects all online processors
+        std::vector<int> processors;
+
+        // pin every worker to a single processor, ordered by the CPU topology;
+        // otherwise the workers float inside the processor set
+        bool affinity { false };
+
+        // time in microseconds an idle worker looks for work before it parks
+        int spin { 50 };
+
+        // collect task latency and run-time histograms and worker times; the task
+        // and queue counters are always collected
+        bool statistics { true };
+
+        // MANGO_THREADPOOL_SIZE, MANGO_THREADPOOL_CPUS (eg. "0-7,16-23"),
+        // MANGO_THREADPOOL_AFFINITY (0/1), MANGO_THREADPOOL_SPIN and
+        // MANGO_THREADPOOL_STATISTICS (0/1)
+        static ThreadPoolConfig fromEnvironment();
     };
 
-    struct TaskQueue;
+    // ----------------------------------------------------------------------------
+    // ThreadPoolStatistics
+    // ----------------------------------------------------------------------------
+
+    // Snapshot of the ThreadPool counters. The counters are kept per thread and
+    // aggregated when the snapshot is taken so collecting them costs practically
+    // nothing; the snapshot is not atomic across the counters.
+
+    struct ThreadPoolStatistics
+    {
+        // log2 histogram of durations: bucket 0 counts durations below one
+        // microsecond and bucket i durations in [2^(i-1), 2^i) microseconds
+        struct Histogram
+        {
+            enum { BUCKETS = 24 };
+            uint64 count[BUCKETS];
+
+            uint64 total() const;
+
+            // upper bound in microseconds of the bucket containing the fraction (0..1)
+            uint64 percentile(double fraction) const;
+        };
+
+        // queues are aggregated by name; the last of the QUEUES entries collects
+        // the names which didn't fit
+        enum { QUEUES = 32 };
+
+        struct Queue
+        {
+            std::string name;
+            uint64 enqueued;
+            uint64 completed;
+            uint64 depth;      // enqueued but not completed
+            Histogram latency; // enqueue -> start
+            Histogram runtime; // start -> finish
+        };
+
+        // times are in microseconds since the pool was created
+        struct Worker
+        {
+            uint64 tasks;
+            uint64 steals; // tasks taken from the other workers
+            uint64 busy;   // running tasks
+            uint64 idle;   // looking for tasks
+            uint64 sleep;  // parked
+        };
+
+        std::vector<Queue> queues;
+        std::vector<Worker> workers;
+
+        // the threads which are not workers running tasks while they wait() for
+        // a queue; idle is the time they found nothing to run and sleep is zero
+        Worker external;
+    };
+
+    // ----------------------------------------------------------------------------
+    // ThreadPool
+    // ----------------------------------------------------------------------------
+
+    class TaskDeque;
+    class TaskInbox;
+    struct WorkerQueue;
+    struct WorkerCounters;
+
+    namespace detail
+    {
+        class FutureStateBase;
+    }
 
     class ThreadPool : private NonCopyable
     {
     private:
-        friend struct TaskQueue;
+        friend class TaskDeque;
+        friend class TaskInbox;
         friend class ConcurrentQueue;
+        friend class detail::FutureStateBase;
         friend class SerialQueue;
 
+        struct Queue;
+
+        struct Task
+        {
+            Queue* queue;
+            int stamp;
+            int barrier;
+            uint64 time; // enqueue time for the statistics
+            TaskFunction func;
+            Task* next; // link of the pooled tasks in a TaskInbox
+        };
+
         struct Queue
         {
             ThreadPool* pool;
@@ -95,6 +418,14 @@ namespace mango
             std::atomic<int> stamp_cancel;
             int stamp_barrier;
             std::string name;
+            int node; // preferred NUMA node, -1 for any
+            int slot; // statistics slot of the queue name
+
+            // tasks blocked by a barrier wait here (min-heap on barrier) until
+            // the preceding tasks have completed
+            SpinLock parked_lock;
+            std::atomic<int> parked_count;
+            std::vector<Task> parked;
 
             void retain()
             {
@@ -109,47 +440,88 @@ namespace mango
             }
         };
 
-        struct Task
+        struct Worker
         {
-            Queue* queue;
-            int stamp;
-            int barrier;
-            std::function<void()> func;
+            std::vector<int> processors; // affinity; empty when not restricted
+            int node { -1 };
+            int cache { -1 };
+            std::vector<size_t> victims; // steal order, nearest first
         };
 
     public:
         ThreadPool(size_t size);
+        ThreadPool(const ThreadPoolConfig& config);
         ~ThreadPool();
 
+        // the instance is configured from the environment unless configureInstance()
+        // is called before the instance is used for the first time
+        static void configureInstance(const ThreadPoolConfig& config);
         static ThreadPool& getInstance();
         static int getInstanceSize();
 
         int size() const;
 
-        void enqueue(std::function<void()>&& func)
+        // time in microseconds an idle worker keeps looking for work before it parks
+        void setSpinBudget(int microseconds);
+        int getSpinBudget() const;
+
+        ThreadPoolStatistics getStatistics() const;
+
+        template <typename F>
+        void enqueue(F&& func)
         {
-            enqueue(m_static_queue, std::move(func));
+            enqueue(m_static_queue, TaskFunction(std::forward<F>(func)));
         }
 
     protected:
         void thread(size_t threadID);
+        bool spin();
+        bool idle() const;
 
         Queue* createQueue(const std::string& name, int priority);
         void deleteQueue(Queue* queue);
 
-        void enqueue(Queue* queue, std::function<void()>&& func);
+        void enqueue(Queue* queue, TaskFunction&& func);
+        void submit(Task&& task);
+        bool dequeue(Task& task);
         bool dequeue_process();
+        void process(Task& task);
+        static bool compare_barrier(const Task& a, const Task& b);
+        bool park(Task& task);
+        void complete(Queue* queue);
         void cancel(Queue* queue);
         void wait(Queue* queue);
+        void execute(Task& task);
+        WorkerCounters& counters();
 
     private:
-        alignas(64) ObjectCache<Queue> m_queue_cache;
-        alignas(64) TaskQueue* m_queues;
+        alignas(64) ObjectPool<Queue> m_queue_cache;
+
+        // one set of priority deques per worker thread; tasks enqueued by a worker go
+        // into its own deque and idle workers steal from the others
+        WorkerQueue* m_worker_queues;
+        size_t m_worker_count;
+        std::vector<Worker> m_workers;
+        std::vector<std::vector<size_t>> m_node_workers;
+        alignas(64) std::atomic<size_t> m_submit_index { 0 };
+        alignas(64) std::atomic<size_t> m_steal_index { 0 };
 
         std::atomic<bool> m_stop { false };
-        std::atomic<int> m_sleep_count { 0 };
-        std::mutex m_queue_mutex;
-        std::condition_variable m_condition;
+        std::atomic<int> m_spin_budget { 50 };
+        alignas(64) std::atomic<int> m_spinning { 0 }; // workers looking for tasks in spin()
+        alignas(64) EventCount m_event;
+
+        // one set of counters per worker and one shared by the other threads
+        WorkerCounters* m_counters;
+        // queues with the same name share a statistics slot; the slots are found
+        // by the hash of the name without the lock, which guards the insertion
+        std::atomic<uint64> m_slot_hashes[ThreadPoolStatistics::QUEUES];
+        std::atomic<int> m_slot_count { 0 };
+        std::vector<std::string> m_slot_names;
+        mutable SpinLock m_slot_lock;
+
+        int getStatisticsSlot(const std::string& name);
+        bool m_statistics;
 
         Queue* m_static_queue;
         std::vector<std::thread> m_threads;
@@ -171,12 +543,22 @@ namespace mango
     public:
         ConcurrentQueue();
         ConcurrentQueue(const std::string& name, Priority priority = Priority::NORMAL);
+        ConcurrentQueue(ThreadPool& pool, const std::string& name, Priority priority = Priority::NORMAL);
         ~ConcurrentQueue();
 
         template <class F, class... Args>
         void enqueue(F&& f, Args&&... args)
         {
-            m_pool.enqueue(m_queue, std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+            m_pool.enqueue(m_queue, detail::bind_task(std::forward<F>(f), std::forward<Args>(args)...));
+        }
+
+        // prefer the workers running on a NUMA node, eg. the node owning the memory
+        // the tasks write to (see getMemoryNode()); -1 for no preference
+        void setNode(int node);
+
+        ThreadPool& pool() const
+        {
+            return m_pool;
         }
 
         void barrier();
@@ -193,12 +575,13 @@ namespace mango
     public:
         SerialQueue();
         SerialQueue(const std::string& name, Priority priority = Priority::NORMAL);
+        SerialQueue(ThreadPool& pool, const std::string& name, Priority priority = Priority::NORMAL);
         ~SerialQueue();
 
         template <class F, class... Args>
         void enqueue(F&& f, Args&&... args)
         {
-            m_pool.enqueue(m_queue, std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+            m_pool.enqueue(m_queue, detail::bind_task(std::forward<F>(f), std::forward<Args>(args)...));
             m_queue->stamp_barrier = m_queue->task_input_count;
         }
 
@@ -213,91 +596,371 @@ namespace mango
         Task(F&& f, Args&&... args)
         {
             ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+            pool.enqueue(detail::bind_task(std::forward<F>(f), std::forward<Args>(args)...));
         }
     };
 
-#if 0
-    // TODO: should probably be deprecated and/or refactored into
-    //       SharedPromise<T> class which only assists in capturing promises.
+    // ----------------------------------------------------------------------------
+    // Future
+    // ----------------------------------------------------------------------------
 
     template <typename T>
-    class FutureTask
+    class Future;
+
+    namespace detail
     {
-    private:
-        using Future = std::future<T>;
-        using Promise = std::promise<T>;
-        using SharedPromise = std::shared_ptr<Promise>;
-        using Function = std::function<T()>;
 
-        Future m_future;
+        class FutureStateBase : private NonCopyable
+        {
+        protected:
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+            std::atomic<bool> m_ready { false };
+            std::exception_ptr m_exception;
+            std::vector<TaskFunction> m_callbacks;
+            ThreadPool* m_pool;
+
+            void complete();
+
+        public:
+            FutureStateBase(ThreadPool& pool = ThreadPool::getInstance())
+                : m_pool(&pool)
+            {
+            }
+
+            virtual ~FutureStateBase() = default;
+
+            ThreadPool& pool() const
+            {
+                return *m_pool;
+            }
+
+            bool ready() const
+            {
+                return m_ready.load(std::memory_order_acquire);
+            }
+
+            std::exception_ptr exception() const
+            {
+                return m_exception;
+            }
+
+            void setException(std::exception_ptr exception);
+
+            // the callback is invoked by the thread which completes the state, or
+            // immediately if the state is already complete; callbacks should be light
+            void addCallback(TaskFunction&& callback);
+
+            // wait helps the ThreadPool process tasks until the state is complete
+            void wait();
+            void rethrow();
+        };
+
+        template <typename T>
+        class FutureState : public FutureStateBase
+        {
+        protected:
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type m_storage;
+            bool m_has_value { false };
+
+        public:
+            using FutureStateBase::FutureStateBase;
+
+            ~FutureState()
+            {
+                if (m_has_value)
+                {
+                    reinterpret_cast<T*>(&m_storage)->~T();
+                }
+            }
+
+            template <typename V>
+            void setValue(V&& value)
+            {
+                new (&m_storage) T(std::forward<V>(value));
+                m_has_value = true;
+                complete();
+            }
+
+            const T& value()
+            {
+                wait();
+                rethrow();
+                return *reinterpret_cast<const T*>(&m_storage);
+            }
+        };
+
+        template <>
+        class FutureState<void> : public FutureStateBase
+        {
+        public:
+            using FutureStateBase::FutureStateBase;
+
+            void setValue()
+            {
+                complete();
+            }
+
+            void value()
+            {
+                wait();
+                rethrow();
+            }
+        };
+
+        // invoke a function and store the result (or the exception it threw) into a state
+
+        template <typename R>
+        struct FutureInvoker
+        {
+            template <typename F, typename... Args>
+            static void run(FutureState<R>& state, F& func, Args&&... args)
+            {
+                try
+                {
+                    state.setValue(func(std::forward<Args>(args)...));
+                }
+                catch (...)
+                {
+                    state.setException(std::current_exception());
+                }
+            }
+        };
+
+        template <>
+        struct FutureInvoker<void>
+        {
+            template <typename F, typename... Args>
+            static void run(FutureState<void>& state, F& func, Args&&... args)
+            {
+                try
+                {
+                    func(std::forward<Args>(args)...);
+                    state.setValue();
+                }
+                catch (...)
+                {
+                    state.setException(std::current_exception());
+                }
+            }
+        };
+
+        // continuation of a Future<T>; void futures don't pass a value to the continuation
+
+        template <typename T>
+        struct FutureContinuation
+        {
+            template <typename F>
+            using Result = typename std::result_of<F(const T&)>::type;
+
+            template <typename R, typename F>
+            static void run(FutureState<T>& source, FutureState<R>& target, F& func)
+            {
+                FutureInvoker<R>::run(target, func, source.value());
+            }
+        };
+
+        template <>
+        struct FutureContinuation<void>
+        {
+            template <typename F>
+            using Result = typename std::result_of<F()>::type;
+
+            template <typename R, typename F>
+            static void run(FutureState<void>& source, FutureState<R>& target, F& func)
+            {
+                MANGO_UNREFERENCED_PARAMETER(source);
+                FutureInvoker<R>::run(target, func);
+            }
+        };
+
+        using SharedFutureState = std::shared_ptr<FutureStateBase>;
+
+        std::shared_ptr<FutureState<void>> when_all(const std::vector<SharedFutureState>& states);
+
+    } // namespace detail
+
+    template <typename T>
+    class Future
+    {
+    protected:
+        template <typename U>
+        friend class Future;
+
+        template <typename U>
+        friend Future<void> when_all(const std::vector<Future<U>>& futures);
+
+        template <typename... U>
+        friend Future<void> when_all(const Future<U>&... futures);
+
+        using State = detail::FutureState<T>;
+        std::shared_ptr<State> m_state;
 
     public:
-        template <class F, class... Args>
-        FutureTask(F&& f, Args&&... args)
+        Future() = default;
+
+        Future(std::shared_ptr<State> state)
+            : m_state(state)
         {
-            SharedPromise shared_promise = std::make_shared<Promise>();
-            m_future = std::move(shared_promise->get_future());
+        }
 
-            Function func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-            auto container = std::bind([shared_promise] (Function func) {
-                T value = func();
-                shared_promise->set_value(value);
-            }, func);
+        bool valid() const
+        {
+            return m_state != nullptr;
+        }
 
-            ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(container);
+        bool ready() const
+        {
+            return m_state->ready();
+        }
+
+        void wait() const
+        {
+            m_state->wait();
         }
 
-        T get()
+        // blocks until the value is available; re-throws exception thrown by the task
+        decltype(std::declval<State>().value()) get() const
         {
-            return m_future.get();
+            return m_state->value();
         }
 
-        void wait()
+        // the continuation is enqueued into the ThreadPool of this future when it completes;
+        // it receives the value as argument (nothing for Future<void>). An exception
+        // is passed through to the returned future without calling the continuation.
+        template <typename F>
+        Future<typename detail::FutureContinuation<T>::template Result<F>> then(F&& func) const
         {
-            m_future.wait();
+            using R = typename detail::FutureContinuation<T>::template Result<F>;
+            using Function = typename std::decay<F>::type;
+
+            auto source = m_state;
+            auto target = std::make_shared<detail::FutureState<R>>(source->pool());
+
+            source->addCallback([source, target, func = Function(std::forward<F>(func))] () mutable {
+                ThreadPool& pool = source->pool();
+                pool.enqueue([source, target, func = std::move(func)] () mutable {
+                    if (source->exception())
+                    {
+                        target->setException(source->exception());
+                    }
+                    else
+                    {
+                        detail::FutureContinuation<T>::template run<R>(*source, *target, func);
+                    }
+                });
+            });
+
+            return Future<R>(target);
         }
     };
 
-    template <>
-    class FutureTask<void>
+    // the returned future completes when all of the futures have completed; it
+    // carries the first exception of the inputs, if any
+
+    template <typename T>
+    Future<void> when_all(const std::vector<Future<T>>& futures)
     {
-    private:
-        using Future = std::future<void>;
-        using Promise = std::promise<void>;
-        using SharedPromise = std::shared_ptr<Promise>;
-        using Function = std::function<void()>;
+        std::vector<detail::SharedFutureState> states;
+        for (auto& future : futures)
+        {
+            states.push_back(future.m_state);
+        }
+        return Future<void>(detail::when_all(states));
+    }
+
+    template <typename... T>
+    Future<void> when_all(const Future<T>&... futures)
+    {
+        std::vector<detail::SharedFutureState> states = { futures.m_state... };
+        return Future<void>(detail::when_all(states));
+    }
+
+    // ----------------------------------------------------------------------------
+    // FutureTask
+    // ----------------------------------------------------------------------------
+
+    // Enqueues the function into the ThreadPool; the result is available
+    // through the Future interface.
 
-        Future m_future;
+    template <typename T>
+    class FutureTask : public Future<T>
+    {
+    protected:
+        template <class F>
+        void enqueue(ThreadPool& pool, F&& func)
+        {
+            auto state = std::make_shared<detail::FutureState<T>>(pool);
+            this->m_state = state;
+
+            pool.enqueue([state, func = std::forward<F>(func)] () mutable {
+                detail::FutureInvoker<T>::run(*state, func);
+            });
+        }
 
     public:
         template <class F, class... Args>
         FutureTask(F&& f, Args&&... args)
         {
-            SharedPromise shared_promise = std::make_shared<Promise>();
-            m_future = std::move(shared_promise->get_future());
-
-            Function func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-            auto container = std::bind([shared_promise] (Function func) {
-                func();
-                shared_promise->set_value();
-            }, func);
-
-            ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(container);
+            enqueue(ThreadPool::getInstance(), detail::bind_task(std::forward<F>(f), std::forward<Args>(args)...));
         }
 
-        void get()
+        template <class F, class... Args>
+        FutureTask(ThreadPool& pool, F&& f, Args&&... args)
         {
-            m_future.get();
+            enqueue(pool, detail::bind_task(std::forward<F>(f), std::forward<Args>(args)...));
         }
+    };
+
+    // ----------------------------------------------------------------------------
+    // TaskGraph
+    // ----------------------------------------------------------------------------
 
-        void wait()
+    // Directed acyclic graph of tasks. A node is enqueued as soon as all of the
+    // nodes preceding it have completed so independent branches overlap in the
+    // ThreadPool instead of waiting for whole stages. The graph can be run again
+    // after wait() has returned.
+
+    class TaskGraph : private NonCopyable
+    {
+    public:
+        using Node = size_t;
+
+    protected:
+        struct NodeData
         {
-            m_future.wait();
+            TaskFunction func;
+            std::vector<Node> successors;
+            int dependencies { 0 };
+            std::atomic<int> remaining { 0 };
+        };
+
+        ConcurrentQueue m_queue;
+        std::vector<std::unique_ptr<NodeData>> m_nodes;
+        std::mutex m_exception_mutex;
+        std::exception_ptr m_exception;
+
+        void schedule(Node node);
+
+    public:
+        TaskGraph();
+        TaskGraph(const std::string& name, Priority priority = Priority::NORMAL);
+        TaskGraph(ThreadPool& pool, const std::string& name, Priority priority = Priority::NORMAL);
+        ~TaskGraph();
+
+        template <class F, class... Args>
+        Node add(F&& f, Args&&... args)
+        {
+            m_nodes.emplace_back(new NodeData());
+            m_nodes.back()->func = detail::bind_task(std::forward<F>(f), std::forward<Args>(args)...);
+            return m_nodes.size() - 1;
         }
+
+        // "after" can't start before "before" has completed
+        void precede(Node before, Node after);
+
+        void run();
+        void wait();
     };
-#endif
 
 } // namespace mango
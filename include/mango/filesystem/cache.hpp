@@ -0,0 +1,63 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <string>
+#include <functional>
+#include "../core/configure.hpp"
+#include "../core/memory.hpp"
+
+namespace mango
+{
+
+    // -----------------------------------------------------------------
+    // container cache
+    // -----------------------------------------------------------------
+
+    // Process-wide cache of the decompressed entries of the containers. The
+    // entries are shared by reference counted views of write protected pages,
+    // like the memory mapped files, so writing through a view faults; an
+    // evicted entry is released when the last view of it is destroyed. The
+    // least recently used entries are evicted when the cached entries exceed the
+    // budget. The cache is disabled by default (a budget of zero); it pays off
+    // when the same entries are mapped repeatedly.
+
+    struct ContainerCacheStatistics
+    {
+        uint64 hits;
+        uint64 misses;
+        uint64 evictions;
+        uint64 bytes;   // size of the cached entries
+        size_t entries; // number of the cached entries
+    };
+
+    void setContainerCacheBudget(uint64 bytes);
+    uint64 getContainerCacheBudget();
+    ContainerCacheStatistics getContainerCacheStatistics();
+    void clearContainerCache();
+
+    // The entry is identified by the memory of the container, the name and the
+    // modification time and crc of the entry, so a container which is mapped
+    // into the same address later can hit only when the entry is the same.
+
+    struct ContainerCacheKey
+    {
+        const uint8* container;
+        uint64 size;
+        std::string entry;
+        uint64 mtime;
+        uint32 crc;
+
+        bool operator < (const ContainerCacheKey& key) const;
+    };
+
+    // Returns a view of the cached entry. On a miss decompress() writes the entry
+    // of the given size straight into the memory which is cached; map() returns
+    // the entry as-is when the cache is disabled or the entry doesn't fit in it.
+    VirtualMemory* mapContainerEntry(const ContainerCacheKey& key, uint64 size,
+                                     std::function<void(Memory dest)> decompress,
+                                     std::function<VirtualMemory*()> map);
+
+} // namespace mango
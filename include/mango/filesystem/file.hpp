@@ -7,6 +7,7 @@
 #include <cstdio>
 #include <string>
 #include <vector>
+#include <memory>
 #include "../core/configure.hpp"
 #include "../core/stream.hpp"
 #include "mapper.hpp"
@@ -35,6 +36,29 @@ namespace mango
         const uint8* data() const;
     };
 
+    // Read-only stream of a file which can be inside a container. The file is not
+    // memory mapped; the containers which support it decode only what is read.
+
+    class MapperStream : public Stream, public Mapper
+    {
+    protected:
+        std::string m_filename;
+        std::unique_ptr<Stream> m_stream;
+
+    public:
+        MapperStream(const Path& path, const std::string& filename);
+        MapperStream(const std::string& filename);
+        ~MapperStream();
+
+        const std::string& filename() const;
+
+        uint64 size() const;
+        uint64 offset() const;
+        void seek(uint64 distance, SeekMode mode);
+        void read(void* dest, size_t size);
+        void write(const void* data, size_t size);
+    };
+
     class FileStream : public Stream
     {
     protected:
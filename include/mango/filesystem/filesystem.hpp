@@ -7,4 +7,6 @@
 #include "mapper.hpp"
 #include "path.hpp"
 #include "file.hpp"
+#include "mgx.hpp"
+#include "cache.hpp"
 #include "fileobserver.hpp"
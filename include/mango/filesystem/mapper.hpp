@@ -8,6 +8,7 @@
 #include <vector>
 #include "../core/configure.hpp"
 #include "../core/memory.hpp"
+#include "../core/stream.hpp"
 
 namespace mango
 {
@@ -95,6 +96,10 @@ namespace mango
         virtual bool isfile(const std::string& filename) const = 0;
         virtual void index(FileIndex& index, const std::string& pathname) = 0;
         virtual VirtualMemory* mmap(const std::string& filename) = 0;
+
+        // read-only stream of the file; the mappers which can decode a part of
+        // the file override this, the default reads from mmap()
+        virtual Stream* open(const std::string& filename);
     };
 
     class Mapper : protected NonCopyable
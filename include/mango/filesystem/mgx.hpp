@@ -0,0 +1,58 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <string>
+#include "../core/configure.hpp"
+#include "../core/memory.hpp"
+#include "../core/stream.hpp"
+
+namespace mango
+{
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    // -----------------------------------------------------------------
+    // WriterMGX
+    // -----------------------------------------------------------------
+
+    // The .mgx archive stores the files in blocks which are compressed
+    // individually; a read decompresses only the blocks it touches and the
+    // stored files are mapped directly from the archive. The directory is a
+    // hash table which is used in place without parsing it.
+    //
+    // The files are queued with add() and compressed on the ThreadPool by
+    // flush(); the memory must remain valid until then. finish() writes the
+    // directory and is called by the destructor, where the errors are lost.
+    // Blocks which don't compress are stored.
+
+    class WriterMGX : private NonCopyable
+    {
+    public:
+        enum Compression
+        {
+            NONE = 0,
+            LZ4  = 1,
+            ZSTD = 2
+        };
+
+    protected:
+        struct WriterStateMGX* m_state;
+
+    public:
+        WriterMGX(Stream& output, Compression compression = LZ4, int level = 6,
+                  uint32 block_size = 64 * 1024, bool checksum = true);
+        ~WriterMGX();
+
+        void add(const std::string& filename, Memory memory);
+        void add(const std::string& filename, Memory memory, Compression compression);
+
+        void flush();
+        void finish();
+    };
+
+#endif
+
+} // namespace mango
@@ -14,6 +14,8 @@
 namespace mango
 {
 
+    class Path;
+
     class ImageDecoderInterface : protected NonCopyable
     {
     public:
@@ -50,4 +52,12 @@ namespace mango
     void registerImageDecoder(ImageDecoder::CreateFunc func, const std::string& extension);
     bool isImageDecoder(const std::string& extension);
 
+    // Reads the header of an image file which can be inside a container. The
+    // file is read through a MapperStream from the start in growing pieces
+    // until the header can be decoded, so a compressed entry is decompressed
+    // only as far as its header. The information which the format stores at
+    // the end of the file (the PCX palette) is reported only once it is read.
+    ImageHeader getImageHeader(const Path& path, const std::string& filename);
+    ImageHeader getImageHeader(const std::string& filename);
+
 } // namespace mango
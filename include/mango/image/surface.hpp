@@ -6,8 +6,11 @@
 
 #include <cstddef>
 #include <string>
+#include <vector>
+#include <mutex>
 #include "../core/configure.hpp"
 #include "../core/object.hpp"
+#include "../core/memory.hpp"
 #include "../filesystem/file.hpp"
 #include "format.hpp"
 
@@ -44,10 +47,82 @@ namespace mango
         void yflip();
     };
 
+    // ----------------------------------------------------------------------------
+    // BitmapPool
+    // ----------------------------------------------------------------------------
+
+    // Recycles the image storage of the Bitmaps constructed from the pool so that
+    // steady-state pipelines don't keep mapping, faulting and unmapping the same
+    // amount of memory. The storage is matched on the image geometry (stride and
+    // height, which width, format and the stride alignment determine). The least
+    // recently released storage is freed when the cached bytes exceed the budget.
+    // The pool must outlive its Bitmaps.
+
+    class BitmapPool : private NonCopyable
+    {
+    protected:
+        struct Block
+        {
+            uint8* image;
+            int stride;
+            int height;
+        };
+
+        std::mutex m_mutex;
+        std::vector<Block> m_blocks; // least recently released first
+        size_t m_budget;
+        size_t m_cached;
+        int m_alignment;
+        AllocationPolicy m_policy;
+
+        void evict(size_t budget);
+
+    public:
+        BitmapPool(size_t budget, int alignment = 64, const AllocationPolicy& policy = getAllocationPolicy());
+        ~BitmapPool();
+
+        // stride of the bitmaps constructed from the pool
+        int getStride(int width, const Format& format) const;
+
+        uint8* acquire(int stride, int height);
+        void release(uint8* image, int stride, int height);
+
+        // free cached storage down to the budget (zero frees all)
+        void trim(size_t budget = 0);
+        void setBudget(size_t budget);
+
+        // bytes of storage waiting for reuse
+        size_t size();
+    };
+
+    // ----------------------------------------------------------------------------
+    // Bitmap
+    // ----------------------------------------------------------------------------
+
     class Bitmap : private NonCopyable, public Surface
     {
+    protected:
+        bool m_aligned { true }; // image was allocated with aligned_malloc()
+        BitmapPool* m_pool { nullptr }; // image is returned to the pool
+
+        // dimensions the pooled image was acquired with; the public members can change
+        int m_pool_stride { 0 };
+        int m_pool_height { 0 };
+
+        void release();
+
     public:
+        // the bitmap takes ownership of an image allocated with new[]
         Bitmap(int width, int height, const Format& format, int stride = 0, uint8* image = nullptr);
+
+        // the image is allocated with the policy instead of the global allocation policy
+        Bitmap(int width, int height, const Format& format, const AllocationPolicy& policy, int stride = 0);
+
+        // the image storage is recycled through the pool
+        Bitmap(BitmapPool& pool, int width, int height, const Format& format);
+        Bitmap(BitmapPool& pool, Memory memory, const std::string& extension, const Format& format);
+        Bitmap(BitmapPool& pool, const std::string& filename, const Format& format);
+
         Bitmap(Memory memory, const std::string& extension);
         Bitmap(Memory memory, const std::string& extension, const Format& format);
         Bitmap(const std::string& filename);
@@ -2,14 +2,299 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <cstring>
+#include <vector>
 #include <mango/core/aes.hpp>
 #include <mango/core/cpuinfo.hpp>
+#include <mango/core/endian.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/parallel.hpp>
 #include "../../external/aes/bc_aes.h"
 
 namespace
 {
     using namespace mango;
 
+    // ----------------------------------------------------------------------------------------
+    // counter
+    // ----------------------------------------------------------------------------------------
+
+    // The counter is a 128 bit big endian integer; GCM increments only the low 32 bits.
+
+    struct CounterAES
+    {
+        u64 high;
+        u64 low;
+        bool inc32;
+
+        CounterAES(const u8* iv, bool inc32)
+            : high(uload64be(iv + 0))
+            , low(uload64be(iv + 8))
+            , inc32(inc32)
+        {
+        }
+
+        void store(u8* iv) const
+        {
+            ustore64be(iv + 0, high);
+            ustore64be(iv + 8, low);
+        }
+
+        void add(u64 count)
+        {
+            if (inc32)
+            {
+                low = (low & 0xffffffff00000000ull) | u32(low + count);
+            }
+            else
+            {
+                const u64 value = low + count;
+                high += value < low;
+                low = value;
+            }
+        }
+
+#if defined(MANGO_ENABLE_AES)
+
+        __m128i next()
+        {
+            __m128i block = _mm_set_epi64x(byteswap(low), byteswap(high));
+            add(1);
+            return block;
+        }
+
+        void next8(__m128i* blocks)
+        {
+#if defined(MANGO_ENABLE_SSSE3)
+            // the counter doesn't wrap around: increment with vector adds
+            const u64 mask = inc32 ? 0xffffffffull : 0xffffffffffffffffull;
+            if ((low & mask) <= mask - 8)
+            {
+                const __m128i reflect = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+                const __m128i base = _mm_set_epi64x(high, low);
+                for (int j = 0; j < 8; ++j)
+                {
+                    blocks[j] = _mm_shuffle_epi8(_mm_add_epi64(base, _mm_set_epi64x(0, j)), reflect);
+                }
+                add(8);
+                return;
+            }
+#endif
+            for (int j = 0; j < 8; ++j)
+            {
+                blocks[j] = next();
+            }
+        }
+
+#endif
+    };
+
+    // ----------------------------------------------------------------------------------------
+    // GHASH
+    // ----------------------------------------------------------------------------------------
+
+    // GF(2^128) element in the GCM bit order: the first bit is the coefficient of x^0.
+
+    struct Block128
+    {
+        u64 high;
+        u64 low;
+    };
+
+    inline Block128 gf128_load(const u8* p)
+    {
+        return { uload64be(p + 0), uload64be(p + 8) };
+    }
+
+    inline void gf128_store(u8* p, Block128 x)
+    {
+        ustore64be(p + 0, x.high);
+        ustore64be(p + 8, x.low);
+    }
+
+    inline Block128 gf128_xor(Block128 a, Block128 b)
+    {
+        return { a.high ^ b.high, a.low ^ b.low };
+    }
+
+    Block128 gf128_multiply(Block128 x, Block128 y)
+    {
+        Block128 z = { 0, 0 };
+
+        for (int i = 0; i < 128; ++i)
+        {
+            const u64 word = i < 64 ? x.high : x.low;
+            if ((word >> (63 - (i & 63))) & 1)
+            {
+                z = gf128_xor(z, y);
+            }
+
+            const u64 carry = y.low & 1;
+            y.low = (y.low >> 1) | (y.high << 63);
+            y.high = (y.high >> 1) ^ (carry ? 0xe100000000000000ull : 0);
+        }
+
+        return z;
+    }
+
+    Block128 gf128_power(Block128 x, u64 n)
+    {
+        Block128 result = { 0x8000000000000000ull, 0 };
+
+        for ( ; n; n >>= 1)
+        {
+            if (n & 1)
+            {
+                result = gf128_multiply(result, x);
+            }
+
+            x = gf128_multiply(x, x);
+        }
+
+        return result;
+    }
+
+    // the last incomplete block is padded with zeros
+    Block128 ghash_generic(Block128 hash, const u8* data, size_t length, Block128 h)
+    {
+        for ( ; length >= 16; length -= 16)
+        {
+            hash = gf128_multiply(gf128_xor(hash, gf128_load(data)), h);
+            data += 16;
+        }
+
+        if (length)
+        {
+            u8 temp[16] = { 0 };
+            std::memcpy(temp, data, length);
+            hash = gf128_multiply(gf128_xor(hash, gf128_load(temp)), h);
+        }
+
+        return hash;
+    }
+
+#if defined(MANGO_ENABLE_CLMUL) && defined(MANGO_ENABLE_SSSE3)
+
+    // "Intel Carry-Less Multiplication Instruction and its Usage for Computing
+    // the GCM Mode" (Gueron, Kounavis). The blocks are byte reflected so that the
+    // bit order matches the carry-less multiply; the products of eight blocks
+    // with the powers of H are accumulated before a single reduction.
+
+    struct ProductCLMUL
+    {
+        __m128i low;
+        __m128i middle;
+        __m128i high;
+    };
+
+    inline void clmul_accumulate(ProductCLMUL& product, __m128i a, __m128i b)
+    {
+        const __m128i m0 = _mm_clmulepi64_si128(a, b, 0x10);
+        const __m128i m1 = _mm_clmulepi64_si128(a, b, 0x01);
+        product.low = _mm_xor_si128(product.low, _mm_clmulepi64_si128(a, b, 0x00));
+        product.high = _mm_xor_si128(product.high, _mm_clmulepi64_si128(a, b, 0x11));
+        product.middle = _mm_xor_si128(product.middle, _mm_xor_si128(m0, m1));
+    }
+
+    inline __m128i clmul_reduce(const ProductCLMUL& product)
+    {
+        __m128i tmp3 = _mm_xor_si128(product.low, _mm_slli_si128(product.middle, 8));
+        __m128i tmp6 = _mm_xor_si128(product.high, _mm_srli_si128(product.middle, 8));
+
+        // shift the 256 bit product left by one
+        __m128i tmp7 = _mm_srli_epi32(tmp3, 31);
+        __m128i tmp8 = _mm_srli_epi32(tmp6, 31);
+        tmp3 = _mm_slli_epi32(tmp3, 1);
+        tmp6 = _mm_slli_epi32(tmp6, 1);
+        __m128i tmp9 = _mm_srli_si128(tmp7, 12);
+        tmp8 = _mm_slli_si128(tmp8, 4);
+        tmp7 = _mm_slli_si128(tmp7, 4);
+        tmp3 = _mm_or_si128(tmp3, tmp7);
+        tmp6 = _mm_or_si128(tmp6, tmp8);
+        tmp6 = _mm_or_si128(tmp6, tmp9);
+
+        // reduce modulo x^128 + x^7 + x^2 + x + 1
+        tmp7 = _mm_slli_epi32(tmp3, 31);
+        tmp8 = _mm_slli_epi32(tmp3, 30);
+        tmp9 = _mm_slli_epi32(tmp3, 25);
+        tmp7 = _mm_xor_si128(tmp7, tmp8);
+        tmp7 = _mm_xor_si128(tmp7, tmp9);
+        tmp8 = _mm_srli_si128(tmp7, 4);
+        tmp7 = _mm_slli_si128(tmp7, 12);
+        tmp3 = _mm_xor_si128(tmp3, tmp7);
+
+        __m128i tmp2 = _mm_srli_epi32(tmp3, 1);
+        __m128i tmp4 = _mm_srli_epi32(tmp3, 2);
+        __m128i tmp5 = _mm_srli_epi32(tmp3, 7);
+        tmp2 = _mm_xor_si128(tmp2, tmp4);
+        tmp2 = _mm_xor_si128(tmp2, tmp5);
+        tmp2 = _mm_xor_si128(tmp2, tmp8);
+        tmp3 = _mm_xor_si128(tmp3, tmp2);
+        return _mm_xor_si128(tmp6, tmp3);
+    }
+
+    inline __m128i clmul_multiply(__m128i a, __m128i b)
+    {
+        ProductCLMUL product = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+        clmul_accumulate(product, a, b);
+        return clmul_reduce(product);
+    }
+
+    // powers[i] is H^(i + 1)
+    void ghash_clmul_powers(__m128i* powers, Block128 h)
+    {
+        powers[0] = _mm_set_epi64x(h.high, h.low);
+        for (int i = 1; i < 8; ++i)
+        {
+            powers[i] = clmul_multiply(powers[i - 1], powers[0]);
+        }
+    }
+
+    Block128 ghash_clmul(Block128 hash, const u8* data, size_t length, const __m128i* powers)
+    {
+        const __m128i reflect = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        const __m128i* src = reinterpret_cast<const __m128i *>(data);
+
+        __m128i x = _mm_set_epi64x(hash.high, hash.low);
+
+        for ( ; length >= 128; length -= 128)
+        {
+            ProductCLMUL product = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+
+            __m128i block = _mm_shuffle_epi8(_mm_loadu_si128(src + 0), reflect);
+            clmul_accumulate(product, _mm_xor_si128(x, block), powers[7]);
+
+            for (int j = 1; j < 8; ++j)
+            {
+                block = _mm_shuffle_epi8(_mm_loadu_si128(src + j), reflect);
+                clmul_accumulate(product, block, powers[7 - j]);
+            }
+
+            x = clmul_reduce(product);
+            src += 8;
+        }
+
+        for ( ; length >= 16; length -= 16)
+        {
+            __m128i block = _mm_shuffle_epi8(_mm_loadu_si128(src++), reflect);
+            x = clmul_multiply(_mm_xor_si128(x, block), powers[0]);
+        }
+
+        if (length)
+        {
+            alignas(16) u8 temp[16] = { 0 };
+            std::memcpy(temp, src, length);
+            __m128i block = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(temp)), reflect);
+            x = clmul_multiply(_mm_xor_si128(x, block), powers[0]);
+        }
+
+        alignas(16) u64 result[2];
+        _mm_store_si128(reinterpret_cast<__m128i *>(result), x);
+        return { result[1], result[0] };
+    }
+
+#endif // defined(MANGO_ENABLE_CLMUL) && defined(MANGO_ENABLE_SSSE3)
+
 #if defined(MANGO_ENABLE_AES)
 
 // ----------------------------------------------------------------------------------------
@@ -243,9 +528,7 @@ inline __m128i aesni_ecb_decrypt_block<10>(__m128i data, const __m128i* schedule
 template <>
 inline __m128i aesni_ecb_decrypt_block<12>(__m128i data, const __m128i* schedule)
 {
-    data = _mm_xor_si128(data, schedule[10]);
-    data = _mm_aesdec_si128(data, schedule[11]);
-    data = _mm_aesdec_si128(data, schedule[12]);
+    data = _mm_xor_si128(data, schedule[12]);
     data = _mm_aesdec_si128(data, schedule[13]);
     data = _mm_aesdec_si128(data, schedule[14]);
     data = _mm_aesdec_si128(data, schedule[15]);
@@ -255,17 +538,15 @@ inline __m128i aesni_ecb_decrypt_block<12>(__m128i data, const __m128i* schedule
     data = _mm_aesdec_si128(data, schedule[19]);
     data = _mm_aesdec_si128(data, schedule[20]);
     data = _mm_aesdec_si128(data, schedule[21]);
+    data = _mm_aesdec_si128(data, schedule[22]);
+    data = _mm_aesdec_si128(data, schedule[23]);
     return _mm_aesdeclast_si128(data, schedule[0]);
 }
 
 template <>
 inline __m128i aesni_ecb_decrypt_block<14>(__m128i data, const __m128i* schedule)
 {
-    data = _mm_xor_si128(data, schedule[10]);
-    data = _mm_aesdec_si128(data, schedule[11]);
-    data = _mm_aesdec_si128(data, schedule[12]);
-    data = _mm_aesdec_si128(data, schedule[13]);
-    data = _mm_aesdec_si128(data, schedule[14]);
+    data = _mm_xor_si128(data, schedule[14]);
     data = _mm_aesdec_si128(data, schedule[15]);
     data = _mm_aesdec_si128(data, schedule[16]);
     data = _mm_aesdec_si128(data, schedule[17]);
@@ -275,30 +556,129 @@ inline __m128i aesni_ecb_decrypt_block<14>(__m128i data, const __m128i* schedule
     data = _mm_aesdec_si128(data, schedule[21]);
     data = _mm_aesdec_si128(data, schedule[22]);
     data = _mm_aesdec_si128(data, schedule[23]);
+    data = _mm_aesdec_si128(data, schedule[24]);
+    data = _mm_aesdec_si128(data, schedule[25]);
+    data = _mm_aesdec_si128(data, schedule[26]);
+    data = _mm_aesdec_si128(data, schedule[27]);
     return _mm_aesdeclast_si128(data, schedule[0]);
 }
 
+// multiple blocks
+
+// The AES instructions have a latency of several cycles but a new one can be
+// started every cycle; eight independent blocks keep the unit busy.
+
+template <int NR>
+inline void aesni_encrypt_blocks(__m128i* data, const __m128i* schedule)
+{
+    for (int j = 0; j < 8; ++j)
+    {
+        data[j] = _mm_xor_si128(data[j], schedule[0]);
+    }
+
+    for (int i = 1; i < NR; ++i)
+    {
+        const __m128i key = schedule[i];
+        for (int j = 0; j < 8; ++j)
+        {
+            data[j] = _mm_aesenc_si128(data[j], key);
+        }
+    }
+
+    for (int j = 0; j < 8; ++j)
+    {
+        data[j] = _mm_aesenclast_si128(data[j], schedule[NR]);
+    }
+}
+
+template <int NR>
+inline void aesni_decrypt_blocks(__m128i* data, const __m128i* schedule)
+{
+    for (int j = 0; j < 8; ++j)
+    {
+        data[j] = _mm_xor_si128(data[j], schedule[NR]);
+    }
+
+    for (int i = NR + 1; i < NR * 2; ++i)
+    {
+        const __m128i key = schedule[i];
+        for (int j = 0; j < 8; ++j)
+        {
+            data[j] = _mm_aesdec_si128(data[j], key);
+        }
+    }
+
+    for (int j = 0; j < 8; ++j)
+    {
+        data[j] = _mm_aesdeclast_si128(data[j], schedule[0]);
+    }
+}
+
 // ECB buffer
 
 template <int NR>
 void aesni_ecb_encrypt(u8* output, const u8* input, size_t blocks, const __m128i* schedule)
 {
+    const __m128i* src = reinterpret_cast<const __m128i *>(input);
+    __m128i* dest = reinterpret_cast<__m128i *>(output);
+
+    for ( ; blocks >= 8; blocks -= 8)
+    {
+        __m128i data[8];
+        for (int j = 0; j < 8; ++j)
+        {
+            data[j] = _mm_loadu_si128(src + j);
+        }
+
+        aesni_encrypt_blocks<NR>(data, schedule);
+
+        for (int j = 0; j < 8; ++j)
+        {
+            _mm_storeu_si128(dest + j, data[j]);
+        }
+
+        src += 8;
+        dest += 8;
+    }
+
     for (size_t i = 0; i < blocks; ++i)
     {
-        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input) + i);
+        __m128i data = _mm_loadu_si128(src + i);
         data = aesni_ecb_encrypt_block<NR>(data, schedule);
-        _mm_storeu_si128(reinterpret_cast<__m128i *>(output) + i, data);
+        _mm_storeu_si128(dest + i, data);
     }
 }
 
 template <int NR>
 void aesni_ecb_decrypt(u8* output, const u8* input, size_t blocks, const __m128i* schedule)
 {
+    const __m128i* src = reinterpret_cast<const __m128i *>(input);
+    __m128i* dest = reinterpret_cast<__m128i *>(output);
+
+    for ( ; blocks >= 8; blocks -= 8)
+    {
+        __m128i data[8];
+        for (int j = 0; j < 8; ++j)
+        {
+            data[j] = _mm_loadu_si128(src + j);
+        }
+
+        aesni_decrypt_blocks<NR>(data, schedule);
+
+        for (int j = 0; j < 8; ++j)
+        {
+            _mm_storeu_si128(dest + j, data[j]);
+        }
+
+        src += 8;
+        dest += 8;
+    }
+
     for (size_t i = 0; i < blocks; ++i)
     {
-        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input) + i);
+        __m128i data = _mm_loadu_si128(src + i);
         data = aesni_ecb_decrypt_block<NR>(data, schedule);
-        _mm_storeu_si128(reinterpret_cast<__m128i *>(output) + i, data);
+        _mm_storeu_si128(dest + i, data);
     }
 }
 
@@ -307,6 +687,7 @@ void aesni_ecb_decrypt(u8* output, const u8* input, size_t blocks, const __m128i
 template <int NR>
 void aesni_cbc_encrypt(u8* output, const u8* input, size_t blocks, __m128i iv, const __m128i* schedule)
 {
+    // each block depends on the previous one so the encryption can't be pipelined
     for (size_t i = 0; i < blocks; ++i)
     {
         __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input) + i);
@@ -319,16 +700,87 @@ void aesni_cbc_encrypt(u8* output, const u8* input, size_t blocks, __m128i iv, c
 template <int NR>
 void aesni_cbc_decrypt(u8* output, const u8* input, size_t blocks, __m128i iv, const __m128i* schedule)
 {
+    const __m128i* src = reinterpret_cast<const __m128i *>(input);
+    __m128i* dest = reinterpret_cast<__m128i *>(output);
+
+    for ( ; blocks >= 8; blocks -= 8)
+    {
+        __m128i temp[8];
+        __m128i data[8];
+        for (int j = 0; j < 8; ++j)
+        {
+            temp[j] = _mm_loadu_si128(src + j);
+            data[j] = temp[j];
+        }
+
+        aesni_decrypt_blocks<NR>(data, schedule);
+
+        _mm_storeu_si128(dest + 0, _mm_xor_si128(data[0], iv));
+        for (int j = 1; j < 8; ++j)
+        {
+            _mm_storeu_si128(dest + j, _mm_xor_si128(data[j], temp[j - 1]));
+        }
+
+        iv = temp[7];
+        src += 8;
+        dest += 8;
+    }
+
     for (size_t i = 0; i < blocks; ++i)
     {
-        __m128i temp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input) + i);
+        __m128i temp = _mm_loadu_si128(src + i);
         __m128i data = aesni_ecb_decrypt_block<NR>(temp, schedule);
         data = _mm_xor_si128(data, iv);
-        _mm_storeu_si128(reinterpret_cast<__m128i *>(output) + i, data);
+        _mm_storeu_si128(dest + i, data);
         iv = temp;
     }
 }
 
+// CTR buffer
+
+template <int NR>
+void aesni_ctr_encrypt(u8* output, const u8* input, size_t length, CounterAES& counter, const __m128i* schedule)
+{
+    const __m128i* src = reinterpret_cast<const __m128i *>(input);
+    __m128i* dest = reinterpret_cast<__m128i *>(output);
+
+    for ( ; length >= 128; length -= 128)
+    {
+        __m128i data[8];
+        counter.next8(data);
+
+        aesni_encrypt_blocks<NR>(data, schedule);
+
+        for (int j = 0; j < 8; ++j)
+        {
+            _mm_storeu_si128(dest + j, _mm_xor_si128(data[j], _mm_loadu_si128(src + j)));
+        }
+
+        src += 8;
+        dest += 8;
+    }
+
+    for ( ; length >= 16; length -= 16)
+    {
+        __m128i data = aesni_ecb_encrypt_block<NR>(counter.next(), schedule);
+        _mm_storeu_si128(dest++, _mm_xor_si128(data, _mm_loadu_si128(src++)));
+    }
+
+    if (length)
+    {
+        alignas(16) u8 temp[16];
+        __m128i data = aesni_ecb_encrypt_block<NR>(counter.next(), schedule);
+        _mm_store_si128(reinterpret_cast<__m128i *>(temp), data);
+
+        const u8* s = reinterpret_cast<const u8 *>(src);
+        u8* d = reinterpret_cast<u8 *>(dest);
+        for (size_t i = 0; i < length; ++i)
+        {
+            d[i] = s[i] ^ temp[i];
+        }
+    }
+}
+
 // EBC selector
 
 void aesni_ecb_encrypt(u8* output, const u8* input, size_t length, const __m128i* schedule, int keybits)
@@ -411,6 +863,26 @@ void aesni_cbc_decrypt(u8* output, const u8* input, size_t length, const u8* ive
     }
 }
 
+// CTR selector
+
+void aesni_ctr_encrypt(u8* output, const u8* input, size_t length, CounterAES& counter, const __m128i* schedule, int keybits)
+{
+    switch (keybits)
+    {
+        case 128:
+            aesni_ctr_encrypt<10>(output, input, length, counter, schedule);
+            break;
+        case 192:
+            aesni_ctr_encrypt<12>(output, input, length, counter, schedule);
+            break;
+        case 256:
+            aesni_ctr_encrypt<14>(output, input, length, counter, schedule);
+            break;
+        default:
+            break;
+    }
+}
+
 void aesni_key_expand(__m128i* schedule, const u8* key, int bits)
 {
     switch (bits)
@@ -448,8 +920,243 @@ struct KeyScheduleAES
 #if defined(MANGO_ENABLE_AES)
     bool aes_supported;
 #endif
+
+    // GHASH key
+    Block128 h;
+#if defined(MANGO_ENABLE_CLMUL) && defined(MANGO_ENABLE_SSSE3)
+    __m128i powers[8];
+    bool clmul_supported;
+#endif
 };
 
+namespace
+{
+
+    constexpr size_t CHUNK_SIZE = 1024 * 4;
+    constexpr size_t SEGMENT_SIZE = 1024 * 1024;
+
+    void ctr_process(const KeyScheduleAES& ks, int bits, u8* output, const u8* input, size_t length, CounterAES& counter)
+    {
+#if defined(MANGO_ENABLE_AES)
+        if (ks.aes_supported)
+        {
+            aesni_ctr_encrypt(output, input, length, counter, ks.schedule, bits);
+            return;
+        }
+#endif
+
+        for (size_t i = 0; i < length; i += 16)
+        {
+            u8 block[16];
+            counter.store(block);
+            counter.add(1);
+            aes_encrypt(block, block, ks.w, bits);
+
+            const size_t count = std::min(length - i, size_t(16));
+            for (size_t j = 0; j < count; ++j)
+            {
+                output[i + j] = input[i + j] ^ block[j];
+            }
+        }
+    }
+
+    Block128 ghash_process(const KeyScheduleAES& ks, Block128 hash, const u8* data, size_t length)
+    {
+#if defined(MANGO_ENABLE_CLMUL) && defined(MANGO_ENABLE_SSSE3)
+        if (ks.clmul_supported)
+        {
+            return ghash_clmul(hash, data, length, ks.powers);
+        }
+#endif
+        return ghash_generic(hash, data, length, ks.h);
+    }
+
+    // The blocks are encrypted and hashed in chunks which stay in the L1 cache.
+    Block128 gcm_segment(const KeyScheduleAES& ks, int bits, u8* output, const u8* input, size_t length,
+                         CounterAES counter, Block128 hash, bool encrypt)
+    {
+        for (size_t offset = 0; offset < length; offset += CHUNK_SIZE)
+        {
+            const size_t size = std::min(length - offset, CHUNK_SIZE);
+            if (!encrypt)
+            {
+                hash = ghash_process(ks, hash, input + offset, size);
+            }
+
+            ctr_process(ks, bits, output + offset, input + offset, size, counter);
+
+            if (encrypt)
+            {
+                hash = ghash_process(ks, hash, output + offset, size);
+            }
+        }
+
+        return hash;
+    }
+
+    // The segments of a large buffer are processed on the ThreadPool. The hash of a
+    // segment is computed from zero and combined afterwards by multiplying the hash
+    // of the preceding data with H^n, where n is the number of blocks in the segment.
+
+    template <typename F>
+    bool parallel_segments(size_t length, bool parallel, F func)
+    {
+        ThreadPool& pool = ThreadPool::getInstance();
+        if (!parallel || length < SEGMENT_SIZE * 4 || pool.size() < 2)
+        {
+            return false;
+        }
+
+        parallel_for(pool, BlockRange(0, int((length + SEGMENT_SIZE - 1) / SEGMENT_SIZE)), [&] (const BlockRange& range)
+        {
+            for (int i = range.begin; i < range.end; ++i)
+            {
+                const size_t offset = size_t(i) * SEGMENT_SIZE;
+                func(i, offset, std::min(length - offset, SEGMENT_SIZE));
+            }
+        });
+
+        return true;
+    }
+
+    void ctr_encrypt(const KeyScheduleAES& ks, int bits, u8* output, const u8* input, size_t length, const u8* iv, bool parallel)
+    {
+        CounterAES counter(iv, false);
+
+        bool done = parallel_segments(length, parallel, [&] (int index, size_t offset, size_t size)
+        {
+            MANGO_UNREFERENCED_PARAMETER(index);
+            CounterAES segment = counter;
+            segment.add(offset / 16);
+            ctr_process(ks, bits, output + offset, input + offset, size, segment);
+        });
+
+        if (!done)
+        {
+            ctr_process(ks, bits, output, input, length, counter);
+        }
+    }
+
+    void gcm_process(const KeyScheduleAES& ks, int bits, u8* output, const u8* input, size_t length,
+                     Memory associated, Memory iv, u8* tag, bool encrypt, bool parallel)
+    {
+        const Block128 zero = { 0, 0 };
+
+        if (!iv.size)
+        {
+            MANGO_EXCEPTION("AES: GCM requires an iv.");
+        }
+
+        // pre-counter block
+        u8 j0[16];
+        if (iv.size == 12)
+        {
+            std::memcpy(j0, iv.address, 12);
+            ustore32be(j0 + 12, 1);
+        }
+        else
+        {
+            u8 block[16];
+            ustore64be(block + 0, 0);
+            ustore64be(block + 8, u64(iv.size) * 8);
+            Block128 hash = ghash_process(ks, zero, iv.address, iv.size);
+            hash = ghash_process(ks, hash, block, 16);
+            gf128_store(j0, hash);
+        }
+
+        CounterAES counter(j0, true);
+        counter.add(1);
+
+        Block128 hash = ghash_process(ks, zero, associated.address, associated.size);
+
+        std::vector<Block128> partial((length + SEGMENT_SIZE - 1) / SEGMENT_SIZE);
+
+        bool done = parallel_segments(length, parallel, [&] (int index, size_t offset, size_t size)
+        {
+            CounterAES segment = counter;
+            segment.add(offset / 16);
+            partial[index] = gcm_segment(ks, bits, output + offset, input + offset, size, segment, zero, encrypt);
+        });
+
+        if (done)
+        {
+            const Block128 shift = gf128_power(ks.h, SEGMENT_SIZE / 16);
+            for (size_t i = 0; i < partial.size(); ++i)
+            {
+                const size_t size = std::min(length - i * SEGMENT_SIZE, SEGMENT_SIZE);
+                const Block128 power = size == SEGMENT_SIZE ? shift : gf128_power(ks.h, (size + 15) / 16);
+                hash = gf128_xor(gf128_multiply(hash, power), partial[i]);
+            }
+        }
+        else
+        {
+            hash = gcm_segment(ks, bits, output, input, length, counter, hash, encrypt);
+        }
+
+        u8 block[16];
+        ustore64be(block + 0, u64(associated.size) * 8);
+        ustore64be(block + 8, u64(length) * 8);
+        hash = ghash_process(ks, hash, block, 16);
+
+        // tag = E(K, J0) ^ S
+        gf128_store(block, hash);
+        CounterAES mask(j0, true);
+        ctr_process(ks, bits, tag, block, 16, mask);
+    }
+
+    void gcm_encrypt(const KeyScheduleAES& ks, int bits, Memory output, Memory input,
+                     Memory associated, Memory iv, int tag_length, bool parallel)
+    {
+        if (tag_length < 4 || tag_length > 16)
+        {
+            MANGO_EXCEPTION("AES: Incorrect GCM tag length.");
+        }
+
+        if (output.size != input.size + tag_length)
+        {
+            MANGO_EXCEPTION("AES: Incorrect GCM output size.");
+        }
+
+        u8 tag[16];
+        gcm_process(ks, bits, output.address, input.address, input.size, associated, iv, tag, true, parallel);
+        std::memcpy(output.address + input.size, tag, tag_length);
+    }
+
+    bool gcm_decrypt(const KeyScheduleAES& ks, int bits, Memory output, Memory input,
+                     Memory associated, Memory iv, int tag_length, bool parallel)
+    {
+        if (tag_length < 4 || tag_length > 16)
+        {
+            MANGO_EXCEPTION("AES: Incorrect GCM tag length.");
+        }
+
+        if (input.size < size_t(tag_length) || output.size != input.size - tag_length)
+        {
+            MANGO_EXCEPTION("AES: Incorrect GCM output size.");
+        }
+
+        u8 tag[16];
+        gcm_process(ks, bits, output.address, input.address, output.size, associated, iv, tag, false, parallel);
+
+        // constant time comparison
+        u8 difference = 0;
+        for (int i = 0; i < tag_length; ++i)
+        {
+            difference |= tag[i] ^ input.address[output.size + i];
+        }
+
+        if (difference)
+        {
+            // don't release unauthenticated plaintext
+            std::memset(output.address, 0, output.size);
+            return false;
+        }
+
+        return true;
+    }
+
+} // namespace
+
 AES::AES(const u8* key, int bits)
     : m_schedule(new KeyScheduleAES())
     , m_bits(bits)
@@ -465,6 +1172,19 @@ AES::AES(const u8* key, int bits)
     {
         aes_key_setup(key, m_schedule->w, bits);
     }
+
+    // GHASH key is the encrypted zero block
+    u8 h[16] = { 0 };
+    ecb_encrypt(h, h, 16);
+    m_schedule->h = gf128_load(h);
+
+#if defined(MANGO_ENABLE_CLMUL) && defined(MANGO_ENABLE_SSSE3)
+    m_schedule->clmul_supported = (getCPUFlags() & CPU_CLMUL) != 0;
+    if (m_schedule->clmul_supported)
+    {
+        ghash_clmul_powers(m_schedule->powers, m_schedule->h);
+    }
+#endif
 }
 
 AES::~AES()
@@ -536,12 +1256,22 @@ void AES::cbc_decrypt(u8* output, const u8* input, size_t length, const u8* iv)
 
 void AES::ctr_encrypt(u8* output, const u8* input, size_t length, const u8* iv)
 {
-    aes_encrypt_ctr(input, length, output, m_schedule->w, m_bits, iv);
+    mango::ctr_encrypt(*m_schedule, m_bits, output, input, length, iv, false);
 }
 
 void AES::ctr_decrypt(u8* output, const u8* input, size_t length, const u8* iv)
 {
-    aes_decrypt_ctr(input, length, output, m_schedule->w, m_bits, iv);
+    mango::ctr_encrypt(*m_schedule, m_bits, output, input, length, iv, false);
+}
+
+void AES::ctr_encrypt_parallel(u8* output, const u8* input, size_t length, const u8* iv)
+{
+    mango::ctr_encrypt(*m_schedule, m_bits, output, input, length, iv, true);
+}
+
+void AES::ctr_decrypt_parallel(u8* output, const u8* input, size_t length, const u8* iv)
+{
+    mango::ctr_encrypt(*m_schedule, m_bits, output, input, length, iv, true);
 }
 
 void AES::ccm_encrypt(Memory output, Memory input, Memory associated, Memory nonce, int mac_length)
@@ -566,4 +1296,24 @@ void AES::ccm_decrypt(Memory output, Memory input, Memory associated, Memory non
                     m_schedule->w, m_bits);
 }
 
+void AES::gcm_encrypt(Memory output, Memory input, Memory associated, Memory iv, int tag_length)
+{
+    mango::gcm_encrypt(*m_schedule, m_bits, output, input, associated, iv, tag_length, false);
+}
+
+bool AES::gcm_decrypt(Memory output, Memory input, Memory associated, Memory iv, int tag_length)
+{
+    return mango::gcm_decrypt(*m_schedule, m_bits, output, input, associated, iv, tag_length, false);
+}
+
+void AES::gcm_encrypt_parallel(Memory output, Memory input, Memory associated, Memory iv, int tag_length)
+{
+    mango::gcm_encrypt(*m_schedule, m_bits, output, input, associated, iv, tag_length, true);
+}
+
+bool AES::gcm_decrypt_parallel(Memory output, Memory input, Memory associated, Memory iv, int tag_length)
+{
+    return mango::gcm_decrypt(*m_schedule, m_bits, output, input, associated, iv, tag_length, true);
+}
+
 } // namespace mango
@@ -4,19 +4,29 @@
 */
 
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <exception>
+#include <unordered_map>
+#include <cmath>
 
 #include <mango/core/compress.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/core/buffer.hpp>
 #include <mango/core/bits.hpp>
 #include <mango/core/endian.hpp>
+#include <mango/core/parallel.hpp>
 
+// the zlib compatible macros would rename compress() to mz_compress()
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
 #include "../../external/miniz/miniz.h"
 
 #ifdef MANGO_ENABLE_LICENSE_BSD
 #include "../../external/lz4/lz4.h"
 #include "../../external/lz4/lz4hc.h"
 #include "../../external/lzo/minilzo.h"
+#define ZSTD_STATIC_LINKING_ONLY
 #include "../../external/zstd/zstd.h"
 #endif
 
@@ -28,543 +38,2458 @@
 namespace mango {
 
 // ----------------------------------------------------------------------------
-// miniz
+// CompressStream
 // ----------------------------------------------------------------------------
 
-namespace miniz {
-
-    size_t bound(size_t size)
+CompressStream::CompressStream(Stream& output, Compressor* compressor)
+    : m_stream(output)
+    , m_compressor(compressor)
+    , m_buffer(1024 * 64)
+    , m_offset(0)
+    , m_finished(false)
+{
+}
+
+CompressStream::~CompressStream()
+{
+    if (!m_finished)
     {
-        const mz_ulong s = static_cast<mz_ulong>(size);
-		return mz_compressBound(s);
+        try
+        {
+            finish();
+        }
+        catch (...)
+        {
+        }
     }
 
-	size_t compress(Memory dest, Memory source, int level)
-	{
-        level = clamp(level, 0, 10);
+    delete m_compressor;
+}
 
-        mz_ulong size = static_cast<mz_ulong>(dest.size);
-        int status = mz_compress2(dest, &size, source, static_cast<mz_ulong>(source.size), level);
+void CompressStream::process(Memory source, Compressor::Operation operation)
+{
+    for (;;)
+    {
+        Memory dest(m_buffer.data(), m_buffer.size());
+        const bool done = m_compressor->compress(dest, source, operation);
 
-        if (status != MZ_OK)
+        const size_t bytes = m_buffer.size() - dest.size;
+        if (bytes)
         {
-            MANGO_EXCEPTION("miniz: compression failed.");
+            m_stream.write(m_buffer.data(), bytes);
         }
 
-        return size;
-	}
+        if (done)
+            break;
+    }
+}
 
-    void decompress(Memory dest, Memory source)
+void CompressStream::flush()
+{
+    if (m_finished)
     {
-        mz_ulong zd = static_cast<mz_ulong>(dest.size);
-        int status = mz_uncompress(dest, &zd, source, static_cast<mz_ulong>(source.size));
+        MANGO_EXCEPTION("CompressStream: the stream has been finished.");
+    }
 
-        const char* msg;
+    process(Memory(), Compressor::FLUSH);
+}
 
-        switch (status)
+void CompressStream::finish()
+{
+    if (!m_finished)
+    {
+        m_finished = true;
+        process(Memory(), Compressor::FINISH);
+    }
+}
+
+uint64 CompressStream::size() const
+{
+    return m_offset;
+}
+
+uint64 CompressStream::offset() const
+{
+    return m_offset;
+}
+
+void CompressStream::seek(uint64 distance, SeekMode mode)
+{
+    MANGO_UNREFERENCED_PARAMETER(distance);
+    MANGO_UNREFERENCED_PARAMETER(mode);
+    MANGO_EXCEPTION("CompressStream: seeking is not supported.");
+}
+
+void CompressStream::read(void* dest, size_t size)
+{
+    MANGO_UNREFERENCED_PARAMETER(dest);
+    MANGO_UNREFERENCED_PARAMETER(size);
+    MANGO_EXCEPTION("CompressStream: reading is not supported.");
+}
+
+void CompressStream::write(const void* data, size_t size)
+{
+    if (m_finished)
+    {
+        MANGO_EXCEPTION("CompressStream: the stream has been finished.");
+    }
+
+    uint8* address = reinterpret_cast<uint8*>(const_cast<void*>(data));
+    process(Memory(address, size), Compressor::PROCESS);
+    m_offset += size;
+}
+
+// ----------------------------------------------------------------------------
+// DecompressStream
+// ----------------------------------------------------------------------------
+
+DecompressStream::DecompressStream(Stream& input, Decompressor* decompressor)
+    : m_stream(input)
+    , m_decompressor(decompressor)
+    , m_buffer(1024 * 64)
+    , m_remain(input.size() - input.offset())
+    , m_offset(0)
+    , m_end(false)
+{
+}
+
+DecompressStream::~DecompressStream()
+{
+    delete m_decompressor;
+}
+
+size_t DecompressStream::readSome(void* dest, size_t size)
+{
+    Memory output(reinterpret_cast<uint8*>(dest), size);
+
+    while (output.size && !m_end)
+    {
+        if (!m_input.size && m_remain)
         {
-            case MZ_OK:
-                msg = nullptr;
-                break;
-            case MZ_MEM_ERROR:
-                msg = "miniz: not enough memory.";
-                break;
-            case MZ_BUF_ERROR:
-                msg = "miniz: not enough room in the output buffer.";
-                break;
-            case MZ_DATA_ERROR:
-                msg = "miniz: corrupted input data.";
-                break;
-            default:
-                msg = "miniz: undefined error.";
-                break;
+            const size_t bytes = size_t(std::min(uint64(m_buffer.size()), m_remain));
+            m_stream.read(m_buffer.data(), bytes);
+            m_input = Memory(m_buffer.data(), bytes);
+            m_remain -= bytes;
         }
 
-        if (msg)
+        const size_t available = m_input.size;
+        const size_t space = output.size;
+
+        m_end = m_decompressor->decompress(output, m_input);
+
+        if (!m_end && available == m_input.size && space == output.size)
         {
-            MANGO_EXCEPTION(msg);
+            // no progress; the input stream has been exhausted
+            MANGO_EXCEPTION("DecompressStream: unexpected end of compressed data.");
         }
     }
 
-} // namespace miniz
-
-#ifdef MANGO_ENABLE_LICENSE_BSD
-
-// ----------------------------------------------------------------------------
-// lz4
-// ----------------------------------------------------------------------------
+    const size_t bytes = size - output.size;
+    m_offset += bytes;
+    return bytes;
+}
+
+bool DecompressStream::end() const
+{
+    return m_end;
+}
+
+uint64 DecompressStream::size() const
+{
+    return m_offset;
+}
+
+uint64 DecompressStream::offset() const
+{
+    return m_offset;
+}
+
+void DecompressStream::seek(uint64 distance, SeekMode mode)
+{
+    switch (mode)
+    {
+        case BEGIN:
+            if (distance < m_offset)
+            {
+                MANGO_EXCEPTION("DecompressStream: seeking backwards is not supported.");
+            }
+            distance -= m_offset;
+            break;
+        case CURRENT:
+            break;
+        case END:
+            MANGO_EXCEPTION("DecompressStream: seeking from the end is not supported.");
+    }
 
-namespace lz4 {
+    uint8 temp[1024 * 4];
 
-    size_t bound(size_t size)
+    while (distance > 0)
     {
-        const int s = int(size);
-		return LZ4_compressBound(s);
+        const size_t bytes = size_t(std::min(uint64(sizeof(temp)), distance));
+        read(temp, bytes);
+        distance -= bytes;
     }
+}
 
-    size_t compress(Memory dest, Memory source, int level)
+void DecompressStream::read(void* dest, size_t size)
+{
+    if (readSome(dest, size) < size)
     {
-        const int source_size = int(source.size);
-        const int dest_size = int(dest.size);
+        MANGO_EXCEPTION("DecompressStream: reading past the end of stream.");
+    }
+}
 
-        size_t written = 0;
+void DecompressStream::write(const void* data, size_t size)
+{
+    MANGO_UNREFERENCED_PARAMETER(data);
+    MANGO_UNREFERENCED_PARAMETER(size);
+    MANGO_EXCEPTION("DecompressStream: writing is not supported.");
+}
 
-        level = clamp(level, 0, 10);
+// ----------------------------------------------------------------------------
+// block streams
+// ----------------------------------------------------------------------------
 
-        if (level > 6)
-        {
-            const int compression_level = 1 + (level - 7) * 5;
-            written = LZ4_compress_HC(source, dest, source_size, dest_size, compression_level);
-        }
-        else
-        {
-            const int acceleration = 19 - level * 3;
-            written = LZ4_compress_fast(source, dest, source_size, dest_size, acceleration);
-        }
+namespace {
 
-	    if (written <= 0 || written > dest.size)
-        {
-			MANGO_EXCEPTION("lz4: compression failed.");
-		}
+    // lz4, lzo and lzfse don't have a streaming format of their own so the stream
+    // is a sequence of blocks. The block header is the uncompressed and compressed
+    // size (u32 little endian); a header with zero sizes ends the stream. The high
+    // bit of the compressed size is set when the block doesn't depend on the
+    // previous blocks, which can then be decompressed in parallel.
 
-        return written;
-	}
+    constexpr u32 BLOCK_INDEPENDENT = 0x80000000;
 
-    void decompress(Memory dest, Memory source)
+    void copyPending(Memory& dest, Memory& pending)
     {
-        int status = LZ4_decompress_fast(source, dest, int(dest.size));
-        if (status < 0)
-        {
-            MANGO_EXCEPTION("lz4: decompression failed.");
-        }
+        const size_t bytes = std::min(dest.size, pending.size);
+        std::memcpy(dest.address, pending.address, bytes);
+        dest.address += bytes;
+        dest.size -= bytes;
+        pending.address += bytes;
+        pending.size -= bytes;
     }
 
-    // stream
-
-    class StreamEncoderLZ4 : public StreamEncoder
+    class BlockCompressor : public Compressor
     {
     protected:
-        LZ4_stream_t* m_stream;
-        int m_acceleration;
-
-        char m_buffer[1024 * 128];
-        size_t m_offset { 0 };
+        std::vector<uint8> m_input;
+        size_t m_input_size;
+        std::vector<uint8> m_output;
+        Memory m_pending;
+        bool m_independent;
+        bool m_finished;
 
-    public:
-        StreamEncoderLZ4(int level)
-            : m_acceleration(level)
-        {
-            m_stream = LZ4_createStream();
-        }
+        // compress a block; dest has room for the bound
+        virtual size_t compressBlock(Memory dest, Memory source) = 0;
 
-        ~StreamEncoderLZ4()
+        void encode()
         {
-            LZ4_freeStream(m_stream);
+            Memory source(m_input.data(), m_input_size);
+            Memory dest(m_output.data() + 8, m_output.size() - 8);
+            const size_t written = compressBlock(dest, source);
+
+            ustore32le(m_output.data() + 0, u32(m_input_size));
+            ustore32le(m_output.data() + 4, u32(written) | (m_independent ? BLOCK_INDEPENDENT : 0));
+            m_pending = Memory(m_output.data(), written + 8);
+            m_input_size = 0;
         }
 
-        size_t bound(size_t size) const
+    public:
+        BlockCompressor(size_t block_size, size_t bound, bool independent)
+            : m_input(block_size)
+            , m_input_size(0)
+            , m_output(bound + 8)
+            , m_independent(independent)
+            , m_finished(false)
         {
-            const int s = int(size);
-            return LZ4_compressBound(s);
         }
 
-        size_t encode(Memory dest, Memory source)
+        bool compress(Memory& dest, Memory& source, Operation operation) override
         {
-            size_t written = 0;
-
-            for (; source.size > 0;)
+            for (;;)
             {
-                size_t block_size = std::min(size_t(1024 * 64), source.size);
+                copyPending(dest, m_pending);
+                if (m_pending.size)
+                    return false;
 
-                if (m_offset + block_size > 1024 * 128)
+                if (m_finished)
                 {
-                    m_offset = 0;
+                    if (source.size)
+                    {
+                        MANGO_EXCEPTION("Compressor: the stream has been finished.");
+                    }
+                    return true;
                 }
 
-                char* temp = m_buffer + m_offset;
-                m_offset += block_size;
+                const size_t bytes = std::min(source.size, m_input.size() - m_input_size);
+                std::memcpy(m_input.data() + m_input_size, source.address, bytes);
+                m_input_size += bytes;
+                source.address += bytes;
+                source.size -= bytes;
 
-                std::memcpy(temp, source.address, block_size);
-                source.address += block_size;
-                source.size -= block_size;
+                if (m_input_size == m_input.size())
+                {
+                    encode();
+                    continue;
+                }
 
-                char* dst = reinterpret_cast<char *>(dest.address);
-                int bytes = LZ4_compress_fast_continue(m_stream, temp, dst, int(block_size), int(dest.size), m_acceleration);
+                if (operation == PROCESS)
+                    return true;
 
-                dest.address += bytes;
-                dest.size -= bytes;
+                if (m_input_size)
+                {
+                    encode();
+                    continue;
+                }
 
-                written += bytes;
-            }
+                if (operation == FLUSH)
+                    return true;
 
-            return written;
+                ustore32le(m_output.data() + 0, 0);
+                ustore32le(m_output.data() + 4, 0);
+                m_pending = Memory(m_output.data(), 8);
+                m_finished = true;
+            }
         }
     };
 
-    class StreamDecoderLZ4 : public StreamDecoder
+    class BlockDecompressor : public Decompressor
     {
     protected:
-        LZ4_streamDecode_t* m_stream;
+        size_t m_block_size;
+        std::vector<uint8> m_input;
+        size_t m_input_size;
+        Memory m_pending;
+        bool m_end;
 
-        char m_buffer[1024 * 128];
-        size_t m_offset { 0 };
+        // decompress a block and return the decompressed data, which must stay
+        // valid until the next call
+        virtual Memory decompressBlock(Memory source, size_t size) = 0;
 
     public:
-        StreamDecoderLZ4()
+        BlockDecompressor(size_t block_size, size_t bound)
+            : m_block_size(block_size)
+            , m_input(bound + 8)
+            , m_input_size(0)
+            , m_end(false)
         {
-            m_stream = LZ4_createStreamDecode();
-        }
-
-        ~StreamDecoderLZ4()
-        {
-            LZ4_freeStreamDecode(m_stream);
         }
 
-        size_t decode(Memory dest, Memory source)
+        bool decompress(Memory& dest, Memory& source) override
         {
-            size_t written = 0;
-
-            for (; dest.size > 0;)
+            for (;;)
             {
-                size_t block_size = std::min(size_t(1024 * 64), dest.size);
+                copyPending(dest, m_pending);
+                if (m_pending.size)
+                    return false;
 
-                if (m_offset + block_size > 1024 * 128)
+                if (m_end)
+                    return true;
+
+                size_t required = 8;
+                if (m_input_size >= 8)
                 {
-                    m_offset = 0;
+                    required += uload32le(m_input.data() + 4) & ~BLOCK_INDEPENDENT;
                 }
 
-                char* temp = m_buffer + m_offset;
-                m_offset += block_size;
-
-                const char* src = reinterpret_cast<const char *>(source.address);
-                int bytes = LZ4_decompress_fast_continue(m_stream, src, temp, int(block_size));
-
+                const size_t bytes = std::min(source.size, required - m_input_size);
+                std::memcpy(m_input.data() + m_input_size, source.address, bytes);
+                m_input_size += bytes;
                 source.address += bytes;
                 source.size -= bytes;
 
-                std::memcpy(dest.address, temp, block_size);
-                dest.address += block_size;
-                dest.size -= block_size;
+                if (m_input_size < required)
+                    return false;
 
-                written += block_size;
-            }
+                const size_t size = uload32le(m_input.data() + 0);
+                const size_t compressed = uload32le(m_input.data() + 4) & ~BLOCK_INDEPENDENT;
 
-            return written;
+                if (required == 8)
+                {
+                    // the header is complete
+                    if (!size && !compressed)
+                    {
+                        m_input_size = 0;
+                        m_end = true;
+                    }
+                    else if (!size || !compressed || size > m_block_size || compressed > m_input.size() - 8)
+                    {
+                        MANGO_EXCEPTION("Decompressor: corrupted block header.");
+                    }
+                    continue;
+                }
+
+                m_pending = decompressBlock(Memory(m_input.data() + 8, compressed), size);
+                m_input_size = 0;
+            }
         }
     };
 
-    StreamEncoder* createStreamEncoder(int level)
+    // ------------------------------------------------------------------------
+    // parallel
+    // ------------------------------------------------------------------------
+
+    size_t getSegmentCount(size_t size, size_t segment_size)
     {
-        StreamEncoder* encoder = new StreamEncoderLZ4(level);
-        return encoder;
+        return std::max(size_t(1), (size + segment_size - 1) / segment_size);
     }
 
-    StreamDecoder* createStreamDecoder()
+    // The source is split into fixed size segments so that the output doesn't
+    // depend on the number of threads. The segments are compressed into the
+    // destination at multiples of the segment bound, which doesn't need any
+    // temporary memory, and compacted afterwards.
+    // func(Memory dest, Memory source, size_t index) returns the compressed size.
+
+    template <typename F>
+    size_t compressSegments(ThreadPool& pool, Memory dest, Memory source, size_t segment_size, size_t segment_bound, const F& func)
     {
-        StreamDecoder* decoder = new StreamDecoderLZ4();
-        return decoder;
-    }
+        const size_t count = getSegmentCount(source.size, segment_size);
+        if (dest.size < count * segment_bound)
+        {
+            MANGO_EXCEPTION("Not enough room in the destination; use bound_parallel().");
+        }
 
-} // namespace lz4
+        std::vector<size_t> sizes(count);
 
-// ----------------------------------------------------------------------------
-// lzo
-// ----------------------------------------------------------------------------
+        parallel_each(pool, count, [&] (size_t index)
+        {
+            const size_t offset = index * segment_size;
+            Memory segment(source.address + offset, std::min(segment_size, source.size - offset));
+            Memory output(dest.address + index * segment_bound, segment_bound);
+            sizes[index] = func(output, segment, index);
+        });
 
-namespace lzo {
+        size_t written = 0;
 
-    size_t bound(size_t size)
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::memmove(dest.address + written, dest.address + i * segment_bound, sizes[i]);
+            written += sizes[i];
+        }
+
+        return written;
+    }
+
+    // The segments of a block stream are independent blocks so that the
+    // stream can also be decompressed in parallel.
+
+    using BlockCompressFunction = size_t (*)(Memory dest, Memory source, int level);
+    using BlockDecompressFunction = void (*)(Memory dest, Memory source);
+
+    size_t getBlockSegmentBound(size_t size, size_t segment_size, size_t block_size, size_t (*bound)(size_t))
     {
-        return size + (size / 16) + 128;
+        const size_t segment = std::min(segment_size, size);
+        const size_t blocks = std::max(size_t(1), (segment + block_size - 1) / block_size);
+        return blocks * (bound(std::min(block_size, segment)) + 8);
     }
 
-    size_t compress(Memory dest, Memory source, int level)
+    size_t compressBlockStream(ThreadPool& pool, Memory dest, Memory source, size_t segment_size, size_t block_size,
+                               size_t (*bound)(size_t), BlockCompressFunction func, int level)
     {
-        void* workmem = aligned_malloc(LZO1X_MEM_COMPRESS);
+        const size_t segment_bound = getBlockSegmentBound(source.size, segment_size, block_size, bound);
 
-        lzo_uint dst_len = (lzo_uint)dest.size;
-        int x = lzo1x_1_compress(
-            source.address,
-            static_cast<lzo_uint>(source.size),
-            dest.address,
-            &dst_len,
-            workmem);
+        size_t written = compressSegments(pool, dest, source, segment_size, segment_bound,
+            [=] (Memory output, Memory segment, size_t index)
+        {
+            MANGO_UNREFERENCED_PARAMETER(index);
 
-        aligned_free(workmem);
-        if (x != LZO_E_OK)
+            size_t bytes = 0;
+
+            while (segment.size)
+            {
+                const size_t size = std::min(block_size, segment.size);
+                Memory block(output.address + bytes + 8, output.size - bytes - 8);
+                const size_t compressed = func(block, Memory(segment.address, size), level);
+                if (!compressed)
+                {
+                    MANGO_EXCEPTION("Compressor: block compression failed.");
+                }
+
+                ustore32le(output.address + bytes + 0, u32(size));
+                ustore32le(output.address + bytes + 4, u32(compressed) | BLOCK_INDEPENDENT);
+                bytes += compressed + 8;
+
+                segment.address += size;
+                segment.size -= size;
+            }
+
+            return bytes;
+        });
+
+        if (dest.size < written + 8)
         {
-            MANGO_EXCEPTION("lzo: compression failed.");
+            MANGO_EXCEPTION("Not enough room in the destination; use bound_parallel().");
         }
 
-        return static_cast<size_t>(dst_len);
-	}
+        // end of stream
+        ustore32le(dest.address + written + 0, 0);
+        ustore32le(dest.address + written + 4, 0);
 
-    void decompress(Memory dest, Memory source)
+        return written + 8;
+    }
+
+    void decompressStream(Memory dest, Memory source, Decompressor* decompressor)
     {
-        lzo_uint dst_len = (lzo_uint)dest.size;
-        int x = lzo1x_decompress(
-            source.address,
-            static_cast<lzo_uint>(source.size),
-            dest.address,
-            &dst_len,
-            NULL);
-        if (x != LZO_E_OK)
+        std::unique_ptr<Decompressor> stream(decompressor);
+        if (!stream->decompress(dest, source))
         {
-            MANGO_EXCEPTION("lzo: decompression failed.");
+            MANGO_EXCEPTION("Decompressor: truncated input or not enough room in the output buffer.");
         }
     }
 
-} // namespace lzo
+    // returns false when the stream has blocks which depend on the previous blocks
+    bool decompressBlockStream(ThreadPool& pool, Memory dest, Memory source, size_t block_size, BlockDecompressFunction func)
+    {
+        struct Block
+        {
+            Memory dest;
+            Memory source;
+        };
 
-// ----------------------------------------------------------------------------
-// zstd
-// ----------------------------------------------------------------------------
+        std::vector<Block> blocks;
+        size_t offset = 0;
 
-namespace zstd {
+        for (;;)
+        {
+            if (source.size < 8)
+            {
+                MANGO_EXCEPTION("Decompressor: unexpected end of compressed data.");
+            }
+
+            const size_t size = uload32le(source.address + 0);
+            const u32 packed = uload32le(source.address + 4);
+            const size_t compressed = packed & ~BLOCK_INDEPENDENT;
+            source.address += 8;
+            source.size -= 8;
+
+            if (!size && !packed)
+                break;
+
+            if (!(packed & BLOCK_INDEPENDENT))
+                return false;
+
+            if (!size || size > block_size || compressed > source.size)
+            {
+                MANGO_EXCEPTION("Decompressor: corrupted block header.");
+            }
+
+            if (size > dest.size - offset)
+            {
+                MANGO_EXCEPTION("Decompressor: not enough room in the output buffer.");
+            }
+
+            Block block;
+            block.dest = Memory(dest.address + offset, size);
+            block.source = Memory(source.address, compressed);
+            blocks.push_back(block);
+
+            offset += size;
+            source.address += compressed;
+            source.size -= compressed;
+        }
+
+        if (offset != dest.size)
+        {
+            MANGO_EXCEPTION("Decompressor: truncated input.");
+        }
+
+        parallel_each(pool, blocks.size(), [&] (size_t index)
+        {
+            func(blocks[index].dest, blocks[index].source);
+        });
+
+        return true;
+    }
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+// miniz
+// ----------------------------------------------------------------------------
+
+namespace miniz {
 
     size_t bound(size_t size)
     {
-        // compression is faster when it has more temporary buffer
-        const size_t turbo = 1024 * 128;
-		return ZSTD_compressBound(size) + turbo;
+        const mz_ulong s = static_cast<mz_ulong>(size);
+		return mz_compressBound(s);
     }
 
-    size_t compress(Memory dest, Memory source, int level)
-    {
-        level = clamp(level * 2, 1, 20);
+	size_t compress(Memory dest, Memory source, int level)
+	{
+        level = clamp(level, 0, 10);
 
-        const size_t x = ZSTD_compress(dest.address, dest.size,
-                                       source.address, source.size, level);
-        if (ZSTD_isError(x))
+        mz_ulong size = static_cast<mz_ulong>(dest.size);
+        int status = mz_compress2(dest, &size, source, static_cast<mz_ulong>(source.size), level);
+
+        if (status != MZ_OK)
         {
-            const char* error = ZSTD_getErrorName(x);
-            std::string s = "ZSTD: ";
-            s += error;
-            MANGO_EXCEPTION(s);
+            MANGO_EXCEPTION("miniz: compression failed.");
         }
 
-        return x;
+        return size;
 	}
 
     void decompress(Memory dest, Memory source)
     {
-        size_t x = ZSTD_decompress((void*)dest.address, dest.size,
-                                   source.address, source.size);
-        if (ZSTD_isError(x))
+        mz_ulong zd = static_cast<mz_ulong>(dest.size);
+        int status = mz_uncompress(dest, &zd, source, static_cast<mz_ulong>(source.size));
+
+        const char* msg;
+
+        switch (status)
         {
-            const char* error = ZSTD_getErrorName(x);
-            std::string s = "ZSTD: ";
-            s += error;
-            MANGO_EXCEPTION(s);
+            case MZ_OK:
+                msg = nullptr;
+                break;
+            case MZ_MEM_ERROR:
+                msg = "miniz: not enough memory.";
+                break;
+            case MZ_BUF_ERROR:
+                msg = "miniz: not enough room in the output buffer.";
+                break;
+            case MZ_DATA_ERROR:
+                msg = "miniz: corrupted input data.";
+                break;
+            default:
+                msg = "miniz: undefined error.";
+                break;
+        }
+
+        if (msg)
+        {
+            MANGO_EXCEPTION(msg);
         }
     }
 
-    // stream
 
-    class StreamEncoderZSTD : public StreamEncoder
+    // incremental
+
+    class CompressorMiniz : public Compressor
     {
     protected:
-        ZSTD_CStream* z;
+        mz_stream m_stream;
 
     public:
-        StreamEncoderZSTD(int level)
+        CompressorMiniz(int level)
         {
-            level = clamp(level * 2, 1, 20);
-            z = ZSTD_createCStream();
-            ZSTD_initCStream(z, level);
+            std::memset(&m_stream, 0, sizeof(m_stream));
+            if (mz_deflateInit(&m_stream, clamp(level, 0, 10)) != MZ_OK)
+            {
+                MANGO_EXCEPTION("miniz: compressor initialization failed.");
+            }
         }
 
-        ~StreamEncoderZSTD()
+        ~CompressorMiniz()
         {
-            ZSTD_freeCStream(z);
+            mz_deflateEnd(&m_stream);
         }
 
-        size_t bound(size_t size) const
+        bool compress(Memory& dest, Memory& source, Operation operation) override
         {
-            // compression is faster when it has more temporary buffer
-            const size_t turbo = 1024 * 128;
-            return ZSTD_compressBound(size) + turbo;
-        }
+            const int flush = operation == PROCESS ? MZ_NO_FLUSH :
+                              operation == FLUSH ? MZ_SYNC_FLUSH : MZ_FINISH;
 
-        size_t encode(Memory dest, Memory source)
-        {
-            ZSTD_inBuffer input;
+            for (;;)
+            {
+                m_stream.next_in = source.address;
+                m_stream.avail_in = static_cast<unsigned int>(std::min(source.size, size_t(1) << 30));
+                m_stream.next_out = dest.address;
+                m_stream.avail_out = static_cast<unsigned int>(std::min(dest.size, size_t(1) << 30));
 
-            input.src = source.address;
-            input.size = source.size;
-            input.pos = 0;
+                const int status = mz_deflate(&m_stream, flush);
 
-            ZSTD_outBuffer output;
+                const size_t consumed = m_stream.next_in - source.address;
+                const size_t written = m_stream.next_out - dest.address;
+                source.address += consumed;
+                source.size -= consumed;
+                dest.address += written;
+                dest.size -= written;
 
-            output.dst = dest.address;
-            output.size = dest.size;
-            output.pos = 0;
+                if (status == MZ_STREAM_END)
+                    return true;
 
-            for (; input.pos < input.size;)
-            {
-                ZSTD_compressStream(z, &output, &input);
-            }
+                if (status != MZ_OK && status != MZ_BUF_ERROR)
+                {
+                    MANGO_EXCEPTION("miniz: compression failed.");
+                }
 
-            ZSTD_flushStream(z, &output);
+                // the flush is complete when the output was not filled
+                if (!dest.size)
+                    return false;
 
-            return output.pos;
+                if (!source.size && operation != FINISH)
+                    return true;
+            }
         }
     };
 
-    class StreamDecoderZSTD : public StreamDecoder
+    class DecompressorMiniz : public Decompressor
     {
     protected:
-        ZSTD_DStream* z;
+        mz_stream m_stream;
+        bool m_end;
 
     public:
-        StreamDecoderZSTD()
+        DecompressorMiniz()
+            : m_end(false)
         {
-            z = ZSTD_createDStream();
-            ZSTD_initDStream(z);
+            std::memset(&m_stream, 0, sizeof(m_stream));
+            if (mz_inflateInit(&m_stream) != MZ_OK)
+            {
+                MANGO_EXCEPTION("miniz: decompressor initialization failed.");
+            }
         }
 
-        ~StreamDecoderZSTD()
+        ~DecompressorMiniz()
         {
-            ZSTD_freeDStream(z);
+            mz_inflateEnd(&m_stream);
         }
 
-        size_t decode(Memory dest, Memory source)
+        bool decompress(Memory& dest, Memory& source) override
         {
-            ZSTD_inBuffer input;
-
-            input.src = source.address;
-            input.size = source.size;
-            input.pos = 0;
+            while (!m_end)
+            {
+                m_stream.next_in = source.address;
+                m_stream.avail_in = static_cast<unsigned int>(std::min(source.size, size_t(1) << 30));
+                m_stream.next_out = dest.address;
+                m_stream.avail_out = static_cast<unsigned int>(std::min(dest.size, size_t(1) << 30));
 
-            ZSTD_outBuffer output;
+                const int status = mz_inflate(&m_stream, MZ_NO_FLUSH);
 
-            output.dst = dest.address;
-            output.size = dest.size;
-            output.pos = 0;
+                const size_t consumed = m_stream.next_in - source.address;
+                const size_t written = m_stream.next_out - dest.address;
+                source.address += consumed;
+                source.size -= consumed;
+                dest.address += written;
+                dest.size -= written;
 
-            for (; input.pos < input.size;)
-            {
-                ZSTD_decompressStream(z, &output, &input);
+                if (status == MZ_STREAM_END)
+                {
+                    m_end = true;
+                }
+                else if (status == MZ_BUF_ERROR)
+                {
+                    // no progress is possible without more input or output
+                    return false;
+                }
+                else if (status != MZ_OK)
+                {
+                    MANGO_EXCEPTION("miniz: corrupted input data.");
+                }
+                else if (!dest.size || !source.size)
+                {
+                    return false;
+                }
             }
 
-            return output.pos;
+            return true;
         }
     };
 
-    StreamEncoder* createStreamEncoder(int level)
+    Compressor* createCompressor(int level)
     {
-        StreamEncoder* encoder = new StreamEncoderZSTD(level);
-        return encoder;
+        Compressor* compressor = new CompressorMiniz(level);
+        return compressor;
     }
 
-    StreamDecoder* createStreamDecoder()
+    Decompressor* createDecompressor()
     {
-        StreamDecoder* decoder = new StreamDecoderZSTD();
-        return decoder;
+        Decompressor* decompressor = new DecompressorMiniz();
+        return decompressor;
     }
 
-} // namespace zstd
-
-#endif // MANGO_ENABLE_LICENSE_BSD
 
-#ifdef MANGO_ENABLE_LICENSE_ZLIB
+    // parallel
 
-// ----------------------------------------------------------------------------
-// bzip2
-// ----------------------------------------------------------------------------
+    // pigz style: the segments are raw deflate streams which end at a byte
+    // boundary with a sync flush and only the last one has the final block. The
+    // adler32 checksums of the segments are combined for the zlib trailer.
+    // Each segment is primed with the end of the previous segment so that the
+    // matches can reach across the boundary like in a serial stream.
 
-namespace bzip2 {
+    constexpr size_t SEGMENT_SIZE = 1024 * 1024;
+    constexpr size_t WINDOW_SIZE = 32 * 1024;
 
-    size_t bound(size_t size)
+    u32 adler32_combine(u32 adler1, u32 adler2, size_t length2)
     {
-        return size + (size / 100) + 600;
+        const u32 base = 65521;
+        const u32 rem = u32(length2 % base);
+
+        u32 sum1 = adler1 & 0xffff;
+        u32 sum2 = (rem * sum1) % base;
+        sum1 += (adler2 & 0xffff) + base - 1;
+        sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + base - rem;
+
+        if (sum1 >= base) sum1 -= base;
+        if (sum1 >= base) sum1 -= base;
+        if (sum2 >= (base << 1)) sum2 -= (base << 1);
+        if (sum2 >= base) sum2 -= base;
+
+        return sum1 | (sum2 << 16);
     }
 
-    size_t compress(Memory dest, Memory source, int level)
+    size_t getSegmentBound(size_t size)
     {
-        const int blockSize100k = clamp(level, 1, 9);
+        // the sync flush marker
+        return bound(std::min(SEGMENT_SIZE, size)) + 16;
+    }
 
-        const int verbosity = 0;
-        const int workFactor = 30;
+    size_t bound_parallel(size_t size)
+    {
+        // zlib header and trailer
+        return getSegmentCount(size, SEGMENT_SIZE) * getSegmentBound(size) + 6;
+    }
 
-        bz_stream strm;
+    size_t compress_parallel(Memory dest, Memory source, int level)
+    {
+        return compress_parallel(ThreadPool::getInstance(), dest, source, level);
+    }
 
-        strm.bzalloc = nullptr;
-        strm.bzfree = nullptr;
-        strm.opaque = nullptr;
+    size_t compress_parallel(ThreadPool& pool, Memory dest, Memory source, int level)
+    {
+        level = clamp(level, 0, 10);
 
-        int x = BZ2_bzCompressInit(&strm, blockSize100k, verbosity, workFactor);
-        if (x != BZ_OK)
+        if (dest.size < 6)
         {
-            MANGO_EXCEPTION("bzip2: compression failed.");
+            MANGO_EXCEPTION("Not enough room in the destination; use bound_parallel().");
         }
 
-        unsigned int destLength = static_cast<unsigned int>(dest.size);
+        const size_t count = getSegmentCount(source.size, SEGMENT_SIZE);
+        std::vector<u32> checksums(count);
 
-        strm.next_in = source;
-        strm.next_out = dest;
-        strm.avail_in = static_cast<unsigned int>(source.size);
-        strm.avail_out = destLength;
+        // zlib header with the compression level hint
+        dest.address[0] = 0x78;
+        dest.address[1] = level < 2 ? 0x01 : level < 6 ? 0x5e : level == 6 ? 0x9c : 0xda;
 
-        x = BZ2_bzCompress(&strm, BZ_FINISH);
-        if (x == BZ_FINISH_OK)
-        {
-            BZ2_bzCompressEnd(&strm);
-            MANGO_EXCEPTION("bzip2: compression failed.");
-        }
-        else if (x != BZ_STREAM_END)
+        Memory output(dest.address + 2, dest.size - 6);
+
+        size_t written = compressSegments(pool, output, source, SEGMENT_SIZE, getSegmentBound(source.size),
+            [&] (Memory dest, Memory source, size_t index)
         {
-            BZ2_bzCompressEnd(&strm);
-            MANGO_EXCEPTION("bzip2: compression failed.");
-        }
+            const bool last = index == count - 1;
 
-        destLength -= strm.avail_out;
-        BZ2_bzCompressEnd(&strm);
+            mz_stream stream;
+            std::memset(&stream, 0, sizeof(stream));
 
-        return static_cast<size_t>(destLength);
-    }
+            if (mz_deflateInit2(&stream, level, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY) != MZ_OK)
+            {
+                MANGO_EXCEPTION("miniz: compressor initialization failed.");
+            }
 
-    void decompress(Memory dest, Memory source)
-    {
-        bz_stream strm;
+            if (index > 0)
+            {
+                // miniz has no deflateSetDictionary(); the window of the previous
+                // segment is compressed into a scratch buffer which is thrown away.
+                // The decompressor has the same data in its window when it
+                // reaches this segment.
+                std::vector<u8> scratch(getSegmentBound(WINDOW_SIZE));
+
+                stream.next_in = source.address - WINDOW_SIZE;
+                stream.avail_in = static_cast<unsigned int>(WINDOW_SIZE);
+                stream.next_out = scratch.data();
+                stream.avail_out = static_cast<unsigned int>(scratch.size());
+
+                const int status = mz_deflate(&stream, MZ_SYNC_FLUSH);
+                if (status != MZ_OK || stream.avail_in)
+                {
+                    mz_deflateEnd(&stream);
+                    MANGO_EXCEPTION("miniz: compression failed.");
+                }
+            }
 
-        strm.bzalloc = nullptr;
-        strm.bzfree = nullptr;
-        strm.opaque = nullptr;
+            stream.next_in = source.address;
+            stream.avail_in = static_cast<unsigned int>(source.size);
+            stream.next_out = dest.address;
+            stream.avail_out = static_cast<unsigned int>(dest.size);
 
-        int x = BZ2_bzDecompressInit(&strm, 0, 0);
-        if (x != BZ_OK)
-        {
-            MANGO_EXCEPTION("bzip2: decompression failed.");
-        }
+            const int status = mz_deflate(&stream, last ? MZ_FINISH : MZ_SYNC_FLUSH);
+            const size_t bytes = size_t(stream.next_out - dest.address);
+            const bool complete = last ? status == MZ_STREAM_END : status == MZ_OK && !stream.avail_in;
 
-        strm.next_in = source;
-        strm.next_out = dest;
-        strm.avail_in = static_cast<unsigned int>(source.size);
-        strm.avail_out = static_cast<unsigned int>(dest.size);
+            mz_deflateEnd(&stream);
 
-        x = BZ2_bzDecompress(&strm);
-        if (x == BZ_OK)
-        {
-            BZ2_bzDecompressEnd(&strm);
-            MANGO_EXCEPTION("bzip2: decompression failed.");
-        }
-        else if (x != BZ_STREAM_END)
+            if (!complete)
+            {
+                MANGO_EXCEPTION("miniz: compression failed.");
+            }
+
+            checksums[index] = u32(mz_adler32(MZ_ADLER32_INIT, source.address, source.size));
+            return bytes;
+        });
+
+        u32 adler = checksums[0];
+
+        for (size_t i = 1; i < count; ++i)
         {
-            BZ2_bzDecompressEnd(&strm);
-            MANGO_EXCEPTION("bzip2: decompression failed.");
+            const size_t length = std::min(SEGMENT_SIZE, source.size - i * SEGMENT_SIZE);
+            adler = adler32_combine(adler, checksums[i], length);
         }
 
-        BZ2_bzDecompressEnd(&strm);
+        ustore32be(dest.address + 2 + written, adler);
+
+        return written + 6;
     }
 
-} // namespace bzip2
+} // namespace miniz
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
 
 // ----------------------------------------------------------------------------
-// lzfse
+// lz4
 // ----------------------------------------------------------------------------
 
-namespace lzfse {
+namespace lz4 {
+
+    size_t bound(size_t size)
+    {
+        const int s = int(size);
+		return LZ4_compressBound(s);
+    }
+
+    size_t compress(Memory dest, Memory source, int level)
+    {
+        const int source_size = int(source.size);
+        const int dest_size = int(dest.size);
+
+        size_t written = 0;
+
+        level = clamp(level, 0, 10);
+
+        if (level > 6)
+        {
+            const int compression_level = 1 + (level - 7) * 5;
+            written = LZ4_compress_HC(source, dest, source_size, dest_size, compression_level);
+        }
+        else
+        {
+            const int acceleration = 19 - level * 3;
+            written = LZ4_compress_fast(source, dest, source_size, dest_size, acceleration);
+        }
+
+	    if (written <= 0 || written > dest.size)
+        {
+			MANGO_EXCEPTION("lz4: compression failed.");
+		}
+
+        return written;
+	}
+
+    void decompress(Memory dest, Memory source)
+    {
+        int status = LZ4_decompress_fast(source, dest, int(dest.size));
+        if (status < 0)
+        {
+            MANGO_EXCEPTION("lz4: decompression failed.");
+        }
+    }
+
+    // stream
+
+    class StreamEncoderLZ4 : public StreamEncoder
+    {
+    protected:
+        LZ4_stream_t* m_stream;
+        int m_acceleration;
+
+        std::vector<char> m_dictionary;
+        char m_buffer[1024 * 128];
+        size_t m_offset { 0 };
+
+    public:
+        StreamEncoderLZ4(int level)
+            : m_acceleration(level)
+        {
+            m_stream = LZ4_createStream();
+        }
+
+        StreamEncoderLZ4(int level, Memory dictionary)
+            : StreamEncoderLZ4(level)
+        {
+            // the first block refers to the dictionary so it must stay in place
+            const size_t size = std::min(dictionary.size, size_t(1024 * 64));
+            const uint8* end = dictionary.address + dictionary.size;
+            m_dictionary.assign(end - size, end);
+            LZ4_loadDict(m_stream, m_dictionary.data(), int(size));
+        }
+
+        ~StreamEncoderLZ4()
+        {
+            LZ4_freeStream(m_stream);
+        }
+
+        size_t bound(size_t size) const
+        {
+            const int s = int(size);
+            return LZ4_compressBound(s);
+        }
+
+        size_t encode(Memory dest, Memory source)
+        {
+            size_t written = 0;
+
+            for (; source.size > 0;)
+            {
+                size_t block_size = std::min(size_t(1024 * 64), source.size);
+
+                if (m_offset + block_size > 1024 * 128)
+                {
+                    m_offset = 0;
+                }
+
+                char* temp = m_buffer + m_offset;
+                m_offset += block_size;
+
+                std::memcpy(temp, source.address, block_size);
+                source.address += block_size;
+                source.size -= block_size;
+
+                char* dst = reinterpret_cast<char *>(dest.address);
+                int bytes = LZ4_compress_fast_continue(m_stream, temp, dst, int(block_size), int(dest.size), m_acceleration);
+
+                dest.address += bytes;
+                dest.size -= bytes;
+
+                written += bytes;
+            }
+
+            return written;
+        }
+    };
+
+    class StreamDecoderLZ4 : public StreamDecoder
+    {
+    protected:
+        LZ4_streamDecode_t* m_stream;
+
+        std::vector<char> m_dictionary;
+        char m_buffer[1024 * 128];
+        size_t m_offset { 0 };
+
+    public:
+        StreamDecoderLZ4()
+        {
+            m_stream = LZ4_createStreamDecode();
+        }
+
+        StreamDecoderLZ4(Memory dictionary)
+            : StreamDecoderLZ4()
+        {
+            const size_t size = std::min(dictionary.size, size_t(1024 * 64));
+            const uint8* end = dictionary.address + dictionary.size;
+            m_dictionary.assign(end - size, end);
+            LZ4_setStreamDecode(m_stream, m_dictionary.data(), int(size));
+        }
+
+        ~StreamDecoderLZ4()
+        {
+            LZ4_freeStreamDecode(m_stream);
+        }
+
+        size_t decode(Memory dest, Memory source)
+        {
+            size_t written = 0;
+
+            for (; dest.size > 0;)
+            {
+                size_t block_size = std::min(size_t(1024 * 64), dest.size);
+
+                if (m_offset + block_size > 1024 * 128)
+                {
+                    m_offset = 0;
+                }
+
+                char* temp = m_buffer + m_offset;
+                m_offset += block_size;
+
+                const char* src = reinterpret_cast<const char *>(source.address);
+                int bytes = LZ4_decompress_fast_continue(m_stream, src, temp, int(block_size));
+
+                source.address += bytes;
+                source.size -= bytes;
+
+                std::memcpy(dest.address, temp, block_size);
+                dest.address += block_size;
+                dest.size -= block_size;
+
+                written += block_size;
+            }
+
+            return written;
+        }
+    };
+
+    StreamEncoder* createStreamEncoder(int level)
+    {
+        StreamEncoder* encoder = new StreamEncoderLZ4(level);
+        return encoder;
+    }
+
+    StreamDecoder* createStreamDecoder()
+    {
+        StreamDecoder* decoder = new StreamDecoderLZ4();
+        return decoder;
+    }
+
+    StreamEncoder* createStreamEncoder(int level, Memory dictionary)
+    {
+        StreamEncoder* encoder = new StreamEncoderLZ4(level, dictionary);
+        return encoder;
+    }
+
+    StreamDecoder* createStreamDecoder(Memory dictionary)
+    {
+        StreamDecoder* decoder = new StreamDecoderLZ4(dictionary);
+        return decoder;
+    }
+
+
+    // incremental
+
+    // the blocks are compressed with the previous 64 KB as dictionary
+
+    constexpr size_t BLOCK_SIZE = 1024 * 64;
+
+    class CompressorLZ4 : public BlockCompressor
+    {
+    protected:
+        LZ4_stream_t* m_stream;
+        LZ4_streamHC_t* m_stream_hc;
+        int m_acceleration;
+        std::vector<char> m_dictionary;
+
+        size_t compressBlock(Memory dest, Memory source) override
+        {
+            const char* src = reinterpret_cast<const char *>(source.address);
+            char* dst = reinterpret_cast<char *>(dest.address);
+
+            int bytes;
+
+            if (m_stream_hc)
+            {
+                bytes = LZ4_compress_HC_continue(m_stream_hc, src, dst, int(source.size), int(dest.size));
+                LZ4_saveDictHC(m_stream_hc, m_dictionary.data(), int(BLOCK_SIZE));
+            }
+            else
+            {
+                bytes = LZ4_compress_fast_continue(m_stream, src, dst, int(source.size), int(dest.size), m_acceleration);
+                LZ4_saveDict(m_stream, m_dictionary.data(), int(BLOCK_SIZE));
+            }
+
+            if (bytes <= 0)
+            {
+                MANGO_EXCEPTION("lz4: compression failed.");
+            }
+
+            return size_t(bytes);
+        }
+
+    public:
+        CompressorLZ4(int level)
+            : BlockCompressor(BLOCK_SIZE, LZ4_compressBound(int(BLOCK_SIZE)), false)
+            , m_stream(nullptr)
+            , m_stream_hc(nullptr)
+            , m_acceleration(1)
+            , m_dictionary(BLOCK_SIZE)
+        {
+            level = clamp(level, 0, 10);
+
+            if (level > 6)
+            {
+                m_stream_hc = LZ4_createStreamHC();
+                LZ4_resetStreamHC(m_stream_hc, 1 + (level - 7) * 5);
+            }
+            else
+            {
+                m_stream = LZ4_createStream();
+                m_acceleration = 19 - level * 3;
+            }
+        }
+
+        ~CompressorLZ4()
+        {
+            if (m_stream_hc)
+                LZ4_freeStreamHC(m_stream_hc);
+            if (m_stream)
+                LZ4_freeStream(m_stream);
+        }
+    };
+
+    class DecompressorLZ4 : public BlockDecompressor
+    {
+    protected:
+        // the previous 64 KB followed by the current block
+        std::vector<char> m_buffer;
+        size_t m_dictionary_size;
+        size_t m_previous_size; // size of the previous decompressed block
+
+        Memory decompressBlock(Memory source, size_t size) override
+        {
+            // slide the window so that the dictionary is just before the block
+            const size_t total = m_dictionary_size + m_previous_size;
+            const size_t keep = std::min(total, BLOCK_SIZE);
+            std::memmove(m_buffer.data(), m_buffer.data() + total - keep, keep);
+            m_dictionary_size = keep;
+
+            const char* src = reinterpret_cast<const char *>(source.address);
+            char* dst = m_buffer.data() + keep;
+
+            int bytes = LZ4_decompress_safe_usingDict(src, dst, int(source.size), int(size),
+                                                      m_buffer.data(), int(keep));
+            if (bytes != int(size))
+            {
+                MANGO_EXCEPTION("lz4: corrupted input data.");
+            }
+
+            m_previous_size = size;
+            return Memory(reinterpret_cast<uint8*>(dst), size);
+        }
+
+    public:
+        DecompressorLZ4()
+            : BlockDecompressor(BLOCK_SIZE, LZ4_compressBound(int(BLOCK_SIZE)))
+            , m_buffer(BLOCK_SIZE * 2)
+            , m_dictionary_size(0)
+            , m_previous_size(0)
+        {
+        }
+    };
+
+    Compressor* createCompressor(int level)
+    {
+        Compressor* compressor = new CompressorLZ4(level);
+        return compressor;
+    }
+
+    Decompressor* createDecompressor()
+    {
+        Decompressor* decompressor = new DecompressorLZ4();
+        return decompressor;
+    }
+
+
+    // parallel
+
+    constexpr size_t SEGMENT_SIZE = 1024 * 1024;
+
+    size_t compressBlock(Memory dest, Memory source, int level)
+    {
+        return compress(dest, source, level);
+    }
+
+    void decompressBlock(Memory dest, Memory source)
+    {
+        const char* src = reinterpret_cast<const char *>(source.address);
+        char* dst = reinterpret_cast<char *>(dest.address);
+
+        int bytes = LZ4_decompress_safe(src, dst, int(source.size), int(dest.size));
+        if (bytes != int(dest.size))
+        {
+            MANGO_EXCEPTION("lz4: corrupted input data.");
+        }
+    }
+
+    size_t bound_parallel(size_t size)
+    {
+        const size_t segment_bound = getBlockSegmentBound(size, SEGMENT_SIZE, BLOCK_SIZE, bound);
+        return getSegmentCount(size, SEGMENT_SIZE) * segment_bound + 8;
+    }
+
+    size_t compress_parallel(Memory dest, Memory source, int level)
+    {
+        return compress_parallel(ThreadPool::getInstance(), dest, source, level);
+    }
+
+    size_t compress_parallel(ThreadPool& pool, Memory dest, Memory source, int level)
+    {
+        return compressBlockStream(pool, dest, source, SEGMENT_SIZE, BLOCK_SIZE, bound, compressBlock, level);
+    }
+
+    void decompress_parallel(Memory dest, Memory source)
+    {
+        decompress_parallel(ThreadPool::getInstance(), dest, source);
+    }
+
+    void decompress_parallel(ThreadPool& pool, Memory dest, Memory source)
+    {
+        if (!decompressBlockStream(pool, dest, source, BLOCK_SIZE, decompressBlock))
+        {
+            decompressStream(dest, source, createDecompressor());
+        }
+    }
+
+} // namespace lz4
+
+// ----------------------------------------------------------------------------
+// lzo
+// ----------------------------------------------------------------------------
+
+namespace lzo {
+
+    size_t bound(size_t size)
+    {
+        return size + (size / 16) + 128;
+    }
+
+    size_t compress(Memory dest, Memory source, int level)
+    {
+        void* workmem = aligned_malloc(LZO1X_MEM_COMPRESS);
+
+        lzo_uint dst_len = (lzo_uint)dest.size;
+        int x = lzo1x_1_compress(
+            source.address,
+            static_cast<lzo_uint>(source.size),
+            dest.address,
+            &dst_len,
+            workmem);
+
+        aligned_free(workmem);
+        if (x != LZO_E_OK)
+        {
+            MANGO_EXCEPTION("lzo: compression failed.");
+        }
+
+        return static_cast<size_t>(dst_len);
+	}
+
+    void decompress(Memory dest, Memory source)
+    {
+        lzo_uint dst_len = (lzo_uint)dest.size;
+        int x = lzo1x_decompress(
+            source.address,
+            static_cast<lzo_uint>(source.size),
+            dest.address,
+            &dst_len,
+            NULL);
+        if (x != LZO_E_OK)
+        {
+            MANGO_EXCEPTION("lzo: decompression failed.");
+        }
+    }
+
+
+    // incremental
+
+    constexpr size_t BLOCK_SIZE = 1024 * 256;
+
+    class CompressorLZO : public BlockCompressor
+    {
+    protected:
+        void* m_workmem;
+
+        size_t compressBlock(Memory dest, Memory source) override
+        {
+            lzo_uint dst_len = static_cast<lzo_uint>(dest.size);
+            int x = lzo1x_1_compress(source.address, static_cast<lzo_uint>(source.size),
+                                     dest.address, &dst_len, m_workmem);
+            if (x != LZO_E_OK)
+            {
+                MANGO_EXCEPTION("lzo: compression failed.");
+            }
+
+            return static_cast<size_t>(dst_len);
+        }
+
+    public:
+        CompressorLZO()
+            : BlockCompressor(BLOCK_SIZE, bound(BLOCK_SIZE), true)
+        {
+            m_workmem = aligned_malloc(LZO1X_MEM_COMPRESS);
+        }
+
+        ~CompressorLZO()
+        {
+            aligned_free(m_workmem);
+        }
+    };
+
+    class DecompressorLZO : public BlockDecompressor
+    {
+    protected:
+        std::vector<uint8> m_buffer;
+
+        Memory decompressBlock(Memory source, size_t size) override
+        {
+            lzo_uint dst_len = static_cast<lzo_uint>(size);
+            int x = lzo1x_decompress_safe(source.address, static_cast<lzo_uint>(source.size),
+                                          m_buffer.data(), &dst_len, NULL);
+            if (x != LZO_E_OK || dst_len != size)
+            {
+                MANGO_EXCEPTION("lzo: corrupted input data.");
+            }
+
+            return Memory(m_buffer.data(), size);
+        }
+
+    public:
+        DecompressorLZO()
+            : BlockDecompressor(BLOCK_SIZE, bound(BLOCK_SIZE))
+            , m_buffer(BLOCK_SIZE)
+        {
+        }
+    };
+
+    Compressor* createCompressor(int level)
+    {
+        MANGO_UNREFERENCED_PARAMETER(level);
+        Compressor* compressor = new CompressorLZO();
+        return compressor;
+    }
+
+    Decompressor* createDecompressor()
+    {
+        Decompressor* decompressor = new DecompressorLZO();
+        return decompressor;
+    }
+
+
+    // parallel
+
+    constexpr size_t SEGMENT_SIZE = 1024 * 1024;
+
+    size_t compressBlock(Memory dest, Memory source, int level)
+    {
+        return compress(dest, source, level);
+    }
+
+    void decompressBlock(Memory dest, Memory source)
+    {
+        lzo_uint dst_len = static_cast<lzo_uint>(dest.size);
+        int x = lzo1x_decompress_safe(source.address, static_cast<lzo_uint>(source.size),
+                                      dest.address, &dst_len, NULL);
+        if (x != LZO_E_OK || dst_len != dest.size)
+        {
+            MANGO_EXCEPTION("lzo: corrupted input data.");
+        }
+    }
+
+    size_t bound_parallel(size_t size)
+    {
+        const size_t segment_bound = getBlockSegmentBound(size, SEGMENT_SIZE, BLOCK_SIZE, bound);
+        return getSegmentCount(size, SEGMENT_SIZE) * segment_bound + 8;
+    }
+
+    size_t compress_parallel(Memory dest, Memory source, int level)
+    {
+        return compress_parallel(ThreadPool::getInstance(), dest, source, level);
+    }
+
+    size_t compress_parallel(ThreadPool& pool, Memory dest, Memory source, int level)
+    {
+        return compressBlockStream(pool, dest, source, SEGMENT_SIZE, BLOCK_SIZE, bound, compressBlock, level);
+    }
+
+    void decompress_parallel(Memory dest, Memory source)
+    {
+        decompress_parallel(ThreadPool::getInstance(), dest, source);
+    }
+
+    void decompress_parallel(ThreadPool& pool, Memory dest, Memory source)
+    {
+        if (!decompressBlockStream(pool, dest, source, BLOCK_SIZE, decompressBlock))
+        {
+            decompressStream(dest, source, createDecompressor());
+        }
+    }
+
+} // namespace lzo
+
+// ----------------------------------------------------------------------------
+// zstd
+// ----------------------------------------------------------------------------
+
+namespace zstd {
+
+    size_t bound(size_t size)
+    {
+        // compression is faster when it has more temporary buffer
+        const size_t turbo = 1024 * 128;
+		return ZSTD_compressBound(size) + turbo;
+    }
+
+    size_t compress(Memory dest, Memory source, int level)
+    {
+        level = clamp(level * 2, 1, 20);
+
+        const size_t x = ZSTD_compress(dest.address, dest.size,
+                                       source.address, source.size, level);
+        if (ZSTD_isError(x))
+        {
+            const char* error = ZSTD_getErrorName(x);
+            std::string s = "ZSTD: ";
+            s += error;
+            MANGO_EXCEPTION(s);
+        }
+
+        return x;
+	}
+
+    void decompress(Memory dest, Memory source)
+    {
+        size_t x = ZSTD_decompress((void*)dest.address, dest.size,
+                                   source.address, source.size);
+        if (ZSTD_isError(x))
+        {
+            const char* error = ZSTD_getErrorName(x);
+            std::string s = "ZSTD: ";
+            s += error;
+            MANGO_EXCEPTION(s);
+        }
+    }
+
+    // stream
+
+    class StreamEncoderZSTD : public StreamEncoder
+    {
+    protected:
+        ZSTD_CStream* z;
+
+    public:
+        StreamEncoderZSTD(int level)
+        {
+            level = clamp(level * 2, 1, 20);
+            z = ZSTD_createCStream();
+            ZSTD_initCStream(z, level);
+        }
+
+        StreamEncoderZSTD(const ZSTD_CDict* cdict)
+        {
+            z = ZSTD_createCStream();
+            ZSTD_initCStream_usingCDict(z, cdict);
+        }
+
+        ~StreamEncoderZSTD()
+        {
+            ZSTD_freeCStream(z);
+        }
+
+        size_t bound(size_t size) const
+        {
+            // compression is faster when it has more temporary buffer
+            const size_t turbo = 1024 * 128;
+            return ZSTD_compressBound(size) + turbo;
+        }
+
+        size_t encode(Memory dest, Memory source)
+        {
+            ZSTD_inBuffer input;
+
+            input.src = source.address;
+            input.size = source.size;
+            input.pos = 0;
+
+            ZSTD_outBuffer output;
+
+            output.dst = dest.address;
+            output.size = dest.size;
+            output.pos = 0;
+
+            for (; input.pos < input.size;)
+            {
+                ZSTD_compressStream(z, &output, &input);
+            }
+
+            ZSTD_flushStream(z, &output);
+
+            return output.pos;
+        }
+    };
+
+    class StreamDecoderZSTD : public StreamDecoder
+    {
+    protected:
+        ZSTD_DStream* z;
+
+    public:
+        StreamDecoderZSTD()
+        {
+            z = ZSTD_createDStream();
+            ZSTD_initDStream(z);
+        }
+
+        StreamDecoderZSTD(const ZSTD_DDict* ddict)
+        {
+            z = ZSTD_createDStream();
+            ZSTD_initDStream_usingDDict(z, ddict);
+        }
+
+        ~StreamDecoderZSTD()
+        {
+            ZSTD_freeDStream(z);
+        }
+
+        size_t decode(Memory dest, Memory source)
+        {
+            ZSTD_inBuffer input;
+
+            input.src = source.address;
+            input.size = source.size;
+            input.pos = 0;
+
+            ZSTD_outBuffer output;
+
+            output.dst = dest.address;
+            output.size = dest.size;
+            output.pos = 0;
+
+            for (; input.pos < input.size;)
+            {
+                ZSTD_decompressStream(z, &output, &input);
+            }
+
+            return output.pos;
+        }
+    };
+
+    StreamEncoder* createStreamEncoder(int level)
+    {
+        StreamEncoder* encoder = new StreamEncoderZSTD(level);
+        return encoder;
+    }
+
+    StreamDecoder* createStreamDecoder()
+    {
+        StreamDecoder* decoder = new StreamDecoderZSTD();
+        return decoder;
+    }
+
+
+    // incremental
+
+    class CompressorZSTD : public Compressor
+    {
+    protected:
+        ZSTD_CStream* z;
+        bool m_finished;
+
+    public:
+        CompressorZSTD(int level)
+            : m_finished(false)
+        {
+            level = clamp(level * 2, 1, 20);
+            z = ZSTD_createCStream();
+            ZSTD_initCStream(z, level);
+        }
+
+        CompressorZSTD(const ZSTD_CDict* cdict)
+            : m_finished(false)
+        {
+            z = ZSTD_createCStream();
+            ZSTD_initCStream_usingCDict(z, cdict);
+        }
+
+        ~CompressorZSTD()
+        {
+            ZSTD_freeCStream(z);
+        }
+
+        bool compress(Memory& dest, Memory& source, Operation operation) override
+        {
+            if (m_finished)
+            {
+                if (source.size)
+                {
+                    MANGO_EXCEPTION("ZSTD: the stream has been finished.");
+                }
+                return true;
+            }
+
+            ZSTD_inBuffer input;
+
+            input.src = source.address;
+            input.size = source.size;
+            input.pos = 0;
+
+            ZSTD_outBuffer output;
+
+            output.dst = dest.address;
+            output.size = dest.size;
+            output.pos = 0;
+
+            size_t x = 0;
+
+            while (input.pos < input.size && output.pos < output.size)
+            {
+                x = ZSTD_compressStream(z, &output, &input);
+                if (ZSTD_isError(x))
+                    break;
+            }
+
+            bool done = input.pos == input.size;
+
+            if (!ZSTD_isError(x) && done && operation != PROCESS)
+            {
+                // returns the number of bytes still to be flushed
+                x = operation == FLUSH ? ZSTD_flushStream(z, &output) : ZSTD_endStream(z, &output);
+                done = x == 0;
+                m_finished = done && operation == FINISH;
+            }
+
+            if (ZSTD_isError(x))
+            {
+                const char* error = ZSTD_getErrorName(x);
+                std::string s = "ZSTD: ";
+                s += error;
+                MANGO_EXCEPTION(s);
+            }
+
+            source.address += input.pos;
+            source.size -= input.pos;
+            dest.address += output.pos;
+            dest.size -= output.pos;
+
+            return done;
+        }
+    };
+
+    class DecompressorZSTD : public Decompressor
+    {
+    protected:
+        ZSTD_DStream* z;
+        bool m_end;
+
+    public:
+        DecompressorZSTD()
+            : m_end(false)
+        {
+            z = ZSTD_createDStream();
+            ZSTD_initDStream(z);
+        }
+
+        DecompressorZSTD(const ZSTD_DDict* ddict)
+            : m_end(false)
+        {
+            z = ZSTD_createDStream();
+            ZSTD_initDStream_usingDDict(z, ddict);
+        }
+
+        ~DecompressorZSTD()
+        {
+            ZSTD_freeDStream(z);
+        }
+
+        bool decompress(Memory& dest, Memory& source) override
+        {
+            if (m_end)
+                return true;
+
+            ZSTD_inBuffer input;
+
+            input.src = source.address;
+            input.size = source.size;
+            input.pos = 0;
+
+            ZSTD_outBuffer output;
+
+            output.dst = dest.address;
+            output.size = dest.size;
+            output.pos = 0;
+
+            // a call without input is still made to flush the buffered output
+            do
+            {
+                size_t x = ZSTD_decompressStream(z, &output, &input);
+                if (ZSTD_isError(x))
+                {
+                    const char* error = ZSTD_getErrorName(x);
+                    std::string s = "ZSTD: ";
+                    s += error;
+                    MANGO_EXCEPTION(s);
+                }
+
+                // the frame has been decoded and flushed
+                if (!x)
+                {
+                    m_end = true;
+                    break;
+                }
+            }
+            while (input.pos < input.size && output.pos < output.size);
+
+            source.address += input.pos;
+            source.size -= input.pos;
+            dest.address += output.pos;
+            dest.size -= output.pos;
+
+            return m_end;
+        }
+    };
+
+    Compressor* createCompressor(int level)
+    {
+        Compressor* compressor = new CompressorZSTD(level);
+        return compressor;
+    }
+
+    Decompressor* createDecompressor()
+    {
+        Decompressor* decompressor = new DecompressorZSTD();
+        return decompressor;
+    }
+
+
+    // parallel
+
+    // the segments are frames with the content size in the header
+
+    constexpr size_t SEGMENT_SIZE = 1024 * 1024 * 4;
+
+    size_t bound_parallel(size_t size)
+    {
+        const size_t segment_bound = ZSTD_compressBound(std::min(SEGMENT_SIZE, size));
+        return getSegmentCount(size, SEGMENT_SIZE) * segment_bound;
+    }
+
+    size_t compress_parallel(Memory dest, Memory source, int level)
+    {
+        return compress_parallel(ThreadPool::getInstance(), dest, source, level);
+    }
+
+    size_t compress_parallel(ThreadPool& pool, Memory dest, Memory source, int level)
+    {
+        const size_t segment_bound = ZSTD_compressBound(std::min(SEGMENT_SIZE, source.size));
+
+        return compressSegments(pool, dest, source, SEGMENT_SIZE, segment_bound,
+            [level] (Memory dest, Memory source, size_t index)
+        {
+            MANGO_UNREFERENCED_PARAMETER(index);
+            return compress(dest, source, level);
+        });
+    }
+
+    void decompress_parallel(Memory dest, Memory source)
+    {
+        decompress_parallel(ThreadPool::getInstance(), dest, source);
+    }
+
+    void decompress_parallel(ThreadPool& pool, Memory dest, Memory source)
+    {
+        struct Frame
+        {
+            Memory dest;
+            Memory source;
+        };
+
+        std::vector<Frame> frames;
+        size_t offset = 0;
+
+        for (Memory next = source; next.size > 0; )
+        {
+            const size_t compressed = ZSTD_findFrameCompressedSize(next.address, next.size);
+            if (ZSTD_isError(compressed))
+            {
+                const char* error = ZSTD_getErrorName(compressed);
+                std::string s = "ZSTD: ";
+                s += error;
+                MANGO_EXCEPTION(s);
+            }
+
+            const unsigned long long size = ZSTD_getFrameContentSize(next.address, next.size);
+            if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR)
+            {
+                // the frames can't be placed without the content size
+                decompress(dest, source);
+                return;
+            }
+
+            if (size > dest.size - offset)
+            {
+                MANGO_EXCEPTION("ZSTD: not enough room in the output buffer.");
+            }
+
+            // empty and skippable frames don't produce any output
+            if (size > 0)
+            {
+                Frame frame;
+                frame.dest = Memory(dest.address + offset, size_t(size));
+                frame.source = Memory(next.address, compressed);
+                frames.push_back(frame);
+            }
+
+            offset += size_t(size);
+            next.address += compressed;
+            next.size -= compressed;
+        }
+
+        if (offset != dest.size)
+        {
+            MANGO_EXCEPTION("ZSTD: truncated input.");
+        }
+
+        parallel_each(pool, frames.size(), [&] (size_t index)
+        {
+            decompress(frames[index].dest, frames[index].source);
+        });
+    }
+
+    // dictionary
+
+    // The trainer picks the segments which cover the most common d-mers
+    // (short substrings) of the samples, a simplified COVER algorithm. The
+    // d-mers are counted once per sample so that one sample repeating itself
+    // doesn't dominate. The samples are split into epochs, one segment is taken
+    // from each epoch and the d-mers it covers are not counted again. The
+    // segments don't span the sample boundaries, so every d-mer they cover is
+    // content of one sample.
+
+    // smallest dictionary which holds a useful amount of content (ZDICT_DICTSIZE_MIN)
+    constexpr size_t DICTIONARY_MIN_SIZE = 256;
+
+    std::vector<uint8> train(const std::vector<Memory>& samples, size_t size)
+    {
+        constexpr size_t dmer = 8;
+
+        if (size < DICTIONARY_MIN_SIZE)
+        {
+            MANGO_EXCEPTION("ZSTD: the dictionary size must be at least 256 bytes.");
+        }
+
+        std::vector<uint8> data;
+        std::vector<size_t> ends; // end offsets of the samples in data
+
+        std::unordered_map<uint64, uint32> frequency;
+        std::vector<uint64> unique;
+
+        for (const Memory& sample : samples)
+        {
+            data.insert(data.end(), sample.address, sample.address + sample.size);
+            ends.push_back(data.size());
+
+            unique.clear();
+
+            for (size_t i = 0; i + dmer <= sample.size; ++i)
+            {
+                unique.push_back(uload64(sample.address + i));
+            }
+
+            std::sort(unique.begin(), unique.end());
+            unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+            for (uint64 key : unique)
+            {
+                ++frequency[key];
+            }
+        }
+
+        if (data.size() <= size)
+        {
+            // the samples fit into the dictionary as they are
+            return data;
+        }
+
+        const size_t k = clamp(size / 64, size_t(16), size_t(1024));
+        const size_t epochs = std::max(size / k, size_t(1));
+        const size_t epoch_size = data.size() / epochs;
+
+        struct Segment
+        {
+            size_t offset;
+            size_t size;
+            uint64 score;
+        };
+
+        std::vector<Segment> segments;
+        std::unordered_map<uint64, uint32> active;
+
+        // the window [i, i + k) covers the d-mers starting at [i, i + k - d]
+        const size_t window = k - dmer + 1;
+
+        uint64 score = 0;
+
+        auto add = [&] (size_t offset)
+        {
+            const uint64 key = uload64(data.data() + offset);
+            if (!active[key]++)
+            {
+                score += frequency[key];
+            }
+        };
+
+        auto remove = [&] (size_t offset)
+        {
+            const uint64 key = uload64(data.data() + offset);
+            if (!--active[key])
+            {
+                score -= frequency[key];
+            }
+        };
+
+        for (size_t epoch = 0; epoch < epochs; ++epoch)
+        {
+            const size_t begin = epoch * epoch_size;
+            const size_t end = std::min(begin + epoch_size, data.size());
+
+            Segment best { begin, 0, 0 };
+            size_t sample = 0;
+            size_t next = begin; // the next d-mer to enter the window
+            bool restart = true;
+
+            for (size_t i = begin; i < end; )
+            {
+                while (ends[sample] <= i)
+                {
+                    ++sample;
+                }
+
+                // the segment stops at the end of the sample
+                const size_t limit = std::min(ends[sample], end);
+
+                if (i + dmer > limit)
+                {
+                    // no more d-mers in this sample; continue from the next one
+                    i = limit;
+                    restart = true;
+                    continue;
+                }
+
+                if (restart)
+                {
+                    active.clear();
+                    score = 0;
+                    next = i;
+                    restart = false;
+                }
+                else
+                {
+                    remove(i - 1);
+                }
+
+                while (next < i + window && next + dmer <= limit)
+                {
+                    add(next++);
+                }
+
+                if (score > best.score)
+                {
+                    best.offset = i;
+                    best.size = std::min(k, limit - i);
+                    best.score = score;
+                }
+
+                ++i;
+            }
+
+            if (!best.score)
+                continue;
+
+            for (size_t j = best.offset; j + dmer <= best.offset + best.size; ++j)
+            {
+                frequency[uload64(data.data() + j)] = 0;
+            }
+
+            segments.push_back(best);
+        }
+
+        // the best segments go to the end of the dictionary where the offsets
+        // to them are the shortest
+        std::sort(segments.begin(), segments.end(), [] (const Segment& a, const Segment& b)
+        {
+            return a.score > b.score;
+        });
+
+        std::vector<uint8> dictionary;
+
+        for (const Segment& segment : segments)
+        {
+            if (dictionary.size() + segment.size > size)
+                continue;
+
+            const uint8* p = data.data() + segment.offset;
+            dictionary.insert(dictionary.begin(), p, p + segment.size);
+        }
+
+        return dictionary;
+    }
+
+    CompressDictionary::CompressDictionary(Memory dictionary, int level)
+    {
+        level = clamp(level * 2, 1, 20);
+
+        // the dictionary content is copied
+        m_cdict = ZSTD_createCDict(dictionary.address, dictionary.size, level);
+        if (!m_cdict)
+        {
+            MANGO_EXCEPTION("ZSTD: dictionary creation failed.");
+        }
+    }
+
+    CompressDictionary::~CompressDictionary()
+    {
+        ZSTD_freeCDict(reinterpret_cast<ZSTD_CDict*>(m_cdict));
+    }
+
+    void* CompressDictionary::handle() const
+    {
+        return m_cdict;
+    }
+
+    DecompressDictionary::DecompressDictionary(Memory dictionary)
+    {
+        m_ddict = ZSTD_createDDict(dictionary.address, dictionary.size);
+        if (!m_ddict)
+        {
+            MANGO_EXCEPTION("ZSTD: dictionary creation failed.");
+        }
+    }
+
+    DecompressDictionary::~DecompressDictionary()
+    {
+        ZSTD_freeDDict(reinterpret_cast<ZSTD_DDict*>(m_ddict));
+    }
+
+    void* DecompressDictionary::handle() const
+    {
+        return m_ddict;
+    }
+
+    // the contexts are reused by the calling thread; the dictionaries are shared
+    struct ContextZSTD
+    {
+        ZSTD_CCtx* cctx { nullptr };
+        ZSTD_DCtx* dctx { nullptr };
+
+        ~ContextZSTD()
+        {
+            ZSTD_freeCCtx(cctx);
+            ZSTD_freeDCtx(dctx);
+        }
+    };
+
+    static thread_local ContextZSTD g_context;
+
+    size_t compress(Memory dest, Memory source, const CompressDictionary& dictionary)
+    {
+        if (!g_context.cctx)
+        {
+            g_context.cctx = ZSTD_createCCtx();
+        }
+
+        const ZSTD_CDict* cdict = reinterpret_cast<const ZSTD_CDict*>(dictionary.handle());
+        const size_t x = ZSTD_compress_usingCDict(g_context.cctx, dest.address, dest.size,
+                                                  source.address, source.size, cdict);
+        if (ZSTD_isError(x))
+        {
+            const char* error = ZSTD_getErrorName(x);
+            std::string s = "ZSTD: ";
+            s += error;
+            MANGO_EXCEPTION(s);
+        }
+
+        return x;
+    }
+
+    void decompress(Memory dest, Memory source, const DecompressDictionary& dictionary)
+    {
+        if (!g_context.dctx)
+        {
+            g_context.dctx = ZSTD_createDCtx();
+        }
+
+        const ZSTD_DDict* ddict = reinterpret_cast<const ZSTD_DDict*>(dictionary.handle());
+        const size_t x = ZSTD_decompress_usingDDict(g_context.dctx, dest.address, dest.size,
+                                                    source.address, source.size, ddict);
+        if (ZSTD_isError(x))
+        {
+            const char* error = ZSTD_getErrorName(x);
+            std::string s = "ZSTD: ";
+            s += error;
+            MANGO_EXCEPTION(s);
+        }
+    }
+
+    StreamEncoder* createStreamEncoder(const CompressDictionary& dictionary)
+    {
+        const ZSTD_CDict* cdict = reinterpret_cast<const ZSTD_CDict*>(dictionary.handle());
+        StreamEncoder* encoder = new StreamEncoderZSTD(cdict);
+        return encoder;
+    }
+
+    StreamDecoder* createStreamDecoder(const DecompressDictionary& dictionary)
+    {
+        const ZSTD_DDict* ddict = reinterpret_cast<const ZSTD_DDict*>(dictionary.handle());
+        StreamDecoder* decoder = new StreamDecoderZSTD(ddict);
+        return decoder;
+    }
+
+    Compressor* createCompressor(const CompressDictionary& dictionary)
+    {
+        const ZSTD_CDict* cdict = reinterpret_cast<const ZSTD_CDict*>(dictionary.handle());
+        Compressor* compressor = new CompressorZSTD(cdict);
+        return compressor;
+    }
+
+    Decompressor* createDecompressor(const DecompressDictionary& dictionary)
+    {
+        const ZSTD_DDict* ddict = reinterpret_cast<const ZSTD_DDict*>(dictionary.handle());
+        Decompressor* decompressor = new DecompressorZSTD(ddict);
+        return decompressor;
+    }
+
+} // namespace zstd
+
+#endif // MANGO_ENABLE_LICENSE_BSD
+
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+
+// ----------------------------------------------------------------------------
+// bzip2
+// ----------------------------------------------------------------------------
+
+namespace bzip2 {
+
+    size_t bound(size_t size)
+    {
+        return size + (size / 100) + 600;
+    }
+
+    size_t compress(Memory dest, Memory source, int level)
+    {
+        const int blockSize100k = clamp(level, 1, 9);
+
+        const int verbosity = 0;
+        const int workFactor = 30;
+
+        bz_stream strm;
+
+        strm.bzalloc = nullptr;
+        strm.bzfree = nullptr;
+        strm.opaque = nullptr;
+
+        int x = BZ2_bzCompressInit(&strm, blockSize100k, verbosity, workFactor);
+        if (x != BZ_OK)
+        {
+            MANGO_EXCEPTION("bzip2: compression failed.");
+        }
+
+        unsigned int destLength = static_cast<unsigned int>(dest.size);
+
+        strm.next_in = source;
+        strm.next_out = dest;
+        strm.avail_in = static_cast<unsigned int>(source.size);
+        strm.avail_out = destLength;
+
+        x = BZ2_bzCompress(&strm, BZ_FINISH);
+        if (x == BZ_FINISH_OK)
+        {
+            BZ2_bzCompressEnd(&strm);
+            MANGO_EXCEPTION("bzip2: compression failed.");
+        }
+        else if (x != BZ_STREAM_END)
+        {
+            BZ2_bzCompressEnd(&strm);
+            MANGO_EXCEPTION("bzip2: compression failed.");
+        }
+
+        destLength -= strm.avail_out;
+        BZ2_bzCompressEnd(&strm);
+
+        return static_cast<size_t>(destLength);
+    }
+
+    void decompress(Memory dest, Memory source)
+    {
+        bz_stream strm;
+
+        strm.bzalloc = nullptr;
+        strm.bzfree = nullptr;
+        strm.opaque = nullptr;
+
+        int x = BZ2_bzDecompressInit(&strm, 0, 0);
+        if (x != BZ_OK)
+        {
+            MANGO_EXCEPTION("bzip2: decompression failed.");
+        }
+
+        strm.next_in = source;
+        strm.next_out = dest;
+        strm.avail_in = static_cast<unsigned int>(source.size);
+        strm.avail_out = static_cast<unsigned int>(dest.size);
+
+        x = BZ2_bzDecompress(&strm);
+        if (x == BZ_OK)
+        {
+            BZ2_bzDecompressEnd(&strm);
+            MANGO_EXCEPTION("bzip2: decompression failed.");
+        }
+        else if (x != BZ_STREAM_END)
+        {
+            BZ2_bzDecompressEnd(&strm);
+            MANGO_EXCEPTION("bzip2: decompression failed.");
+        }
+
+        BZ2_bzDecompressEnd(&strm);
+    }
+
+
+    // incremental
+
+    class CompressorBZIP2 : public Compressor
+    {
+    protected:
+        bz_stream m_stream;
+        bool m_finished;
+
+    public:
+        CompressorBZIP2(int level)
+            : m_finished(false)
+        {
+            std::memset(&m_stream, 0, sizeof(m_stream));
+
+            const int blockSize100k = clamp(level, 1, 9);
+            const int verbosity = 0;
+            const int workFactor = 30;
+
+            int x = BZ2_bzCompressInit(&m_stream, blockSize100k, verbosity, workFactor);
+            if (x != BZ_OK)
+            {
+                MANGO_EXCEPTION("bzip2: compressor initialization failed.");
+            }
+        }
+
+        ~CompressorBZIP2()
+        {
+            BZ2_bzCompressEnd(&m_stream);
+        }
+
+        bool compress(Memory& dest, Memory& source, Operation operation) override
+        {
+            const size_t limit = size_t(1) << 30;
+
+            for (;;)
+            {
+                if (m_finished)
+                {
+                    if (source.size)
+                    {
+                        MANGO_EXCEPTION("bzip2: the stream has been finished.");
+                    }
+                    return true;
+                }
+
+                // the input of a flush can't change while it is in progress so a
+                // large input is processed before flushing
+                const int action = (operation == PROCESS || source.size > limit) ? BZ_RUN :
+                                   operation == FLUSH ? BZ_FLUSH : BZ_FINISH;
+
+                if (action == BZ_RUN && !source.size)
+                    return true;
+
+                // bzip2 reports an error when it can't make progress
+                if (!dest.size)
+                    return false;
+
+                m_stream.next_in = reinterpret_cast<char *>(source.address);
+                m_stream.avail_in = static_cast<unsigned int>(std::min(source.size, limit));
+                m_stream.next_out = reinterpret_cast<char *>(dest.address);
+                m_stream.avail_out = static_cast<unsigned int>(std::min(dest.size, limit));
+
+                int x = BZ2_bzCompress(&m_stream, action);
+
+                const size_t consumed = reinterpret_cast<uint8*>(m_stream.next_in) - source.address;
+                const size_t written = reinterpret_cast<uint8*>(m_stream.next_out) - dest.address;
+                source.address += consumed;
+                source.size -= consumed;
+                dest.address += written;
+                dest.size -= written;
+
+                if (x < 0)
+                {
+                    MANGO_EXCEPTION("bzip2: compression failed.");
+                }
+
+                if (action == BZ_FLUSH && x == BZ_RUN_OK)
+                    return true;
+
+                if (action == BZ_FINISH && x == BZ_STREAM_END)
+                {
+                    m_finished = true;
+                }
+            }
+        }
+    };
+
+    class DecompressorBZIP2 : public Decompressor
+    {
+    protected:
+        bz_stream m_stream;
+        bool m_end;
+
+    public:
+        DecompressorBZIP2()
+            : m_end(false)
+        {
+            std::memset(&m_stream, 0, sizeof(m_stream));
+
+            int x = BZ2_bzDecompressInit(&m_stream, 0, 0);
+            if (x != BZ_OK)
+            {
+                MANGO_EXCEPTION("bzip2: decompressor initialization failed.");
+            }
+        }
+
+        ~DecompressorBZIP2()
+        {
+            BZ2_bzDecompressEnd(&m_stream);
+        }
+
+        bool decompress(Memory& dest, Memory& source) override
+        {
+            const size_t limit = size_t(1) << 30;
+
+            while (!m_end)
+            {
+                m_stream.next_in = reinterpret_cast<char *>(source.address);
+                m_stream.avail_in = static_cast<unsigned int>(std::min(source.size, limit));
+                m_stream.next_out = reinterpret_cast<char *>(dest.address);
+                m_stream.avail_out = static_cast<unsigned int>(std::min(dest.size, limit));
+
+                int x = BZ2_bzDecompress(&m_stream);
+
+                const size_t consumed = reinterpret_cast<uint8*>(m_stream.next_in) - source.address;
+                const size_t written = reinterpret_cast<uint8*>(m_stream.next_out) - dest.address;
+                source.address += consumed;
+                source.size -= consumed;
+                dest.address += written;
+                dest.size -= written;
+
+                if (x == BZ_STREAM_END)
+                {
+                    m_end = true;
+                }
+                else if (x != BZ_OK)
+                {
+                    MANGO_EXCEPTION("bzip2: corrupted input data.");
+                }
+                else if (!dest.size || !source.size)
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    };
+
+    Compressor* createCompressor(int level)
+    {
+        Compressor* compressor = new CompressorBZIP2(level);
+        return compressor;
+    }
+
+    Decompressor* createDecompressor()
+    {
+        Decompressor* decompressor = new DecompressorBZIP2();
+        return decompressor;
+    }
+
+} // namespace bzip2
+
+// ----------------------------------------------------------------------------
+// lzfse
+// ----------------------------------------------------------------------------
+
+namespace lzfse {
 
     size_t bound(size_t size)
     {
@@ -587,11 +2512,476 @@ namespace lzfse {
         const size_t scratch_size = lzfse_decode_scratch_size();
         Buffer scratch(scratch_size);
         size_t written = lzfse_decode_buffer(dest.address, dest.size, source, source.size, scratch);
-        MANGO_UNREFERENCED_PARAMETER(written);
+        if (!written && dest.size)
+        {
+            MANGO_EXCEPTION("lzfse: decompression failed.");
+        }
+    }
+
+
+    // incremental
+
+    constexpr size_t BLOCK_SIZE = 1024 * 1024;
+
+    class CompressorLZFSE : public BlockCompressor
+    {
+    protected:
+        Buffer m_scratch;
+
+        size_t compressBlock(Memory dest, Memory source) override
+        {
+            size_t written = lzfse_encode_buffer(dest.address, dest.size, source, source.size, m_scratch);
+            if (!written)
+            {
+                MANGO_EXCEPTION("lzfse: compression failed.");
+            }
+
+            return written;
+        }
+
+    public:
+        CompressorLZFSE()
+            : BlockCompressor(BLOCK_SIZE, bound(BLOCK_SIZE), true)
+            , m_scratch(lzfse_encode_scratch_size())
+        {
+        }
+    };
+
+    class DecompressorLZFSE : public BlockDecompressor
+    {
+    protected:
+        Buffer m_scratch;
+        std::vector<uint8> m_buffer;
+
+        Memory decompressBlock(Memory source, size_t size) override
+        {
+            size_t written = lzfse_decode_buffer(m_buffer.data(), size, source, source.size, m_scratch);
+            if (written != size)
+            {
+                MANGO_EXCEPTION("lzfse: corrupted input data.");
+            }
+
+            return Memory(m_buffer.data(), size);
+        }
+
+    public:
+        DecompressorLZFSE()
+            : BlockDecompressor(BLOCK_SIZE, bound(BLOCK_SIZE))
+            , m_scratch(lzfse_decode_scratch_size())
+            , m_buffer(BLOCK_SIZE)
+        {
+        }
+    };
+
+    Compressor* createCompressor(int level)
+    {
+        MANGO_UNREFERENCED_PARAMETER(level);
+        Compressor* compressor = new CompressorLZFSE();
+        return compressor;
+    }
+
+    Decompressor* createDecompressor()
+    {
+        Decompressor* decompressor = new DecompressorLZFSE();
+        return decompressor;
+    }
+
+
+    // parallel
+
+    constexpr size_t SEGMENT_SIZE = 1024 * 1024;
+
+    size_t compressBlock(Memory dest, Memory source, int level)
+    {
+        return compress(dest, source, level);
+    }
+
+    void decompressBlock(Memory dest, Memory source)
+    {
+        const size_t scratch_size = lzfse_decode_scratch_size();
+        Buffer scratch(scratch_size);
+        size_t written = lzfse_decode_buffer(dest.address, dest.size, source, source.size, scratch);
+        if (written != dest.size)
+        {
+            MANGO_EXCEPTION("lzfse: corrupted input data.");
+        }
+    }
+
+    size_t bound_parallel(size_t size)
+    {
+        const size_t segment_bound = getBlockSegmentBound(size, SEGMENT_SIZE, BLOCK_SIZE, bound);
+        return getSegmentCount(size, SEGMENT_SIZE) * segment_bound + 8;
+    }
+
+    size_t compress_parallel(Memory dest, Memory source, int level)
+    {
+        return compress_parallel(ThreadPool::getInstance(), dest, source, level);
+    }
+
+    size_t compress_parallel(ThreadPool& pool, Memory dest, Memory source, int level)
+    {
+        return compressBlockStream(pool, dest, source, SEGMENT_SIZE, BLOCK_SIZE, bound, compressBlock, level);
+    }
+
+    void decompress_parallel(Memory dest, Memory source)
+    {
+        decompress_parallel(ThreadPool::getInstance(), dest, source);
+    }
+
+    void decompress_parallel(ThreadPool& pool, Memory dest, Memory source)
+    {
+        if (!decompressBlockStream(pool, dest, source, BLOCK_SIZE, decompressBlock))
+        {
+            decompressStream(dest, source, createDecompressor());
+        }
     }
 
 } // namespace lzfse
 
 #endif // MANGO_ENABLE_LICENSE_ZLIB
 
+// ----------------------------------------------------------------------------
+// auto
+// ----------------------------------------------------------------------------
+
+// The stream header is the magic and the uncompressed size (u64 little endian).
+// The blocks have a header with the codec (u8) and the uncompressed and
+// compressed sizes (u32 little endian).
+
+namespace {
+
+    constexpr u32 AUTO_MAGIC = 0x4341474d; // "MGAC"
+    constexpr size_t AUTO_HEADER_SIZE = 12;
+    constexpr size_t AUTO_BLOCK_HEADER_SIZE = 9;
+    constexpr size_t AUTO_BLOCK_SIZE = 1024 * 1024;
+    constexpr size_t AUTO_SAMPLE_SIZE = 1024 * 16;
+
+    enum AutoCodec : u8
+    {
+        AUTO_STORE = 0,
+        AUTO_MINIZ = 1,
+        AUTO_LZ4   = 2,
+        AUTO_LZO   = 3,
+        AUTO_ZSTD  = 4,
+        AUTO_BZIP2 = 5,
+        AUTO_LZFSE = 6,
+    };
+
+    // The blocks are decoded with checked decoders which throw unless the block
+    // decodes into exactly dest.size bytes; the block sizes come from the stream
+    // and can't be trusted.
+
+    void decompressAutoMiniz(Memory dest, Memory source)
+    {
+        mz_ulong bytes = static_cast<mz_ulong>(dest.size);
+        int status = mz_uncompress(dest, &bytes, source, static_cast<mz_ulong>(source.size));
+        if (status != MZ_OK || bytes != dest.size)
+        {
+            MANGO_EXCEPTION("miniz: corrupted input data.");
+        }
+    }
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    void decompressAutoZSTD(Memory dest, Memory source)
+    {
+        size_t bytes = ZSTD_decompress(dest.address, dest.size, source.address, source.size);
+        if (ZSTD_isError(bytes) || bytes != dest.size)
+        {
+            MANGO_EXCEPTION("ZSTD: corrupted input data.");
+        }
+    }
+
+#endif
+
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+
+    void decompressAutoBZIP2(Memory dest, Memory source)
+    {
+        bz_stream strm;
+
+        strm.bzalloc = nullptr;
+        strm.bzfree = nullptr;
+        strm.opaque = nullptr;
+
+        if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK)
+        {
+            MANGO_EXCEPTION("bzip2: decompression failed.");
+        }
+
+        strm.next_in = source;
+        strm.next_out = dest;
+        strm.avail_in = static_cast<unsigned int>(source.size);
+        strm.avail_out = static_cast<unsigned int>(dest.size);
+
+        int status = BZ2_bzDecompress(&strm);
+        const unsigned int remaining = strm.avail_out;
+        BZ2_bzDecompressEnd(&strm);
+
+        if (status != BZ_STREAM_END || remaining)
+        {
+            MANGO_EXCEPTION("bzip2: corrupted input data.");
+        }
+    }
+
+#endif
+
+    struct AutoCandidate
+    {
+        u8 codec;
+        int level;
+        float encode; // nominal single core throughput in MB/s
+        float decode;
+        size_t (*bound)(size_t size);
+        size_t (*compress)(Memory dest, Memory source, int level);
+        void (*decompress)(Memory dest, Memory source); // checked decoder
+    };
+
+    // roughly in the order of decompression speed; a slower candidate must
+    // compress better to be selected
+    const AutoCandidate g_auto_candidates[] =
+    {
+#ifdef MANGO_ENABLE_LICENSE_BSD
+        { AUTO_LZ4,   4,  500, 3000, lz4::bound,   lz4::compress,   lz4::decompressBlock },
+        { AUTO_LZ4,   9,   40, 3000, lz4::bound,   lz4::compress,   lz4::decompressBlock },
+        { AUTO_LZO,   6,  300,  800, lzo::bound,   lzo::compress,   lzo::decompressBlock },
+        { AUTO_ZSTD,  1,  400, 1000, zstd::bound,  zstd::compress,  decompressAutoZSTD },
+        { AUTO_ZSTD,  3,  200, 1000, zstd::bound,  zstd::compress,  decompressAutoZSTD },
+        { AUTO_ZSTD,  6,   80,  900, zstd::bound,  zstd::compress,  decompressAutoZSTD },
+        { AUTO_ZSTD,  8,   40,  900, zstd::bound,  zstd::compress,  decompressAutoZSTD },
+#endif
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+        { AUTO_LZFSE, 6,   80,  500, lzfse::bound, lzfse::compress, lzfse::decompressBlock },
+#endif
+        { AUTO_MINIZ, 6,   30,  300, miniz::bound, miniz::compress, decompressAutoMiniz },
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+        { AUTO_BZIP2, 9,   10,   30, bzip2::bound, bzip2::compress, decompressAutoBZIP2 },
+#endif
+    };
+
+    const AutoCandidate* findAutoCandidate(u8 codec)
+    {
+        for (const AutoCandidate& candidate : g_auto_candidates)
+        {
+            if (candidate.codec == codec)
+                return &candidate;
+        }
+        return nullptr;
+    }
+
+    size_t getAutoBlockBound(size_t size)
+    {
+        size_t bound = size;
+        for (const AutoCandidate& candidate : g_auto_candidates)
+        {
+            bound = std::max(bound, candidate.bound(size));
+        }
+        return bound + AUTO_BLOCK_HEADER_SIZE;
+    }
+
+    // order-0 entropy in bits per byte
+    float getEntropy(Memory source)
+    {
+        u32 histogram[256] = { 0 };
+        for (size_t i = 0; i < source.size; ++i)
+        {
+            ++histogram[source.address[i]];
+        }
+
+        double entropy = 0;
+        for (u32 count : histogram)
+        {
+            if (count)
+            {
+                const double p = double(count) / double(source.size);
+                entropy -= p * std::log2(p);
+            }
+        }
+
+        return float(entropy);
+    }
+
+    const AutoCandidate* selectAutoCandidate(Memory block, const CompressPolicy& policy)
+    {
+        // the sample is taken from the middle of the block
+        const size_t sample_size = std::min(block.size, AUTO_SAMPLE_SIZE);
+        Memory sample(block.address + (block.size - sample_size) / 2, sample_size);
+
+        if (!sample.size || getEntropy(sample) > 7.9f)
+            return nullptr;
+
+        // one trial buffer per thread; the blocks are compressed in parallel
+        static thread_local std::vector<u8> compressed;
+        compressed.resize(getAutoBlockBound(AUTO_SAMPLE_SIZE));
+
+        const AutoCandidate* selected = nullptr;
+        size_t selected_size = sample.size;
+
+        for (const AutoCandidate& candidate : g_auto_candidates)
+        {
+            // the nominal throughput is used instead of measuring it so that the
+            // selection doesn't depend on the machine, its load or the threads
+            if (candidate.encode < policy.encode || candidate.decode < policy.decode)
+                continue;
+
+            // the bzip2 level is the block size in 100 KB; a larger block than the
+            // sample allocates more sort state but compresses it the same
+            int level = candidate.level;
+            if (candidate.codec == AUTO_BZIP2)
+            {
+                level = std::min(level, int(sample.size / 100000) + 1);
+            }
+
+            const size_t size = candidate.compress(Memory(compressed.data(), compressed.size()), sample, level);
+
+            // at least 1% smaller than the faster candidate
+            if (size < selected_size - selected_size / 100)
+            {
+                selected = &candidate;
+                selected_size = size;
+            }
+        }
+
+        return selected;
+    }
+
+    size_t compressAutoBlock(Memory dest, Memory source, const CompressPolicy& policy)
+    {
+        if (!source.size)
+            return 0;
+
+        const AutoCandidate* candidate = selectAutoCandidate(source, policy);
+
+        Memory output(dest.address + AUTO_BLOCK_HEADER_SIZE, dest.size - AUTO_BLOCK_HEADER_SIZE);
+        size_t written = source.size;
+
+        if (candidate)
+        {
+            written = candidate->compress(output, source, candidate->level);
+        }
+
+        // the sample can be misleading
+        if (!candidate || written >= source.size)
+        {
+            candidate = nullptr;
+            written = source.size;
+            std::memcpy(output.address, source.address, source.size);
+        }
+
+        dest.address[0] = candidate ? candidate->codec : AUTO_STORE;
+        ustore32le(dest.address + 1, u32(source.size));
+        ustore32le(dest.address + 5, u32(written));
+
+        return written + AUTO_BLOCK_HEADER_SIZE;
+    }
+
+} // namespace
+
+size_t bound_auto(size_t size)
+{
+    const size_t segment_bound = getAutoBlockBound(std::min(AUTO_BLOCK_SIZE, size));
+    return AUTO_HEADER_SIZE + getSegmentCount(size, AUTO_BLOCK_SIZE) * segment_bound;
+}
+
+size_t compress_auto(Memory dest, Memory source, const CompressPolicy& policy)
+{
+    if (dest.size < bound_auto(source.size))
+    {
+        MANGO_EXCEPTION("compress_auto: not enough room in the destination; use bound_auto().");
+    }
+
+    ustore32le(dest.address + 0, AUTO_MAGIC);
+    ustore64le(dest.address + 4, source.size);
+
+    Memory blocks(dest.address + AUTO_HEADER_SIZE, dest.size - AUTO_HEADER_SIZE);
+    const size_t segment_bound = getAutoBlockBound(std::min(AUTO_BLOCK_SIZE, source.size));
+
+    const size_t written = compressSegments(ThreadPool::getInstance(), blocks, source, AUTO_BLOCK_SIZE, segment_bound,
+        [&policy] (Memory dest, Memory source, size_t index)
+    {
+        MANGO_UNREFERENCED_PARAMETER(index);
+        return compressAutoBlock(dest, source, policy);
+    });
+
+    return AUTO_HEADER_SIZE + written;
+}
+
+size_t size_auto(Memory source)
+{
+    if (source.size < AUTO_HEADER_SIZE || uload32le(source.address) != AUTO_MAGIC)
+    {
+        MANGO_EXCEPTION("decompress_auto: incorrect header.");
+    }
+
+    return size_t(uload64le(source.address + 4));
+}
+
+void decompress_auto(Memory dest, Memory source)
+{
+    const size_t size = size_auto(source);
+    if (dest.size < size)
+    {
+        MANGO_EXCEPTION("decompress_auto: not enough room in the output buffer.");
+    }
+
+    source.address += AUTO_HEADER_SIZE;
+    source.size -= AUTO_HEADER_SIZE;
+
+    struct Block
+    {
+        u8 codec;
+        Memory dest;
+        Memory source;
+    };
+
+    std::vector<Block> blocks;
+
+    for (size_t offset = 0; offset < size; )
+    {
+        if (source.size < AUTO_BLOCK_HEADER_SIZE)
+        {
+            MANGO_EXCEPTION("decompress_auto: unexpected end of compressed data.");
+        }
+
+        Block block;
+        block.codec = source.address[0];
+        const size_t uncompressed = uload32le(source.address + 1);
+        const size_t compressed = uload32le(source.address + 5);
+        source.address += AUTO_BLOCK_HEADER_SIZE;
+        source.size -= AUTO_BLOCK_HEADER_SIZE;
+
+        if (!uncompressed || uncompressed > size - offset || compressed > source.size ||
+            (block.codec == AUTO_STORE && compressed != uncompressed))
+        {
+            MANGO_EXCEPTION("decompress_auto: corrupted block header.");
+        }
+
+        if (block.codec != AUTO_STORE && !findAutoCandidate(block.codec))
+        {
+            MANGO_EXCEPTION("decompress_auto: unsupported codec.");
+        }
+
+        block.dest = Memory(dest.address + offset, uncompressed);
+        block.source = Memory(source.address, compressed);
+        blocks.push_back(block);
+
+        offset += uncompressed;
+        source.address += compressed;
+        source.size -= compressed;
+    }
+
+    parallel_each(blocks.size(), [&] (size_t index)
+    {
+        const Block& block = blocks[index];
+        if (block.codec == AUTO_STORE)
+        {
+            std::memcpy(block.dest.address, block.source.address, block.source.size);
+        }
+        else
+        {
+            findAutoCandidate(block.codec)->decompress(block.dest, block.source);
+        }
+    });
+}
+
 } // namespace mango
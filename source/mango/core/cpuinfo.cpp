@@ -3,8 +3,17 @@
     Copyright (C) 2012-2016 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
 #include <mango/core/cpuinfo.hpp>
 
+#if defined(MANGO_PLATFORM_LINUX)
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
 namespace
 {
 
@@ -22,7 +31,7 @@ namespace
 
     void cpuid(int* info, int id)
     {
-        __cpuid(info, id);
+        __cpuidex(info, id, 0);
     }
 
 #elif defined(MANGO_PLATFORM_UNIX)
@@ -109,6 +118,8 @@ namespace
                     if ((cpuInfo[1] & 0x20000000) != 0) flags |= CPU_SHA;
                     if ((cpuInfo[1] & 0x40000000) != 0) flags |= CPU_AVX512BW;
                     if ((cpuInfo[1] & 0x80000000) != 0) flags |= CPU_AVX512VL;
+                    // ecx
+                    if ((cpuInfo[2] & 0x00000400) != 0) flags |= CPU_VPCLMULQDQ;
                     break;
 			}
 		}
@@ -212,6 +223,124 @@ namespace
         return 0; // unsupported platform
     }
 
+#endif
+
+    // ----------------------------------------------------------------------------
+    // getCPUTopologyInternal()
+    // ----------------------------------------------------------------------------
+
+    CPUTopology getDefaultTopology()
+    {
+        CPUTopology topology;
+        topology.nodes = 1;
+
+        const int count = std::max(1, int(std::thread::hardware_concurrency()));
+        for (int i = 0; i < count; ++i)
+        {
+            CPUTopology::Processor processor;
+            processor.id = i;
+            processor.core = i;
+            processor.package = 0;
+            processor.cache = 0;
+            processor.node = 0;
+            topology.processors.push_back(processor);
+        }
+
+        return topology;
+    }
+
+#if defined(MANGO_PLATFORM_LINUX)
+
+    std::string readSysFile(const std::string& filename)
+    {
+        std::ifstream file(filename);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    int readSysInt(const std::string& filename, int value)
+    {
+        std::string text = readSysFile(filename);
+        return text.empty() ? value : std::atoi(text.c_str());
+    }
+
+    CPUTopology getCPUTopologyInternal()
+    {
+        const std::string base = "/sys/devices/system/cpu/";
+
+        std::vector<int> online = parseCPUList(readSysFile(base + "online"));
+        if (online.empty())
+        {
+            return getDefaultTopology();
+        }
+
+        CPUTopology topology;
+        topology.nodes = 1;
+
+        for (int id : online)
+        {
+            const std::string cpu = base + "cpu" + std::to_string(id) + "/";
+
+            CPUTopology::Processor processor;
+            processor.id = id;
+            processor.package = readSysInt(cpu + "topology/physical_package_id", 0);
+            processor.core = (processor.package << 16) | readSysInt(cpu + "topology/core_id", id);
+            processor.cache = id;
+            processor.node = 0;
+
+            // last level cache is the one with highest level
+            int level = 0;
+            for (int index = 0; ; ++index)
+            {
+                const std::string cache = cpu + "cache/index" + std::to_string(index) + "/";
+                int x = readSysInt(cache + "level", -1);
+                if (x < 0)
+                    break;
+
+                if (x >= level)
+                {
+                    std::vector<int> shared = parseCPUList(readSysFile(cache + "shared_cpu_list"));
+                    if (!shared.empty())
+                    {
+                        level = x;
+                        processor.cache = *std::min_element(shared.begin(), shared.end());
+                    }
+                }
+            }
+
+            topology.processors.push_back(processor);
+        }
+
+        // the node ids can have gaps, for example memory-only nodes
+        for (int node : parseCPUList(readSysFile("/sys/devices/system/node/online")))
+        {
+            const std::string filename = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+
+            for (int id : parseCPUList(readSysFile(filename)))
+            {
+                for (auto& processor : topology.processors)
+                {
+                    if (processor.id == id)
+                    {
+                        processor.node = node;
+                    }
+                }
+            }
+
+            topology.nodes = std::max(topology.nodes, node + 1);
+        }
+
+        return topology;
+    }
+
+#else
+
+    CPUTopology getCPUTopologyInternal()
+    {
+        return getDefaultTopology();
+    }
+
 #endif
 
 } // namespace
@@ -225,4 +354,82 @@ namespace mango
         return flags;
     }
 
+    const CPUTopology::Processor* CPUTopology::find(int id) const
+    {
+        for (auto& processor : processors)
+        {
+            if (processor.id == id)
+                return &processor;
+        }
+
+        return nullptr;
+    }
+
+    const CPUTopology& getCPUTopology()
+    {
+        static CPUTopology topology = getCPUTopologyInternal();
+        return topology;
+    }
+
+    std::vector<int> parseCPUList(const std::string& list)
+    {
+        std::vector<int> result;
+        std::stringstream stream(list);
+        std::string range;
+
+        while (std::getline(stream, range, ','))
+        {
+            if (range.empty())
+                continue;
+
+            int first = 0;
+            int last = 0;
+            const size_t dash = range.find('-');
+
+            if (dash == std::string::npos)
+            {
+                first = last = std::atoi(range.c_str());
+            }
+            else
+            {
+                first = std::atoi(range.substr(0, dash).c_str());
+                last = std::atoi(range.substr(dash + 1).c_str());
+            }
+
+            for (int i = first; i <= last; ++i)
+            {
+                result.push_back(i);
+            }
+        }
+
+        return result;
+    }
+
+#if defined(MANGO_PLATFORM_LINUX) && defined(SYS_get_mempolicy)
+
+    int getMemoryNode(const void* address)
+    {
+        if (getCPUTopology().nodes < 2)
+            return -1;
+
+        // MPOL_F_NODE | MPOL_F_ADDR: return the node of the page at address
+        const unsigned long flags = 1 | 2;
+
+        int node = -1;
+        if (syscall(SYS_get_mempolicy, &node, nullptr, 0, address, flags) != 0)
+            return -1;
+
+        return node;
+    }
+
+#else
+
+    int getMemoryNode(const void* address)
+    {
+        MANGO_UNREFERENCED_PARAMETER(address);
+        return -1;
+    }
+
+#endif
+
 } // namespace mango
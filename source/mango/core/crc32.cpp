@@ -6,6 +6,8 @@
 #include <mango/core/exception.hpp>
 #include <mango/core/bits.hpp>
 #include <mango/core/endian.hpp>
+#include <mango/core/cpuinfo.hpp>
+#include <mango/core/parallel.hpp>
 
 #if defined(MANGO_ENABLE_SSE4_2)
 
@@ -760,18 +762,407 @@ namespace {
         return ~crc;
     }
 
+    // The crc of the combined blocks is crc0 * x^(8 * size) + crc1 modulo the
+    // polynomial; the bits are reflected so that x^0 is the highest bit.
+
+    u32 multiply_modp(u32 a, u32 b, u32 poly)
+    {
+        u32 product = 0;
+
+        for (u32 mask = 1u << 31; mask; mask >>= 1)
+        {
+            if (a & mask)
+            {
+                product ^= b;
+                if (!(a & (mask - 1)))
+                    break;
+            }
+
+            b = (b & 1) ? (b >> 1) ^ poly : b >> 1;
+        }
+
+        return product;
+    }
+
+    u32 crc_combine(u32 crc0, u32 crc1, u64 size, u32 poly)
+    {
+        u32 power = 1u << 23; // x^8
+        u32 shift = 1u << 31; // x^0
+
+        for ( ; size; size >>= 1)
+        {
+            if (size & 1)
+            {
+                shift = multiply_modp(power, shift, poly);
+            }
+
+            power = multiply_modp(power, power, poly);
+        }
+
+        return multiply_modp(shift, crc0, poly) ^ crc1;
+    }
+
+    // ----------------------------------------------------------------------------
+    // folding
+    // ----------------------------------------------------------------------------
+
+    // Carry-less multiplication folds the data into 128 bit accumulators which
+    // are reduced to the crc at the end ("Fast CRC Computation for Generic
+    // Polynomials Using PCLMULQDQ Instruction", Intel 2009). The constants are
+    // x^n mod P for the folding distances (bit reflected, shifted left by one),
+    // the polynomial and the Barrett constant floor(x^64 / P).
+
+    struct FoldConstants
+    {
+        u64 k1, k2; // 4 x 128 bits
+        u64 k3, k4; // 128 bits
+        u64 k5;     // 64 bits
+        u64 poly, mu;
+        u64 k6, k7; // 4 x 512 bits
+    };
+
+    const FoldConstants g_crc32_fold =
+    {
+        0x154442bd4, 0x1c6e41596,
+        0x1751997d0, 0x0ccaa009e,
+        0x163cd6124,
+        0x1db710641, 0x1f7011641,
+        0x11542778a, 0x1322d1430
+    };
+
+    const FoldConstants g_crc32c_fold =
+    {
+        0x0740eef02, 0x09e4addf8,
+        0x0f20c0dfe, 0x14cd00bd6,
+        0x0dd45aab8,
+        0x105ec76f1, 0x0dea713f1,
+        0x0dcb17aa4, 0x0b9e02b86
+    };
+
+#if defined(MANGO_ENABLE_CLMUL)
+
+    inline __m128i fold128(__m128i x, __m128i k, __m128i data)
+    {
+        const __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+        const __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+        return _mm_xor_si128(_mm_xor_si128(lo, hi), data);
+    }
+
+#if defined(MANGO_ENABLE_VPCLMULQDQ)
+
+    inline __m512i fold512(__m512i x, __m512i k, __m512i data)
+    {
+        const __m512i lo = _mm512_clmulepi64_epi128(x, k, 0x00);
+        const __m512i hi = _mm512_clmulepi64_epi128(x, k, 0x11);
+        return _mm512_xor_si512(_mm512_xor_si512(lo, hi), data);
+    }
+
+#endif
+
+    // the size must be a multiple of 16 and at least 64; the crc is not inverted
+    u32 crc_fold(u32 crc, const u8* data, size_t size, const FoldConstants& c, bool wide)
+    {
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00));
+        __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10));
+        __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20));
+        __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30));
+
+#if defined(MANGO_ENABLE_VPCLMULQDQ)
+        if (wide && size >= 512)
+        {
+            __m512i z[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                z[i] = _mm512_loadu_si512(data + i * 64);
+            }
+
+            z[0] = _mm512_xor_si512(z[0], _mm512_inserti32x4(_mm512_setzero_si512(), _mm_cvtsi32_si128(crc), 0));
+            data += 256;
+            size -= 256;
+
+            const __m512i k4x = _mm512_broadcast_i32x4(_mm_set_epi64x(c.k7, c.k6));
+            for ( ; size >= 256; size -= 256)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    z[i] = fold512(z[i], k4x, _mm512_loadu_si512(data + i * 64));
+                }
+                data += 256;
+            }
+
+            const __m512i k1x = _mm512_broadcast_i32x4(_mm_set_epi64x(c.k2, c.k1));
+            z[0] = fold512(z[0], k1x, z[1]);
+            z[0] = fold512(z[0], k1x, z[2]);
+            z[0] = fold512(z[0], k1x, z[3]);
+
+            x1 = _mm512_extracti32x4_epi32(z[0], 0);
+            x2 = _mm512_extracti32x4_epi32(z[0], 1);
+            x3 = _mm512_extracti32x4_epi32(z[0], 2);
+            x4 = _mm512_extracti32x4_epi32(z[0], 3);
+        }
+        else
+#endif
+        {
+            MANGO_UNREFERENCED_PARAMETER(wide);
+            x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+            data += 64;
+            size -= 64;
+        }
+
+        // fold 4 x 128 bits
+        const __m128i k12 = _mm_set_epi64x(c.k2, c.k1);
+        for ( ; size >= 64; size -= 64)
+        {
+            x1 = fold128(x1, k12, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00)));
+            x2 = fold128(x2, k12, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10)));
+            x3 = fold128(x3, k12, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20)));
+            x4 = fold128(x4, k12, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30)));
+            data += 64;
+        }
+
+        // fold into 128 bits
+        const __m128i k34 = _mm_set_epi64x(c.k4, c.k3);
+        x1 = fold128(x1, k34, x2);
+        x1 = fold128(x1, k34, x3);
+        x1 = fold128(x1, k34, x4);
+
+        for ( ; size >= 16; size -= 16)
+        {
+            x1 = fold128(x1, k34, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+            data += 16;
+        }
+
+        // fold 128 bits to 64 bits
+        const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+        x2 = _mm_clmulepi64_si128(x1, k34, 0x10);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, mask);
+        x1 = _mm_clmulepi64_si128(x1, _mm_set_epi64x(0, c.k5), 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction to 32 bits
+        const __m128i poly = _mm_set_epi64x(c.mu, c.poly);
+        x2 = _mm_and_si128(x1, mask);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+        x2 = _mm_and_si128(x2, mask);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return u32(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+    }
+
+    template <typename F8>
+    inline u32 crc_fold_template(u32 crc, Memory memory, const FoldConstants& constants, F8 u8_func)
+    {
+        static const bool wide = (getCPUFlags() & CPU_VPCLMULQDQ) != 0;
+
+        const size_t size = memory.size & ~size_t(15);
+
+        crc = ~crc;
+        crc = crc_fold(crc, memory.address, size, constants, wide);
+
+        for (size_t i = size; i < memory.size; ++i)
+        {
+            crc = u8_func(crc, memory.address[i]);
+        }
+
+        return ~crc;
+    }
+
+#endif // MANGO_ENABLE_CLMUL
+
+    // ----------------------------------------------------------------------------
+    // interleaving
+    // ----------------------------------------------------------------------------
+
+    // The crc instructions have a latency of three cycles but one can start
+    // every cycle; three independent streams keep the unit busy. The streams
+    // are merged by shifting the crc over the following stream with a table.
+
+    constexpr size_t INTERLEAVE_SIZE = 1024 * 4;
+
+    struct ShiftTable
+    {
+        u32 table[4][256];
+
+        ShiftTable(u32 poly)
+        {
+            // x^(8 * INTERLEAVE_SIZE)
+            u32 power = 1u << 23;
+            u32 shift = 1u << 31;
+
+            for (size_t size = INTERLEAVE_SIZE; size; size >>= 1)
+            {
+                if (size & 1)
+                {
+                    shift = multiply_modp(power, shift, poly);
+                }
+
+                power = multiply_modp(power, power, poly);
+            }
+
+            for (int i = 0; i < 4; ++i)
+            {
+                for (u32 j = 0; j < 256; ++j)
+                {
+                    table[i][j] = multiply_modp(shift, j << (i * 8), poly);
+                }
+            }
+        }
+
+        u32 operator () (u32 crc) const
+        {
+            return table[0][(crc >>  0) & 0xff] ^
+                   table[1][(crc >>  8) & 0xff] ^
+                   table[2][(crc >> 16) & 0xff] ^
+                   table[3][(crc >> 24) & 0xff];
+        }
+    };
+
+    // processes the whole interleave blocks; the crc is not inverted
+    template <typename F64>
+    inline u32 crc_interleave(u32 crc, Memory& memory, const ShiftTable& shift, F64 u64_func)
+    {
+        for ( ; memory.size >= INTERLEAVE_SIZE * 3; memory.size -= INTERLEAVE_SIZE * 3)
+        {
+            const u8* data0 = memory.address;
+            const u8* data1 = data0 + INTERLEAVE_SIZE;
+            const u8* data2 = data1 + INTERLEAVE_SIZE;
+
+            u32 crc0 = crc;
+            u32 crc1 = 0;
+            u32 crc2 = 0;
+
+            for (size_t i = 0; i < INTERLEAVE_SIZE; i += 8)
+            {
+                crc0 = u64_func(crc0, data0 + i);
+                crc1 = u64_func(crc1, data1 + i);
+                crc2 = u64_func(crc2, data2 + i);
+            }
+
+            crc = shift(shift(crc0) ^ crc1) ^ crc2;
+            memory.address += INTERLEAVE_SIZE * 3;
+        }
+
+        return crc;
+    }
+
+    // ----------------------------------------------------------------------------
+    // parallel
+    // ----------------------------------------------------------------------------
+
+    struct PartialCRC
+    {
+        u32 crc;
+        u64 size;
+    };
+
+    template <typename F, typename C>
+    u32 crc_parallel(u32 crc, Memory memory, F func, C combine)
+    {
+        constexpr size_t SEGMENT_SIZE = 1024 * 1024;
+
+        ThreadPool& pool = ThreadPool::getInstance();
+        if (memory.size < SEGMENT_SIZE * 4 || pool.size() < 2)
+        {
+            return func(crc, memory);
+        }
+
+        const int count = int((memory.size + SEGMENT_SIZE - 1) / SEGMENT_SIZE);
+        const PartialCRC identity = { 0, 0 };
+
+        // the segments are reduced in order; the crc of an empty block is zero
+        PartialCRC result = parallel_reduce(pool, BlockRange(0, count), identity,
+            [&] (const BlockRange& range, const PartialCRC& value)
+        {
+            MANGO_UNREFERENCED_PARAMETER(value);
+            const size_t begin = size_t(range.begin) * SEGMENT_SIZE;
+            const size_t end = std::min(size_t(range.end) * SEGMENT_SIZE, memory.size);
+            PartialCRC partial;
+            partial.crc = func(0, Memory(memory.address + begin, end - begin));
+            partial.size = end - begin;
+            return partial;
+        },
+            [&] (const PartialCRC& a, const PartialCRC& b)
+        {
+            PartialCRC partial;
+            partial.crc = combine(a.crc, b.crc, b.size);
+            partial.size = a.size + b.size;
+            return partial;
+        });
+
+        return combine(crc, result.crc, result.size);
+    }
+
 } // namespace
 
 namespace mango {
 
     u32 crc32(u32 crc, Memory memory)
     {
+#if defined(MANGO_HARDWARE_CRC32)
+        if (memory.size >= INTERLEAVE_SIZE * 3)
+        {
+            static const ShiftTable shift(0xedb88320);
+            crc = ~crc_interleave(~crc, memory, shift, u64_crc32);
+        }
+#elif defined(MANGO_ENABLE_CLMUL)
+        static const bool clmul = (getCPUFlags() & CPU_CLMUL) != 0;
+        if (clmul && memory.size >= 64)
+        {
+            return crc_fold_template(crc, memory, g_crc32_fold, u8_crc32);
+        }
+#endif
         return crc_template(crc, memory, u8_crc32, u64_crc32);
     }
 
     u32 crc32c(u32 crc, Memory memory)
     {
+#if defined(MANGO_ENABLE_VPCLMULQDQ)
+        // folding 4 x 512 bits at a time is faster than the crc instruction
+        static const bool wide = (getCPUFlags() & CPU_VPCLMULQDQ) != 0;
+        if (wide && memory.size >= 1024)
+        {
+            return crc_fold_template(crc, memory, g_crc32c_fold, u8_crc32c);
+        }
+#endif
+
+#if defined(MANGO_HARDWARE_CRC32C)
+        if (memory.size >= INTERLEAVE_SIZE * 3)
+        {
+            static const ShiftTable shift(0x82f63b78);
+            crc = ~crc_interleave(~crc, memory, shift, u64_crc32c);
+        }
+#elif defined(MANGO_ENABLE_CLMUL)
+        static const bool clmul = (getCPUFlags() & CPU_CLMUL) != 0;
+        if (clmul && memory.size >= 64)
+        {
+            return crc_fold_template(crc, memory, g_crc32c_fold, u8_crc32c);
+        }
+#endif
         return crc_template(crc, memory, u8_crc32c, u64_crc32c);
     }
 
+    u32 crc32_parallel(u32 crc, Memory memory)
+    {
+        return crc_parallel(crc, memory, crc32, crc32_combine);
+    }
+
+    u32 crc32c_parallel(u32 crc, Memory memory)
+    {
+        return crc_parallel(crc, memory, crc32c, crc32c_combine);
+    }
+
+    u32 crc32_combine(u32 crc0, u32 crc1, u64 size)
+    {
+        return crc_combine(crc0, crc1, size, 0xedb88320);
+    }
+
+    u32 crc32c_combine(u32 crc0, u32 crc1, u64 size)
+    {
+        return crc_combine(crc0, crc1, size, 0x82f63b78);
+    }
+
 } // namespace mango
@@ -2,7 +2,12 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <algorithm>
+#include <cstring>
 #include <mango/core/hash.hpp>
+#include <mango/core/endian.hpp>
+
+#define XXH_STATIC_LINKING_ONLY
 #include "../../external/zstd/common/xxhash.h"
 
 namespace mango {
@@ -19,4 +24,118 @@ namespace mango {
         return XXH64(memory.address, memory.size, seed);
     }
 
+    // ----------------------------------------------------------------------------
+    // BlockHashContext
+    // ----------------------------------------------------------------------------
+
+    BlockHashContext::BlockHashContext(Transform transform)
+        : m_transform(transform)
+        , m_size(0)
+    {
+    }
+
+    void BlockHashContext::update(Memory memory)
+    {
+        size_t used = size_t(m_size & 63);
+        m_size += memory.size;
+
+        if (used)
+        {
+            const size_t bytes = std::min(64 - used, memory.size);
+            std::memcpy(m_buffer + used, memory.address, bytes);
+            memory.address += bytes;
+            memory.size -= bytes;
+
+            if (used + bytes < 64)
+                return;
+
+            m_transform(m_state, m_buffer, 1);
+        }
+
+        // the block count is an int
+        while (memory.size >= 64)
+        {
+            const size_t count = std::min(memory.size / 64, size_t(1) << 24);
+            m_transform(m_state, memory.address, int(count));
+            memory.address += count * 64;
+            memory.size -= count * 64;
+        }
+
+        std::memcpy(m_buffer, memory.address, memory.size);
+    }
+
+    void BlockHashContext::finish(bool bigendian)
+    {
+        size_t used = size_t(m_size & 63);
+        m_buffer[used++] = 0x80;
+
+        if (used > 56)
+        {
+            std::memset(m_buffer + used, 0, 64 - used);
+            m_transform(m_state, m_buffer, 1);
+            used = 0;
+        }
+
+        std::memset(m_buffer + used, 0, 56 - used);
+
+        const uint64 bits = m_size * 8;
+        if (bigendian)
+            ustore64be(m_buffer + 56, bits);
+        else
+            ustore64le(m_buffer + 56, bits);
+
+        m_transform(m_state, m_buffer, 1);
+    }
+
+    // ----------------------------------------------------------------------------
+    // XXHash32Context
+    // ----------------------------------------------------------------------------
+
+    static_assert(sizeof(XXH32_state_t) <= 48, "XXHash32Context state is too small.");
+    static_assert(sizeof(XXH64_state_t) <= 88, "XXHash64Context state is too small.");
+
+    XXHash32Context::XXHash32Context(uint32 seed)
+    {
+        reset(seed);
+    }
+
+    void XXHash32Context::reset(uint32 seed)
+    {
+        XXH32_reset(reinterpret_cast<XXH32_state_t*>(m_state), seed);
+    }
+
+    void XXHash32Context::update(Memory memory)
+    {
+        XXH32_update(reinterpret_cast<XXH32_state_t*>(m_state), memory.address, memory.size);
+    }
+
+    uint32 XXHash32Context::final() const
+    {
+        return XXH32_digest(reinterpret_cast<const XXH32_state_t*>(m_state));
+    }
+
+    // ----------------------------------------------------------------------------
+    // XXHash64Context
+    // ----------------------------------------------------------------------------
+
+    XXHash64Context::XXHash64Context(uint64 seed)
+    {
+        reset(seed);
+    }
+
+    void XXHash64Context::reset(uint64 seed)
+    {
+        XXH64_reset(reinterpret_cast<XXH64_state_t*>(m_state), seed);
+    }
+
+    void XXHash64Context::update(Memory memory)
+    {
+        XXH64_update(reinterpret_cast<XXH64_state_t*>(m_state), memory.address, memory.size);
+    }
+
+    uint64 XXHash64Context::final() const
+    {
+        return XXH64_digest(reinterpret_cast<const XXH64_state_t*>(m_state));
+    }
+
 } // namespace mango
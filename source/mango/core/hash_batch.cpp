@@ -0,0 +1,495 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <mango/core/hash.hpp>
+#include <mango/core/endian.hpp>
+#include <mango/core/cpuinfo.hpp>
+#include <mango/math/vector.hpp>
+
+namespace {
+    using namespace mango;
+
+    // ----------------------------------------------------------------------------
+    // lanes
+    // ----------------------------------------------------------------------------
+
+    // Each SIMD lane hashes a different message; the block of every lane is
+    // transposed so that vector i holds the word i of all the lanes.
+
+#if defined(MANGO_ENABLE_AVX512)
+
+    using HashVector = uint32x16;
+
+    inline HashVector hash_load(const uint32* source)
+    {
+        return simd::uint32x16_uload(source);
+    }
+
+    inline void hash_store(uint32* dest, HashVector v)
+    {
+        simd::uint32x16_ustore(dest, v);
+    }
+
+#elif defined(MANGO_ENABLE_AVX2)
+
+    using HashVector = uint32x8;
+
+    inline HashVector hash_load(const uint32* source)
+    {
+        return simd::uint32x8_uload(source);
+    }
+
+    inline void hash_store(uint32* dest, HashVector v)
+    {
+        simd::uint32x8_ustore(dest, v);
+    }
+
+#else
+
+    // SSE2, NEON and the scalar fallback
+    using HashVector = uint32x4;
+
+    inline HashVector hash_load(const uint32* source)
+    {
+        return simd::uint32x4_uload(source);
+    }
+
+    inline void hash_store(uint32* dest, HashVector v)
+    {
+        simd::uint32x4_ustore(dest, v);
+    }
+
+#endif
+
+    constexpr int LANES = HashVector::VectorSize;
+
+    template <int count>
+    inline HashVector rotateLeft(HashVector v)
+    {
+        return (v << count) | (v >> (32 - count));
+    }
+
+    template <int count>
+    inline HashVector rotateRight(HashVector v)
+    {
+        return (v >> count) | (v << (32 - count));
+    }
+
+    struct Lane
+    {
+        const uint8* data;
+        size_t blocks;
+        uint8 tail[128];
+        size_t tail_blocks;
+        size_t index;
+        bool active;
+    };
+
+    // Hashes the messages with the batch transform. Hasher has the initial
+    // state (IV), whether the words are big endian, the transform and the
+    // output conversion. The longest messages are started first to keep the
+    // lanes busy until the end.
+
+    template <typename Hasher>
+    void hash_lanes(uint32* output, const Memory* messages, const std::vector<size_t>& order)
+    {
+        constexpr int WORDS = Hasher::STATE_SIZE;
+
+        alignas(64) uint32 state[WORDS][LANES];
+        alignas(64) uint32 words[16][LANES];
+        const uint8 idle[64] = { 0 };
+
+        Lane lanes[LANES];
+        size_t next = 0;
+
+        auto start = [&] (int i)
+        {
+            Lane& lane = lanes[i];
+            lane.active = next < order.size();
+            if (!lane.active)
+                return;
+
+            lane.index = order[next++];
+            const Memory& message = messages[lane.index];
+
+            lane.data = message.address;
+            lane.blocks = message.size / 64;
+
+            // padding and the message size in bits
+            const size_t remain = message.size & 63;
+            lane.tail_blocks = remain < 56 ? 1 : 2;
+
+            uint8* tail = lane.tail;
+            std::memcpy(tail, message.address + lane.blocks * 64, remain);
+            tail[remain] = 0x80;
+            std::memset(tail + remain + 1, 0, lane.tail_blocks * 64 - remain - 9);
+
+            uint8* length = tail + lane.tail_blocks * 64 - 8;
+            if (Hasher::BIG_ENDIAN_WORDS)
+                ustore64be(length, uint64(message.size) * 8);
+            else
+                ustore64le(length, uint64(message.size) * 8);
+
+            for (int j = 0; j < WORDS; ++j)
+            {
+                state[j][i] = Hasher::IV[j];
+            }
+        };
+
+        int active = 0;
+        for (int i = 0; i < LANES; ++i)
+        {
+            start(i);
+            active += lanes[i].active;
+        }
+
+        while (active)
+        {
+            for (int i = 0; i < LANES; ++i)
+            {
+                Lane& lane = lanes[i];
+
+                const uint8* block = idle;
+                if (lane.active)
+                {
+                    block = lane.blocks ? lane.data : lane.tail;
+                }
+
+                for (int j = 0; j < 16; ++j)
+                {
+                    words[j][i] = Hasher::BIG_ENDIAN_WORDS ? uload32be(block + j * 4) : uload32le(block + j * 4);
+                }
+            }
+
+            HashVector s[WORDS];
+            HashVector w[16];
+
+            for (int j = 0; j < WORDS; ++j)
+            {
+                s[j] = hash_load(state[j]);
+            }
+
+            for (int j = 0; j < 16; ++j)
+            {
+                w[j] = hash_load(words[j]);
+            }
+
+            Hasher::transform(s, w);
+
+            for (int j = 0; j < WORDS; ++j)
+            {
+                hash_store(state[j], s[j]);
+            }
+
+            // advance the lanes and start the next message in the finished ones
+            for (int i = 0; i < LANES; ++i)
+            {
+                Lane& lane = lanes[i];
+                if (!lane.active)
+                    continue;
+
+                if (lane.blocks)
+                {
+                    lane.data += 64;
+                    --lane.blocks;
+                    continue;
+                }
+
+                if (--lane.tail_blocks)
+                {
+                    // the second tail block
+                    std::memmove(lane.tail, lane.tail + 64, 64);
+                    continue;
+                }
+
+                uint32* hash = output + lane.index * WORDS;
+                for (int j = 0; j < WORDS; ++j)
+                {
+                    hash[j] = Hasher::output(state[j][i]);
+                }
+
+                start(i);
+                active -= !lanes[i].active;
+            }
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // MD5
+    // ----------------------------------------------------------------------------
+
+    struct HasherMD5
+    {
+        enum { STATE_SIZE = 4 };
+        enum { BIG_ENDIAN_WORDS = 0 };
+
+        static const uint32 IV[4];
+
+        static uint32 output(uint32 value)
+        {
+            return value;
+        }
+
+        static void transform(HashVector* state, const HashVector* w)
+        {
+            HashVector a = state[0];
+            HashVector b = state[1];
+            HashVector c = state[2];
+            HashVector d = state[3];
+
+            const HashVector ones(0xffffffff);
+
+#define ROUND_TAIL(a, b, expr, k, s, t) \
+    a = a + (expr) + HashVector(t) + w[k]; \
+    a = b + rotateLeft<s>(a)
+
+#define ROUND0(a, b, c, d, k, s, t)  ROUND_TAIL(a, b, d ^ (b & (c ^ d)), k, s, t)
+#define ROUND1(a, b, c, d, k, s, t)  ROUND_TAIL(a, b, c ^ (d & (b ^ c)), k, s, t)
+#define ROUND2(a, b, c, d, k, s, t)  ROUND_TAIL(a, b, b ^ c ^ d        , k, s, t)
+#define ROUND3(a, b, c, d, k, s, t)  ROUND_TAIL(a, b, c ^ (b | (d ^ ones)), k, s, t)
+
+            ROUND0(a, b, c, d,  0,  7, 0xD76AA478);
+            ROUND0(d, a, b, c,  1, 12, 0xE8C7B756);
+            ROUND0(c, d, a, b,  2, 17, 0x242070DB);
+            ROUND0(b, c, d, a,  3, 22, 0xC1BDCEEE);
+            ROUND0(a, b, c, d,  4,  7, 0xF57C0FAF);
+            ROUND0(d, a, b, c,  5, 12, 0x4787C62A);
+            ROUND0(c, d, a, b,  6, 17, 0xA8304613);
+            ROUND0(b, c, d, a,  7, 22, 0xFD469501);
+            ROUND0(a, b, c, d,  8,  7, 0x698098D8);
+            ROUND0(d, a, b, c,  9, 12, 0x8B44F7AF);
+            ROUND0(c, d, a, b, 10, 17, 0xFFFF5BB1);
+            ROUND0(b, c, d, a, 11, 22, 0x895CD7BE);
+            ROUND0(a, b, c, d, 12,  7, 0x6B901122);
+            ROUND0(d, a, b, c, 13, 12, 0xFD987193);
+            ROUND0(c, d, a, b, 14, 17, 0xA679438E);
+            ROUND0(b, c, d, a, 15, 22, 0x49B40821);
+            ROUND1(a, b, c, d,  1,  5, 0xF61E2562);
+            ROUND1(d, a, b, c,  6,  9, 0xC040B340);
+            ROUND1(c, d, a, b, 11, 14, 0x265E5A51);
+            ROUND1(b, c, d, a,  0, 20, 0xE9B6C7AA);
+            ROUND1(a, b, c, d,  5,  5, 0xD62F105D);
+            ROUND1(d, a, b, c, 10,  9, 0x02441453);
+            ROUND1(c, d, a, b, 15, 14, 0xD8A1E681);
+            ROUND1(b, c, d, a,  4, 20, 0xE7D3FBC8);
+            ROUND1(a, b, c, d,  9,  5, 0x21E1CDE6);
+            ROUND1(d, a, b, c, 14,  9, 0xC33707D6);
+            ROUND1(c, d, a, b,  3, 14, 0xF4D50D87);
+            ROUND1(b, c, d, a,  8, 20, 0x455A14ED);
+            ROUND1(a, b, c, d, 13,  5, 0xA9E3E905);
+            ROUND1(d, a, b, c,  2,  9, 0xFCEFA3F8);
+            ROUND1(c, d, a, b,  7, 14, 0x676F02D9);
+            ROUND1(b, c, d, a, 12, 20, 0x8D2A4C8A);
+            ROUND2(a, b, c, d,  5,  4, 0xFFFA3942);
+            ROUND2(d, a, b, c,  8, 11, 0x8771F681);
+            ROUND2(c, d, a, b, 11, 16, 0x6D9D6122);
+            ROUND2(b, c, d, a, 14, 23, 0xFDE5380C);
+            ROUND2(a, b, c, d,  1,  4, 0xA4BEEA44);
+            ROUND2(d, a, b, c,  4, 11, 0x4BDECFA9);
+            ROUND2(c, d, a, b,  7, 16, 0xF6BB4B60);
+            ROUND2(b, c, d, a, 10, 23, 0xBEBFBC70);
+            ROUND2(a, b, c, d, 13,  4, 0x289B7EC6);
+            ROUND2(d, a, b, c,  0, 11, 0xEAA127FA);
+            ROUND2(c, d, a, b,  3, 16, 0xD4EF3085);
+            ROUND2(b, c, d, a,  6, 23, 0x04881D05);
+            ROUND2(a, b, c, d,  9,  4, 0xD9D4D039);
+            ROUND2(d, a, b, c, 12, 11, 0xE6DB99E5);
+            ROUND2(c, d, a, b, 15, 16, 0x1FA27CF8);
+            ROUND2(b, c, d, a,  2, 23, 0xC4AC5665);
+            ROUND3(a, b, c, d,  0,  6, 0xF4292244);
+            ROUND3(d, a, b, c,  7, 10, 0x432AFF97);
+            ROUND3(c, d, a, b, 14, 15, 0xAB9423A7);
+            ROUND3(b, c, d, a,  5, 21, 0xFC93A039);
+            ROUND3(a, b, c, d, 12,  6, 0x655B59C3);
+            ROUND3(d, a, b, c,  3, 10, 0x8F0CCC92);
+            ROUND3(c, d, a, b, 10, 15, 0xFFEFF47D);
+            ROUND3(b, c, d, a,  1, 21, 0x85845DD1);
+            ROUND3(a, b, c, d,  8,  6, 0x6FA87E4F);
+            ROUND3(d, a, b, c, 15, 10, 0xFE2CE6E0);
+            ROUND3(c, d, a, b,  6, 15, 0xA3014314);
+            ROUND3(b, c, d, a, 13, 21, 0x4E0811A1);
+            ROUND3(a, b, c, d,  4,  6, 0xF7537E82);
+            ROUND3(d, a, b, c, 11, 10, 0xBD3AF235);
+            ROUND3(c, d, a, b,  2, 15, 0x2AD7D2BB);
+            ROUND3(b, c, d, a,  9, 21, 0xEB86D391);
+
+#undef ROUND_TAIL
+#undef ROUND0
+#undef ROUND1
+#undef ROUND2
+#undef ROUND3
+
+            state[0] = state[0] + a;
+            state[1] = state[1] + b;
+            state[2] = state[2] + c;
+            state[3] = state[3] + d;
+        }
+    };
+
+    const uint32 HasherMD5::IV[4] =
+    {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+    };
+
+    // ----------------------------------------------------------------------------
+    // SHA-256
+    // ----------------------------------------------------------------------------
+
+    struct HasherSHA2
+    {
+        enum { STATE_SIZE = 8 };
+        enum { BIG_ENDIAN_WORDS = 1 };
+
+        static const uint32 IV[8];
+
+        static uint32 output(uint32 value)
+        {
+#ifdef MANGO_LITTLE_ENDIAN
+            return byteswap(value);
+#else
+            return value;
+#endif
+        }
+
+        static void transform(HashVector* state, const HashVector* block)
+        {
+            static const uint32 k[] =
+            {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+            };
+
+            HashVector w[16];
+            for (int i = 0; i < 16; ++i)
+            {
+                w[i] = block[i];
+            }
+
+            HashVector a = state[0];
+            HashVector b = state[1];
+            HashVector c = state[2];
+            HashVector d = state[3];
+            HashVector e = state[4];
+            HashVector f = state[5];
+            HashVector g = state[6];
+            HashVector h = state[7];
+
+            for (int i = 0; i < 64; ++i)
+            {
+                // the message schedule is kept in a ring of 16 words
+                if (i >= 16)
+                {
+                    const HashVector w15 = w[(i - 15) & 15];
+                    const HashVector w2 = w[(i - 2) & 15];
+                    const HashVector s0 = rotateRight<7>(w15) ^ rotateRight<18>(w15) ^ (w15 >> 3);
+                    const HashVector s1 = rotateRight<17>(w2) ^ rotateRight<19>(w2) ^ (w2 >> 10);
+                    w[i & 15] = w[i & 15] + s0 + w[(i - 7) & 15] + s1;
+                }
+
+                const HashVector S1 = rotateRight<6>(e) ^ rotateRight<11>(e) ^ rotateRight<25>(e);
+                const HashVector ch = g ^ (e & (f ^ g));
+                const HashVector t1 = h + S1 + ch + HashVector(k[i]) + w[i & 15];
+                const HashVector S0 = rotateRight<2>(a) ^ rotateRight<13>(a) ^ rotateRight<22>(a);
+                const HashVector maj = (a & b) | (c & (a | b));
+                const HashVector t2 = S0 + maj;
+
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+
+            state[0] = state[0] + a;
+            state[1] = state[1] + b;
+            state[2] = state[2] + c;
+            state[3] = state[3] + d;
+            state[4] = state[4] + e;
+            state[5] = state[5] + f;
+            state[6] = state[6] + g;
+            state[7] = state[7] + h;
+        }
+    };
+
+    const uint32 HasherSHA2::IV[8] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    std::vector<size_t> getLongestFirst(const Memory* messages, size_t count)
+    {
+        std::vector<size_t> order(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            order[i] = i;
+        }
+
+        std::stable_sort(order.begin(), order.end(), [messages] (size_t a, size_t b)
+        {
+            return messages[a].size > messages[b].size;
+        });
+
+        return order;
+    }
+
+} // namespace
+
+namespace mango {
+
+    void md5_batch(uint32 (*hash)[4], const Memory* messages, size_t count)
+    {
+        if (count == 1)
+        {
+            md5(hash[0], messages[0]);
+        }
+        else if (count > 1)
+        {
+            std::vector<size_t> order = getLongestFirst(messages, count);
+            hash_lanes<HasherMD5>(hash[0], messages, order);
+        }
+    }
+
+    void sha2_batch(uint32 (*hash)[8], const Memory* messages, size_t count)
+    {
+        std::vector<size_t> order = getLongestFirst(messages, count);
+
+        bool hardware = false;
+#if defined(__ARM_FEATURE_CRYPTO)
+        hardware = (getCPUFlags() & CPU_ARM_SHA2) != 0;
+#elif defined(MANGO_ENABLE_SHA)
+        hardware = (getCPUFlags() & CPU_SHA) != 0;
+#endif
+
+        // the large messages, and a lone message, are faster with the
+        // hardware transform than in one lane
+        const size_t threshold = hardware ? 1024 * 4 : ~size_t(0);
+
+        size_t large = 0;
+        while (large < order.size() && (messages[order[large]].size >= threshold || order.size() - large == 1))
+        {
+            sha2(hash[order[large]], messages[order[large]]);
+            ++large;
+        }
+
+        order.erase(order.begin(), order.begin() + large);
+
+        if (!order.empty())
+        {
+            hash_lanes<HasherSHA2>(hash[0], messages, order);
+        }
+    }
+
+} // namespace mango
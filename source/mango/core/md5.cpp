@@ -2,6 +2,7 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <cstring>
 #include <mango/core/hash.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/core/bits.hpp>
@@ -100,44 +101,58 @@ namespace {
 #undef ROUND2
 #undef ROUND3
 
+    void md5_transform(uint32* state, const uint8* data, int count)
+    {
+        uint32 block[16];
+
+        for (int i = 0; i < count; ++i)
+        {
+            std::memcpy(block, data, 64);
+#ifdef MANGO_BIG_ENDIAN
+            for (int j = 0; j < 16; ++j)
+            {
+                block[j] = byteswap(block[j]);
+            }
+#endif
+            md5_update(state, block);
+            data += 64;
+        }
+    }
+
 } // namespace
 
 namespace mango {
 
-    void md5(uint32 hash[4], Memory memory)
+    MD5Context::MD5Context()
+        : BlockHashContext(md5_transform)
     {
-        hash[0] = 0x67452301;
-        hash[1] = 0xEFCDAB89;
-        hash[2] = 0x98BADCFE;
-        hash[3] = 0x10325476;
+        reset();
+    }
 
-        const uint32 size = uint32(memory.size);
-        uint32 i = 0;
-        for ( ; size - i >= 64; i += 64)
-        {
-            md5_update(hash, reinterpret_cast<const uint32 *>(memory.address + i));
-        }
+    void MD5Context::reset()
+    {
+        m_state[0] = 0x67452301;
+        m_state[1] = 0xEFCDAB89;
+        m_state[2] = 0x98BADCFE;
+        m_state[3] = 0x10325476;
+        m_size = 0;
+    }
 
-        uint32 block[16];
-        uint8* byteBlock = reinterpret_cast<uint8 *>(block);
+    void MD5Context::final(uint32 hash[4])
+    {
+        finish(false);
 
-        uint32 remain = size - i;
-        memcpy(byteBlock, memory.address + i, remain);
+        hash[0] = m_state[0];
+        hash[1] = m_state[1];
+        hash[2] = m_state[2];
+        hash[3] = m_state[3];
+    }
 
-        byteBlock[remain++] = 0x80;
-        if (64 - remain >= 8)
-        {
-            memset(byteBlock + remain, 0, 56 - remain);
-        }
-        else
-        {
-            memset(byteBlock + remain, 0, 64 - remain);
-            md5_update(hash, block);
-            memset(block, 0, 56);
-        }
-        block[14] = size << 3;
-        block[15] = size >> 29;
-        md5_update(hash, block);
+    void md5(uint32 hash[4], Memory memory)
+    {
+        MD5Context context;
+        context.update(memory);
+        context.final(hash);
     }
 
 } // namespace mango
@@ -3,8 +3,22 @@
     Copyright (C) 2012-2017 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <cassert>
+#include <map>
+#include <mutex>
 #include <mango/core/bits.hpp>
 #include <mango/core/memory.hpp>
+#include <mango/core/exception.hpp>
+
+#if defined(MANGO_PLATFORM_LINUX)
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#endif
 
 namespace mango {
 
@@ -66,26 +80,26 @@ namespace mango {
 
 #if defined(MANGO_COMPILER_MICROSOFT)
 
-    void* aligned_malloc(size_t size, size_t alignment)
+    static void* heap_malloc(size_t size, size_t alignment)
     {
         assert(u32_is_power_of_two(uint32(alignment)));
         return _aligned_malloc(size, alignment);
     }
 
-    void aligned_free(void* aligned)
+    static void heap_free(void* aligned)
     {
         _aligned_free(aligned);
     }
 
 #elif defined(MANGO_PLATFORM_LINUX)
 
-    void* aligned_malloc(size_t size, size_t alignment)
+    static void* heap_malloc(size_t size, size_t alignment)
     {
         assert(u32_is_power_of_two(uint32(alignment)));
         return memalign(alignment, size);
     }
 
-    void aligned_free(void* aligned)
+    static void heap_free(void* aligned)
     {
         free(aligned);
     }
@@ -94,7 +108,7 @@ namespace mango {
 
     // generic implementation
 
-    void* aligned_malloc(size_t size, size_t alignment)
+    static void* heap_malloc(size_t size, size_t alignment)
     {
         assert(u32_is_power_of_two(uint32(alignment)));
 
@@ -113,7 +127,7 @@ namespace mango {
         return aligned;
     }
 
-    void aligned_free(void* aligned)
+    static void heap_free(void* aligned)
     {
         if (aligned) {
             void* block = reinterpret_cast<void**>(aligned)[-1];
@@ -123,4 +137,501 @@ namespace mango {
 
 #endif
 
+    // -----------------------------------------------------------------------
+    // allocation policy
+    // -----------------------------------------------------------------------
+
+    namespace
+    {
+
+        std::atomic<int> g_policy_pages { AllocationPolicy::PAGES_DEFAULT };
+        std::atomic<int> g_policy_node { -1 };
+        std::atomic<size_t> g_policy_threshold { 4 * 1024 * 1024 };
+
+        // mapped allocations and their sizes; never destroyed as memory can be
+        // released after the static destructors have been run
+        struct PageMappings
+        {
+            std::mutex mutex;
+            std::map<uintptr_t, size_t> sizes;
+            std::atomic<size_t> count { 0 };
+        };
+
+        PageMappings& getPageMappings()
+        {
+            static PageMappings* mappings = new PageMappings();
+            return *mappings;
+        }
+
+    } // namespace
+
+#if defined(MANGO_PLATFORM_LINUX)
+
+    static size_t read_huge_page_size()
+    {
+        // the default huge page size, which MAP_HUGETLB uses, is reported in kB
+        std::ifstream file("/proc/meminfo");
+        std::string line;
+
+        while (std::getline(file, line))
+        {
+            if (line.compare(0, 13, "Hugepagesize:") == 0)
+            {
+                const size_t size = std::strtoull(line.c_str() + 13, nullptr, 10) * 1024;
+                if (size && !(size & (size - 1)))
+                    return size;
+                break;
+            }
+        }
+
+        // hugetlbfs is not available; assume the common 2 MB huge pages
+        return 2 * 1024 * 1024;
+    }
+
+    static size_t read_transparent_huge_page_size()
+    {
+        // transparent huge pages are PMD sized regardless of the hugetlbfs
+        // default, which can be 1 GB
+        std::ifstream file("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+        size_t size = 0;
+
+        if (file >> size && size && !(size & (size - 1)))
+            return size;
+
+        return 2 * 1024 * 1024;
+    }
+
+    static size_t get_huge_page_size()
+    {
+        static const size_t size = read_huge_page_size();
+        return size;
+    }
+
+    static size_t get_transparent_huge_page_size()
+    {
+        static const size_t size = read_transparent_huge_page_size();
+        return size;
+    }
+
+    static size_t round_up(size_t size, size_t alignment)
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    static void* map_anonymous(size_t size, int flags)
+    {
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+        return address == MAP_FAILED ? nullptr : address;
+    }
+
+    static void bind_node(void* address, size_t size, int node)
+    {
+#if defined(SYS_mbind)
+        // MPOL_PREFERRED: the kernel falls back to other nodes when the node runs out
+        const int mode = 1;
+
+        unsigned long mask[16] = { 0 };
+        if (node >= int(sizeof(mask) * 8))
+            return;
+
+        mask[node / (sizeof(unsigned long) * 8)] |= 1ul << (node % (sizeof(unsigned long) * 8));
+
+        // failure is not an error; the pages just come from the default node
+        syscall(SYS_mbind, address, size, mode, mask, sizeof(mask) * 8, 0);
+#else
+        MANGO_UNREFERENCED_PARAMETER(address);
+        MANGO_UNREFERENCED_PARAMETER(size);
+        MANGO_UNREFERENCED_PARAMETER(node);
+#endif
+    }
+
+    static void* map_pages(size_t size, const AllocationPolicy& policy, size_t& mapped)
+    {
+        void* address = nullptr;
+
+#if defined(MAP_HUGETLB)
+        if (policy.pages == AllocationPolicy::PAGES_HUGE)
+        {
+            // fails when the system has no huge pages reserved
+            mapped = round_up(size, get_huge_page_size());
+            address = map_anonymous(mapped, MAP_HUGETLB);
+        }
+#endif
+
+        if (!address && policy.pages != AllocationPolicy::PAGES_DEFAULT)
+        {
+            // over-allocate and trim the mapping to huge page alignment so that
+            // the kernel can back it with transparent huge pages
+            const size_t huge_page_size = get_transparent_huge_page_size();
+            mapped = round_up(size, huge_page_size);
+
+            uint8* base = reinterpret_cast<uint8*>(map_anonymous(mapped + huge_page_size, 0));
+            if (!base)
+                return nullptr;
+
+            uint8* aligned = reinterpret_cast<uint8*>(round_up(reinterpret_cast<uintptr_t>(base), huge_page_size));
+            const size_t head = aligned - base;
+            const size_t tail = huge_page_size - head;
+
+            if (head)
+                munmap(base, head);
+            if (tail)
+                munmap(aligned + mapped, tail);
+
+            address = aligned;
+
+#if defined(MADV_HUGEPAGE)
+            madvise(address, mapped, MADV_HUGEPAGE);
+#endif
+        }
+
+        if (!address)
+        {
+            mapped = round_up(size, size_t(sysconf(_SC_PAGESIZE)));
+            address = map_anonymous(mapped, 0);
+            if (!address)
+                return nullptr;
+        }
+
+        if (policy.node >= 0)
+        {
+            bind_node(address, mapped, policy.node);
+        }
+
+        return address;
+    }
+
+    static void unmap_pages(void* address, size_t size)
+    {
+        munmap(address, size);
+    }
+
+#else
+
+    static void* map_pages(size_t size, const AllocationPolicy& policy, size_t& mapped)
+    {
+        MANGO_UNREFERENCED_PARAMETER(size);
+        MANGO_UNREFERENCED_PARAMETER(policy);
+        MANGO_UNREFERENCED_PARAMETER(mapped);
+        return nullptr;
+    }
+
+    static void unmap_pages(void* address, size_t size)
+    {
+        MANGO_UNREFERENCED_PARAMETER(address);
+        MANGO_UNREFERENCED_PARAMETER(size);
+    }
+
+#endif
+
+    void setAllocationPolicy(const AllocationPolicy& policy)
+    {
+        g_policy_pages = policy.pages;
+        g_policy_node = policy.node;
+        g_policy_threshold = policy.threshold;
+    }
+
+    AllocationPolicy getAllocationPolicy()
+    {
+        AllocationPolicy policy;
+        policy.pages = AllocationPolicy::Pages(g_policy_pages.load(std::memory_order_relaxed));
+        policy.node = g_policy_node.load(std::memory_order_relaxed);
+        policy.threshold = g_policy_threshold.load(std::memory_order_relaxed);
+        return policy;
+    }
+
+    void* aligned_malloc(size_t size, size_t alignment)
+    {
+        // fast path for the default policy
+        if (g_policy_pages.load(std::memory_order_relaxed) == AllocationPolicy::PAGES_DEFAULT &&
+            g_policy_node.load(std::memory_order_relaxed) < 0)
+        {
+            return heap_malloc(size, alignment);
+        }
+
+        return aligned_malloc(size, alignment, getAllocationPolicy());
+    }
+
+    void* aligned_malloc(size_t size, size_t alignment, const AllocationPolicy& policy)
+    {
+        const bool mapped = policy.pages != AllocationPolicy::PAGES_DEFAULT || policy.node >= 0;
+
+        // the mappings are page aligned which covers any sensible alignment
+        if (mapped && size >= policy.threshold && alignment <= 4096)
+        {
+            size_t mapped_size = 0;
+            if (void* address = map_pages(size, policy, mapped_size))
+            {
+                PageMappings& mappings = getPageMappings();
+                std::lock_guard<std::mutex> lock(mappings.mutex);
+                mappings.sizes[reinterpret_cast<uintptr_t>(address)] = mapped_size;
+                ++mappings.count;
+                return address;
+            }
+        }
+
+        return heap_malloc(size, alignment);
+    }
+
+    void aligned_free(void* aligned)
+    {
+        // mappings are page aligned; the heap allocations can be too
+        PageMappings& mappings = getPageMappings();
+
+        if (aligned && !(reinterpret_cast<uintptr_t>(aligned) & 4095) && mappings.count > 0)
+        {
+            std::unique_lock<std::mutex> lock(mappings.mutex);
+
+            auto i = mappings.sizes.find(reinterpret_cast<uintptr_t>(aligned));
+            if (i != mappings.sizes.end())
+            {
+                const size_t size = i->second;
+                mappings.sizes.erase(i);
+                --mappings.count;
+                lock.unlock();
+
+                unmap_pages(aligned, size);
+                return;
+            }
+        }
+
+        heap_free(aligned);
+    }
+
+    // -----------------------------------------------------------------------
+    // Arena
+    // -----------------------------------------------------------------------
+
+    namespace
+    {
+
+        // Chunks released by the arenas; bounded so that one huge decode doesn't
+        // pin its memory for the lifetime of the process.
+        class ArenaChunkCache
+        {
+        protected:
+            struct Chunk
+            {
+                uint8* address;
+                size_t size;
+            };
+
+            SpinLock m_lock;
+            std::vector<Chunk> m_chunks;
+            size_t m_bytes { 0 };
+            size_t m_limit { 8 * 1024 * 1024 };
+
+            // called with the lock held; returns the chunks to be freed
+            std::vector<Chunk> evict(size_t limit)
+            {
+                std::vector<Chunk> evicted;
+                while (m_bytes > limit)
+                {
+                    evicted.push_back(m_chunks.back());
+                    m_bytes -= m_chunks.back().size;
+                    m_chunks.pop_back();
+                }
+                return evicted;
+            }
+
+        public:
+            ~ArenaChunkCache()
+            {
+                for (auto& chunk : m_chunks)
+                {
+                    aligned_free(chunk.address);
+                }
+            }
+
+            uint8* acquire(size_t& size)
+            {
+                SpinLockGuard guard(m_lock);
+
+                // best fit which doesn't waste more than half of the chunk
+                size_t best = m_chunks.size();
+                for (size_t i = 0; i < m_chunks.size(); ++i)
+                {
+                    const size_t s = m_chunks[i].size;
+                    if (s >= size && s / 2 <= size && (best == m_chunks.size() || s < m_chunks[best].size))
+                    {
+                        best = i;
+                    }
+                }
+
+                if (best < m_chunks.size())
+                {
+                    Chunk chunk = m_chunks[best];
+                    m_chunks.erase(m_chunks.begin() + best);
+                    m_bytes -= chunk.size;
+                    size = chunk.size;
+                    return chunk.address;
+                }
+
+                guard.unlock();
+
+                uint8* address = reinterpret_cast<uint8*>(aligned_malloc(size, 64));
+                if (!address)
+                {
+                    MANGO_EXCEPTION("Arena: memory allocation failed.");
+                }
+
+                return address;
+            }
+
+            void release(uint8* address, size_t size)
+            {
+                SpinLockGuard guard(m_lock);
+
+                if (m_bytes + size <= m_limit)
+                {
+                    m_chunks.push_back({ address, size });
+                    m_bytes += size;
+                    return;
+                }
+
+                guard.unlock();
+                aligned_free(address);
+            }
+
+            void setLimit(size_t bytes)
+            {
+                SpinLockGuard guard(m_lock);
+                m_limit = bytes;
+                std::vector<Chunk> evicted = evict(bytes);
+                guard.unlock();
+
+                for (auto& chunk : evicted)
+                {
+                    aligned_free(chunk.address);
+                }
+            }
+
+            size_t getLimit()
+            {
+                SpinLockGuard guard(m_lock);
+                return m_limit;
+            }
+
+            void trim()
+            {
+                SpinLockGuard guard(m_lock);
+                std::vector<Chunk> evicted = evict(0);
+                guard.unlock();
+
+                for (auto& chunk : evicted)
+                {
+                    aligned_free(chunk.address);
+                }
+            }
+        };
+
+        ArenaChunkCache& getArenaChunkCache()
+        {
+            static ArenaChunkCache cache;
+            return cache;
+        }
+
+    } // namespace
+
+    void setArenaCacheLimit(size_t bytes)
+    {
+        getArenaChunkCache().setLimit(bytes);
+    }
+
+    size_t getArenaCacheLimit()
+    {
+        return getArenaChunkCache().getLimit();
+    }
+
+    void trimArenaCache()
+    {
+        getArenaChunkCache().trim();
+    }
+
+    Arena::Arena(size_t chunk_size)
+        : m_chunk_size(std::max(chunk_size, size_t(4096)))
+        , m_current(0)
+        , m_offset(0)
+    {
+        // the cache must outlive the arena
+        getArenaChunkCache();
+    }
+
+    Arena::~Arena()
+    {
+        ArenaChunkCache& cache = getArenaChunkCache();
+        for (auto& chunk : m_chunks)
+        {
+            cache.release(chunk.address, chunk.size);
+        }
+    }
+
+    void* Arena::allocate(size_t size, size_t alignment)
+    {
+        assert(u32_is_power_of_two(uint32(alignment)));
+
+        const uintptr_t mask = alignment - 1;
+
+        SpinLockGuard guard(m_lock);
+
+        for ( ; m_current < m_chunks.size(); ++m_current, m_offset = 0)
+        {
+            const Chunk& chunk = m_chunks[m_current];
+
+            const uintptr_t base = reinterpret_cast<uintptr_t>(chunk.address);
+            const uintptr_t aligned = (base + m_offset + mask) & ~mask;
+            const size_t offset = size_t(aligned - base);
+
+            if (offset + size <= chunk.size)
+            {
+                m_offset = offset + size;
+                return chunk.address + offset;
+            }
+        }
+
+        // allocations larger than the chunk size get a chunk of their own
+        Chunk chunk;
+        chunk.size = std::max(m_chunk_size, size + alignment);
+        chunk.address = getArenaChunkCache().acquire(chunk.size);
+        m_chunks.push_back(chunk);
+
+        m_current = m_chunks.size() - 1;
+
+        const uintptr_t base = reinterpret_cast<uintptr_t>(chunk.address);
+        const size_t offset = size_t(((base + mask) & ~mask) - base);
+
+        m_offset = offset + size;
+        return chunk.address + offset;
+    }
+
+    Arena::Marker Arena::marker() const
+    {
+        Marker marker;
+        marker.chunk = m_current;
+        marker.offset = m_offset;
+        return marker;
+    }
+
+    void Arena::rewind(const Marker& marker)
+    {
+        m_current = marker.chunk;
+        m_offset = marker.offset;
+    }
+
+    void Arena::reset()
+    {
+        m_current = 0;
+        m_offset = 0;
+    }
+
+    size_t Arena::capacity() const
+    {
+        size_t bytes = 0;
+        for (auto& chunk : m_chunks)
+        {
+            bytes += chunk.size;
+        }
+        return bytes;
+    }
+
 } // namespace mango
@@ -0,0 +1,389 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mutex>
+#include <memory>
+#include <mango/core/object_pool.hpp>
+#include <mango/core/bits.hpp>
+#include <mango/core/exception.hpp>
+
+namespace
+{
+    using namespace mango;
+
+    constexpr uint32 NO_MAGAZINE = 0xffffffff;
+
+    // ------------------------------------------------------------
+    // registry
+    // ------------------------------------------------------------
+
+    // Live pools; a thread which exits returns its magazines only to pools which
+    // are still alive. The registry is never destroyed because the thread caches
+    // can be released after the static destructors have been run.
+
+    struct PoolRegistry
+    {
+        std::mutex mutex;
+        std::vector<uint64> pools;
+        uint64 next_id { 1 };
+
+        bool alive(uint64 id) const
+        {
+            return std::find(pools.begin(), pools.end(), id) != pools.end();
+        }
+    };
+
+    PoolRegistry& getPoolRegistry()
+    {
+        static PoolRegistry* registry = new PoolRegistry();
+        return *registry;
+    }
+
+    // set when the calling thread's cache has been destroyed; the cache can't be
+    // used anymore but static destructors might still recycle objects
+    thread_local bool g_thread_cache_destroyed = false;
+
+} // namespace
+
+namespace mango
+{
+
+    // ------------------------------------------------------------
+    // ObjectPoolThreadCache
+    // ------------------------------------------------------------
+
+    struct ObjectPoolThreadCache
+    {
+        // the entries are not moved when the vector grows because the object
+        // constructors can register the thread to other pools meanwhile
+        std::vector<std::unique_ptr<ObjectPoolBase::ThreadEntry>> entries;
+
+        ObjectPoolBase::ThreadEntry* find(uint64 id)
+        {
+            for (auto& entry : entries)
+            {
+                if (entry->id == id)
+                    return entry.get();
+            }
+            return nullptr;
+        }
+
+        ~ObjectPoolThreadCache()
+        {
+            g_thread_cache_destroyed = true;
+
+            PoolRegistry& registry = getPoolRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            for (auto& entry : entries)
+            {
+                if (registry.alive(entry->id))
+                {
+                    entry->pool->restock(*entry);
+                }
+            }
+        }
+    };
+
+    static thread_local ObjectPoolThreadCache g_thread_cache;
+
+    // ------------------------------------------------------------
+    // ObjectPoolBase
+    // ------------------------------------------------------------
+
+    ObjectPoolBase::ObjectPoolBase()
+        : m_full(NO_MAGAZINE)
+        , m_empty(NO_MAGAZINE)
+        , m_magazine_count(0)
+    {
+        for (auto& chunk : m_chunks)
+        {
+            chunk = nullptr;
+        }
+
+        m_shared.id = 0;
+        m_shared.pool = this;
+        m_shared.loaded = nullptr;
+        m_shared.previous = nullptr;
+
+        PoolRegistry& registry = getPoolRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        m_id = registry.next_id++;
+        registry.pools.push_back(m_id);
+    }
+
+    ObjectPoolBase::~ObjectPoolBase()
+    {
+        {
+            PoolRegistry& registry = getPoolRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            registry.pools.erase(std::find(registry.pools.begin(), registry.pools.end(), m_id));
+        }
+
+        for (auto& chunk : m_chunks)
+        {
+            delete[] chunk.load();
+        }
+    }
+
+    ObjectPoolBase::Magazine* ObjectPoolBase::magazine(uint32 index) const
+    {
+        // chunk k holds the indices [16 * (2^k - 1), 16 * (2^(k+1) - 1))
+        const uint32 biased = index + 16;
+        const int chunk = u32_index_of_msb(biased) - 4;
+        return m_chunks[chunk].load(std::memory_order_acquire) + (biased - (16u << chunk));
+    }
+
+    ObjectPoolBase::Magazine* ObjectPoolBase::createMagazine()
+    {
+        // called with the grow lock held
+        const uint32 index = m_magazine_count;
+        const int chunk = u32_index_of_msb(index + 16) - 4;
+
+        if (chunk >= MAX_CHUNKS)
+        {
+            MANGO_EXCEPTION("ObjectPool: out of magazines.");
+        }
+
+        if (!m_chunks[chunk].load(std::memory_order_relaxed))
+        {
+            m_chunks[chunk].store(new Magazine[16u << chunk], std::memory_order_release);
+        }
+
+        ++m_magazine_count;
+
+        Magazine* result = magazine(index);
+        result->next = NO_MAGAZINE;
+        result->index = index;
+        result->count = 0;
+        return result;
+    }
+
+    void ObjectPoolBase::push(std::atomic<uint64>& head, Magazine* magazine)
+    {
+        uint64 current = head.load(std::memory_order_acquire);
+        for (;;)
+        {
+            magazine->next.store(uint32(current), std::memory_order_relaxed);
+            const uint64 desired = (((current >> 32) + 1) << 32) | magazine->index;
+            if (head.compare_exchange_weak(current, desired, std::memory_order_release, std::memory_order_acquire))
+                break;
+        }
+    }
+
+    ObjectPoolBase::Magazine* ObjectPoolBase::pop(std::atomic<uint64>& head)
+    {
+        uint64 current = head.load(std::memory_order_acquire);
+        for (;;)
+        {
+            const uint32 index = uint32(current);
+            if (index == NO_MAGAZINE)
+                return nullptr;
+
+            // the next link can be stale if someone else popped the magazine
+            // meanwhile but then the tag has changed and the exchange fails
+            Magazine* top = magazine(index);
+            const uint32 next = top->next.load(std::memory_order_relaxed);
+            const uint64 desired = (((current >> 32) + 1) << 32) | next;
+            if (head.compare_exchange_weak(current, desired, std::memory_order_acquire, std::memory_order_acquire))
+                return top;
+        }
+    }
+
+    ObjectPoolBase::Magazine* ObjectPoolBase::refill()
+    {
+        // the objects are constructed before taking the lock
+        std::vector<void*> objects;
+        grow(objects);
+
+        SpinLockGuard guard(m_grow_lock);
+
+        Magazine* current = nullptr;
+
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            if (!current || current->count == MAGAZINE_SIZE)
+            {
+                if (current)
+                {
+                    push(m_full, current);
+                }
+
+                current = pop(m_empty);
+                if (!current)
+                {
+                    current = createMagazine();
+                }
+            }
+
+            current->objects[current->count++] = objects[i];
+        }
+
+        return current;
+    }
+
+    ObjectPoolBase::Magazine* ObjectPoolBase::emptyMagazine()
+    {
+        Magazine* result = pop(m_empty);
+        if (!result)
+        {
+            SpinLockGuard guard(m_grow_lock);
+            result = createMagazine();
+        }
+        return result;
+    }
+
+    void* ObjectPoolBase::acquireFrom(ThreadEntry& entry)
+    {
+        Magazine* loaded = entry.loaded;
+        if (loaded->count)
+        {
+            return loaded->objects[--loaded->count];
+        }
+
+        if (entry.previous->count)
+        {
+            std::swap(entry.loaded, entry.previous);
+            loaded = entry.loaded;
+            return loaded->objects[--loaded->count];
+        }
+
+        // both magazines are empty: exchange one of them for a full one
+        Magazine* full = pop(m_full);
+        if (!full)
+        {
+            full = refill();
+        }
+
+        // the constructors called by refill() might have used the entry
+        push(entry.previous->count ? m_full : m_empty, entry.previous);
+        entry.previous = entry.loaded;
+        entry.loaded = full;
+
+        return full->objects[--full->count];
+    }
+
+    void ObjectPoolBase::discardTo(ThreadEntry& entry, void* object)
+    {
+        Magazine* loaded = entry.loaded;
+        if (loaded->count < MAGAZINE_SIZE)
+        {
+            loaded->objects[loaded->count++] = object;
+            return;
+        }
+
+        if (!entry.previous->count)
+        {
+            std::swap(entry.loaded, entry.previous);
+            loaded = entry.loaded;
+            loaded->objects[loaded->count++] = object;
+            return;
+        }
+
+        // both magazines have objects: hand one of them over to the depot
+        push(m_full, entry.previous);
+        entry.previous = entry.loaded;
+        entry.loaded = emptyMagazine();
+
+        loaded = entry.loaded;
+        loaded->objects[loaded->count++] = object;
+    }
+
+    void* ObjectPoolBase::acquireObject()
+    {
+        if (g_thread_cache_destroyed)
+        {
+            SpinLockGuard guard(m_shared_lock);
+            if (!m_shared.loaded)
+            {
+                m_shared.loaded = emptyMagazine();
+                m_shared.previous = emptyMagazine();
+            }
+            return acquireFrom(m_shared);
+        }
+
+        ThreadEntry* entry = g_thread_cache.find(m_id);
+        if (!entry)
+        {
+            entry = registerThread();
+        }
+
+        return acquireFrom(*entry);
+    }
+
+    void ObjectPoolBase::discardObject(void* object)
+    {
+        if (g_thread_cache_destroyed)
+        {
+            SpinLockGuard guard(m_shared_lock);
+            if (!m_shared.loaded)
+            {
+                m_shared.loaded = emptyMagazine();
+                m_shared.previous = emptyMagazine();
+            }
+            discardTo(m_shared, object);
+            return;
+        }
+
+        ThreadEntry* entry = g_thread_cache.find(m_id);
+        if (!entry)
+        {
+            entry = registerThread();
+        }
+
+        discardTo(*entry, object);
+    }
+
+    ObjectPoolBase::ThreadEntry* ObjectPoolBase::registerThread()
+    {
+        auto& entries = g_thread_cache.entries;
+
+        // forget the pools which have been destroyed
+        {
+            PoolRegistry& registry = getPoolRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [&] (const std::unique_ptr<ThreadEntry>& entry)
+            {
+                return !registry.alive(entry->id);
+            }), entries.end());
+        }
+
+        ThreadEntry* entry = new ThreadEntry();
+        entry->id = m_id;
+        entry->pool = this;
+        entry->loaded = emptyMagazine();
+        entry->previous = emptyMagazine();
+
+        entries.emplace_back(entry);
+        return entry;
+    }
+
+    void ObjectPoolBase::restock(ThreadEntry& entry)
+    {
+        push(entry.loaded->count ? m_full : m_empty, entry.loaded);
+        push(entry.previous->count ? m_full : m_empty, entry.previous);
+    }
+
+    void ObjectPoolBase::flush()
+    {
+        if (g_thread_cache_destroyed)
+            return;
+
+        auto& entries = g_thread_cache.entries;
+
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            if (entries[i]->id == m_id)
+            {
+                restock(*entries[i]);
+                entries.erase(entries.begin() + i);
+                break;
+            }
+        }
+    }
+
+} // namespace mango
@@ -505,21 +505,13 @@ namespace {
             state[2] += c;
             state[3] += d;
             state[4] += e;
+
+            block += 64;
         }
     }
 
-} // namespace
-
-namespace mango {
-
-    void sha1(uint32 hash[5], Memory memory)
+    BlockHashContext::Transform select_sha1_transform()
     {
-        hash[0] = 0x67452301;
-        hash[1] = 0xEFCDAB89;
-        hash[2] = 0x98BADCFE;
-        hash[3] = 0x10325476;
-        hash[4] = 0xC3D2E1F0;
-
         auto transform = generic_sha1_update;
 #if defined(__ARM_FEATURE_CRYPTO)
         if ((getCPUFlags() & CPU_ARM_SHA1) != 0)
@@ -532,41 +524,53 @@ namespace mango {
             transform = intel_sha1_update;
         }
 #endif
+        return transform;
+    }
 
-        const uint32 len = uint32(memory.size);
-        const uint8* message = memory.address;
+} // namespace
 
-        int block_count = len / 64;
-        transform(hash, message, block_count);
-        message += block_count * 64;
-        uint32 i = block_count * 64;
+namespace mango {
 
-        uint8 block[64];
-        uint32 rem = len - i;
-        memcpy(block, message + i, rem);
+    SHA1Context::SHA1Context()
+        : BlockHashContext(select_sha1_transform())
+    {
+        reset();
+    }
 
-        block[rem++] = 0x80;
-        if (64 - rem >= 8)
-        {
-            memset(block + rem, 0, 56 - rem);
-        }
-        else
-        {
-            memset(block + rem, 0, 64 - rem);
-            transform(hash, block, 1);
-            memset(block, 0, 56);
-        }
+    void SHA1Context::reset()
+    {
+        m_state[0] = 0x67452301;
+        m_state[1] = 0xEFCDAB89;
+        m_state[2] = 0x98BADCFE;
+        m_state[3] = 0x10325476;
+        m_state[4] = 0xC3D2E1F0;
+        m_size = 0;
+    }
 
-        ustore64be(block + 56, memory.size * 8);
-        transform(hash, block, 1);
+    void SHA1Context::final(uint32 hash[5])
+    {
+        finish(true);
 
 #ifdef MANGO_LITTLE_ENDIAN
-        hash[0] = byteswap(hash[0]);
-        hash[1] = byteswap(hash[1]);
-        hash[2] = byteswap(hash[2]);
-        hash[3] = byteswap(hash[3]);
-        hash[4] = byteswap(hash[4]);
+        hash[0] = byteswap(m_state[0]);
+        hash[1] = byteswap(m_state[1]);
+        hash[2] = byteswap(m_state[2]);
+        hash[3] = byteswap(m_state[3]);
+        hash[4] = byteswap(m_state[4]);
+#else
+        hash[0] = m_state[0];
+        hash[1] = m_state[1];
+        hash[2] = m_state[2];
+        hash[3] = m_state[3];
+        hash[4] = m_state[4];
 #endif
     }
 
+    void sha1(uint32 hash[5], Memory memory)
+    {
+        SHA1Context context;
+        context.update(memory);
+        context.final(hash);
+    }
+
 } // namespace mango
@@ -567,21 +567,8 @@ namespace {
         }
     }
 
-} // namespace
-
-namespace mango {
-
-    void sha2(uint32 hash[8], Memory memory)
+    BlockHashContext::Transform select_sha2_transform()
     {
-        hash[0] = 0x6a09e667;
-        hash[1] = 0xbb67ae85;
-        hash[2] = 0x3c6ef372;
-        hash[3] = 0xa54ff53a;
-        hash[4] = 0x510e527f;
-        hash[5] = 0x9b05688c;
-        hash[6] = 0x1f83d9ab;
-        hash[7] = 0x5be0cd19;
-
         auto transform = generic_sha2_transform;
 #if defined(__ARM_FEATURE_CRYPTO)
         if ((getCPUFlags() & CPU_ARM_SHA2) != 0)
@@ -594,39 +581,62 @@ namespace mango {
             transform = intel_sha2_transform;
         }
 #endif
+        return transform;
+    }
 
-        uint32 size = uint32(memory.size);
-        const uint8* data = memory.address;
+} // namespace
 
-        const int block_count = size / 64;
-        transform(hash, data, block_count);
-        data += block_count * 64;
-        size -= block_count * 64;
-        
-        uint8 buffer[64];
-        std::memcpy(buffer, data, size);
-        std::memset(buffer + size, 0, 64 - size);
-        buffer[size] = 0x80;
+namespace mango {
 
-        if (size >= 56)
-        {
-            transform(hash, buffer, 1);
-            std::memset(buffer, 0, 56);
-        }
+    SHA2Context::SHA2Context()
+        : BlockHashContext(select_sha2_transform())
+    {
+        reset();
+    }
+
+    void SHA2Context::reset()
+    {
+        m_state[0] = 0x6a09e667;
+        m_state[1] = 0xbb67ae85;
+        m_state[2] = 0x3c6ef372;
+        m_state[3] = 0xa54ff53a;
+        m_state[4] = 0x510e527f;
+        m_state[5] = 0x9b05688c;
+        m_state[6] = 0x1f83d9ab;
+        m_state[7] = 0x5be0cd19;
+        m_size = 0;
+    }
 
-        ustore64be(buffer + 56, memory.size * 8);
-        transform(hash, buffer, 1);
+    void SHA2Context::final(uint32 hash[8])
+    {
+        finish(true);
 
 #ifdef MANGO_LITTLE_ENDIAN
-        hash[0] = byteswap(hash[0]);
-        hash[1] = byteswap(hash[1]);
-        hash[2] = byteswap(hash[2]);
-        hash[3] = byteswap(hash[3]);
-        hash[4] = byteswap(hash[4]);
-        hash[5] = byteswap(hash[5]);
-        hash[6] = byteswap(hash[6]);
-        hash[7] = byteswap(hash[7]);
+        hash[0] = byteswap(m_state[0]);
+        hash[1] = byteswap(m_state[1]);
+        hash[2] = byteswap(m_state[2]);
+        hash[3] = byteswap(m_state[3]);
+        hash[4] = byteswap(m_state[4]);
+        hash[5] = byteswap(m_state[5]);
+        hash[6] = byteswap(m_state[6]);
+        hash[7] = byteswap(m_state[7]);
+#else
+        hash[0] = m_state[0];
+        hash[1] = m_state[1];
+        hash[2] = m_state[2];
+        hash[3] = m_state[3];
+        hash[4] = m_state[4];
+        hash[5] = m_state[5];
+        hash[6] = m_state[6];
+        hash[7] = m_state[7];
 #endif
     }
 
+    void sha2(uint32 hash[8], Memory memory)
+    {
+        SHA2Context context;
+        context.update(memory);
+        context.final(hash);
+    }
+
 } // namespace mango
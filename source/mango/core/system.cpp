@@ -60,6 +60,7 @@ namespace mango
         if (flags & CPU_NEON) info << "NEON ";
         if (flags & CPU_AES) info << "AES ";
         if (flags & CPU_CLMUL) info << "CLMUL ";
+        if (flags & CPU_VPCLMULQDQ) info << "VPCLMULQDQ ";
         if (flags & CPU_FMA3) info << "FMA3 ";
         if (flags & CPU_MOVBE) info << "MOVBE ";
         if (flags & CPU_POPCNT) info << "POPCNT ";
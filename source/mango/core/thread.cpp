@@ -3,12 +3,27 @@
     Copyright (C) 2012-2016 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
 #include <mango/core/thread.hpp>
-#include "../../external/concurrentqueue/concurrentqueue.h"
+#include <mango/core/memory.hpp>
+#include <mango/core/cpuinfo.hpp>
+#include <mango/core/bits.hpp>
 
 using std::chrono::high_resolution_clock;
-using std::chrono::duration_cast;
 using std::chrono::milliseconds;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+
+#if defined(MANGO_PLATFORM_LINUX)
+
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#endif
 
 // ------------------------------------------------------------
 // thread affinity
@@ -18,239 +33,1257 @@ using std::chrono::milliseconds;
 
 #include <pthread.h>
 
-    template <typename H>
-    static void set_thread_affinity(H handle, int processor)
+    static void set_current_thread_affinity(const std::vector<int>& processors)
     {
         cpu_set_t cpuset;
 
         CPU_ZERO(&cpuset);
-        CPU_SET(processor, &cpuset);
-        pthread_setaffinity_np(handle, sizeof(cpu_set_t), &cpuset);
+        for (int processor : processors)
+        {
+            CPU_SET(processor, &cpuset);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
     }
 
-    static void set_current_thread_affinity(int processor)
+#elif defined(MANGO_PLATFORM_WINDOWS)
+
+    static void set_current_thread_affinity(const std::vector<int>& processors)
     {
-        set_thread_affinity(pthread_self(), processor);
+        DWORD_PTR mask = 0;
+        for (int processor : processors)
+        {
+            if (processor < int(sizeof(DWORD_PTR) * 8))
+                mask |= DWORD_PTR(1) << processor;
+        }
+        SetThreadAffinityMask(GetCurrentThread(), mask);
     }
 
-#elif defined(MANGO_PLATFORM_WINDOWS)
+#else
+
+    // TODO: IOS, OSX, ANDROID
+
+    static void set_current_thread_affinity(const std::vector<int>& processors)
+    {
+        MANGO_UNREFERENCED_PARAMETER(processors);
+    }
+
+#endif
+
+namespace mango
+{
+
+    // ------------------------------------------------------------
+    // EventCount
+    // ------------------------------------------------------------
 
-    template <typename H>
-    static void set_thread_affinity(H handle, int processor)
+    EventCount::Key EventCount::prepareWait()
     {
-        SetThreadAffinityMask(handle, DWORD_PTR(1) << processor);
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_epoch.load(std::memory_order_acquire);
     }
 
-    static void set_current_thread_affinity(int processor)
+    void EventCount::cancelWait()
     {
-        set_thread_affinity(GetCurrentThread(), processor);
+        m_waiters.fetch_sub(1, std::memory_order_seq_cst);
     }
 
-#else
+    void EventCount::notify()
+    {
+        // pairs with the fence in prepareWait(): either we see the waiter or
+        // the waiter sees the state we changed before notifying
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!m_waiters.load(std::memory_order_relaxed))
+            return;
+
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        wake(false);
+    }
 
-    // TODO: IOS, OSX, ANDROID
+    void EventCount::notifyAll()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!m_waiters.load(std::memory_order_relaxed))
+            return;
+
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        wake(true);
+    }
 
-    template <typename H>
-    static void set_thread_affinity(H handle, int processor)
+#if defined(MANGO_PLATFORM_LINUX)
+
+    static_assert(sizeof(std::atomic<uint32>) == sizeof(int), "futex requires 32 bit atomic.");
+
+    void EventCount::wait(Key key)
+    {
+        int* address = reinterpret_cast<int*>(&m_epoch);
+
+        while (m_epoch.load(std::memory_order_acquire) == key)
+        {
+            // returns immediately if the epoch has already changed
+            syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, int(key), nullptr, nullptr, 0);
+        }
+
+        m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    void EventCount::wake(bool all)
+    {
+        int* address = reinterpret_cast<int*>(&m_epoch);
+        syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+    }
+
+#else
+
+    void EventCount::wait(Key key)
     {
-        MANGO_UNREFERENCED_PARAMETER(handle);
-        MANGO_UNREFERENCED_PARAMETER(processor);
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (m_epoch.load(std::memory_order_acquire) == key)
+        {
+            m_condition.wait(lock);
+        }
+
+        lock.unlock();
+        m_waiters.fetch_sub(1, std::memory_order_seq_cst);
     }
 
-    static void set_current_thread_affinity(int processor)
+    void EventCount::wake(bool all)
     {
-        MANGO_UNREFERENCED_PARAMETER(processor);
+        {
+            // the waiter checks the epoch while holding the mutex
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+
+        if (all)
+            m_condition.notify_all();
+        else
+            m_condition.notify_one();
     }
 
 #endif
 
-// MinGW usually uses winpthreads as std::thread backend, so we need
-// to convert winpthreads' pthread_t to Win32 HANDLE.
-#if defined(__WINPTHREADS_VERSION)
+    // ------------------------------------------------------------
+    // TaskFunction storage
+    // ------------------------------------------------------------
+
+    namespace
+    {
+        struct TaskStorageBlock
+        {
+            alignas(std::max_align_t) unsigned char data[TASK_STORAGE_BLOCK_SIZE];
+        };
 
-#include <pthread.h>
+        ObjectPool<TaskStorageBlock>& getTaskStorageCache()
+        {
+            static ObjectPool<TaskStorageBlock> cache(64);
+            return cache;
+        }
+    }
 
-    static auto get_native_handle(std::thread& t)
+    void* allocateTaskStorage(size_t size, size_t alignment)
     {
-        // Note: this function is documented as private.
-        return pthread_gethandle(t.native_handle());
+        if (alignment > alignof(std::max_align_t))
+        {
+            void* storage = aligned_malloc(size, alignment);
+            if (!storage)
+                throw std::bad_alloc();
+            return storage;
+        }
+
+        if (size > TASK_STORAGE_BLOCK_SIZE)
+            return ::operator new (size);
+
+        return getTaskStorageCache().acquire();
     }
 
-#else
+    void freeTaskStorage(void* storage, size_t size, size_t alignment)
+    {
+        if (alignment > alignof(std::max_align_t))
+        {
+            aligned_free(storage);
+            return;
+        }
+
+        if (size > TASK_STORAGE_BLOCK_SIZE)
+        {
+            ::operator delete (storage);
+            return;
+        }
+
+        getTaskStorageCache().discard(reinterpret_cast<TaskStorageBlock*>(storage));
+    }
+
+    // ------------------------------------------------------------
+    // TaskDeque
+    // ------------------------------------------------------------
+
+    // Chase-Lev work-stealing deque ("Dynamic Circular Work-Stealing Deque",
+    // with the memory orderings of Le et al. for weak memory models). Only the
+    // owning worker pushes and pops at the bottom, so the most recently created
+    // task runs next while its data is still in the cache; the thieves take the
+    // oldest task from the top. The ring holds pointers to pooled tasks as a
+    // thief reads the slot before it knows whether it won the race for it.
+    // The ordering of the SerialQueue and barrier() tasks doesn't depend on the
+    // deque as the blocked tasks are parked with their queue.
+
+    class TaskDeque
+    {
+    protected:
+        using Task = ThreadPool::Task;
+
+        struct Ring
+        {
+            int64 mask;
+            std::unique_ptr<std::atomic<Task*>[]> slots;
+
+            Ring(int64 capacity)
+                : mask(capacity - 1)
+                , slots(new std::atomic<Task*>[size_t(capacity)])
+            {
+            }
+
+            std::atomic<Task*>& operator [] (int64 index) const
+            {
+                return slots[size_t(index & mask)];
+            }
+        };
+
+        alignas(64) std::atomic<int64> m_top { 0 };
+        alignas(64) std::atomic<int64> m_bottom { 0 };
+        std::atomic<Ring*> m_ring;
+
+        // the replaced rings are kept until the deque is destroyed as a thief
+        // can still be reading from them; only the owner touches this
+        std::vector<std::unique_ptr<Ring>> m_rings;
+
+        static bool release(Task* node, Task& task)
+        {
+            task = std::move(*node);
+            getTaskCache().discard(node);
+            return true;
+        }
+
+        Ring* grow(Ring* ring, int64 top, int64 bottom)
+        {
+            Ring* larger = new Ring((ring->mask + 1) * 2);
+            for (int64 i = top; i < bottom; ++i)
+            {
+                (*larger)[i].store((*ring)[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+
+            m_rings.emplace_back(larger);
+            m_ring.store(larger, std::memory_order_release);
+            return larger;
+        }
+
+    public:
+        // the inboxes link their tasks in nodes from the same pool
+        static ObjectPool<Task>& getTaskCache()
+        {
+            // never destroyed as the deques of the instance() pool outlive the static destructors;
+            // the pool is over-aligned, which operator new doesn't respect before C++17
+            static ObjectPool<Task>* cache = new (aligned_malloc(sizeof(ObjectPool<Task>), alignof(ObjectPool<Task>))) ObjectPool<Task>(256);
+            return *cache;
+        }
+
+        TaskDeque()
+        {
+            m_rings.emplace_back(new Ring(64));
+            m_ring.store(m_rings.back().get(), std::memory_order_relaxed);
+        }
+
+        ~TaskDeque()
+        {
+            Task task;
+            while (pop(task))
+            {
+            }
+        }
+
+        bool empty() const
+        {
+            const int64 bottom = m_bottom.load(std::memory_order_relaxed);
+            const int64 top = m_top.load(std::memory_order_relaxed);
+            return bottom <= top;
+        }
+
+        // owner only
+        void push(Task&& task)
+        {
+            Task* node = getTaskCache().acquire();
+            *node = std::move(task);
+
+            const int64 bottom = m_bottom.load(std::memory_order_relaxed);
+            const int64 top = m_top.load(std::memory_order_acquire);
+            Ring* ring = m_ring.load(std::memory_order_relaxed);
+
+            if (bottom - top > ring->mask)
+            {
+                ring = grow(ring, top, bottom);
+            }
+
+            (*ring)[bottom].store(node, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        // owner only; takes the newest task
+        bool pop(Task& task)
+        {
+            const int64 bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+            Ring* ring = m_ring.load(std::memory_order_relaxed);
+            m_bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64 top = m_top.load(std::memory_order_relaxed);
+
+            if (top > bottom)
+            {
+                // empty
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            Task* node = (*ring)[bottom].load(std::memory_order_relaxed);
+            if (top == bottom)
+            {
+                // the last task; race against the thieves for it
+                const bool won = m_top.compare_exchange_strong(top, top + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed);
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                if (!won)
+                    return false;
+            }
+
+            return release(node, task);
+        }
+
+        // any thread; takes the oldest task
+        bool steal(Task& task)
+        {
+            int64 top = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64 bottom = m_bottom.load(std::memory_order_acquire);
+
+            if (top >= bottom)
+                return false;
+
+            Ring* ring = m_ring.load(std::memory_order_acquire);
+            Task* node = (*ring)[top].load(std::memory_order_relaxed);
+
+            if (!m_top.compare_exchange_strong(top, top + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                // lost the race to the owner or another thief
+                return false;
+            }
+
+            return release(node, task);
+        }
+    };
+
+    // Tasks submitted to a worker by the other threads; the deque can only be
+    // pushed by its owner. The owner drains its inbox after its own deque and
+    // the thieves take from it too so a busy worker doesn't hold the tasks.
+    // The tasks are linked in pooled nodes like in the deques so submitting
+    // from outside the pool doesn't allocate either.
+
+    class TaskInbox
+    {
+    protected:
+        using Task = ThreadPool::Task;
+
+        SpinLock m_lock;
+        Task* m_head { nullptr };
+        Task* m_tail { nullptr };
+        std::atomic<size_t> m_size { 0 };
+
+    public:
+        ~TaskInbox()
+        {
+            Task task;
+            while (pop(task))
+            {
+            }
+        }
+
+        bool empty() const
+        {
+            return m_size.load(std::memory_order_relaxed) == 0;
+        }
+
+        void push(Task&& task)
+        {
+            Task* node = TaskDeque::getTaskCache().acquire();
+            *node = std::move(task);
+            node->next = nullptr;
+
+            SpinLockGuard guard(m_lock);
+
+            if (m_tail)
+                m_tail->next = node;
+            else
+                m_head = node;
+
+            m_tail = node;
+            m_size.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bool pop(Task& task)
+        {
+            if (empty())
+                return false;
+
+            Task* node;
+
+            {
+                SpinLockGuard guard(m_lock);
+
+                node = m_head;
+                if (!node)
+                    return false;
+
+                m_head = node->next;
+                if (!m_head)
+                    m_tail = nullptr;
+
+                m_size.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            task = std::move(*node);
+            TaskDeque::getTaskCache().discard(node);
+
+            return true;
+        }
+    };
+
+    struct alignas(64) WorkerQueue
+    {
+        TaskDeque deques[3];
+        TaskInbox inboxes[3];
+    };
+
+    // identity of the worker thread running the current code; used to route
+    // tasks enqueued from inside a task into the worker's own deque
+    struct WorkerContext
+    {
+        ThreadPool* pool;
+        size_t index;
+    };
+
+    static thread_local WorkerContext g_worker_context = { nullptr, 0 };
+
+    // ------------------------------------------------------------
+    // statistics
+    // ------------------------------------------------------------
+
+    namespace
+    {
+
+        constexpr int STATISTICS_SLOTS = ThreadPoolStatistics::QUEUES;
+        constexpr int HISTOGRAM_BUCKETS = ThreadPoolStatistics::Histogram::BUCKETS;
+
+        inline uint64 now_ns()
+        {
+            return std::chrono::duration_cast<nanoseconds>(high_resolution_clock::now().time_since_epoch()).count();
+        }
+
+        inline int histogram_bucket(uint64 ns)
+        {
+            const uint64 us = ns / 1000;
+            const int bucket = us ? u64_index_of_msb(us) + 1 : 0;
+            return std::min(bucket, HISTOGRAM_BUCKETS - 1);
+        }
+
+        inline void increment(std::atomic<uint64>& counter, uint64 value = 1)
+        {
+            counter.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        inline uint64 load(const std::atomic<uint64>& counter)
+        {
+            return counter.load(std::memory_order_relaxed);
+        }
+
+    } // namespace
+
+    struct QueueCounters
+    {
+        std::atomic<uint64> enqueued;
+        std::atomic<uint64> completed;
+        std::atomic<uint64> latency[HISTOGRAM_BUCKETS];
+        std::atomic<uint64> runtime[HISTOGRAM_BUCKETS];
+    };
+
+    // the counters are written by the owning thread only (except the shared set)
+    // so the cache lines stay local until someone asks for the statistics
+    struct alignas(64) WorkerCounters
+    {
+        std::atomic<uint64> tasks;
+        std::atomic<uint64> steals;
+        std::atomic<uint64> busy; // nanoseconds
+        std::atomic<uint64> idle; // nanoseconds
+        std::atomic<uint64> sleep; // nanoseconds
+        QueueCounters queues[STATISTICS_SLOTS];
+
+        WorkerCounters()
+        {
+            tasks = 0;
+            steals = 0;
+            busy = 0;
+            idle = 0;
+            sleep = 0;
+
+            for (auto& queue : queues)
+            {
+                queue.enqueued = 0;
+                queue.completed = 0;
+
+                for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+                {
+                    queue.latency[i] = 0;
+                    queue.runtime[i] = 0;
+                }
+            }
+        }
+    };
+
+    uint64 ThreadPoolStatistics::Histogram::total() const
+    {
+        uint64 sum = 0;
+        for (int i = 0; i < BUCKETS; ++i)
+        {
+            sum += count[i];
+        }
+        return sum;
+    }
+
+    uint64 ThreadPoolStatistics::Histogram::percentile(double fraction) const
+    {
+        const uint64 sum = total();
+        if (!sum)
+            return 0;
+
+        const double limit = std::min(std::max(fraction, 0.0), 1.0) * double(sum);
+
+        uint64 accumulated = 0;
+        int bucket = 0;
+        for ( ; bucket < BUCKETS - 1; ++bucket)
+        {
+            accumulated += count[bucket];
+            if (accumulated > 0 && double(accumulated) >= limit)
+                break;
+        }
+
+        return uint64(1) << bucket;
+    }
+
+    // ------------------------------------------------------------
+    // ThreadPoolConfig
+    // ------------------------------------------------------------
+
+    ThreadPoolConfig ThreadPoolConfig::fromEnvironment()
+    {
+        ThreadPoolConfig config;
+
+        if (const char* size = std::getenv("MANGO_THREADPOOL_SIZE"))
+        {
+            config.threads = size_t(std::max(0, std::atoi(size)));
+        }
+
+        if (const char* cpus = std::getenv("MANGO_THREADPOOL_CPUS"))
+        {
+            config.processors = parseCPUList(cpus);
+        }
+
+        if (const char* affinity = std::getenv("MANGO_THREADPOOL_AFFINITY"))
+        {
+            config.affinity = std::atoi(affinity) != 0;
+        }
+
+        if (const char* spin = std::getenv("MANGO_THREADPOOL_SPIN"))
+        {
+            config.spin = std::atoi(spin);
+        }
+
+        if (const char* statistics = std::getenv("MANGO_THREADPOOL_STATISTICS"))
+        {
+            config.statistics = std::atoi(statistics) != 0;
+        }
+
+        return config;
+    }
+
+    // ------------------------------------------------------------
+    // ThreadPool
+    // ------------------------------------------------------------
+
+    static ThreadPoolConfig make_config(size_t size)
+    {
+        ThreadPoolConfig config;
+        config.threads = std::max(size, size_t(1));
+        return config;
+    }
+
+    ThreadPool::ThreadPool(size_t size)
+        : ThreadPool(make_config(size))
+    {
+    }
+
+    ThreadPool::ThreadPool(const ThreadPoolConfig& config)
+        : m_queue_cache(32)
+        , m_worker_queues(nullptr)
+        , m_worker_count(0)
+        , m_counters(nullptr)
+        , m_statistics(config.statistics)
+    {
+        // the storage cache must outlive the pool as tasks might still be in flight
+        getTaskStorageCache();
+
+        const CPUTopology& topology = getCPUTopology();
+
+        // resolve the processor set
+        std::vector<CPUTopology::Processor> processors;
+        for (int id : config.processors)
+        {
+            if (const CPUTopology::Processor* processor = topology.find(id))
+            {
+                processors.push_back(*processor);
+            }
+        }
+
+        const bool restricted = !processors.empty();
+        if (!restricted)
+        {
+            processors = topology.processors;
+        }
+
+        const size_t size = config.threads ? config.threads :
+            std::max(processors.size(), size_t(2)) - 1;
+
+        m_worker_count = size;
+        m_spin_budget = std::max(0, config.spin);
+
+        if (config.affinity)
+        {
+            // one worker per physical core first, then the SMT siblings; the
+            // processors sharing a cache or node are kept next to each other
+            std::vector<std::pair<int, CPUTopology::Processor>> order;
+            for (auto& processor : processors)
+            {
+                int sibling = 0;
+                for (auto& other : order)
+                {
+                    if (other.second.core == processor.core)
+                        ++sibling;
+                }
+                order.emplace_back(sibling, processor);
+            }
+
+            std::stable_sort(order.begin(), order.end(), [] (const std::pair<int, CPUTopology::Processor>& a,
+                                                             const std::pair<int, CPUTopology::Processor>& b)
+            {
+                if (a.first != b.first) return a.first < b.first;
+                if (a.second.node != b.second.node) return a.second.node < b.second.node;
+                if (a.second.cache != b.second.cache) return a.second.cache < b.second.cache;
+                return a.second.core < b.second.core;
+            });
+
+            for (size_t i = 0; i < order.size(); ++i)
+            {
+                processors[i] = order[i].second;
+            }
+        }
+
+        m_workers.resize(m_worker_count);
+
+        for (size_t i = 0; i < m_worker_count; ++i)
+        {
+            Worker& worker = m_workers[i];
+
+            if (config.affinity)
+            {
+                const CPUTopology::Processor& processor = processors[i % processors.size()];
+                worker.processors.push_back(processor.id);
+                worker.node = processor.node;
+                worker.cache = processor.cache;
+            }
+            else if (restricted)
+            {
+                // the workers float inside the processor set
+                for (auto& processor : processors)
+                {
+                    worker.processors.push_back(processor.id);
+                }
+
+                worker.node = processors[0].node;
+                worker.cache = processors[0].cache;
+
+                for (auto& processor : processors)
+                {
+                    if (processor.node != worker.node)
+                        worker.node = -1;
+                    if (processor.cache != worker.cache)
+                        worker.cache = -1;
+                }
+            }
+
+            if (worker.node >= 0)
+            {
+                if (m_node_workers.size() <= size_t(worker.node))
+                {
+                    m_node_workers.resize(worker.node + 1);
+                }
+                m_node_workers[worker.node].push_back(i);
+            }
+        }
+
+        // steal order: workers sharing the cache first, then the node, then the rest
+        for (size_t i = 0; i < m_worker_count; ++i)
+        {
+            Worker& worker = m_workers[i];
+
+            auto distance = [&] (size_t index) -> int
+            {
+                const Worker& victim = m_workers[index];
+                if (worker.cache >= 0 && victim.cache == worker.cache) return 0;
+                if (worker.node >= 0 && victim.node == worker.node) return 1;
+                return 2;
+            };
+
+            for (size_t j = 1; j < m_worker_count; ++j)
+            {
+                worker.victims.push_back((i + j) % m_worker_count);
+            }
+
+            std::stable_sort(worker.victims.begin(), worker.victims.end(), [&] (size_t a, size_t b)
+            {
+                return distance(a) < distance(b);
+            });
+        }
+
+        // over-aligned type; new[] does not respect the alignment before C++17
+        void* storage = aligned_malloc(sizeof(WorkerQueue) * m_worker_count, alignof(WorkerQueue));
+        m_worker_queues = reinterpret_cast<WorkerQueue*>(storage);
+        for (size_t i = 0; i < m_worker_count; ++i)
+        {
+            new (m_worker_queues + i) WorkerQueue();
+        }
+
+        storage = aligned_malloc(sizeof(WorkerCounters) * (m_worker_count + 1), alignof(WorkerCounters));
+        m_counters = reinterpret_cast<WorkerCounters*>(storage);
+        for (size_t i = 0; i <= m_worker_count; ++i)
+        {
+            new (m_counters + i) WorkerCounters();
+        }
+
+        m_static_queue = createQueue("static", static_cast<int>(Priority::NORMAL));
+
+        m_threads.resize(m_worker_count);
+
+        for (size_t i = 0; i < m_worker_count; ++i)
+        {
+            m_threads[i] = std::thread([this, i] {
+                if (!m_workers[i].processors.empty())
+                {
+                    set_current_thread_affinity(m_workers[i].processors);
+                }
+
+                thread(i);
+            });
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        m_stop = true;
+        m_event.notifyAll();
+
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+
+        deleteQueue(m_static_queue);
+
+        for (size_t i = 0; i < m_worker_count; ++i)
+        {
+            m_worker_queues[i].~WorkerQueue();
+        }
+        aligned_free(m_worker_queues);
+
+        for (size_t i = 0; i <= m_worker_count; ++i)
+        {
+            m_counters[i].~WorkerCounters();
+        }
+        aligned_free(m_counters);
+    }
+
+    static std::atomic<bool> g_instance_created { false };
+
+    static ThreadPoolConfig& get_instance_config()
+    {
+        static ThreadPoolConfig config = ThreadPoolConfig::fromEnvironment();
+        return config;
+    }
+
+    static ThreadPoolConfig create_instance_config()
+    {
+        g_instance_created = true;
+        return get_instance_config();
+    }
+
+    void ThreadPool::configureInstance(const ThreadPoolConfig& config)
+    {
+        if (g_instance_created)
+        {
+            MANGO_EXCEPTION("ThreadPool instance has already been created.");
+        }
+
+        get_instance_config() = config;
+    }
+
+    ThreadPool& ThreadPool::getInstance()
+    {
+        static ThreadPool instance(create_instance_config());
+        return instance;
+    }
+
+    int ThreadPool::getInstanceSize()
+    {
+        ThreadPool& pool = getInstance();
+        return pool.size();
+    }
+
+    int ThreadPool::size() const
+    {
+        return int(m_threads.size());
+    }
+
+    void ThreadPool::setSpinBudget(int microseconds)
+    {
+        m_spin_budget = std::max(0, microseconds);
+    }
+
+    int ThreadPool::getSpinBudget() const
+    {
+        return m_spin_budget;
+    }
+
+    ThreadPoolStatistics ThreadPool::getStatistics() const
+    {
+        ThreadPoolStatistics statistics;
+
+        std::vector<std::string> names;
+        {
+            SpinLockGuard guard(m_slot_lock);
+            names = m_slot_names;
+        }
+
+        for (size_t slot = 0; slot < names.size(); ++slot)
+        {
+            ThreadPoolStatistics::Queue queue;
+
+            queue.name = names[slot];
+            queue.enqueued = 0;
+            queue.completed = 0;
+            std::fill_n(queue.latency.count, HISTOGRAM_BUCKETS, 0);
+            std::fill_n(queue.runtime.count, HISTOGRAM_BUCKETS, 0);
+
+            // completions first so that the depth can't go negative
+            for (size_t i = 0; i <= m_worker_count; ++i)
+            {
+                queue.completed += load(m_counters[i].queues[slot].completed);
+            }
+
+            for (size_t i = 0; i <= m_worker_count; ++i)
+            {
+                const QueueCounters& counters = m_counters[i].queues[slot];
+
+                queue.enqueued += load(counters.enqueued);
+
+                for (int j = 0; j < HISTOGRAM_BUCKETS; ++j)
+                {
+                    queue.latency.count[j] += load(counters.latency[j]);
+                    queue.runtime.count[j] += load(counters.runtime[j]);
+                }
+            }
+
+            queue.depth = queue.enqueued > queue.completed ? queue.enqueued - queue.completed : 0;
+
+            statistics.queues.push_back(queue);
+        }
+
+        auto getWorker = [] (const WorkerCounters& counters)
+        {
+            ThreadPoolStatistics::Worker worker;
+
+            worker.tasks = load(counters.tasks);
+            worker.steals = load(counters.steals);
+            worker.busy = load(counters.busy) / 1000;
+            worker.idle = load(counters.idle) / 1000;
+            worker.sleep = load(counters.sleep) / 1000;
+
+            return worker;
+        };
+
+        for (size_t i = 0; i < m_worker_count; ++i)
+        {
+            statistics.workers.push_back(getWorker(m_counters[i]));
+        }
+
+        // the last set of counters is shared by the other threads
+        statistics.external = getWorker(m_counters[m_worker_count]);
+
+        return statistics;
+    }
+
+    void ThreadPool::thread(size_t threadID)
+    {
+        g_worker_context.pool = this;
+        g_worker_context.index = threadID;
+
+        while (!m_stop.load(std::memory_order_relaxed))
+        {
+            if (dequeue_process())
+                continue;
+
+            // don't be too eager to sleep; the next task of a burst is usually close
+            if (spin())
+                continue;
+
+            EventCount::Key key = m_event.prepareWait();
+
+            // re-check after announcing the wait; a concurrent submit() either
+            // notices the waiter or we notice the task it pushed
+            if (m_stop.load() || !idle())
+            {
+                m_event.cancelWait();
+                continue;
+            }
+
+            if (m_statistics)
+            {
+                const uint64 start = now_ns();
+                m_event.wait(key);
+                increment(m_counters[threadID].sleep, now_ns() - start);
+            }
+            else
+            {
+                m_event.wait(key);
+            }
+
+            // look for the work as a spinner so that finding it wakes the next
+            // worker; a burst of tasks ramps up the workers one by one
+            spin();
+        }
+
+        g_worker_context.pool = nullptr;
+    }
+
+    bool ThreadPool::spin()
+    {
+        const int budget = m_spin_budget.load(std::memory_order_relaxed);
+        if (budget <= 0)
+            return false;
+
+        auto start = high_resolution_clock::now();
+        auto deadline = start + microseconds(budget);
+
+        // time spent looking for tasks
+        auto measure = [&] ()
+        {
+            if (m_statistics)
+            {
+                const uint64 idle = std::chrono::duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+                increment(counters().idle, idle);
+            }
+        };
+
+        // submit() doesn't wake a sleeping worker while a spinning one is
+        // going to pick up the task
+        m_spinning.fetch_add(1, std::memory_order_seq_cst);
+
+        do
+        {
+            std::this_thread::yield();
+
+            Task task;
+            if (dequeue(task))
+            {
+                // the last spinner hands the role over to a sleeping worker if
+                // more work is waiting, as the submits didn't wake anyone
+                if (m_spinning.fetch_sub(1, std::memory_order_seq_cst) == 1 && !idle())
+                {
+                    m_event.notify();
+                }
+
+                measure();
+                process(task);
+                return true;
+            }
+        }
+        while (high_resolution_clock::now() < deadline && !m_stop.load(std::memory_order_relaxed));
+
+        // pairs with the fence in submit(): the caller re-checks the deques
+        // before it sleeps so a task pushed while we were counted is seen
+        m_spinning.fetch_sub(1, std::memory_order_seq_cst);
+
+        measure();
+        return false;
+    }
+
+    bool ThreadPool::idle() const
+    {
+        for (size_t i = 0; i < m_worker_count; ++i)
+        {
+            for (int priority = 0; priority < 3; ++priority)
+            {
+                if (!m_worker_queues[i].deques[priority].empty() ||
+                    !m_worker_queues[i].inboxes[priority].empty())
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    void ThreadPool::enqueue(Queue* queue, TaskFunction&& func)
+    {
+        queue->retain();
+
+        Task task;
+        task.queue = queue;
+        task.stamp = queue->task_input_count++;
+        task.barrier = queue->stamp_barrier;
+        task.time = m_statistics ? now_ns() : 0;
+        task.func = std::move(func);
+
+        increment(counters().queues[queue->slot].enqueued);
+
+        submit(std::move(task));
+    }
+
+    void ThreadPool::submit(Task&& task)
+    {
+        size_t index;
+
+        const int node = task.queue->node;
+        const bool local = node >= 0 && size_t(node) < m_node_workers.size() && !m_node_workers[node].empty();
+
+        if (g_worker_context.pool == this && (!local || m_workers[g_worker_context.index].node == node))
+        {
+            // fast path: keep the task on the worker which created it
+            index = g_worker_context.index;
+        }
+        else if (local)
+        {
+            // the queue prefers the workers on a specific NUMA node
+            const std::vector<size_t>& workers = m_node_workers[node];
+            index = workers[m_submit_index.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+        }
+        else
+        {
+            // external threads distribute the tasks among the workers
+            index = m_submit_index.fetch_add(1, std::memory_order_relaxed) % m_worker_count;
+        }
+
+        const int priority = task.queue->priority;
+        if (g_worker_context.pool == this && g_worker_context.index == index)
+            m_worker_queues[index].deques[priority].push(std::move(task));
+        else
+            m_worker_queues[index].inboxes[priority].push(std::move(task));
+
+        // a spinning worker picks up the task without the cost of a wake; the
+        // fence pairs with the one in the spinner's prepareWait()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_spinning.load(std::memory_order_relaxed) > 0)
+            return;
+
+        m_event.notify();
+    }
 
-    static auto get_native_handle(std::thread& t)
+    bool ThreadPool::dequeue(Task& task)
     {
-        return t.native_handle();
-    }
+        const bool worker = g_worker_context.pool == this;
+        const size_t self = worker ? g_worker_context.index : m_worker_count;
 
-#endif
+        // scan task queues in priority order
+        for (size_t priority = 0; priority < 3; ++priority)
+        {
+            if (worker)
+            {
+                // local deque first, then steal from the nearest workers
+                if (m_worker_queues[self].deques[priority].pop(task) ||
+                    m_worker_queues[self].inboxes[priority].pop(task))
+                    return true;
 
-namespace mango
-{
+                for (size_t victim : m_workers[self].victims)
+                {
+                    if (m_worker_queues[victim].deques[priority].steal(task) ||
+                        m_worker_queues[victim].inboxes[priority].pop(task))
+                    {
+                        increment(m_counters[self].steals);
+                        return true;
+                    }
+                }
+            }
+            else
+            {
+                // external threads rotate their starting point so that they
+                // don't all hammer the first worker
+                const size_t start = m_steal_index.fetch_add(1, std::memory_order_relaxed);
+                for (size_t i = 0; i < m_worker_count; ++i)
+                {
+                    const size_t victim = (start + i) % m_worker_count;
+                    if (m_worker_queues[victim].deques[priority].steal(task) ||
+                        m_worker_queues[victim].inboxes[priority].pop(task))
+                        return true;
+                }
+            }
+        }
 
-    // ------------------------------------------------------------
-    // TaskQueue
-    // ------------------------------------------------------------
+        return false;
+    }
 
-    struct TaskQueue
+    bool ThreadPool::dequeue_process()
     {
-        using Task = ThreadPool::Task;
-        moodycamel::ConcurrentQueue<Task> tasks;
-    };
+        Task task;
+        if (!dequeue(task))
+            return false;
 
-    // ------------------------------------------------------------
-    // ThreadPool
-    // ------------------------------------------------------------
+        process(task);
+        return true;
+    }
 
-    ThreadPool::ThreadPool(size_t size)
-        : m_queue_cache(32)
-        , m_queues(nullptr)
-        , m_threads(size)
+    void ThreadPool::process(Task& task)
     {
-        m_queues = new TaskQueue[3];
-        m_static_queue = createQueue("static", static_cast<int>(Priority::NORMAL));
+        Queue* queue = task.queue;
 
-        // NOTE: let OS scheduler shuffle tasks as it sees fit
-        //       this gives better performance overall UNTIL we have some practical
-        //       use for the affinity (eg. dependent tasks using same cache)
-        const bool affinity = false;//std::thread::hardware_concurrency() > 1;
-		if (affinity)
+        // check if the task is cancelled
+        if (task.stamp > queue->stamp_cancel)
         {
-            set_current_thread_affinity(0);
-        }
-
-        for (size_t i = 0; i < size; ++i)
-        {
-            m_threads[i] = std::thread([this, i] {
-                thread(i);
-            });
+            // the task is blocked by a barrier: leave it with the queue, it is handed
+            // back to the scheduler when the preceding tasks have completed
+            if (task.barrier > queue->task_complete_count && park(task))
+                return;
 
-			if (affinity)
-            {
-                set_thread_affinity(get_native_handle(m_threads[i]), int(i + 1));
-            }
+            // process task
+            execute(task);
         }
+
+        increment(counters().queues[queue->slot].completed);
+        complete(queue);
     }
 
-    ThreadPool::~ThreadPool()
+    void ThreadPool::execute(Task& task)
     {
-        m_stop = true;
-        m_condition.notify_all();
+        WorkerCounters& counters = this->counters();
 
-        for (auto& thread : m_threads)
+        if (m_statistics)
         {
-            thread.join();
+            const uint64 start = now_ns();
+            task.func();
+            const uint64 finish = now_ns();
+
+            QueueCounters& queue = counters.queues[task.queue->slot];
+            increment(queue.latency[histogram_bucket(start - task.time)]);
+            increment(queue.runtime[histogram_bucket(finish - start)]);
+            increment(counters.busy, finish - start);
+        }
+        else
+        {
+            task.func();
         }
 
-        deleteQueue(m_static_queue);
-        delete[] m_queues;
+        increment(counters.tasks);
     }
 
-    ThreadPool& ThreadPool::getInstance()
+    WorkerCounters& ThreadPool::counters()
     {
-        static ThreadPool instance(std::max(std::thread::hardware_concurrency() - 1, 1U));
-        return instance;
+        // threads which are not workers share the last set of counters
+        const bool worker = g_worker_context.pool == this;
+        return m_counters[worker ? g_worker_context.index : m_worker_count];
     }
 
-    int ThreadPool::getInstanceSize()
+    bool ThreadPool::compare_barrier(const Task& a, const Task& b)
     {
-        ThreadPool& pool = getInstance();
-        return pool.size();
+        return a.barrier > b.barrier;
     }
 
-    int ThreadPool::size() const
+    bool ThreadPool::park(Task& task)
     {
-        return int(m_threads.size());
-    }
+        Queue* queue = task.queue;
 
-    void ThreadPool::thread(size_t threadID)
-    {
-        auto time0 = high_resolution_clock::now();
+        SpinLockGuard guard(queue->parked_lock);
 
-        while (!m_stop.load(std::memory_order_relaxed))
+        // announce the parking before re-checking the barrier; complete() increments
+        // the counter before looking at the parked count so one of us sees the other
+        ++queue->parked_count;
+
+        if (task.barrier <= queue->task_complete_count)
         {
-            if (dequeue_process())
-            {
-                // remember the last time we processed a task
-                time0 = high_resolution_clock::now();
-            }
-            else
-            {
-                // don't be too eager to sleep
-                auto time1 = high_resolution_clock::now();
-                auto elapsed = duration_cast<milliseconds>(time1 - time0).count();
-                if (elapsed >= milliseconds(2).count())
-                {
-                    // sleep but check what's happening after a while unless signaled
-                    ++m_sleep_count;
-                    std::unique_lock<std::mutex> lock(m_queue_mutex);
-                    m_condition.wait_for(lock, milliseconds(32));
-                    --m_sleep_count;
-                }
-                else
-                {
-                    // no work; yield and try again soon
-                    std::this_thread::yield();
-                }
-            }
+            // predecessors completed in the meanwhile
+            --queue->parked_count;
+            return false;
         }
-    }
-
-    void ThreadPool::enqueue(Queue* queue, std::function<void()>&& func)
-    {
-        queue->retain();
-
-        Task task;
-        task.queue = queue;
-        task.stamp = queue->task_input_count++;
-        task.barrier = queue->stamp_barrier;
-        task.func = std::move(func);
 
-        m_queues[queue->priority].tasks.enqueue(std::move(task));
+        queue->parked.push_back(std::move(task));
+        std::push_heap(queue->parked.begin(), queue->parked.end(), compare_barrier);
 
-        if (m_sleep_count > 0)
-            m_condition.notify_one();
+        return true;
     }
 
-    bool ThreadPool::dequeue_process()
+    void ThreadPool::complete(Queue* queue)
     {
-        // scan task queues in priority order
-        for (size_t priority = 0; priority < 3; ++priority)
+        const int count = ++queue->task_complete_count;
+
+        if (queue->parked_count > 0)
         {
-            Task task;
-            if (m_queues[priority].tasks.try_dequeue(task))
+            std::vector<Task> unblocked;
+
+            SpinLockGuard guard(queue->parked_lock);
+
+            auto& parked = queue->parked;
+            while (!parked.empty() && parked.front().barrier <= count)
             {
-                Queue* queue = task.queue;
-                
-                // check if the task is cancelled
-                if (task.stamp > queue->stamp_cancel)
-                {
-                    // wait until task is not blocked by a barrier
-                    while (task.barrier > queue->task_complete_count)
-                        ;
-                    
-                    // process task
-                    task.func();
-                }
+                std::pop_heap(parked.begin(), parked.end(), compare_barrier);
+                unblocked.push_back(std::move(parked.back()));
+                parked.pop_back();
+                --queue->parked_count;
+            }
 
-                ++queue->task_complete_count;
-                queue->release();
-                
-                return true;
+            guard.unlock();
+
+            for (auto& task : unblocked)
+            {
+                submit(std::move(task));
             }
         }
 
-        return false;
+        queue->release();
     }
 
     void ThreadPool::wait(Queue* queue)
     {
+        // a worker waiting inside of a task is accounted as busy
+        const bool measure = m_statistics && g_worker_context.pool != this;
+
         // NOTE: we might be waiting here a while if other threads keep enqueuing tasks
         while (queue->task_complete_count < queue->task_input_count)
         {
             if (!dequeue_process())
             {
-                std::this_thread::yield();
+                if (measure)
+                {
+                    const uint64 start = now_ns();
+                    std::this_thread::yield();
+                    increment(counters().idle, now_ns() - start);
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
             }
         }
     }
@@ -272,10 +1305,59 @@ namespace mango
         queue->stamp_cancel = -1;
         queue->stamp_barrier = 0;
         queue->name = name;
+        queue->node = -1;
+        queue->parked_count = 0;
+
+        queue->slot = getStatisticsSlot(name);
 
         return queue;
     }
 
+    int ThreadPool::getStatisticsSlot(const std::string& name)
+    {
+        // FNV-1a; zero marks an empty slot
+        uint64 hash = 0xcbf29ce484222325ull;
+        for (char c : name)
+        {
+            hash = (hash ^ uint8(c)) * 0x100000001b3ull;
+        }
+        hash |= 1;
+
+        // the slots are only ever added so the published ones can be searched
+        // without the lock
+        int count = m_slot_count.load(std::memory_order_acquire);
+        for (int i = 0; i < count; ++i)
+        {
+            if (m_slot_hashes[i].load(std::memory_order_relaxed) == hash)
+                return i;
+        }
+
+        SpinLockGuard guard(m_slot_lock);
+
+        count = m_slot_count.load(std::memory_order_relaxed);
+        for (int i = 0; i < count; ++i)
+        {
+            if (m_slot_hashes[i].load(std::memory_order_relaxed) == hash)
+                return i;
+        }
+
+        // the last slot collects the names which didn't fit
+        if (count >= STATISTICS_SLOTS - 1)
+        {
+            if (m_slot_names.size() < size_t(STATISTICS_SLOTS))
+            {
+                m_slot_names.push_back("other");
+            }
+            return STATISTICS_SLOTS - 1;
+        }
+
+        m_slot_names.push_back(name);
+        m_slot_hashes[count].store(hash, std::memory_order_relaxed);
+        m_slot_count.store(count + 1, std::memory_order_release);
+
+        return count;
+    }
+
     void ThreadPool::deleteQueue(Queue* queue)
     {
         m_queue_cache.discard(queue);
@@ -297,11 +1379,22 @@ namespace mango
         m_queue = m_pool.createQueue(name, static_cast<int>(priority));
     }
 
+    ConcurrentQueue::ConcurrentQueue(ThreadPool& pool, const std::string& name, Priority priority)
+    : m_pool(pool)
+    {
+        m_queue = m_pool.createQueue(name, static_cast<int>(priority));
+    }
+
     ConcurrentQueue::~ConcurrentQueue()
     {
         m_queue->release();
     }
 
+    void ConcurrentQueue::setNode(int node)
+    {
+        m_queue->node = node;
+    }
+
     void ConcurrentQueue::barrier()
     {
         m_queue->stamp_barrier = m_queue->task_input_count;
@@ -333,6 +1426,12 @@ namespace mango
         m_queue = m_pool.createQueue(name, static_cast<int>(priority));
     }
 
+    SerialQueue::SerialQueue(ThreadPool& pool, const std::string& name, Priority priority)
+    : m_pool(pool)
+    {
+        m_queue = m_pool.createQueue(name, static_cast<int>(priority));
+    }
+
     SerialQueue::~SerialQueue()
     {
         m_queue->release();
@@ -348,4 +1447,249 @@ namespace mango
         m_pool.wait(m_queue);
     }
 
+    // ------------------------------------------------------------
+    // Future
+    // ------------------------------------------------------------
+
+    namespace detail
+    {
+
+        void FutureStateBase::complete()
+        {
+            std::vector<TaskFunction> callbacks;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_ready.store(true, std::memory_order_release);
+                callbacks.swap(m_callbacks);
+            }
+
+            m_condition.notify_all();
+
+            for (auto& callback : callbacks)
+            {
+                callback();
+            }
+        }
+
+        void FutureStateBase::setException(std::exception_ptr exception)
+        {
+            m_exception = exception;
+            complete();
+        }
+
+        void FutureStateBase::addCallback(TaskFunction&& callback)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!ready())
+                {
+                    m_callbacks.push_back(std::move(callback));
+                    return;
+                }
+            }
+
+            callback();
+        }
+
+        void FutureStateBase::wait()
+        {
+            ThreadPool& pool = *m_pool;
+
+            while (!ready())
+            {
+                // help the pool instead of blocking a thread which might be a worker
+                if (!pool.dequeue_process())
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_condition.wait_for(lock, milliseconds(1), [this] {
+                        return ready();
+                    });
+                }
+            }
+        }
+
+        void FutureStateBase::rethrow()
+        {
+            if (m_exception)
+            {
+                std::rethrow_exception(m_exception);
+            }
+        }
+
+        std::shared_ptr<FutureState<void>> when_all(const std::vector<SharedFutureState>& states)
+        {
+            if (states.empty())
+            {
+                auto result = std::make_shared<FutureState<void>>();
+                result->setValue();
+                return result;
+            }
+
+            auto result = std::make_shared<FutureState<void>>(states[0]->pool());
+
+            struct Counter
+            {
+                std::atomic<size_t> remaining;
+                std::mutex mutex;
+                std::exception_ptr exception;
+            };
+
+            auto counter = std::make_shared<Counter>();
+            counter->remaining = states.size();
+
+            for (auto& state : states)
+            {
+                auto source = state;
+                state->addCallback([result, counter, source] {
+                    if (source->exception())
+                    {
+                        std::lock_guard<std::mutex> lock(counter->mutex);
+                        if (!counter->exception)
+                        {
+                            counter->exception = source->exception();
+                        }
+                    }
+
+                    if (!--counter->remaining)
+                    {
+                        if (counter->exception)
+                            result->setException(counter->exception);
+                        else
+                            result->setValue();
+                    }
+                });
+            }
+
+            return result;
+        }
+
+    } // namespace detail
+
+    // ------------------------------------------------------------
+    // TaskGraph
+    // ------------------------------------------------------------
+
+    TaskGraph::TaskGraph()
+        : m_queue("taskgraph")
+    {
+    }
+
+    TaskGraph::TaskGraph(const std::string& name, Priority priority)
+        : m_queue(name, priority)
+    {
+    }
+
+    TaskGraph::TaskGraph(ThreadPool& pool, const std::string& name, Priority priority)
+        : m_queue(pool, name, priority)
+    {
+    }
+
+    TaskGraph::~TaskGraph()
+    {
+        // the enqueued nodes reference the graph
+        m_queue.wait();
+    }
+
+    void TaskGraph::precede(Node before, Node after)
+    {
+        m_nodes[before]->successors.push_back(after);
+        ++m_nodes[after]->dependencies;
+    }
+
+    void TaskGraph::run()
+    {
+        const size_t count = m_nodes.size();
+
+        // verify that the graph can be completed (Kahn's topological sort)
+        std::vector<int> dependencies(count);
+        std::vector<Node> roots;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            dependencies[i] = m_nodes[i]->dependencies;
+            if (!dependencies[i])
+            {
+                roots.push_back(i);
+            }
+        }
+
+        std::vector<Node> stack = roots;
+        size_t visited = 0;
+
+        while (!stack.empty())
+        {
+            Node node = stack.back();
+            stack.pop_back();
+            ++visited;
+
+            for (Node successor : m_nodes[node]->successors)
+            {
+                if (!--dependencies[successor])
+                {
+                    stack.push_back(successor);
+                }
+            }
+        }
+
+        if (visited != count)
+        {
+            MANGO_EXCEPTION("TaskGraph contains a cycle.");
+        }
+
+        m_exception = nullptr;
+
+        for (auto& node : m_nodes)
+        {
+            node->remaining = node->dependencies;
+        }
+
+        for (Node node : roots)
+        {
+            schedule(node);
+        }
+    }
+
+    void TaskGraph::schedule(Node node)
+    {
+        m_queue.enqueue([this, node] {
+            NodeData& data = *m_nodes[node];
+
+            try
+            {
+                data.func();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(m_exception_mutex);
+                if (!m_exception)
+                {
+                    m_exception = std::current_exception();
+                }
+            }
+
+            // successors are enqueued before this task completes so wait() can't
+            // observe the queue being drained in between
+            for (Node successor : data.successors)
+            {
+                if (!--m_nodes[successor]->remaining)
+                {
+                    schedule(successor);
+                }
+            }
+        });
+    }
+
+    void TaskGraph::wait()
+    {
+        m_queue.wait();
+
+        if (m_exception)
+        {
+            std::exception_ptr exception = m_exception;
+            m_exception = nullptr;
+            std::rethrow_exception(exception);
+        }
+    }
+
 } // namespace mango
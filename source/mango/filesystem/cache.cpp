@@ -0,0 +1,250 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <map>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <tuple>
+#include <algorithm>
+#include <mango/core/exception.hpp>
+#include <mango/filesystem/cache.hpp>
+
+#if defined(MANGO_PLATFORM_UNIX)
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+#define ID "ContainerCache: "
+
+namespace
+{
+    using namespace mango;
+
+    // -----------------------------------------------------------------
+    // CachedMemory
+    // -----------------------------------------------------------------
+
+    // The cached entry is shared by all of its views so it is decompressed into
+    // pages which are then protected against writing like the memory mapped
+    // files are; a view which writes into its memory faults instead of
+    // corrupting the others. The platforms without page protection share the
+    // decompressed memory.
+
+    class CachedMemory : public VirtualMemory
+    {
+    protected:
+        size_t m_mapped_size;
+
+    public:
+        CachedMemory(size_t size)
+        {
+            // zero sized mappings are not allowed
+            m_mapped_size = std::max(size, size_t(1));
+
+#if defined(MANGO_PLATFORM_WINDOWS)
+            void* address = VirtualAlloc(NULL, m_mapped_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            if (!address)
+            {
+                MANGO_EXCEPTION(ID"Out of memory.");
+            }
+#elif defined(MANGO_PLATFORM_UNIX)
+            void* address = ::mmap(nullptr, m_mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (address == MAP_FAILED)
+            {
+                MANGO_EXCEPTION(ID"Out of memory.");
+            }
+#else
+            void* address = new uint8[m_mapped_size];
+#endif
+
+            m_memory = Memory(reinterpret_cast<uint8*>(address), size);
+        }
+
+        ~CachedMemory()
+        {
+#if defined(MANGO_PLATFORM_WINDOWS)
+            VirtualFree(m_memory.address, 0, MEM_RELEASE);
+#elif defined(MANGO_PLATFORM_UNIX)
+            ::munmap(m_memory.address, m_mapped_size);
+#else
+            delete[] m_memory.address;
+#endif
+        }
+
+        // called when the entry has been decompressed
+        void protect()
+        {
+#if defined(MANGO_PLATFORM_WINDOWS)
+            DWORD protection;
+            VirtualProtect(m_memory.address, m_mapped_size, PAGE_READONLY, &protection);
+#elif defined(MANGO_PLATFORM_UNIX)
+            ::mprotect(m_memory.address, m_mapped_size, PROT_READ);
+#endif
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // ContainerCache
+    // -----------------------------------------------------------------
+
+    class VirtualMemoryCache : public VirtualMemory
+    {
+    protected:
+        std::shared_ptr<VirtualMemory> m_entry;
+
+    public:
+        VirtualMemoryCache(std::shared_ptr<VirtualMemory> entry)
+            : m_entry(entry)
+        {
+            m_memory = *entry;
+        }
+
+        ~VirtualMemoryCache()
+        {
+        }
+    };
+
+    struct ContainerCache
+    {
+        struct Entry
+        {
+            ContainerCacheKey key;
+            std::shared_ptr<VirtualMemory> memory;
+            uint64 size;
+        };
+
+        std::mutex mutex;
+        std::list<Entry> entries; // most recently used first
+        std::map<ContainerCacheKey, std::list<Entry>::iterator> lookup;
+
+        uint64 budget { 0 }; // disabled until the application sets a budget
+        uint64 bytes { 0 };
+        uint64 hits { 0 };
+        uint64 misses { 0 };
+        uint64 evictions { 0 };
+
+        // the mutex must be locked
+        void evict(uint64 limit)
+        {
+            while (bytes > limit)
+            {
+                Entry& entry = entries.back();
+                bytes -= entry.size;
+                lookup.erase(entry.key);
+                entries.pop_back();
+                ++evictions;
+            }
+        }
+    };
+
+    // never destroyed as the views can be released after the static destructors have been run
+    ContainerCache& getContainerCache()
+    {
+        static ContainerCache* cache = new ContainerCache();
+        return *cache;
+    }
+
+} // namespace
+
+namespace mango
+{
+
+    bool ContainerCacheKey::operator < (const ContainerCacheKey& key) const
+    {
+        return std::tie(container, size, mtime, crc, entry) <
+               std::tie(key.container, key.size, key.mtime, key.crc, key.entry);
+    }
+
+    void setContainerCacheBudget(uint64 bytes)
+    {
+        ContainerCache& cache = getContainerCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.budget = bytes;
+        cache.evict(bytes);
+    }
+
+    uint64 getContainerCacheBudget()
+    {
+        ContainerCache& cache = getContainerCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        return cache.budget;
+    }
+
+    ContainerCacheStatistics getContainerCacheStatistics()
+    {
+        ContainerCache& cache = getContainerCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+
+        ContainerCacheStatistics statistics;
+        statistics.hits = cache.hits;
+        statistics.misses = cache.misses;
+        statistics.evictions = cache.evictions;
+        statistics.bytes = cache.bytes;
+        statistics.entries = cache.entries.size();
+        return statistics;
+    }
+
+    void clearContainerCache()
+    {
+        ContainerCache& cache = getContainerCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.evict(0);
+    }
+
+    VirtualMemory* mapContainerEntry(const ContainerCacheKey& key, uint64 size,
+                                     std::function<void(Memory dest)> decompress,
+                                     std::function<VirtualMemory*()> map)
+    {
+        ContainerCache& cache = getContainerCache();
+
+        {
+            std::lock_guard<std::mutex> lock(cache.mutex);
+
+            if (!cache.budget || size > cache.budget)
+            {
+                // disabled or too large to be cached; the caller gets the memory as-is
+                return map();
+            }
+
+            auto i = cache.lookup.find(key);
+            if (i != cache.lookup.end())
+            {
+                ++cache.hits;
+                cache.entries.splice(cache.entries.begin(), cache.entries, i->second);
+                return new VirtualMemoryCache(i->second->memory);
+            }
+
+            ++cache.misses;
+        }
+
+        // the decompression is done without the lock so that the other
+        // entries can be accessed in the meantime
+        // NOTE: decompression limited on 32 bit platforms
+        auto memory = std::make_shared<CachedMemory>(static_cast<size_t>(size));
+        decompress(*memory);
+        memory->protect();
+
+        std::lock_guard<std::mutex> lock(cache.mutex);
+
+        auto i = cache.lookup.find(key);
+        if (i != cache.lookup.end())
+        {
+            // another thread cached the entry first
+            cache.entries.splice(cache.entries.begin(), cache.entries, i->second);
+            return new VirtualMemoryCache(i->second->memory);
+        }
+
+        if (size <= cache.budget)
+        {
+            cache.entries.push_front({ key, memory, size });
+            cache.lookup[key] = cache.entries.begin();
+            cache.bytes += size;
+            cache.evict(cache.budget);
+        }
+
+        return new VirtualMemoryCache(memory);
+    }
+
+} // namespace mango
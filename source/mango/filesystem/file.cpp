@@ -82,4 +82,67 @@ namespace mango
         return (*m_memory)->address;
     }
 
+    // -----------------------------------------------------------------
+    // MapperStream
+    // -----------------------------------------------------------------
+
+    MapperStream::MapperStream(const Path& path, const std::string& filename)
+    {
+        // use parent path's mapper
+        m_mapper = path;
+        m_pathname = path.pathname();
+
+        // parse and create mappers
+        m_filename = parse(m_pathname + filename, "");
+
+        m_stream.reset(m_mapper->open(m_filename));
+    }
+
+    MapperStream::MapperStream(const std::string& filename)
+    {
+        // create mapper to raw filesystem
+        m_mapper = getFileMapper();
+
+        // parse and create mappers
+        m_filename = parse(filename, "");
+
+        m_stream.reset(m_mapper->open(m_filename));
+    }
+
+    MapperStream::~MapperStream()
+    {
+    }
+
+    const std::string& MapperStream::filename() const
+    {
+        return m_filename;
+    }
+
+    uint64 MapperStream::size() const
+    {
+        return m_stream->size();
+    }
+
+    uint64 MapperStream::offset() const
+    {
+        return m_stream->offset();
+    }
+
+    void MapperStream::seek(uint64 distance, SeekMode mode)
+    {
+        m_stream->seek(distance, mode);
+    }
+
+    void MapperStream::read(void* dest, size_t size)
+    {
+        m_stream->read(dest, size);
+    }
+
+    void MapperStream::write(const void* data, size_t size)
+    {
+        MANGO_UNREFERENCED_PARAMETER(data);
+        MANGO_UNREFERENCED_PARAMETER(size);
+        MANGO_EXCEPTION(ID"The stream is read-only.");
+    }
+
 } // namespace mango
@@ -3,8 +3,11 @@
     Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <vector>
+#include <memory>
+#include <cstring>
 #include <algorithm>
 #include <mango/core/string.hpp>
+#include <mango/core/exception.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
 
@@ -19,7 +22,9 @@ namespace mango
 #ifdef MANGO_ENABLE_LICENSE_GPL
     AbstractMapper* createMapperRAR(Memory parent, const std::string& password);
 #endif
-    //AbstractMapper* createMapperMGX(Memory parent, const std::string& password);
+#ifdef MANGO_ENABLE_LICENSE_BSD
+    AbstractMapper* createMapperMGX(Memory parent, const std::string& password);
+#endif
 
     typedef AbstractMapper* (*CreateMapperFunc)(Memory, const std::string&);
 
@@ -59,6 +64,10 @@ namespace mango
         extensions.push_back(MapperExtension("cbr", createMapperRAR));
 #endif
 
+#ifdef MANGO_ENABLE_LICENSE_BSD
+        extensions.push_back(MapperExtension("mgx", createMapperMGX));
+#endif
+
         return extensions;
     } ();
 
@@ -114,6 +123,75 @@ namespace mango
         }
     }
 
+    // -----------------------------------------------------------------
+    // AbstractMapper
+    // -----------------------------------------------------------------
+
+    class VirtualMemoryStream : public Stream
+    {
+    protected:
+        std::unique_ptr<VirtualMemory> m_memory;
+        uint64 m_offset;
+
+    public:
+        VirtualMemoryStream(VirtualMemory* memory)
+            : m_memory(memory)
+            , m_offset(0)
+        {
+        }
+
+        uint64 size() const override
+        {
+            return (*m_memory)->size;
+        }
+
+        uint64 offset() const override
+        {
+            return m_offset;
+        }
+
+        void seek(uint64 distance, SeekMode mode) override
+        {
+            switch (mode)
+            {
+                case BEGIN:
+                    m_offset = distance;
+                    break;
+
+                case CURRENT:
+                    m_offset += distance;
+                    break;
+
+                case END:
+                    m_offset = size() - distance;
+                    break;
+            }
+        }
+
+        void read(void* dest, size_t size) override
+        {
+            if (m_offset + size > this->size())
+            {
+                MANGO_EXCEPTION("VirtualMemoryStream: Reading past end of file.");
+            }
+
+            std::memcpy(dest, (*m_memory)->address + m_offset, size);
+            m_offset += size;
+        }
+
+        void write(const void* data, size_t size) override
+        {
+            MANGO_UNREFERENCED_PARAMETER(data);
+            MANGO_UNREFERENCED_PARAMETER(size);
+            MANGO_EXCEPTION("VirtualMemoryStream: The stream is read-only.");
+        }
+    };
+
+    Stream* AbstractMapper::open(const std::string& filename)
+    {
+        return new VirtualMemoryStream(mmap(filename));
+    }
+
     // -----------------------------------------------------------------
     // Mapper
     // -----------------------------------------------------------------
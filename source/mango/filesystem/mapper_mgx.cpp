@@ -1,97 +1,895 @@
 /*
     MANGO Multimedia Development Platform
-    Copyright (C) 2012-2016 Twilight Finland 3D Oy Ltd. All rights reserved.
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
-#include <map>
+#include <set>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+#include <exception>
 #include <mango/core/pointer.hpp>
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
+#include <mango/core/compress.hpp>
+#include <mango/core/crc32.hpp>
+#include <mango/core/hash.hpp>
+#include <mango/core/parallel.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
-
-#include "../../external/lz4/lz4.h"
+#include <mango/filesystem/mgx.hpp>
 
 #define ID ".mgx mapper: "
 
-#if 0
+#ifdef MANGO_ENABLE_LICENSE_BSD
 
-// TODO
+#include "../../external/lz4/lz4.h"
+#include "../../external/zstd/zstd.h"
 
 namespace
 {
 
     using namespace mango;
 
+    // The archive layout (little endian):
+    //
+    // Archive     header
+    // blocks      the blocks of a file are stored consecutively
+    // Directory   header, followed by:
+    //             Block[blocks]
+    //             FileHeader[files]
+    //             uint32 buckets[buckets] (file index + 1, zero is an empty bucket)
+    //             filenames
+    // Trailer     location of the directory
+    //
+    // The blocks have the same uncompressed size except the last block of a
+    // file. The buckets are a hash table of the filenames (xxhash32, linear
+    // probing) so that the files are found without parsing the directory.
+
+    enum
+    {
+        ARCHIVE_SIGNATURE   = 0x3158474d, // "MGX1"
+        DIRECTORY_SIGNATURE = 0x4458474d, // "MGXD"
+        TRAILER_SIGNATURE   = 0x4558474d, // "MGXE"
+        VERSION = 1,
+
+        ARCHIVE_SIZE = 16,
+        DIRECTORY_SIZE = 20,
+        BLOCK_SIZE = 24,
+        FILEHEADER_SIZE = 32,
+        TRAILER_SIZE = 20,
+
+        BLOCK_CHECKSUM = 0x01
+    };
+
 	struct Block
 	{
 		uint64 offset;
-		uint64 size;
+		uint32 compressed;
+		uint32 uncompressed;
+		uint32 checksum;     // crc32c of the uncompressed data
+		uint8  compression;
+		uint8  flags;
+
+        Block()
+        {
+        }
+
+        Block(LittleEndianPointer p)
+        {
+            offset       = p.read64();
+            compressed   = p.read32();
+            uncompressed = p.read32();
+            checksum     = p.read32();
+            compression  = p.read8();
+            flags        = p.read8();
+        }
+
+        void write(LittleEndianStream& s) const
+        {
+            s.write64(offset);
+            s.write32(compressed);
+            s.write32(uncompressed);
+            s.write32(checksum);
+            s.write8(compression);
+            s.write8(flags);
+            s.write16(0);
+        }
 	};
 
 	struct Archive
 	{
 		uint32 signature;
 		uint32 version;
-		Block directory;
+		uint64 reserved;
 	};
 
 	struct Directory
 	{
 		uint32 signature;
+		uint32 files;
+		uint32 blocks;
+		uint32 buckets;
+		uint32 blockSize;
 	};
 
 	struct FileHeader
 	{
-		Block compressed;
-		uint64 uncompressed;
-		uint32 checksum;
-		uint32 compression;
+		uint64 size;
+		uint32 firstBlock;
+		uint32 blockCount;
+		uint32 filenameOffset;
 		uint32 filenameSize;
+		uint32 hash;
+
+        FileHeader()
+        {
+        }
+
+        FileHeader(LittleEndianPointer p)
+        {
+            size           = p.read64();
+            firstBlock     = p.read32();
+            blockCount     = p.read32();
+            filenameOffset = p.read32();
+            filenameSize   = p.read32();
+            hash           = p.read32();
+        }
+
+        void write(LittleEndianStream& s) const
+        {
+            s.write64(size);
+            s.write32(firstBlock);
+            s.write32(blockCount);
+            s.write32(filenameOffset);
+            s.write32(filenameSize);
+            s.write32(hash);
+            s.write32(0);
+        }
 	};
 
+    uint32 filename_hash(const std::string& filename)
+    {
+        uint8* address = reinterpret_cast<uint8*>(const_cast<char*>(filename.data()));
+        return xxhash32(Memory(address, filename.length()));
+    }
+
 } // namespace
 
 namespace mango
 {
 
+    // -----------------------------------------------------------------
+    // VirtualMemoryMGX
+    // -----------------------------------------------------------------
+
+    class VirtualMemoryMGX : public mango::VirtualMemory
+    {
+    protected:
+        uint8* m_delete_address;
+
+    public:
+        VirtualMemoryMGX(uint8* address, uint8* delete_address, size_t size)
+            : m_delete_address(delete_address)
+        {
+            m_memory = Memory(address, size);
+        }
+
+        ~VirtualMemoryMGX()
+        {
+            delete [] m_delete_address;
+        }
+    };
+
     // -----------------------------------------------------------------
     // MapperMGX
     // -----------------------------------------------------------------
 
-    class MapperMGX : public Mapper
+    class MapperMGX : public AbstractMapper
     {
+    protected:
+        Memory m_parent_memory;
+        Directory m_directory;
+        uint8* m_blocks;
+        uint8* m_files;
+        uint8* m_buckets;
+        uint8* m_filenames;
+        uint64 m_filenames_size;
+
     public:
+        MapperMGX(Memory parent, const std::string& password)
+            : m_parent_memory(parent)
+        {
+            MANGO_UNREFERENCED_PARAMETER(password);
+
+            if (parent.size < ARCHIVE_SIZE + TRAILER_SIZE)
+            {
+                MANGO_EXCEPTION(ID"Incorrect archive size.");
+            }
+
+            LittleEndianPointer p = parent.address;
+            if (p.read32() != ARCHIVE_SIGNATURE || p.read32() != VERSION)
+            {
+                MANGO_EXCEPTION(ID"Incorrect archive signature.");
+            }
+
+            p = parent.address + parent.size - TRAILER_SIZE;
+            uint64 offset = p.read64();
+            uint64 size = p.read64();
+            if (p.read32() != TRAILER_SIGNATURE)
+            {
+                MANGO_EXCEPTION(ID"Incorrect trailer signature.");
+            }
+
+            if (offset > parent.size || size > parent.size - offset || size < DIRECTORY_SIZE)
+            {
+                MANGO_EXCEPTION(ID"Incorrect directory.");
+            }
+
+            p = parent.address + offset;
+            m_directory.signature = p.read32();
+            m_directory.files     = p.read32();
+            m_directory.blocks    = p.read32();
+            m_directory.buckets   = p.read32();
+            m_directory.blockSize = p.read32();
+
+            const uint64 tables = uint64(m_directory.blocks) * BLOCK_SIZE +
+                                  uint64(m_directory.files) * FILEHEADER_SIZE +
+                                  uint64(m_directory.buckets) * 4;
+
+            if (m_directory.signature != DIRECTORY_SIGNATURE || !m_directory.blockSize ||
+                !m_directory.buckets || (m_directory.buckets & (m_directory.buckets - 1)) ||
+                tables > size - DIRECTORY_SIZE)
+            {
+                MANGO_EXCEPTION(ID"Incorrect directory.");
+            }
+
+            m_blocks = p;
+            m_files = m_blocks + m_directory.blocks * BLOCK_SIZE;
+            m_buckets = m_files + m_directory.files * FILEHEADER_SIZE;
+            m_filenames = m_buckets + m_directory.buckets * 4;
+            m_filenames_size = size - DIRECTORY_SIZE - tables;
+        }
+
+        ~MapperMGX()
+        {
+        }
+
+        Block getBlock(uint32 index) const
+        {
+            if (index >= m_directory.blocks)
+            {
+                MANGO_EXCEPTION(ID"Incorrect block index.");
+            }
+
+            Block block(m_blocks + index * BLOCK_SIZE);
+            if (block.offset > m_parent_memory.size || block.compressed > m_parent_memory.size - block.offset)
+            {
+                MANGO_EXCEPTION(ID"Incorrect block.");
+            }
+
+            return block;
+        }
+
+        FileHeader getFile(uint32 index) const
+        {
+            return FileHeader(m_files + index * FILEHEADER_SIZE);
+        }
+
+        std::string getFilename(const FileHeader& header) const
+        {
+            if (header.filenameOffset > m_filenames_size || header.filenameSize > m_filenames_size - header.filenameOffset)
+            {
+                MANGO_EXCEPTION(ID"Incorrect filename.");
+            }
+
+            const char* s = reinterpret_cast<const char*>(m_filenames + header.filenameOffset);
+            return std::string(s, header.filenameSize);
+        }
+
+        uint32 getBlockSize() const
+        {
+            return m_directory.blockSize;
+        }
+
+        uint8* getAddress(const Block& block) const
+        {
+            return m_parent_memory.address + block.offset;
+        }
+
+        // checks that the blocks of the file are in the archive and that their
+        // uncompressed sizes add up to the file size
+        void validate(const FileHeader& header) const
+        {
+            const uint64 blockSize = m_directory.blockSize;
+            if (header.size > uint64(m_directory.blocks) * blockSize)
+            {
+                MANGO_EXCEPTION(ID"Incorrect file header.");
+            }
+
+            const uint64 count = (header.size + blockSize - 1) / blockSize;
+
+            if (header.blockCount != count || uint64(header.firstBlock) + count > m_directory.blocks)
+            {
+                MANGO_EXCEPTION(ID"Incorrect file header.");
+            }
+
+            for (uint32 i = 0; i < header.blockCount; ++i)
+            {
+                Block block = getBlock(header.firstBlock + i);
+
+                const uint64 expected = std::min(blockSize, header.size - i * blockSize);
+                if (block.uncompressed != expected)
+                {
+                    MANGO_EXCEPTION(ID"Incorrect block.");
+                }
+
+                if (block.compression == WriterMGX::NONE && block.compressed != block.uncompressed)
+                {
+                    MANGO_EXCEPTION(ID"Incorrect block.");
+                }
+            }
+        }
+
+        // returns the file index or -1 when the file is not found
+        int find(const std::string& filename) const
+        {
+            const uint32 hash = filename_hash(filename);
+            const uint32 mask = m_directory.buckets - 1;
+
+            for (uint32 i = 0; i < m_directory.buckets; ++i)
+            {
+                const uint32 bucket = uload32le(m_buckets + ((hash + i) & mask) * 4);
+                if (!bucket || bucket > m_directory.files)
+                    break;
+
+                FileHeader header = getFile(bucket - 1);
+                if (header.hash == hash && getFilename(header) == filename)
+                {
+                    return int(bucket - 1);
+                }
+            }
+
+            return -1;
+        }
+
+        void decompress(uint8* dest, const Block& block) const
+        {
+            Memory source(getAddress(block), block.compressed);
+            Memory target(dest, block.uncompressed);
+
+            switch (block.compression)
+            {
+                case WriterMGX::NONE:
+                    if (block.compressed != block.uncompressed)
+                    {
+                        MANGO_EXCEPTION(ID"Incorrect block.");
+                    }
+                    std::memcpy(dest, source.address, source.size);
+                    break;
+
+                // the block sizes come from the archive; the decoders must stay
+                // inside them and produce exactly the uncompressed size
+                case WriterMGX::LZ4:
+                {
+                    const char* src = reinterpret_cast<const char *>(source.address);
+                    char* dst = reinterpret_cast<char *>(target.address);
+                    int bytes = LZ4_decompress_safe(src, dst, int(block.compressed), int(block.uncompressed));
+                    if (bytes != int(block.uncompressed))
+                    {
+                        MANGO_EXCEPTION(ID"Corrupted block.");
+                    }
+                    break;
+                }
+
+                case WriterMGX::ZSTD:
+                {
+                    size_t bytes = ZSTD_decompress(target.address, target.size, source.address, source.size);
+                    if (ZSTD_isError(bytes) || bytes != block.uncompressed)
+                    {
+                        MANGO_EXCEPTION(ID"Corrupted block.");
+                    }
+                    break;
+                }
+
+                default:
+                    MANGO_EXCEPTION(ID"Unsupported compression algorithm.");
+            }
+
+            if ((block.flags & BLOCK_CHECKSUM) && crc32c(0, target) != block.checksum)
+            {
+                MANGO_EXCEPTION(ID"Block checksum mismatch.");
+            }
+        }
 
         bool isfile(const std::string& filename) const override
         {
+            return find(filename) >= 0;
         }
 
         void index(FileIndex& index, const std::string& pathname) override
         {
+            std::set<std::string> folders;
+
+            for (uint32 i = 0; i < m_directory.files; ++i)
+            {
+                FileHeader header = getFile(i);
+                std::string filename = getFilename(header);
+
+                if (isPrefix(filename, pathname))
+                {
+                    filename = filename.substr(pathname.length());
+                    size_t n = filename.find_first_of("/");
+
+                    if (n != std::string::npos)
+                    {
+                        // the folders are not stored; they are implied by the filenames
+                        std::string folder = filename.substr(0, n + 1);
+                        if (folders.insert(folder).second)
+                        {
+                            index.emplace(folder, 0, FileInfo::DIRECTORY);
+                        }
+                    }
+                    else
+                    {
+                        bool compressed = false;
+                        for (uint32 j = 0; j < header.blockCount; ++j)
+                        {
+                            compressed |= getBlock(header.firstBlock + j).compression != WriterMGX::NONE;
+                        }
+
+                        index.emplace(filename, header.size, compressed ? FileInfo::COMPRESSED : 0);
+                    }
+                }
+            }
         }
 
         VirtualMemory* mmap(const std::string& filename) override
         {
+            int index = find(filename);
+            if (index < 0)
+            {
+                MANGO_EXCEPTION(ID"File not found.");
+            }
+
+            FileHeader header = getFile(index);
+            validate(header);
+
+            const size_t size = size_t(header.size);
+
+            // the stored blocks are consecutive so the file is mapped from the archive;
+            // the checksums are verified only when the blocks are decompressed
+            bool stored = true;
+            uint64 offset = header.blockCount ? getBlock(header.firstBlock).offset : 0;
+
+            for (uint32 i = 0; i < header.blockCount; ++i)
+            {
+                Block block = getBlock(header.firstBlock + i);
+                stored &= block.compression == WriterMGX::NONE && block.offset == offset;
+                offset += block.compressed;
+            }
+
+            if (stored)
+            {
+                uint8* address = header.blockCount ? getAddress(getBlock(header.firstBlock)) : nullptr;
+                return new VirtualMemoryMGX(address, nullptr, size);
+            }
+
+            uint8* buffer = new uint8[size];
+
+            try
+            {
+                const uint64 blockSize = m_directory.blockSize;
+
+                // validate() has checked that the blocks cover the file exactly
+                parallel_each(header.blockCount, [&] (size_t i)
+                {
+                    Block block = getBlock(header.firstBlock + uint32(i));
+                    decompress(buffer + i * blockSize, block);
+                });
+            }
+            catch (...)
+            {
+                delete[] buffer;
+                throw;
+            }
+
+            return new VirtualMemoryMGX(buffer, buffer, size);
         }
+
+        Stream* open(const std::string& filename) override;
     };
 
     // -----------------------------------------------------------------
-    // functions
+    // StreamMGX
     // -----------------------------------------------------------------
 
-    Mapper* createMapperMGX(Memory parent, const std::string& password)
+    // Decompresses only the blocks which are read; the last partially read
+    // block is cached for the following reads.
+
+    class StreamMGX : public Stream
     {
-        Mapper* mapper = new MapperMGX(parent, password);
-        return mapper;
+    protected:
+        const MapperMGX& m_mapper;
+        FileHeader m_header;
+        uint64 m_offset;
+        std::vector<uint8> m_cache;
+        uint32 m_cache_block;
+
+    public:
+        StreamMGX(const MapperMGX& mapper, const FileHeader& header)
+            : m_mapper(mapper)
+            , m_header(header)
+            , m_offset(0)
+            , m_cache_block(0xffffffff)
+        {
+        }
+
+        uint64 size() const override
+        {
+            return m_header.size;
+        }
+
+        uint64 offset() const override
+        {
+            return m_offset;
+        }
+
+        void seek(uint64 distance, SeekMode mode) override
+        {
+            switch (mode)
+            {
+                case BEGIN:
+                    m_offset = distance;
+                    break;
+
+                case CURRENT:
+                    m_offset += distance;
+                    break;
+
+                case END:
+                    m_offset = m_header.size - distance;
+                    break;
+            }
+        }
+
+        void read(void* dest, size_t size) override
+        {
+            if (m_offset > m_header.size || size > m_header.size - m_offset)
+            {
+                MANGO_EXCEPTION(ID"Reading past end of file.");
+            }
+
+            uint8* d = reinterpret_cast<uint8*>(dest);
+            const uint32 blockSize = m_mapper.getBlockSize();
+
+            while (size > 0)
+            {
+                const uint32 index = uint32(m_offset / blockSize);
+                const uint32 start = uint32(m_offset % blockSize);
+
+                Block block = m_mapper.getBlock(m_header.firstBlock + index);
+                if (start >= block.uncompressed)
+                {
+                    MANGO_EXCEPTION(ID"Incorrect block.");
+                }
+
+                const size_t bytes = std::min(size, size_t(block.uncompressed - start));
+
+                if (block.compression == WriterMGX::NONE && block.compressed == block.uncompressed)
+                {
+                    std::memcpy(d, m_mapper.getAddress(block) + start, bytes);
+                }
+                else if (bytes == block.uncompressed)
+                {
+                    // the whole block is read
+                    m_mapper.decompress(d, block);
+                }
+                else
+                {
+                    if (m_cache_block != index)
+                    {
+                        m_cache_block = 0xffffffff;
+                        m_cache.resize(block.uncompressed);
+                        m_mapper.decompress(m_cache.data(), block);
+                        m_cache_block = index;
+                    }
+
+                    std::memcpy(d, m_cache.data() + start, bytes);
+                }
+
+                d += bytes;
+                size -= bytes;
+                m_offset += bytes;
+            }
+        }
+
+        void write(const void* data, size_t size) override
+        {
+            MANGO_UNREFERENCED_PARAMETER(data);
+            MANGO_UNREFERENCED_PARAMETER(size);
+            MANGO_EXCEPTION(ID"The stream is read-only.");
+        }
+    };
+
+    Stream* MapperMGX::open(const std::string& filename)
+    {
+        int index = find(filename);
+        if (index < 0)
+        {
+            MANGO_EXCEPTION(ID"File not found.");
+        }
+
+        FileHeader header = getFile(index);
+        validate(header);
+
+        return new StreamMGX(*this, header);
     }
 
-} // namespace mango
+    // -----------------------------------------------------------------
+    // WriterMGX
+    // -----------------------------------------------------------------
 
-#else
+    struct WriterStateMGX
+    {
+        struct Pending
+        {
+            std::string filename;
+            Memory memory;
+            WriterMGX::Compression compression;
+        };
+
+        Stream& stream;
+        WriterMGX::Compression compression;
+        int level;
+        uint32 blockSize;
+        bool checksum;
+        bool finished;
+
+        uint64 offset;
+        std::vector<Pending> pending;
+        std::vector<Block> blocks;
+        std::vector<FileHeader> files;
+        std::string filenames;
+        std::unordered_set<std::string> unique;
+
+        WriterStateMGX(Stream& stream)
+            : stream(stream)
+        {
+        }
+    };
 
-    void dummy_mgx_function_to_satisfy_linker()
+    WriterMGX::WriterMGX(Stream& output, Compression compression, int level, uint32 block_size, bool checksum)
+        : m_state(new WriterStateMGX(output))
     {
-        // TODO: remove this when .mgx support is done
+        m_state->compression = compression;
+        m_state->level = level;
+        m_state->blockSize = std::max(block_size, 1u);
+        m_state->checksum = checksum;
+        m_state->finished = false;
+        m_state->offset = ARCHIVE_SIZE;
+
+        LittleEndianStream s(output);
+        s.write32(ARCHIVE_SIGNATURE);
+        s.write32(VERSION);
+        s.write64(0);
     }
 
-#endif // 0
+    WriterMGX::~WriterMGX()
+    {
+        try
+        {
+            finish();
+        }
+        catch (...)
+        {
+        }
+
+        delete m_state;
+    }
+
+    void WriterMGX::add(const std::string& filename, Memory memory)
+    {
+        add(filename, memory, m_state->compression);
+    }
+
+    void WriterMGX::add(const std::string& filename, Memory memory, Compression compression)
+    {
+        if (m_state->finished)
+        {
+            MANGO_EXCEPTION(ID"The archive is finished.");
+        }
+
+        if (!m_state->unique.insert(filename).second)
+        {
+            MANGO_EXCEPTION(ID"Duplicate filename.");
+        }
+
+        m_state->pending.push_back({ filename, memory, compression });
+    }
+
+    void WriterMGX::flush()
+    {
+        WriterStateMGX& state = *m_state;
+        LittleEndianStream s(state.stream);
+
+        struct Job
+        {
+            Memory source;
+            WriterMGX::Compression compression;
+            std::vector<uint8> buffer;
+            Block block;
+        };
+
+        std::vector<Job> jobs;
+
+        for (auto& pending : state.pending)
+        {
+            FileHeader header;
+            header.size = pending.memory.size;
+            header.firstBlock = uint32(state.blocks.size() + jobs.size());
+            header.blockCount = 0;
+            header.filenameOffset = uint32(state.filenames.length());
+            header.filenameSize = uint32(pending.filename.length());
+            header.hash = filename_hash(pending.filename);
+
+            for (size_t offset = 0; offset < pending.memory.size; offset += state.blockSize)
+            {
+                Job job;
+                job.source = Memory(pending.memory.address + offset, std::min(pending.memory.size - offset, size_t(state.blockSize)));
+                job.compression = pending.compression;
+                jobs.push_back(std::move(job));
+                ++header.blockCount;
+            }
+
+            state.files.push_back(header);
+            state.filenames += pending.filename;
+        }
+
+        state.pending.clear();
+
+        // the jobs are compressed in batches to limit the memory usage
+        const size_t batch = std::max(size_t(1), size_t(64 * 1024 * 1024) / state.blockSize);
+
+        for (size_t first = 0; first < jobs.size(); first += batch)
+        {
+            const size_t count = std::min(batch, jobs.size() - first);
+
+            parallel_each(count, [&] (size_t index)
+            {
+                Job& job = jobs[first + index];
+                Block& block = job.block;
+
+                block.uncompressed = uint32(job.source.size);
+                block.compression = WriterMGX::NONE;
+                block.flags = state.checksum ? BLOCK_CHECKSUM : 0;
+                block.checksum = state.checksum ? crc32c(0, job.source) : 0;
+
+                size_t bytes = 0;
+                switch (job.compression)
+                {
+                    case WriterMGX::LZ4:
+                        job.buffer.resize(lz4::bound(job.source.size));
+                        bytes = lz4::compress(Memory(job.buffer.data(), job.buffer.size()), job.source, state.level);
+                        break;
+
+                    case WriterMGX::ZSTD:
+                        job.buffer.resize(zstd::bound(job.source.size));
+                        bytes = zstd::compress(Memory(job.buffer.data(), job.buffer.size()), job.source, state.level);
+                        break;
+
+                    default:
+                        break;
+                }
+
+                if (bytes > 0 && bytes < job.source.size)
+                {
+                    block.compression = uint8(job.compression);
+                    block.compressed = uint32(bytes);
+                }
+                else
+                {
+                    block.compressed = block.uncompressed;
+                }
+            });
+
+            for (size_t i = first; i < first + count; ++i)
+            {
+                Job& job = jobs[i];
+                job.block.offset = state.offset;
+
+                if (job.block.compression == WriterMGX::NONE)
+                {
+                    s.write(job.source.address, job.source.size);
+                }
+                else
+                {
+                    s.write(job.buffer.data(), job.block.compressed);
+                }
+
+                state.offset += job.block.compressed;
+                state.blocks.push_back(job.block);
+
+                std::vector<uint8>().swap(job.buffer);
+            }
+        }
+    }
+
+    void WriterMGX::finish()
+    {
+        if (m_state->finished)
+            return;
+
+        flush();
+
+        WriterStateMGX& state = *m_state;
+        state.finished = true;
+
+        const uint32 fileCount = uint32(state.files.size());
+
+        // hash table which is at most half full
+        uint32 bucketCount = 1;
+        while (bucketCount < fileCount * 2)
+        {
+            bucketCount *= 2;
+        }
+
+        std::vector<uint32> buckets(bucketCount, 0);
+        for (uint32 i = 0; i < fileCount; ++i)
+        {
+            uint32 bucket = state.files[i].hash & (bucketCount - 1);
+            while (buckets[bucket])
+            {
+                bucket = (bucket + 1) & (bucketCount - 1);
+            }
+            buckets[bucket] = i + 1;
+        }
+
+        LittleEndianStream s(state.stream);
+
+        const uint64 directoryOffset = state.offset;
+
+        s.write32(DIRECTORY_SIGNATURE);
+        s.write32(fileCount);
+        s.write32(uint32(state.blocks.size()));
+        s.write32(bucketCount);
+        s.write32(state.blockSize);
+
+        for (auto& block : state.blocks)
+        {
+            block.write(s);
+        }
+
+        for (auto& file : state.files)
+        {
+            file.write(s);
+        }
+
+        for (auto bucket : buckets)
+        {
+            s.write32(bucket);
+        }
+
+        s.write(state.filenames.data(), state.filenames.length());
+
+        const uint64 directorySize = DIRECTORY_SIZE + state.blocks.size() * BLOCK_SIZE +
+            fileCount * FILEHEADER_SIZE + bucketCount * 4 + state.filenames.length();
+
+        s.write64(directoryOffset);
+        s.write64(directorySize);
+        s.write32(TRAILER_SIGNATURE);
+    }
+
+    // -----------------------------------------------------------------
+    // functions
+    // -----------------------------------------------------------------
+
+    AbstractMapper* createMapperMGX(Memory parent, const std::string& password)
+    {
+        AbstractMapper* mapper = new MapperMGX(parent, password);
+        return mapper;
+    }
+
+} // namespace mango
+
+#endif // MANGO_ENABLE_LICENSE_BSD
@@ -12,6 +12,7 @@
 #include <mango/core/pointer.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
+#include <mango/filesystem/cache.hpp>
 
 #ifdef MANGO_ENABLE_LICENSE_GPL
 
@@ -229,6 +230,7 @@ namespace
         uint64  packed_size;
         uint64  unpacked_size;
         uint32  file_crc;
+        uint32  file_time;
         uint8   version;
         uint8   method;
         std::string filename;
@@ -271,7 +273,7 @@ namespace
                     unpacked_size = p.read32();
                     ++p; // Host OS
                     file_crc = p.read32();
-                    p += 4; // FileTime
+                    file_time = p.read32();
                     version = p.read8();
                     method = p.read8();
                     int filename_size = p.read16();
@@ -348,6 +350,7 @@ namespace
         uint64  packed_size;
         uint64  unpacked_size;
         uint32  crc;
+        uint32  mtime;
         uint8   version;
         uint8   method;
         bool    is_rar5;
@@ -404,11 +407,13 @@ namespace mango
     class MapperRAR : public AbstractMapper
     {
     public:
+        Memory m_parent_memory;
         std::string m_password;
         std::map<std::string, FileHeader> m_files;
 
         MapperRAR(Memory parent, const std::string& password)
-        : m_password(password)
+        : m_parent_memory(parent)
+        , m_password(password)
         {
             uint8* start = parent.address;
             uint8* end = parent.address + parent.size;
@@ -467,6 +472,7 @@ namespace mango
                             file.packed_size = header.packed_size;
                             file.unpacked_size = header.unpacked_size;
                             file.crc = header.file_crc;
+                            file.mtime = header.file_time;
                             file.version = header.version;
                             file.method  = header.method;
                             file.is_rar5 = false;
@@ -537,7 +543,6 @@ namespace mango
             uint64 length = vint(p);
 
             MANGO_UNREFERENCED_PARAMETER(attributes);
-            MANGO_UNREFERENCED_PARAMETER(mtime);
             MANGO_UNREFERENCED_PARAMETER(host_os);
 
             bool is_directory = (flags & 1) != 0;
@@ -579,6 +584,7 @@ namespace mango
             file.packed_size = compressed_data.size;
             file.unpacked_size = unpacked_size;
             file.crc = crc;
+            file.mtime = mtime;
             file.version = algorithm;
             file.method  = method;
             file.is_rar5 = true;
@@ -708,7 +714,27 @@ namespace mango
             }
 
             FileHeader& header = i->second;
-            return header.mmap();
+            if (!header.compressed())
+            {
+                return header.mmap();
+            }
+
+            // the decompressed entries are shared through the cache
+            ContainerCacheKey key;
+            key.container = m_parent_memory.address;
+            key.size = m_parent_memory.size;
+            key.entry = filename;
+            key.mtime = header.mtime;
+            key.crc = header.crc;
+
+            return mapContainerEntry(key, header.unpacked_size, [&] (Memory dest) {
+                if (!decompress(dest.address, header.data, header.unpacked_size, header.packed_size, header.version))
+                {
+                    MANGO_EXCEPTION(ID"Decompression failed.");
+                }
+            }, [&] {
+                return header.mmap();
+            });
         }
     };
 
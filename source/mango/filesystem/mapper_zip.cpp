@@ -3,14 +3,24 @@
     Copyright (C) 2012-2017 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <map>
+#include <algorithm>
 #include <mango/core/pointer.hpp>
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
+#include <mango/core/memory.hpp>
+#include <mango/core/aes.hpp>
+#include <mango/core/hash.hpp>
+#include <mango/core/crc32.hpp>
+#include <mango/core/endian.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
+#include <mango/filesystem/cache.hpp>
 
 #include "../../external/miniz/miniz.h"
 
+// the zlib compatibility macro would hide mango::crc32
+#undef crc32
+
 #define ID ".zip mapper: "
 
 namespace
@@ -102,6 +112,10 @@ namespace
         std::string filename;      // filename is stored after the header
         bool        folder;        // if the last character of filename is "/", it is a folder
 
+        uint16      aesVersion = 0;     // WinZip AES: 1 (AE-1) or 2 (AE-2)
+        uint8       aesStrength = 0;    // WinZip AES: 1 (AES-128), 2 (AES-192) or 3 (AES-256)
+        uint16      aesCompression = 0; // WinZip AES: the actual compression method
+
         DirFileHeader()
         {
         }
@@ -163,6 +177,14 @@ namespace
                             if (localOffset == 0xffffffff) localOffset = e.read64();
                             if (diskStart == 0xffff) e += 4;
                             break;
+
+                        case 0x9901:
+                            // WinZip AES extra field
+                            aesVersion = e.read16();
+                            e += 2; // vendor id: "AE"
+                            aesStrength = e.read8();
+                            aesCompression = e.read16();
+                            break;
                     }
                     ext = next;
                 }
@@ -269,18 +291,29 @@ namespace
     // zip functions
     // --------------------------------------------------------------------
 
-    inline uint32 zip_crc32(uint32 crc, uint8 v)
+    struct ZipCRCTable
     {
-        static const uint32 crc_table[] =
+        uint32 table[256];
+
+        ZipCRCTable()
         {
-            0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
-            0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
-        };
+            for (uint32 i = 0; i < 256; ++i)
+            {
+                uint32 x = i;
+                for (int j = 0; j < 8; ++j)
+                {
+                    x = (x >> 1) ^ (0xedb88320 & (0 - (x & 1)));
+                }
+                table[i] = x;
+            }
+        }
+    };
+
+    const ZipCRCTable g_zip_crc_table;
 
-        uint32 x = crc;
-        x = (x >> 4) ^ crc_table[(x & 0xf) ^ (v & 0xf)];
-        x = (x >> 4) ^ crc_table[(x & 0xf) ^ (v >> 4)];
-        return x;
+    inline uint32 zip_crc32(uint32 crc, uint8 v)
+    {
+        return (crc >> 8) ^ g_zip_crc_table.table[(crc ^ v) & 0xff];
 	}
 
 	inline uint8 zip_decrypt_value(uint32* keys)
@@ -365,6 +398,215 @@ namespace
 		return true;
 	}
 
+    // --------------------------------------------------------------------
+    // WinZip AES
+    // --------------------------------------------------------------------
+
+    // AE-1 and AE-2 encrypted entries: the AES and HMAC keys are derived from the
+    // password with PBKDF2-HMAC-SHA1. The data is encrypted with AES in counter
+    // mode and authenticated with HMAC-SHA1 (truncated to 10 bytes).
+
+    enum
+    {
+        AES_VERIFIER_SIZE = 2,
+        AES_MAC_SIZE = 10,
+        AES_ITERATIONS = 1000
+    };
+
+    enum class DecryptStatus
+    {
+        OK,
+        PASSWORD,
+        AUTHENTICATION
+    };
+
+    inline int aes_salt_size(int strength)
+    {
+        return 4 * (strength + 1);
+    }
+
+    inline int aes_key_size(int strength)
+    {
+        return 8 * (strength + 1);
+    }
+
+    class HMAC_SHA1
+    {
+    protected:
+        SHA1Context m_inner;
+        SHA1Context m_outer;
+
+    public:
+        HMAC_SHA1(const uint8* key, size_t size)
+        {
+            uint8 block[64] = { 0 };
+
+            if (size > 64)
+            {
+                uint32 hash[5];
+                sha1(hash, Memory(const_cast<uint8*>(key), size));
+                std::memcpy(block, hash, 20);
+            }
+            else
+            {
+                std::memcpy(block, key, size);
+            }
+
+            for (int i = 0; i < 64; ++i)
+            {
+                block[i] ^= 0x36;
+            }
+
+            m_inner.update(Memory(block, 64));
+
+            for (int i = 0; i < 64; ++i)
+            {
+                block[i] ^= 0x36 ^ 0x5c;
+            }
+
+            m_outer.update(Memory(block, 64));
+        }
+
+        void update(Memory memory)
+        {
+            m_inner.update(memory);
+        }
+
+        void final(uint8 mac[20])
+        {
+            uint32 hash[5];
+            m_inner.final(hash);
+            m_outer.update(Memory(reinterpret_cast<uint8*>(hash), 20));
+            m_outer.final(hash);
+            std::memcpy(mac, hash, 20);
+        }
+    };
+
+    void pbkdf2_sha1(uint8* output, size_t size, const std::string& password, const uint8* salt, size_t salt_size)
+    {
+        // the keyed contexts are copied instead of hashing the key for every iteration
+        const HMAC_SHA1 prf(reinterpret_cast<const uint8*>(password.data()), password.length());
+
+        for (uint32 index = 1; size > 0; ++index)
+        {
+            uint8 counter[4];
+            ustore32be(counter, index);
+
+            HMAC_SHA1 hmac = prf;
+            hmac.update(Memory(const_cast<uint8*>(salt), salt_size));
+            hmac.update(Memory(counter, 4));
+
+            uint8 u[20];
+            uint8 t[20];
+            hmac.final(u);
+            std::memcpy(t, u, 20);
+
+            for (int i = 1; i < AES_ITERATIONS; ++i)
+            {
+                hmac = prf;
+                hmac.update(Memory(u, 20));
+                hmac.final(u);
+
+                for (int j = 0; j < 20; ++j)
+                {
+                    t[j] ^= u[j];
+                }
+            }
+
+            const size_t bytes = std::min(size, size_t(20));
+            std::memcpy(output, t, bytes);
+            output += bytes;
+            size -= bytes;
+        }
+    }
+
+    // The encrypted data is: salt, password verifier, data, mac.
+    DecryptStatus zip_decrypt_aes(uint8* out, const uint8* in, uint64 size, int strength, const std::string& password)
+    {
+        if (password.empty())
+        {
+            // missing password
+            return DecryptStatus::PASSWORD;
+        }
+
+        const int salt_size = aes_salt_size(strength);
+        const int key_size = aes_key_size(strength);
+
+        // aes key, hmac key and the password verifier
+        uint8 keys[32 * 2 + AES_VERIFIER_SIZE];
+        pbkdf2_sha1(keys, key_size * 2 + AES_VERIFIER_SIZE, password, in, salt_size);
+
+        in += salt_size;
+        if (std::memcmp(in, keys + key_size * 2, AES_VERIFIER_SIZE))
+        {
+            // incorrect password
+            return DecryptStatus::PASSWORD;
+        }
+
+        in += AES_VERIFIER_SIZE;
+        size -= salt_size + AES_VERIFIER_SIZE + AES_MAC_SIZE;
+
+        AES aes(keys, key_size * 8);
+        HMAC_SHA1 hmac(keys + key_size, key_size);
+
+        // The counter is a little endian integer; the key stream is computed in
+        // chunks with ECB which pipelines the blocks through the AES unit.
+        constexpr size_t CHUNK_SIZE = 1024 * 4;
+        alignas(16) uint8 keystream[CHUNK_SIZE];
+        uint64 counter = 1;
+
+        for (uint64 offset = 0; offset < size; offset += CHUNK_SIZE)
+        {
+            const size_t bytes = size_t(std::min(size - offset, uint64(CHUNK_SIZE)));
+            const size_t blocks = (bytes + 15) / 16;
+
+            hmac.update(Memory(const_cast<uint8*>(in + offset), bytes));
+
+            for (size_t i = 0; i < blocks; ++i)
+            {
+                ustore64le(keystream + i * 16 + 0, counter++);
+                ustore64le(keystream + i * 16 + 8, 0);
+            }
+
+            aes.ecb_encrypt(keystream, keystream, blocks * 16);
+
+            for (size_t i = 0; i < bytes; ++i)
+            {
+                out[offset + i] = in[offset + i] ^ keystream[i];
+            }
+        }
+
+        uint8 mac[20];
+        hmac.final(mac);
+        if (std::memcmp(in + size, mac, AES_MAC_SIZE))
+        {
+            // the data has been corrupted or tampered with
+            return DecryptStatus::AUTHENTICATION;
+        }
+
+        return DecryptStatus::OK;
+    }
+
+    const char* zip_inflate_error(int zcode)
+    {
+        const char* msg = ID"Internal error.";
+        switch (zcode)
+        {
+            case Z_MEM_ERROR:
+                msg = ID"Memory error.";
+                break;
+
+            case Z_BUF_ERROR:
+                msg = ID"Buffer error.";
+                break;
+
+            case Z_DATA_ERROR:
+                msg = ID"Data error.";
+                break;
+        }
+        return msg;
+    }
+
 	uint64 zip_decompress(uint8* compressed, uint8* uncompressed, uint64 compressedLen, uint64 uncompressedLen)
 	{
 		z_stream zstream;
@@ -385,22 +627,7 @@ namespace
     	int zcode = inflate(&zstream, Z_FINISH);
 		if (zcode != Z_STREAM_END)
         {
-            const char* msg = ID"Internal error.";
-            switch (zcode)
-            {
-                case Z_MEM_ERROR:
-                    msg = ID"Memory error.";
-                    break;
-
-                case Z_BUF_ERROR:
-                    msg = ID"Buffer error.";
-                    break;
-
-                case Z_DATA_ERROR:
-                    msg = ID"Data error.";
-                    break;
-            }
-            MANGO_EXCEPTION(msg);
+            MANGO_EXCEPTION(zip_inflate_error(zcode));
         }
 
 		if (inflateEnd(&zstream) != Z_OK)
@@ -438,6 +665,156 @@ namespace mango
         }
     };
 
+    // -----------------------------------------------------------------
+    // StreamZIP
+    // -----------------------------------------------------------------
+
+    // Inflates the entry sequentially on demand; the output buffer is filled
+    // only up to the furthest offset which has been read so the untouched
+    // pages are never committed and reading the start of a large entry
+    // decompresses only what it needs. The data which has been decompressed
+    // is kept so seeking backwards doesn't restart the decompression. The crc
+    // is accumulated while decompressing and checked at the end of the entry.
+
+    class StreamZIP : public Stream
+    {
+    protected:
+        enum { CHUNK_SIZE = 64 * 1024 };
+
+        z_stream m_zstream;
+        uint8* m_compressed;
+        uint64 m_compressed_size;
+        uint8* m_buffer;
+        uint64 m_size;
+        uint64 m_decoded;
+        uint64 m_offset;
+        uint32 m_expected_crc;
+        uint32 m_crc;
+
+        void decode(uint64 end)
+        {
+            // decompress at least one chunk at a time
+            end = std::min(std::max(end, m_decoded + CHUNK_SIZE), m_size);
+
+            while (m_decoded < end)
+            {
+                if (!m_zstream.avail_in && m_compressed_size)
+                {
+                    // the input is given in pieces as zlib uses 32 bit sizes
+                    const uInt bytes = uInt(std::min(m_compressed_size, uint64(0x40000000)));
+                    m_zstream.next_in = m_compressed;
+                    m_zstream.avail_in = bytes;
+                    m_compressed += bytes;
+                    m_compressed_size -= bytes;
+                }
+
+                m_zstream.next_out = m_buffer + m_decoded;
+                m_zstream.avail_out = uInt(std::min(end - m_decoded, uint64(0x40000000)));
+
+                uint8* output = m_zstream.next_out;
+                int zcode = inflate(&m_zstream, Z_NO_FLUSH);
+                m_decoded = m_zstream.next_out - m_buffer;
+
+                m_crc = crc32(m_crc, Memory(output, m_zstream.next_out - output));
+
+                if (zcode == Z_STREAM_END)
+                {
+                    if (m_decoded != m_size)
+                    {
+                        MANGO_EXCEPTION(ID"Incorrect decompressed size.");
+                    }
+                }
+                else if (zcode != Z_OK)
+                {
+                    MANGO_EXCEPTION(zip_inflate_error(zcode));
+                }
+            }
+
+            if (m_decoded == m_size && m_crc != m_expected_crc)
+            {
+                MANGO_EXCEPTION(ID"CRC mismatch.");
+            }
+        }
+
+    public:
+        StreamZIP(uint8* compressed, uint64 compressed_size, uint64 size, uint32 crc)
+            : m_compressed(compressed)
+            , m_compressed_size(compressed_size)
+            , m_size(size)
+            , m_decoded(0)
+            , m_offset(0)
+            , m_expected_crc(crc)
+            , m_crc(0)
+        {
+            std::memset(&m_zstream, 0, sizeof(m_zstream));
+
+            if (inflateInit2(&m_zstream, -MAX_WBITS) != Z_OK)
+            {
+                MANGO_EXCEPTION(ID"InflateInit failed.");
+            }
+
+            // NOTE: decompression limited on 32 bit platforms
+            m_buffer = new uint8[static_cast<std::size_t>(size)];
+        }
+
+        ~StreamZIP()
+        {
+            inflateEnd(&m_zstream);
+            delete[] m_buffer;
+        }
+
+        uint64 size() const override
+        {
+            return m_size;
+        }
+
+        uint64 offset() const override
+        {
+            return m_offset;
+        }
+
+        void seek(uint64 distance, SeekMode mode) override
+        {
+            switch (mode)
+            {
+                case BEGIN:
+                    m_offset = distance;
+                    break;
+
+                case CURRENT:
+                    m_offset += distance;
+                    break;
+
+                case END:
+                    m_offset = m_size - distance;
+                    break;
+            }
+        }
+
+        void read(void* dest, size_t size) override
+        {
+            if (m_offset > m_size || size > m_size - m_offset)
+            {
+                MANGO_EXCEPTION(ID"Reading past end of file.");
+            }
+
+            if (m_offset + size > m_decoded)
+            {
+                decode(m_offset + size);
+            }
+
+            std::memcpy(dest, m_buffer + m_offset, size);
+            m_offset += size;
+        }
+
+        void write(const void* data, size_t size) override
+        {
+            MANGO_UNREFERENCED_PARAMETER(data);
+            MANGO_UNREFERENCED_PARAMETER(size);
+            MANGO_EXCEPTION(ID"The stream is read-only.");
+        }
+    };
+
     // -----------------------------------------------------------------
     // MapperZIP
     // -----------------------------------------------------------------
@@ -492,12 +869,33 @@ namespace mango
         {
         }
 
+        uint8* getAddress(const DirFileHeader& header, uint8* start) const
+        {
+            LittleEndianPointer p = start + header.localOffset;
+
+            LocalFileHeader localHeader(p);
+            if (!localHeader.status())
+            {
+                MANGO_EXCEPTION(ID"Invalid local header.");
+            }
+
+            uint64 offset = header.localOffset + 30 + localHeader.filenameLen + localHeader.extraFieldLen;
+            return start + offset;
+        }
+
         VirtualMemory* mmap(const DirFileHeader& header, uint8* start, const std::string& password)
         {
             bool encrypted = (header.flags & 1) != 0;
             bool compressed = false;
 
-            switch (header.compression)
+            // WinZip AES stores the actual compression method in the extra field
+            const bool aes = header.compression == 99;
+            if (aes && (header.aesStrength < 1 || header.aesStrength > 3))
+            {
+                MANGO_EXCEPTION(ID"Unsupported AES encryption.");
+            }
+
+            switch (aes ? header.aesCompression : header.compression)
             {
                 case 0:
                     compressed = false;
@@ -512,52 +910,88 @@ namespace mango
                     MANGO_EXCEPTION(ID"Unsupported compression algorithm.");
             }
 
-            LittleEndianPointer p = start + header.localOffset;
+            uint8* address = getAddress(header, start);
+            uint64 size = 0;
+            uint64 compressedSize = header.compressedSize;
 
-            LocalFileHeader localHeader(p);
-            if (!localHeader.status())
+            uint8* buffer = nullptr; // remember allocated memory
+
+            // the decrypted data is scratch memory when it is decompressed
+            Arena arena;
+
+            if (encrypted && aes)
             {
-                MANGO_EXCEPTION(ID"Invalid local header.");
-            }
+                const uint64 overhead = aes_salt_size(header.aesStrength) + AES_VERIFIER_SIZE + AES_MAC_SIZE;
+                if (header.compressedSize < overhead)
+                {
+                    MANGO_EXCEPTION(ID"Invalid AES encrypted data.");
+                }
 
-            uint64 offset = header.localOffset + 30 + localHeader.filenameLen + localHeader.extraFieldLen;
+                compressedSize = header.compressedSize - overhead;
 
-            uint8* address = start + offset;
-            uint64 size = 0;
+                // NOTE: decryption limited on 32 bit platforms
+                const std::size_t decrypted_size = static_cast<std::size_t>(compressedSize);
+                uint8* decrypted = compressed ? arena.allocate<uint8>(decrypted_size) : new uint8[decrypted_size];
+                if (!compressed)
+                {
+                    buffer = decrypted;
+                }
 
-            uint8* buffer = nullptr; // remember allocated memory
+                DecryptStatus status = zip_decrypt_aes(decrypted, address, header.compressedSize,
+                                                       header.aesStrength, password);
+                if (status != DecryptStatus::OK)
+                {
+                    delete[] buffer;
+                    if (status == DecryptStatus::PASSWORD)
+                    {
+                        MANGO_EXCEPTION(ID"Decryption failed (probably incorrect password).");
+                    }
+                    MANGO_EXCEPTION(ID"Decryption failed (authentication code mismatch).");
+                }
 
-            if (encrypted)
+                address = decrypted;
+            }
+            else if (encrypted)
             {
+                if (header.compressedSize < DCKEYSIZE)
+                {
+                    MANGO_EXCEPTION(ID"Invalid encrypted data.");
+                }
+
                 // decryption header
                 uint8* dcheader = address;
                 address += DCKEYSIZE;
+                compressedSize = header.compressedSize - DCKEYSIZE;
 
                 // NOTE: decryption limited on 32 bit platforms
-                const std::size_t compressed_size = static_cast<std::size_t>(header.compressedSize);
-                buffer = new uint8[compressed_size];
+                const std::size_t decrypted_size = static_cast<std::size_t>(compressedSize);
+                uint8* decrypted = compressed ? arena.allocate<uint8>(decrypted_size) : new uint8[decrypted_size];
+                if (!compressed)
+                {
+                    buffer = decrypted;
+                }
+
+                // the password check uses the modification time when the crc is stored after the data
+                const uint32 check = (header.flags & 8) ? uint32(header.lastModTime) << 16 : header.crc;
 
-                bool status = zip_decrypt(buffer, address, header.compressedSize, dcheader,
-                                          header.versionUsed & 0xff, header.crc, password);
+                bool status = zip_decrypt(decrypted, address, compressedSize, dcheader,
+                                          header.versionUsed & 0xff, check, password);
                 if (!status)
                 {
                     delete[] buffer;
                     MANGO_EXCEPTION(ID"Decryption failed (probably incorrect password).");
                 }
 
-                address = buffer;
+                address = decrypted;
             }
 
             if (compressed)
             {
                 // NOTE: decompression limited on 32 bit platforms
                 const std::size_t uncompressed_size = static_cast<std::size_t>(header.uncompressedSize);
-                uint8* uncompressed_buffer = new uint8[uncompressed_size];
-
-                uint64 outsize = zip_decompress(address, uncompressed_buffer, header.compressedSize, header.uncompressedSize);
+                buffer = new uint8[uncompressed_size];
 
-                delete[] buffer;
-                buffer = uncompressed_buffer;
+                uint64 outsize = zip_decompress(address, buffer, compressedSize, header.uncompressedSize);
 
                 if (outsize != header.uncompressedSize)
                 {
@@ -575,6 +1009,16 @@ namespace mango
                 size = header.uncompressedSize;
             }
 
+            // AE-2 doesn't store the crc as the mac already authenticates the data
+            if (aes && header.aesVersion == 1)
+            {
+                if (crc32(0, Memory(address, size_t(size))) != header.crc)
+                {
+                    delete[] buffer;
+                    MANGO_EXCEPTION(ID"CRC mismatch.");
+                }
+            }
+
             VirtualMemory* memory;
             if (buffer)
             {
@@ -627,7 +1071,8 @@ namespace mango
                     else
                     {
                         uint32 flags = 0;
-                        if (header.compression > 0)
+                        const uint16 compression = header.compression == 99 ? header.aesCompression : header.compression;
+                        if (compression > 0)
                         {
                             flags |= FileInfo::COMPRESSED;
                         }
@@ -646,7 +1091,56 @@ namespace mango
                 MANGO_EXCEPTION(ID"File not found.");
             }
 
-            return mmap(i->second, m_parent_memory.address, m_password);
+            const DirFileHeader& header = i->second;
+            const uint16 compression = header.compression == 99 ? header.aesCompression : header.compression;
+            const bool encrypted = (header.flags & 1) != 0;
+
+            // the decompressed entries are shared through the cache; the encrypted
+            // entries are not so that the password is checked for every mapping
+            if (compression != 8 || encrypted)
+            {
+                return mmap(header, m_parent_memory.address, m_password);
+            }
+
+            ContainerCacheKey key;
+            key.container = m_parent_memory.address;
+            key.size = m_parent_memory.size;
+            key.entry = filename;
+            key.mtime = (uint32(header.lastModDate) << 16) | header.lastModTime;
+            key.crc = header.crc;
+
+            return mapContainerEntry(key, header.uncompressedSize, [&] (Memory dest) {
+                uint8* address = getAddress(header, m_parent_memory.address);
+                uint64 outsize = zip_decompress(address, dest.address, header.compressedSize, header.uncompressedSize);
+                if (outsize != header.uncompressedSize)
+                {
+                    MANGO_EXCEPTION(ID"Incorrect decompressed size.");
+                }
+            }, [&] {
+                return mmap(header, m_parent_memory.address, m_password);
+            });
+        }
+
+        Stream* open(const std::string& filename) override
+        {
+            auto i = m_files.find(filename);
+            if (i == m_files.end())
+            {
+                MANGO_EXCEPTION(ID"File not found.");
+            }
+
+            const DirFileHeader& header = i->second;
+
+            // the encrypted entries are authenticated before use and the stored
+            // entries are mapped without a copy so only deflate is streamed
+            const bool encrypted = (header.flags & 1) != 0;
+            if (encrypted || header.compression != 8)
+            {
+                return AbstractMapper::open(filename);
+            }
+
+            uint8* address = getAddress(header, m_parent_memory.address);
+            return new StreamZIP(address, header.compressedSize, header.uncompressedSize, header.crc);
         }
     };
 
@@ -532,18 +532,17 @@ namespace mango
         if (!encode)
             return;
 
-        ConcurrentQueue queue;
-
         uint8* address = memory.address;
 
         const int xblocks = round_to_next(surface.width, width);
         const int yblocks = round_to_next(surface.height, height);
 
-        for (int y = 0; y < yblocks; ++y)
+        parallel_for(BlockRange(0, yblocks), [this, xblocks, &surface, address] (const BlockRange& range)
         {
-            queue.enqueue([this, y, xblocks, &surface, address]
+            Bitmap temp(width, height, format);
+
+            for (int y = range.begin; y < range.end; ++y)
             {
-                Bitmap temp(width, height, format);
                 uint8* data = address + y * xblocks * bytes;
 
                 for (int x = 0; x < xblocks; ++x)
@@ -555,10 +554,8 @@ namespace mango
                     encode(*this, data, image, temp.stride);
                     data += bytes;
                 }
-            });
-        }
-
-        queue.wait();
+            }
+        });
     }
 
 } // namespace mango
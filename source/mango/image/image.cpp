@@ -3,10 +3,16 @@
     Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <map>
+#include <cstdlib>
+#include <algorithm>
 #include <mango/core/string.hpp>
 #include <mango/core/timer.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/filesystem/file.hpp>
 #include <mango/image/image.hpp>
 
+#define ID "ImageDecoder: "
+
 namespace mango
 {
 
@@ -211,6 +217,79 @@ namespace mango
         }
     }
 
+    // ----------------------------------------------------------------------------
+    // getImageHeader()
+    // ----------------------------------------------------------------------------
+
+    static ImageHeader getImageHeader(MapperStream& stream)
+    {
+        ImageHeader header;
+
+        const size_t size = size_t(stream.size());
+        if (!size || !isImageDecoder(stream.filename()))
+        {
+            return header;
+        }
+
+        // The decoders are given a buffer of the full size so that they never
+        // read outside of it; the part which has not been read yet is zero.
+        // calloc() gets the large buffers as fresh pages from the system so
+        // they are committed only where the data is copied.
+        uint8* buffer = reinterpret_cast<uint8*>(std::calloc(size, 1));
+        if (!buffer)
+        {
+            MANGO_EXCEPTION(ID"Out of memory.");
+        }
+
+        size_t prefix = 0;
+
+        try
+        {
+            for (size_t bytes = 64 * 1024; ; bytes *= 4)
+            {
+                bytes = std::min(bytes, size);
+                stream.read(buffer + prefix, bytes - prefix);
+                prefix = bytes;
+
+                try
+                {
+                    ImageDecoder decoder(Memory(buffer, size), stream.filename());
+                    header = decoder.header();
+                }
+                catch (Exception&)
+                {
+                    // the header extends past the prefix
+                    if (prefix == size)
+                        throw;
+                    header = ImageHeader();
+                }
+
+                if ((header.width > 0 && header.height > 0) || prefix == size)
+                    break;
+            }
+        }
+        catch (...)
+        {
+            std::free(buffer);
+            throw;
+        }
+
+        std::free(buffer);
+        return header;
+    }
+
+    ImageHeader getImageHeader(const Path& path, const std::string& filename)
+    {
+        MapperStream stream(path, filename);
+        return getImageHeader(stream);
+    }
+
+    ImageHeader getImageHeader(const std::string& filename)
+    {
+        MapperStream stream(filename);
+        return getImageHeader(stream);
+    }
+
     // ----------------------------------------------------------------------------
     // ImageEncoder
     // ----------------------------------------------------------------------------
@@ -109,6 +109,9 @@ namespace
 
         Buffer m_compressed;
 
+        // scratch memory for the decoding
+        Arena m_arena;
+
         // IHDR
         int m_width;
         int m_height;
@@ -599,13 +602,10 @@ namespace
 
     void ParserPNG::filter(uint8* buffer, int bytes, int height)
     {
+        ArenaScope scope(m_arena);
+
         // zero scanline
-        uint8* zero = new uint8[bytes];
-        if (!zero)
-        {
-            setError("Memory allocation failed.");
-            return;
-        }
+        uint8* zero = m_arena.allocate<uint8>(bytes);
         std::memset(zero, 0, bytes);
         const uint8* p = zero;
 
@@ -687,19 +687,12 @@ namespace
             p = s;
             s += bytes;
         }
-
-        delete[] zero;
     }
 
     uint8* ParserPNG::deinterlace1to4(uint8* buffer)
     {
         const int stride = FILTER_BYTE + m_bytes_per_line;
-        uint8* temp = new uint8[m_height * stride];
-        if (!temp)
-        {
-            setError("Memory allocation failed.");
-            return buffer;
-        }
+        uint8* temp = m_arena.allocate<uint8>(m_height * stride);
         std::memset(temp, 0, m_height * stride);
 
         uint8* p = buffer;
@@ -743,19 +736,13 @@ namespace
         }
 
         // migrate to deinterleaved temp buffer
-        delete[] buffer;
         return temp;
     }
 
     uint8* ParserPNG::deinterlace8to16(uint8* buffer)
     {
         const int stride = FILTER_BYTE + m_bytes_per_line;
-        uint8* temp = new uint8[m_height * stride];
-        if (!temp)
-        {
-            setError("Memory allocation failed.");
-            return buffer;
-        }
+        uint8* temp = m_arena.allocate<uint8>(m_height * stride);
 
         uint8* p = buffer;
         const int size = m_bytes_per_line / m_width;
@@ -795,7 +782,6 @@ namespace
         }
 
         // migrate to deinterleaved temp buffer
-        delete[] buffer;
         return temp;
     }
 
@@ -1270,14 +1256,12 @@ namespace
                 buffer_size = (FILTER_BYTE + m_bytes_per_line) * m_height;
             }
 
+            // the decompressed and deinterlaced buffers are released after processing
+            ArenaScope scope(m_arena);
+
             // allocate output buffer
             print("  buffer bytes: %d\n", buffer_size);
-            uint8* buffer = new uint8[buffer_size];
-            if (!buffer)
-            {
-                setError("Memory allocation failed.");
-                return m_error;
-            }
+            uint8* buffer = m_arena.allocate<uint8>(buffer_size);
 
             // decompress stream
             mz_stream stream;
@@ -1305,8 +1289,7 @@ namespace
             status = mz_inflateEnd(&stream);
 
             // process image
-            buffer = process(dest.image, dest.stride, buffer, ptr_palette);
-            delete[] buffer;
+            process(dest.image, dest.stride, buffer, ptr_palette);
         }
 
         return m_error;
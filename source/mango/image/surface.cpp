@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <mango/core/exception.hpp>
 #include <mango/core/thread.hpp>
+#include <mango/core/parallel.hpp>
 #include <mango/core/string.hpp>
 #include <mango/core/bits.hpp>
 #include <mango/core/half.hpp>
@@ -176,7 +177,12 @@ namespace
     // load_surface()
     // ----------------------------------------------------------------------------
 
-    Surface load_surface(Memory memory, const std::string& extension, const Format* format)
+    uint8* allocate_image(size_t size)
+    {
+        return reinterpret_cast<uint8*>(aligned_malloc(size, 64));
+    }
+
+    Surface load_surface(Memory memory, const std::string& extension, const Format* format, BitmapPool* pool = nullptr)
     {
         Surface surface(0, 0, Format(), 0, nullptr);
 
@@ -189,8 +195,17 @@ namespace
             surface.width  = header.width;
             surface.height = header.height;
             surface.format = format ? *format : header.format;
-            surface.stride = surface.width * surface.format.bytes();
-            surface.image  = new uint8[surface.height * surface.stride];
+
+            if (pool)
+            {
+                surface.stride = pool->getStride(surface.width, surface.format);
+                surface.image  = pool->acquire(surface.stride, surface.height);
+            }
+            else
+            {
+                surface.stride = surface.width * surface.format.bytes();
+                surface.image  = allocate_image(size_t(surface.height) * surface.stride);
+            }
 
             // decode
             decoder.decode(surface, nullptr, 0, 0, 0);
@@ -199,11 +214,11 @@ namespace
         return surface;
     }
 
-    Surface load_surface(const std::string& filename, const Format* format)
+    Surface load_surface(const std::string& filename, const Format* format, BitmapPool* pool = nullptr)
     {
         const std::string extension = getExtension(filename);
         File file(filename);
-        Surface surface = load_surface(file, extension, format);
+        Surface surface = load_surface(file, extension, format, pool);
         return surface;
     }
 
@@ -223,7 +238,7 @@ namespace
                 surface.height = header.height;
                 surface.format = Format(8, 0xff, 0);
                 surface.stride = surface.width;
-                surface.image  = new uint8[surface.height * surface.stride];
+                surface.image  = allocate_image(size_t(surface.height) * surface.stride);
 
                 // decode
                 decoder.decode(surface, &palette, 0, 0, 0);
@@ -403,58 +418,32 @@ namespace mango
         rect.width = dest.width;
         rect.height = dest.height;
 
-        ConcurrentQueue queue("blit", Priority::HIGH);
-
         Blitter blitter(dest.format, source.format);
 
-        const int threads = ThreadPool::getInstanceSize();
-        const int tasksize = (rect.width * rect.height) / threads;
-
-        const bool fast = dest.format == source.format;
-
-        // don't use thread pool for:
-        // - really small tasks
-        // - when the pixel formats are identical ("fast mode")
-        const int N = (tasksize < 8192) || fast ? 1 : threads;
-        const int section = rect.height / N;
-
-        int ypos = 0;
-
-        // queue conversion tasks
-        for (int i = 0; i < N; ++i)
+        auto convert = [&] (const BlockRange& range)
         {
-            const bool last = (i == (N - 1));
-            const int ycount = last ? rect.height - ypos : section;
-
-            if (N == 1)
-            {
-                // execute on main thread
-                BlitRect temp = rect;
-
-                temp.destImage += ypos * rect.destStride;
-                temp.srcImage += ypos * rect.srcStride;
-                temp.height = ycount;
+            BlitRect temp = rect;
 
-                blitter.convert(temp);
-            }
-            else
-            {
-                queue.enqueue([=, &blitter]
-                {
-                    BlitRect temp = rect;
+            temp.destImage += range.begin * rect.destStride;
+            temp.srcImage += range.begin * rect.srcStride;
+            temp.height = range.size();
 
-                    temp.destImage += ypos * rect.destStride;
-                    temp.srcImage += ypos * rect.srcStride;
-                    temp.height = ycount;
+            blitter.convert(temp);
+        };
 
-                    blitter.convert(temp);
-                });
-            }
+        const bool fast = dest.format == source.format;
 
-            ypos += section;
+        if (fast)
+        {
+            // identical pixel formats are a memory copy ("fast mode")
+            convert(BlockRange(0, rect.height));
+        }
+        else
+        {
+            // blocks smaller than 8K pixels are not worth splitting
+            const int grain = std::max(1, 8192 / std::max(1, rect.width));
+            parallel_for(BlockRange(0, rect.height, grain), convert);
         }
-
-        queue.wait();
     }
 
     void Surface::xflip()
@@ -529,7 +518,44 @@ namespace mango
             stride = width * format.bytes();
 
         if (!image)
-            image = new uint8[stride * height];
+            image = allocate_image(size_t(stride) * height);
+        else
+            m_aligned = false;
+    }
+
+    Bitmap::Bitmap(int _width, int _height, const Format& _format, const AllocationPolicy& policy, int _stride)
+        : Surface(_width, _height, _format, _stride, nullptr)
+    {
+        if (!stride)
+            stride = width * format.bytes();
+
+        image = reinterpret_cast<uint8*>(aligned_malloc(size_t(stride) * height, 64, policy));
+    }
+
+    Bitmap::Bitmap(BitmapPool& pool, int _width, int _height, const Format& _format)
+        : Surface(_width, _height, _format, 0, nullptr)
+        , m_pool(&pool)
+    {
+        stride = pool.getStride(width, format);
+        image = pool.acquire(stride, height);
+        m_pool_stride = stride;
+        m_pool_height = height;
+    }
+
+    Bitmap::Bitmap(BitmapPool& pool, Memory memory, const std::string& extension, const Format& format)
+        : Surface(load_surface(memory, extension, &format, &pool))
+        , m_pool(&pool)
+        , m_pool_stride(stride)
+        , m_pool_height(height)
+    {
+    }
+
+    Bitmap::Bitmap(BitmapPool& pool, const std::string& filename, const Format& format)
+        : Surface(load_surface(filename, &format, &pool))
+        , m_pool(&pool)
+        , m_pool_stride(stride)
+        , m_pool_height(height)
+    {
     }
 
     Bitmap::Bitmap(Memory memory, const std::string& extension)
@@ -564,23 +590,49 @@ namespace mango
 
     Bitmap::Bitmap(Bitmap&& bitmap)
         : Surface(bitmap)
+        , m_aligned(bitmap.m_aligned)
+        , m_pool(bitmap.m_pool)
+        , m_pool_stride(bitmap.m_pool_stride)
+        , m_pool_height(bitmap.m_pool_height)
     {
         bitmap.image = nullptr;
     }
 
     Bitmap::~Bitmap()
     {
-        delete[] image;
+        release();
+    }
+
+    void Bitmap::release()
+    {
+        if (m_pool)
+            m_pool->release(image, m_pool_stride, m_pool_height);
+        else if (m_aligned)
+            aligned_free(image);
+        else
+            delete[] image;
+
+        image = nullptr;
     }
 
     Bitmap& Bitmap::operator = (Bitmap&& bitmap)
     {
+        if (this == &bitmap)
+            return *this;
+
+        // free the current image
+        release();
+
         // copy surface
         width = bitmap.width;
         height = bitmap.height;
         format = bitmap.format;
         stride = bitmap.stride;
         image = bitmap.image;
+        m_aligned = bitmap.m_aligned;
+        m_pool = bitmap.m_pool;
+        m_pool_stride = bitmap.m_pool_stride;
+        m_pool_height = bitmap.m_pool_height;
 
         // move image ownership
         bitmap.image = nullptr;
@@ -588,4 +640,99 @@ namespace mango
         return *this;
     }
 
+    // ----------------------------------------------------------------------------
+    // BitmapPool
+    // ----------------------------------------------------------------------------
+
+    BitmapPool::BitmapPool(size_t budget, int alignment, const AllocationPolicy& policy)
+        : m_budget(budget)
+        , m_cached(0)
+        , m_alignment(std::max(alignment, 1))
+        , m_policy(policy)
+    {
+    }
+
+    BitmapPool::~BitmapPool()
+    {
+        trim(0);
+    }
+
+    int BitmapPool::getStride(int width, const Format& format) const
+    {
+        const int bytes = width * format.bytes();
+        return (bytes + m_alignment - 1) / m_alignment * m_alignment;
+    }
+
+    uint8* BitmapPool::acquire(int stride, int height)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // most recently released first; its pages are most likely still warm
+        for (size_t i = m_blocks.size(); i-- > 0; )
+        {
+            const Block& block = m_blocks[i];
+            if (block.stride == stride && block.height == height)
+            {
+                uint8* image = block.image;
+                m_cached -= size_t(stride) * height;
+                m_blocks.erase(m_blocks.begin() + i);
+                return image;
+            }
+        }
+
+        lock.unlock();
+
+        return reinterpret_cast<uint8*>(aligned_malloc(size_t(stride) * height, 64, m_policy));
+    }
+
+    void BitmapPool::release(uint8* image, int stride, int height)
+    {
+        if (!image)
+            return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Block block;
+        block.image = image;
+        block.stride = stride;
+        block.height = height;
+        m_blocks.push_back(block);
+        m_cached += size_t(stride) * height;
+
+        evict(m_budget);
+    }
+
+    void BitmapPool::evict(size_t budget)
+    {
+        // called with the mutex locked
+        size_t count = 0;
+        while (m_cached > budget && count < m_blocks.size())
+        {
+            const Block& block = m_blocks[count++];
+            m_cached -= size_t(block.stride) * block.height;
+            aligned_free(block.image);
+        }
+
+        m_blocks.erase(m_blocks.begin(), m_blocks.begin() + count);
+    }
+
+    void BitmapPool::trim(size_t budget)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        evict(budget);
+    }
+
+    void BitmapPool::setBudget(size_t budget)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget = budget;
+        evict(m_budget);
+    }
+
+    size_t BitmapPool::size()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_cached;
+    }
+
 } // namespace mango
@@ -55,6 +55,7 @@ namespace jpeg
     using mango::Surface;
 	using mango::Stream;
     using mango::ThreadPool;
+    using mango::Arena;
 
     using BlockType = mango::int16;
 
@@ -310,6 +311,9 @@ namespace jpeg
         AlignedVector<uint16> quantTableVector;
         BlockType* blockVector;
 
+        // scratch memory for the decoding
+        Arena m_arena;
+
         std::vector< Frame > frames;
         Frame* scanFrame; // current Progressive AC scan frame
 
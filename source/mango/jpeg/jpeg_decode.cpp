@@ -291,7 +291,6 @@ namespace jpeg
 
     Parser::~Parser()
     {
-        aligned_free(blockVector);
     }
 
     bool Parser::isJPEG(Memory memory) const
@@ -1330,7 +1329,8 @@ namespace jpeg
 
         // allocate blocks
         int count = mcus * blocks_in_mcu * 64;
-        blockVector = reinterpret_cast<BlockType*>(aligned_malloc(count * sizeof(BlockType)));
+        m_arena.reset();
+        blockVector = m_arena.allocate<BlockType>(count);
 
         // target surface size has to match (clipping isn't yet supported)
         if (target.width != xsize || target.height != ysize)
@@ -1442,18 +1442,52 @@ namespace jpeg
         uint8* image = m_surface->address<uint8>(0, 0);
 
         ConcurrentQueue queue("jpeg.sequential", Priority::HIGH);
+        queue.setNode(getMemoryNode(image));
 
-        if (!restartInterval)
+        BlockType* data = blockVector;
+        const int mcu_data_size = blocks_in_mcu * 64;
+
+        auto processRows = [=] (const BlockRange& range)
         {
-            BlockType* data = blockVector;
-            const int mcu_data_size = blocks_in_mcu * 64;
+            for (int y = range.begin; y < range.end; ++y)
+            {
+                uint8* dest = image + y * ystride;
+                BlockType* source = data + y * xmcu * mcu_data_size;
+
+                ProcessFunc process = processState.process;
+                int width = xblock;
+                int height = yblock;
+
+                if (yclip && y == ymcu - 1)
+                {
+                    process = processState.clipped;
+                    height = yclip;
+                }
+
+                for (int x = 0; x < xmcu; ++x)
+                {
+                    if (xclip && x == xmcu - 1)
+                    {
+                        process = processState.clipped;
+                        width = xclip;
+                    }
 
+                    process(dest, stride, source, &processState, width, height);
+                    source += mcu_data_size;
+                    dest += xstride;
+                }
+            }
+        };
+
+        if (!restartInterval)
+        {
             const int pool_size = ThreadPool::getInstanceSize();
 
             const int S = pool_size > 1 ? 4 * pool_size : 1;
             const int N = std::max(ymcu / S, pool_size);
 
-            // use threadpool to process blocks
+            // decode a batch of rows and let the threadpool process it while
+            // the next batch is being decoded
             for (int y = 0; y < ymcu; y += N)
             {
                 const int y0 = y;
@@ -1469,37 +1503,9 @@ namespace jpeg
                     handleRestart();
                 }
 
-                // enqueue task
-                queue.enqueue([=] {
-                    for (int y = y0; y < y1; ++y)
-                    {
-                        uint8* dest = image + y * ystride;
-                        BlockType* source = data + y * xmcu * mcu_data_size;
-
-                        ProcessFunc process = processState.process;
-                        int width = xblock;
-                        int height = yblock;
-
-                        if (yclip && y == ymcu - 1)
-                        {
-                            process = processState.clipped;
-                            height = yclip;
-                        }
-
-                        for (int x = 0; x < xmcu; ++x)
-                        {
-                            if (xclip && x == xmcu - 1)
-                            {
-                                process = processState.clipped;
-                                width = xclip;
-                            }
-
-                            process(dest, stride, source, &processState, width, height);
-                            source += mcu_data_size;
-                            dest += xstride;
-                        }
-                    }
-                });
+                // at least a few rows per task; single-row tasks cost more to
+                // schedule than they take to process
+                parallel_for(queue, BlockRange(y0, y1, 4), processRows);
             }
         }
         else
@@ -1689,50 +1695,43 @@ namespace jpeg
         BlockType* data = blockVector;
 
         ConcurrentQueue queue("jpeg.progressive", Priority::HIGH);
-        const int pool_size = ThreadPool::getInstanceSize();
+        queue.setNode(getMemoryNode(image));
 
-        const int S = pool_size > 1 ? 4 * pool_size : 1;
-        const int N = std::max(ymcu / S, pool_size);
-
-        // use threadpool to process blocks
-        for (int y = 0; y < ymcu; y += N)
+        auto processRows = [=] (const BlockRange& range)
         {
-            const int y0 = y;
-            const int y1 = std::min(y + N, ymcu);
-            jpegPrint("  Process: [%d, %d] --> ThreadPool.\n", y0, y1 - 1);
+            jpegPrint("  Process: [%d, %d] --> ThreadPool.\n", range.begin, range.end - 1);
 
-            // enqueue task
-            queue.enqueue([=] {
-                for (int y = y0; y < y1; ++y)
-                {
-                    uint8* dest = image + y * ystride;
-                    BlockType* source = data + y * xmcu * mcu_data_size;
+            for (int y = range.begin; y < range.end; ++y)
+            {
+                uint8* dest = image + y * ystride;
+                BlockType* source = data + y * xmcu * mcu_data_size;
+
+                ProcessFunc process = processState.process;
+                int width = xblock;
+                int height = yblock;
 
-                    ProcessFunc process = processState.process;
-                    int width = xblock;
-                    int height = yblock;
+                if (yclip && y == ymcu - 1)
+                {
+                    process = processState.clipped;
+                    height = yclip;
+                }
 
-                    if (yclip && y == ymcu - 1)
+                for (int x = 0; x < xmcu; ++x)
+                {
+                    if (xclip && x == xmcu - 1)
                     {
                         process = processState.clipped;
-                        height = yclip;
+                        width = xclip;
                     }
 
-                    for (int x = 0; x < xmcu; ++x)
-                    {
-                        if (xclip && x == xmcu - 1)
-                        {
-                            process = processState.clipped;
-                            width = xclip;
-                        }
-
-                        process(dest, stride, source, &processState, width, height);
-                        source += mcu_data_size;
-                        dest += xstride;
-                    }
+                    process(dest, stride, source, &processState, width, height);
+                    source += mcu_data_size;
+                    dest += xstride;
                 }
-            });
-        }
+            }
+        };
+
+        parallel_for(queue, BlockRange(0, ymcu, 4), processRows);
 
         // synchronize
         queue.wait();
@@ -986,30 +986,29 @@ namespace
         // writing marker data
         jp.write_markers(s, sample_format, surface.width, surface.height);
 
-        ConcurrentQueue queue;
-
         // bitstream for each MCU scan
-        Buffer* buffers = new Buffer[jp.vertical_mcus];
+        std::vector<Buffer> buffers(jp.vertical_mcus);
 
         // encode MCUs
         const int bottom_mcu = jp.vertical_mcus - 1;
 
-        for (int y = 0; y < jp.vertical_mcus; ++y)
+        parallel_for(BlockRange(0, jp.vertical_mcus), [&jp, &surface, &buffers, input, bottom_mcu] (const BlockRange& range)
         {
-            int rows;
-
-            if (y < bottom_mcu)
+            for (int y = range.begin; y < range.end; ++y)
             {
-                rows = jp.mcu_height;
-            }
-            else
-            {
-                // clipping
-                rows = jp.rows_in_bottom_mcus;
-            }
+                u8* image = input + y * surface.stride * jp.mcu_height;
 
-            queue.enqueue([&jp, y, buffers, input, rows] {
-                u8* image = input;
+                int rows;
+
+                if (y < bottom_mcu)
+                {
+                    rows = jp.mcu_height;
+                }
+                else
+                {
+                    // clipping
+                    rows = jp.rows_in_bottom_mcus;
+                }
 
                 HuffmanEncoder huffman;
 
@@ -1064,12 +1063,8 @@ namespace
                 // flush encoding buffer
                 ptr = huffman.flush(ptr);
                 buffers[y].write(huff_temp, ptr - huff_temp);
-            });
-
-            input += surface.stride * jp.mcu_height;
-        }
-
-        queue.wait();
+            }
+        });
 
         for (int y = 0; y < jp.vertical_mcus; ++y)
         {
@@ -1083,8 +1078,6 @@ namespace
             s.write16(0xffd0 + index);
         }
 
-        delete[] buffers;
-
         // EOI marker
         s.write16(0xffd9);
     }
@@ -0,0 +1,327 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <vector>
+#include <mango/core/aes.hpp>
+#include "test.hpp"
+
+using namespace mango;
+
+namespace
+{
+
+    // 128 bit big endian increment of the counter block
+    void increment(u8* counter)
+    {
+        for (int i = 15; i >= 0 && !++counter[i]; --i)
+            ;
+    }
+
+    // ----------------------------------------------------------------------------
+    // ECB / CBC / CTR
+    // ----------------------------------------------------------------------------
+
+    void test_aes_ecb()
+    {
+        // FIPS-197 appendix C
+        const std::vector<u8> key = test::hex("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f");
+        std::vector<u8> plain = test::hex("00112233445566778899aabbccddeeff");
+
+        const char* expected[] =
+        {
+            "69c4e0d86a7b0430d8cdb78070b4c55a",
+            "dda97ca4864cdfe06eaf70a0ec0d7191",
+            "8ea2b7ca516745bfeafc49904b496089",
+        };
+
+        for (int i = 0; i < 3; ++i)
+        {
+            AES aes(key.data(), 128 + i * 64);
+
+            std::vector<u8> cipher(16);
+            aes.ecb_encrypt(cipher.data(), plain.data(), 16);
+            CHECK(cipher == test::hex(expected[i]));
+
+            std::vector<u8> decrypted(16);
+            aes.ecb_decrypt(decrypted.data(), cipher.data(), 16);
+            CHECK(decrypted == plain);
+        }
+
+        // the pipelined blocks give the same result as the blocks one at a time
+        std::vector<u8> data = test::random_data(16 * 37, 1);
+
+        for (int bits = 128; bits <= 256; bits += 64)
+        {
+            AES aes(key.data(), bits);
+
+            std::vector<u8> cipher(data.size());
+            aes.ecb_encrypt(cipher.data(), data.data(), data.size());
+
+            std::vector<u8> block(16);
+            for (size_t offset = 0; offset < data.size(); offset += 16)
+            {
+                aes.ecb_encrypt(block.data(), data.data() + offset, 16);
+                CHECK(std::equal(block.begin(), block.end(), cipher.begin() + offset));
+            }
+
+            std::vector<u8> decrypted(data.size());
+            aes.ecb_decrypt(decrypted.data(), cipher.data(), cipher.size());
+            CHECK(decrypted == data);
+        }
+    }
+
+    void test_aes_cbc_ctr()
+    {
+        // NIST SP 800-38A F.2.1 and F.5.1
+        const std::vector<u8> key = test::hex("2b7e151628aed2a6abf7158809cf4f3c");
+        std::vector<u8> plain = test::hex(
+            "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+            "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710");
+
+        AES aes(key.data(), 128);
+        std::vector<u8> output(plain.size());
+        std::vector<u8> decrypted(plain.size());
+
+        const std::vector<u8> cbc_iv = test::hex("000102030405060708090a0b0c0d0e0f");
+        aes.cbc_encrypt(output.data(), plain.data(), plain.size(), cbc_iv.data());
+        CHECK(output == test::hex(
+            "7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+            "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7"));
+        aes.cbc_decrypt(decrypted.data(), output.data(), output.size(), cbc_iv.data());
+        CHECK(decrypted == plain);
+
+        const std::vector<u8> ctr_iv = test::hex("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+        aes.ctr_encrypt(output.data(), plain.data(), plain.size(), ctr_iv.data());
+        CHECK(output == test::hex(
+            "874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff"
+            "5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee"));
+        aes.ctr_decrypt(decrypted.data(), output.data(), output.size(), ctr_iv.data());
+        CHECK(decrypted == plain);
+    }
+
+    void test_aes_ctr()
+    {
+        // the keystream is the encrypted counter; the counter carries over the
+        // 32 and 64 bit boundaries inside the pipelined blocks
+        const std::vector<u8> key = test::hex("603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4");
+        std::vector<u8> iv = test::hex("00010203040506ffffffffffffffffe3");
+        std::vector<u8> data = test::random_data(16 * 301, 2);
+
+        for (int bits = 128; bits <= 256; bits += 64)
+        {
+            AES aes(key.data(), bits);
+
+            std::vector<u8> expected(data.size());
+            std::vector<u8> counter = iv;
+
+            for (size_t offset = 0; offset < data.size(); offset += 16)
+            {
+                aes.ecb_encrypt(expected.data() + offset, counter.data(), 16);
+                for (int i = 0; i < 16; ++i)
+                {
+                    expected[offset + i] ^= data[offset + i];
+                }
+                increment(counter.data());
+            }
+
+            std::vector<u8> cipher(data.size());
+            aes.ctr_encrypt(cipher.data(), data.data(), data.size(), iv.data());
+            CHECK(cipher == expected);
+
+            // the cbc decryption is pipelined, the encryption is serial
+            std::vector<u8> decrypted(data.size());
+            aes.cbc_encrypt(cipher.data(), data.data(), data.size(), iv.data());
+            aes.cbc_decrypt(decrypted.data(), cipher.data(), cipher.size(), iv.data());
+            CHECK(decrypted == data);
+        }
+    }
+
+    void test_aes_ctr_parallel()
+    {
+        // the large buffers are split into segments with their own counters
+        const std::vector<u8> key = test::hex("000102030405060708090a0b0c0d0e0f");
+        std::vector<u8> iv = test::hex("0f0e0d0c0b0a0908ffffffffffff0000");
+        std::vector<u8> data = test::random_data(5 * 1024 * 1024 + 16 * 3, 3);
+
+        AES aes(key.data(), 128);
+
+        std::vector<u8> expected(data.size());
+        aes.ctr_encrypt(expected.data(), data.data(), data.size(), iv.data());
+
+        std::vector<u8> cipher(data.size());
+        aes.ctr_encrypt_parallel(cipher.data(), data.data(), data.size(), iv.data());
+        CHECK(cipher == expected);
+
+        std::vector<u8> decrypted(data.size());
+        aes.ctr_decrypt_parallel(decrypted.data(), cipher.data(), cipher.size(), iv.data());
+        CHECK(decrypted == data);
+    }
+
+    // ----------------------------------------------------------------------------
+    // GCM
+    // ----------------------------------------------------------------------------
+
+    struct VectorGCM
+    {
+        const char* key;
+        const char* iv;
+        const char* plain;
+        const char* associated;
+        const char* cipher;
+        const char* tag;
+    };
+
+    void test_aes_gcm()
+    {
+        // The Galois/Counter Mode of Operation, test cases 1, 2, 4, 5 and 16
+        const char* plain =
+            "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+            "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39";
+        const char* associated = "feedfacedeadbeeffeedfacedeadbeefabaddad2";
+
+        const VectorGCM vectors[] =
+        {
+            { "00000000000000000000000000000000", "000000000000000000000000", "", "",
+              "",
+              "58e2fccefa7e3061367f1d57a4e7455a" },
+            { "00000000000000000000000000000000", "000000000000000000000000", "00000000000000000000000000000000", "",
+              "0388dace60b6a392f328c2b971b2fe78",
+              "ab6e47d42cec13bdf53a67b21257bddf" },
+            { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", plain, associated,
+              "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+              "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+              "5bc94fbc3221a5db94fae95ae7121a47" },
+            { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbad", plain, associated,
+              "61353b4c2806934a777ff51fa22a4755699b2a714fcdc6f83766e5f97b6c7423"
+              "73806900e49f24b22b097544d4896b424989b5e1ebac0f07c23f4598",
+              "3612d2e79e3b0785561be14aaca2fccb" },
+            { "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", plain, associated,
+              "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+              "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662",
+              "76fc6ece0f4e1768cddf8853bb2d551b" },
+        };
+
+        for (const VectorGCM& vector : vectors)
+        {
+            std::vector<u8> key = test::hex(vector.key);
+            std::vector<u8> iv = test::hex(vector.iv);
+            std::vector<u8> input = test::hex(vector.plain);
+            std::vector<u8> aad = test::hex(vector.associated);
+
+            std::vector<u8> expected = test::hex(vector.cipher);
+            std::vector<u8> tag = test::hex(vector.tag);
+            expected.insert(expected.end(), tag.begin(), tag.end());
+
+            AES aes(key.data(), int(key.size() * 8));
+
+            std::vector<u8> output(input.size() + 16);
+            aes.gcm_encrypt(test::memory(output), test::memory(input), test::memory(aad), test::memory(iv), 16);
+            CHECK(output == expected);
+
+            std::vector<u8> decrypted(input.size());
+            CHECK(aes.gcm_decrypt(test::memory(decrypted), test::memory(output), test::memory(aad), test::memory(iv), 16));
+            CHECK(decrypted == input);
+
+            // a truncated tag is the prefix of the full tag
+            std::vector<u8> truncated(input.size() + 12);
+            aes.gcm_encrypt(test::memory(truncated), test::memory(input), test::memory(aad), test::memory(iv), 12);
+            CHECK(std::equal(truncated.begin(), truncated.end(), expected.begin()));
+        }
+    }
+
+    void test_aes_gcm_tamper()
+    {
+        const std::vector<u8> key = test::hex("feffe9928665731c6d6a8f9467308308");
+        std::vector<u8> iv = test::hex("cafebabefacedbaddecaf888");
+        std::vector<u8> input = test::random_data(1000, 4);
+        std::vector<u8> aad = test::random_data(37, 5);
+
+        AES aes(key.data(), 128);
+
+        std::vector<u8> output(input.size() + 16);
+        aes.gcm_encrypt(test::memory(output), test::memory(input), test::memory(aad), test::memory(iv), 16);
+
+        // a changed ciphertext, tag or associated data is rejected and the output cleared
+        const size_t positions[] = { 0, 500, input.size() + 15 };
+
+        for (size_t position : positions)
+        {
+            std::vector<u8> damaged = output;
+            damaged[position] ^= 1;
+
+            std::vector<u8> decrypted(input.size(), 0xcc);
+            CHECK(!aes.gcm_decrypt(test::memory(decrypted), test::memory(damaged), test::memory(aad), test::memory(iv), 16));
+            CHECK(std::count(decrypted.begin(), decrypted.end(), 0) == int(decrypted.size()));
+        }
+
+        std::vector<u8> other = aad;
+        other[0] ^= 0x80;
+
+        std::vector<u8> decrypted(input.size());
+        CHECK(!aes.gcm_decrypt(test::memory(decrypted), test::memory(output), test::memory(other), test::memory(iv), 16));
+    }
+
+    void test_aes_gcm_sizes()
+    {
+        // the partial blocks and the eight block GHASH aggregation
+        const std::vector<u8> key = test::hex("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f");
+        std::vector<u8> iv = test::random_data(12, 6);
+        std::vector<u8> data = test::random_data(16 * 20, 7);
+        std::vector<u8> aad = test::random_data(16 * 10, 8);
+
+        AES aes(key.data(), 256);
+
+        for (size_t size = 0; size <= data.size(); size += 13)
+        {
+            Memory input(data.data(), size);
+            Memory associated(aad.data(), size % aad.size());
+
+            std::vector<u8> output(size + 16);
+            aes.gcm_encrypt(test::memory(output), input, associated, test::memory(iv), 16);
+
+            std::vector<u8> decrypted(size);
+            CHECK(aes.gcm_decrypt(test::memory(decrypted), test::memory(output), associated, test::memory(iv), 16));
+            CHECK(test::equal(test::memory(decrypted), input));
+        }
+    }
+
+    void test_aes_gcm_parallel()
+    {
+        // the segments hash from zero and are combined with the powers of H
+        const std::vector<u8> key = test::hex("feffe9928665731c6d6a8f9467308308");
+        std::vector<u8> iv = test::hex("cafebabefacedbaddecaf888");
+        std::vector<u8> input = test::random_data(6 * 1024 * 1024 + 7, 9);
+        std::vector<u8> aad = test::random_data(100, 10);
+
+        AES aes(key.data(), 128);
+
+        std::vector<u8> expected(input.size() + 16);
+        aes.gcm_encrypt(test::memory(expected), test::memory(input), test::memory(aad), test::memory(iv), 16);
+
+        std::vector<u8> output(input.size() + 16);
+        aes.gcm_encrypt_parallel(test::memory(output), test::memory(input), test::memory(aad), test::memory(iv), 16);
+        CHECK(output == expected);
+
+        std::vector<u8> decrypted(input.size());
+        CHECK(aes.gcm_decrypt_parallel(test::memory(decrypted), test::memory(output), test::memory(aad), test::memory(iv), 16));
+        CHECK(decrypted == input);
+
+        output[input.size() / 2] ^= 1;
+        CHECK(!aes.gcm_decrypt_parallel(test::memory(decrypted), test::memory(output), test::memory(aad), test::memory(iv), 16));
+    }
+
+} // namespace
+
+int main()
+{
+    test::run("aes ecb", test_aes_ecb);
+    test::run("aes cbc ctr", test_aes_cbc_ctr);
+    test::run("aes ctr", test_aes_ctr);
+    test::run("aes ctr parallel", test_aes_ctr_parallel);
+    test::run("aes gcm", test_aes_gcm);
+    test::run("aes gcm tamper", test_aes_gcm_tamper);
+    test::run("aes gcm sizes", test_aes_gcm_sizes);
+    test::run("aes gcm parallel", test_aes_gcm_parallel);
+    return test::result();
+}
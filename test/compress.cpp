@@ -0,0 +1,677 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mango/core/buffer.hpp>
+#include <mango/core/compress.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/parallel.hpp>
+#include <mango/core/thread.hpp>
+#include "test.hpp"
+
+using namespace mango;
+
+namespace
+{
+
+    // the content is a mix of text, random and zero blocks so that the
+    // codecs see both compressible and incompressible data
+    std::vector<uint8> mixed_data(size_t size)
+    {
+        std::vector<uint8> text = test::text_data(size, 1);
+        std::vector<uint8> noise = test::random_data(size, 2);
+        std::vector<uint8> data(size);
+
+        for (size_t offset = 0; offset < size; offset += 300000)
+        {
+            const size_t bytes = std::min(size - offset, size_t(300000));
+            switch ((offset / 300000) % 3)
+            {
+                case 0: std::memcpy(&data[offset], &text[offset], bytes); break;
+                case 1: std::memcpy(&data[offset], &noise[offset], bytes); break;
+                case 2: std::memset(&data[offset], 0, bytes); break;
+            }
+        }
+
+        return data;
+    }
+
+    bool throws(const std::function<void()>& func)
+    {
+        try
+        {
+            func();
+        }
+        catch (const Exception&)
+        {
+            return true;
+        }
+        return false;
+    }
+
+    // ----------------------------------------------------------------------------
+    // Compressor / Decompressor
+    // ----------------------------------------------------------------------------
+
+    struct StreamCodec
+    {
+        const char* name;
+        Compressor* (*createCompressor)(int level);
+        Decompressor* (*createDecompressor)();
+        void (*decompress)(Memory dest, Memory source);
+        bool flush; // the output after FLUSH decodes all of the input
+    };
+
+    const StreamCodec g_stream_codecs[] =
+    {
+        { "miniz", miniz::createCompressor, miniz::createDecompressor, miniz::decompress, true },
+#ifdef MANGO_ENABLE_LICENSE_BSD
+        { "lz4", lz4::createCompressor, lz4::createDecompressor, nullptr, true },
+        { "lzo", lzo::createCompressor, lzo::createDecompressor, nullptr, true },
+        { "zstd", zstd::createCompressor, zstd::createDecompressor, zstd::decompress, true },
+#endif
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+        { "bzip2", bzip2::createCompressor, bzip2::createDecompressor, bzip2::decompress, false },
+        { "lzfse", lzfse::createCompressor, lzfse::createDecompressor, nullptr, true },
+#endif
+    };
+
+    // pushes the source through the compressor with an output buffer of the given size
+    void compress_chunk(Compressor& compressor, std::vector<uint8>& output, Memory source,
+                        Compressor::Operation operation, size_t chunk)
+    {
+        std::vector<uint8> temp(chunk);
+
+        for (int guard = 0; guard < 1000000; ++guard)
+        {
+            Memory dest(temp.data(), temp.size());
+            const bool done = compressor.compress(dest, source, operation);
+            output.insert(output.end(), temp.data(), temp.data() + temp.size() - dest.size);
+            if (done)
+                return;
+        }
+
+        CHECK(false);
+    }
+
+    std::vector<uint8> compress_chunks(Compressor& compressor, const std::vector<uint8>& data,
+                                       size_t input_chunk, size_t output_chunk)
+    {
+        std::vector<uint8> output;
+
+        for (size_t offset = 0; offset < data.size(); offset += input_chunk)
+        {
+            const size_t bytes = std::min(input_chunk, data.size() - offset);
+            Memory source(const_cast<uint8*>(data.data()) + offset, bytes);
+            compress_chunk(compressor, output, source, Compressor::PROCESS, output_chunk);
+        }
+
+        compress_chunk(compressor, output, Memory(), Compressor::FINISH, output_chunk);
+        return output;
+    }
+
+    // returns true when the end of the stream was decoded
+    bool decompress_chunks(Decompressor& decompressor, std::vector<uint8>& output, const std::vector<uint8>& data,
+                           size_t input_chunk, size_t output_chunk)
+    {
+        std::vector<uint8> temp(output_chunk);
+        size_t offset = 0;
+        Memory source;
+
+        for (;;)
+        {
+            if (!source.size && offset < data.size())
+            {
+                const size_t bytes = std::min(input_chunk, data.size() - offset);
+                source = Memory(const_cast<uint8*>(data.data()) + offset, bytes);
+                offset += bytes;
+            }
+
+            const size_t available = source.size;
+
+            Memory dest(temp.data(), temp.size());
+            const bool done = decompressor.decompress(dest, source);
+            const size_t produced = temp.size() - dest.size;
+            output.insert(output.end(), temp.data(), temp.data() + produced);
+
+            if (done)
+                return true;
+
+            // all of the input has been consumed and no more output is coming
+            if (!produced && source.size == available && offset == data.size())
+                return false;
+        }
+    }
+
+    void test_compressor()
+    {
+        const size_t sizes[] = { 0, 1, 5000, 1024 * 1024 + 7 };
+
+        for (size_t size : sizes)
+        {
+            std::vector<uint8> data = mixed_data(size);
+
+            for (const StreamCodec& codec : g_stream_codecs)
+            {
+                // odd sized chunks which don't line up with the blocks of the codecs
+                std::unique_ptr<Compressor> compressor(codec.createCompressor(6));
+                std::vector<uint8> compressed = compress_chunks(*compressor, data, 7777, 999);
+
+                std::unique_ptr<Decompressor> decompressor(codec.createDecompressor());
+                std::vector<uint8> decompressed;
+                CHECK(decompress_chunks(*decompressor, decompressed, compressed, 333, 4321));
+
+                if (decompressed != data)
+                {
+                    std::printf("%s: size %d does not match.\n", codec.name, int(size));
+                    CHECK(decompressed == data);
+                }
+
+                // the stream is compatible with the memory block decompressor
+                if (codec.decompress && size)
+                {
+                    std::vector<uint8> block(size);
+                    codec.decompress(test::memory(block), test::memory(compressed));
+                    CHECK(block == data);
+                }
+            }
+        }
+    }
+
+    void test_compressor_flush()
+    {
+        std::vector<uint8> data = mixed_data(200000);
+        const size_t half = data.size() / 2;
+
+        for (const StreamCodec& codec : g_stream_codecs)
+        {
+            if (!codec.flush)
+                continue;
+
+            std::unique_ptr<Compressor> compressor(codec.createCompressor(6));
+            std::vector<uint8> compressed;
+            compress_chunk(*compressor, compressed, Memory(data.data(), half), Compressor::PROCESS, 4096);
+            compress_chunk(*compressor, compressed, Memory(), Compressor::FLUSH, 4096);
+
+            // the output so far decodes the input so far without the end of the stream
+            std::unique_ptr<Decompressor> decompressor(codec.createDecompressor());
+            std::vector<uint8> decompressed;
+            CHECK(!decompress_chunks(*decompressor, decompressed, compressed, 1000, 1000));
+            CHECK(decompressed.size() == half && std::equal(decompressed.begin(), decompressed.end(), data.begin()));
+
+            // the stream continues after the flush
+            compress_chunk(*compressor, compressed, Memory(data.data() + half, data.size() - half), Compressor::PROCESS, 4096);
+            compress_chunk(*compressor, compressed, Memory(), Compressor::FINISH, 4096);
+
+            decompressor.reset(codec.createDecompressor());
+            decompressed.clear();
+            CHECK(decompress_chunks(*decompressor, decompressed, compressed, 1000, 1000));
+            CHECK(decompressed == data);
+        }
+    }
+
+    void test_compress_stream()
+    {
+        std::vector<uint8> data = mixed_data(700000);
+
+        for (const StreamCodec& codec : g_stream_codecs)
+        {
+            Buffer buffer;
+            {
+                CompressStream stream(buffer, codec.createCompressor(6));
+                for (size_t offset = 0; offset < data.size(); offset += 10000)
+                {
+                    stream.write(data.data() + offset, std::min(size_t(10000), data.size() - offset));
+                }
+                CHECK(stream.size() == data.size());
+                stream.finish();
+            }
+
+            buffer.seek(0, Stream::BEGIN);
+
+            DecompressStream stream(buffer, codec.createDecompressor());
+            std::vector<uint8> decompressed(data.size());
+            stream.read(decompressed.data(), 1000);
+            stream.seek(1000, Stream::CURRENT);
+            stream.read(decompressed.data() + 2000, data.size() - 2000);
+            std::memcpy(decompressed.data() + 1000, data.data() + 1000, 1000);
+
+            uint8 extra;
+            CHECK(stream.readSome(&extra, 1) == 0);
+            CHECK(stream.end());
+            CHECK(stream.size() == data.size());
+            CHECK(decompressed == data);
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // compress_parallel
+    // ----------------------------------------------------------------------------
+
+    struct Codec
+    {
+        const char* name;
+        size_t (*bound_parallel)(size_t size);
+        size_t (*compress_parallel)(Memory dest, Memory source, int level);
+        void (*decompress_parallel)(Memory dest, Memory source);
+        void (*decompress)(Memory dest, Memory source);
+        size_t (*compress_pool)(ThreadPool& pool, Memory dest, Memory source, int level);
+        void (*decompress_pool)(ThreadPool& pool, Memory dest, Memory source);
+    };
+
+    const Codec g_codecs[] =
+    {
+        // deflate has no index of the segments; the stream is decompressed serially
+        { "miniz", miniz::bound_parallel, miniz::compress_parallel, miniz::decompress, miniz::decompress, miniz::compress_parallel, nullptr },
+#ifdef MANGO_ENABLE_LICENSE_BSD
+        { "lz4", lz4::bound_parallel, lz4::compress_parallel, lz4::decompress_parallel, nullptr, lz4::compress_parallel, lz4::decompress_parallel },
+        { "lzo", lzo::bound_parallel, lzo::compress_parallel, lzo::decompress_parallel, nullptr, lzo::compress_parallel, lzo::decompress_parallel },
+        { "zstd", zstd::bound_parallel, zstd::compress_parallel, zstd::decompress_parallel, zstd::decompress, zstd::compress_parallel, zstd::decompress_parallel },
+#endif
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+        { "lzfse", lzfse::bound_parallel, lzfse::compress_parallel, lzfse::decompress_parallel, nullptr, lzfse::compress_parallel, lzfse::decompress_parallel },
+#endif
+    };
+
+    void test_compress_parallel()
+    {
+        const size_t sizes[] = { 0, 1000, 5 * 1024 * 1024 + 3 };
+
+        for (size_t size : sizes)
+        {
+            std::vector<uint8> data = mixed_data(size);
+
+            for (const Codec& codec : g_codecs)
+            {
+                std::vector<uint8> compressed(codec.bound_parallel(size));
+                compressed.resize(codec.compress_parallel(test::memory(compressed), test::memory(data), 4));
+
+                std::vector<uint8> decompressed(size);
+                codec.decompress_parallel(test::memory(decompressed), test::memory(compressed));
+                if (decompressed != data)
+                {
+                    std::printf("%s: size %d does not match.\n", codec.name, int(size));
+                    CHECK(decompressed == data);
+                }
+
+                // the output is a standard stream of the codec; zstd rejects
+                // the null destination of the empty vector
+                if (codec.decompress && size)
+                {
+                    std::fill(decompressed.begin(), decompressed.end(), 0);
+                    codec.decompress(test::memory(decompressed), test::memory(compressed));
+                    CHECK(decompressed == data);
+                }
+
+                // the stream ends early at a block or frame boundary; deflate
+                // has no boundaries to cut at
+                if (codec.decompress_pool && size > 1024 * 1024)
+                {
+                    std::vector<uint8> truncated;
+
+                    if (!std::strcmp(codec.name, "zstd"))
+                    {
+                        const uint8 magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+                        auto second = std::search(compressed.begin() + 4, compressed.end(), magic, magic + 4);
+                        CHECK(second != compressed.end());
+                        truncated.assign(compressed.begin(), second);
+                    }
+                    else
+                    {
+                        // the first block and the end of stream marker
+                        const size_t block = 8 + (uload32le(&compressed[4]) & 0x7fffffff);
+                        truncated.assign(compressed.begin(), compressed.begin() + block);
+                        truncated.resize(block + 8, 0);
+                    }
+
+                    CHECK(throws([&] { codec.decompress_parallel(test::memory(decompressed), test::memory(truncated)); }));
+                }
+            }
+        }
+    }
+
+    void test_compress_parallel_deterministic()
+    {
+        // the output doesn't depend on the number of threads or on the timing
+        std::vector<uint8> data = mixed_data(4 * 1024 * 1024);
+
+        for (const Codec& codec : g_codecs)
+        {
+            std::vector<uint8> first(codec.bound_parallel(data.size()));
+            std::vector<uint8> second(codec.bound_parallel(data.size()));
+            first.resize(codec.compress_parallel(test::memory(first), test::memory(data), 4));
+            second.resize(codec.compress_parallel(test::memory(second), test::memory(data), 4));
+            CHECK(first == second);
+        }
+    }
+
+    void test_compress_parallel_pool()
+    {
+        // the pools of any size give the same output as the instance
+        std::vector<uint8> data = mixed_data(5 * 1024 * 1024);
+
+        for (size_t threads : { 1, 2, 4 })
+        {
+            ThreadPool pool(threads);
+
+            for (const Codec& codec : g_codecs)
+            {
+                std::vector<uint8> expected(codec.bound_parallel(data.size()));
+                expected.resize(codec.compress_parallel(test::memory(expected), test::memory(data), 4));
+
+                std::vector<uint8> compressed(codec.bound_parallel(data.size()));
+                compressed.resize(codec.compress_pool(pool, test::memory(compressed), test::memory(data), 4));
+                CHECK(compressed == expected);
+
+                std::vector<uint8> decompressed(data.size());
+                if (codec.decompress_pool)
+                {
+                    codec.decompress_pool(pool, test::memory(decompressed), test::memory(compressed));
+                }
+                else
+                {
+                    codec.decompress_parallel(test::memory(decompressed), test::memory(compressed));
+                }
+                CHECK(decompressed == data);
+            }
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // compress_auto
+    // ----------------------------------------------------------------------------
+
+    std::vector<uint8> compress_auto_vector(std::vector<uint8>& data, const CompressPolicy& policy = CompressPolicy())
+    {
+        std::vector<uint8> compressed(bound_auto(data.size()));
+        compressed.resize(compress_auto(test::memory(compressed), test::memory(data), policy));
+        return compressed;
+    }
+
+    void test_compress_auto()
+    {
+        const size_t sizes[] = { 0, 1, 5000, 3 * 1024 * 1024 + 17 };
+
+        for (size_t size : sizes)
+        {
+            std::vector<uint8> data = mixed_data(size);
+            std::vector<uint8> compressed = compress_auto_vector(data);
+            CHECK(size_auto(test::memory(compressed)) == size);
+
+            std::vector<uint8> decompressed(size);
+            decompress_auto(test::memory(decompressed), test::memory(compressed));
+            CHECK(decompressed == data);
+
+            // the selection doesn't depend on the timing or the threads
+            CHECK(compress_auto_vector(data) == compressed);
+        }
+    }
+
+    void test_compress_auto_select()
+    {
+        // the blocks are 1 MB; the first is noise and the second text
+        const size_t block = 1024 * 1024;
+        std::vector<uint8> data = test::random_data(block, 10);
+        std::vector<uint8> text = test::text_data(block, 11);
+        data.insert(data.end(), text.begin(), text.end());
+
+        // the codec is the first byte of the block header after the 12 byte header
+        std::vector<uint8> compressed = compress_auto_vector(data);
+        CHECK(compressed[12] == 0);
+        CHECK(compressed[12 + 9 + block] != 0);
+        CHECK(compressed.size() < data.size() * 3 / 4);
+
+        // no codec meets the targets; everything is stored
+        CompressPolicy impossible;
+        impossible.encode = 100000;
+        compressed = compress_auto_vector(data, impossible);
+        CHECK(compressed.size() == 12 + 2 * 9 + data.size());
+
+        std::vector<uint8> decompressed(data.size());
+        decompress_auto(test::memory(decompressed), test::memory(compressed));
+        CHECK(decompressed == data);
+
+        // a slower codec is not selected when the decoding target excludes it
+        CompressPolicy fast;
+        fast.decode = 2000;
+        std::vector<uint8> fast_compressed = compress_auto_vector(data, fast);
+        std::vector<uint8> best_compressed = compress_auto_vector(data);
+        CHECK(fast_compressed.size() >= best_compressed.size());
+
+        decompress_auto(test::memory(decompressed), test::memory(fast_compressed));
+        CHECK(decompressed == data);
+    }
+
+    void test_compress_auto_errors()
+    {
+        std::vector<uint8> data = mixed_data(100000);
+        std::vector<uint8> compressed = compress_auto_vector(data);
+        std::vector<uint8> decompressed(data.size());
+
+        CHECK(throws([&] { std::vector<uint8> small(100); compress_auto(test::memory(small), test::memory(data)); }));
+        CHECK(throws([&] { decompress_auto(Memory(decompressed.data(), data.size() - 1), test::memory(compressed)); }));
+
+        std::vector<uint8> magic = compressed;
+        magic[0] ^= 0xff;
+        CHECK(throws([&] { size_auto(test::memory(magic)); }));
+
+        std::vector<uint8> truncated(compressed.begin(), compressed.begin() + 20);
+        CHECK(throws([&] { decompress_auto(test::memory(decompressed), test::memory(truncated)); }));
+
+        std::vector<uint8> codec = compressed;
+        codec[12] = 200;
+        CHECK(throws([&] { decompress_auto(test::memory(decompressed), test::memory(codec)); }));
+
+        // a damaged payload of the first block
+        std::vector<uint8> damaged = compressed;
+        const size_t size = uload32le(&damaged[17]);
+        CHECK(damaged[12] != 0);
+        std::memset(&damaged[21], 0xff, size);
+        CHECK(throws([&] { decompress_auto(test::memory(decompressed), test::memory(damaged)); }));
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+        // a single lz4 literal run of the whole block reads past the end of the
+        // block; the padding keeps an unbounded decoder inside the vector
+        CompressPolicy policy;
+        policy.decode = 2000;
+
+        std::vector<uint8> overrun = compress_auto_vector(data, policy);
+        const size_t uncompressed = uload32le(&overrun[13]);
+        const size_t lengths = (uncompressed - 15) / 255;
+        overrun.resize(overrun.size() + uncompressed + lengths + 2);
+
+        overrun[21] = 0xf0;
+        std::memset(&overrun[22], 0xff, lengths);
+        overrun[22 + lengths] = uint8(uncompressed - 15 - lengths * 255);
+        CHECK(throws([&] { decompress_auto(test::memory(decompressed), test::memory(overrun)); }));
+#endif
+    }
+
+    // ----------------------------------------------------------------------------
+    // dictionary compression
+    // ----------------------------------------------------------------------------
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    // small records which resemble each other but have little redundancy alone
+    std::vector<std::vector<uint8>> records(size_t count, uint32 seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<std::vector<uint8>> result;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            char text[512];
+            const int length = std::snprintf(text, sizeof(text),
+                "{ \"type\": \"texture\", \"name\": \"asset_%u\", \"width\": %u, \"height\": %u, "
+                "\"format\": \"rgba8\", \"mipmaps\": %u, \"compression\": \"bc7\", \"flags\": [ \"srgb\", \"repeat\" ] }",
+                unsigned(rng() % 100000), unsigned(rng() % 4096), unsigned(rng() % 4096), unsigned(rng() % 12));
+            result.emplace_back(text, text + length);
+        }
+
+        return result;
+    }
+
+    std::vector<uint8> train_records(const std::vector<std::vector<uint8>>& samples, size_t size)
+    {
+        std::vector<Memory> memory;
+        for (const auto& sample : samples)
+        {
+            memory.emplace_back(const_cast<uint8*>(sample.data()), sample.size());
+        }
+        return zstd::train(memory, size);
+    }
+
+    void test_dictionary_train()
+    {
+        bool thrown = false;
+        try
+        {
+            train_records(records(10, 1), 255);
+        }
+        catch (const Exception&)
+        {
+            thrown = true;
+        }
+        CHECK(thrown);
+
+        // the samples which fit are the dictionary as they are
+        std::vector<std::vector<uint8>> few = records(2, 2);
+        std::vector<uint8> dictionary = train_records(few, 4096);
+        CHECK(dictionary.size() == few[0].size() + few[1].size());
+        CHECK(std::equal(few[0].begin(), few[0].end(), dictionary.begin()));
+
+        // the trained dictionary is within the size and its content comes from the samples
+        std::vector<std::vector<uint8>> many = records(2000, 3);
+        dictionary = train_records(many, 2048);
+        CHECK(dictionary.size() > 0 && dictionary.size() <= 2048);
+
+        const std::string text(dictionary.begin(), dictionary.end());
+        CHECK(text.find("\"format\": \"rgba8\"") != std::string::npos);
+    }
+
+    void test_dictionary_compress()
+    {
+        std::vector<uint8> dictionary = train_records(records(2000, 4), 4096);
+        zstd::CompressDictionary cdict(test::memory(dictionary), 6);
+        zstd::DecompressDictionary ddict(test::memory(dictionary));
+
+        size_t plain_total = 0;
+        size_t dictionary_total = 0;
+
+        for (auto& record : records(100, 5))
+        {
+            std::vector<uint8> plain(zstd::bound(record.size()));
+            plain_total += zstd::compress(test::memory(plain), test::memory(record), 6);
+
+            std::vector<uint8> compressed(zstd::bound(record.size()));
+            compressed.resize(zstd::compress(test::memory(compressed), test::memory(record), cdict));
+            dictionary_total += compressed.size();
+
+            std::vector<uint8> decompressed(record.size());
+            zstd::decompress(test::memory(decompressed), test::memory(compressed), ddict);
+            CHECK(decompressed == record);
+        }
+
+        // the records share most of their content with the dictionary
+        CHECK(dictionary_total * 2 < plain_total);
+    }
+
+    void test_dictionary_threads()
+    {
+        // the digested dictionaries are shared by the threads; each thread has its own contexts
+        std::vector<uint8> dictionary = train_records(records(2000, 6), 4096);
+        zstd::CompressDictionary cdict(test::memory(dictionary), 6);
+        zstd::DecompressDictionary ddict(test::memory(dictionary));
+
+        std::vector<std::vector<uint8>> input = records(1000, 7);
+        std::vector<int> results(input.size(), 0);
+
+        parallel_each(input.size(), [&] (size_t index)
+        {
+            std::vector<uint8>& record = input[index];
+
+            std::vector<uint8> compressed(zstd::bound(record.size()));
+            compressed.resize(zstd::compress(test::memory(compressed), test::memory(record), cdict));
+
+            std::vector<uint8> decompressed(record.size());
+            zstd::decompress(test::memory(decompressed), test::memory(compressed), ddict);
+            results[index] = decompressed == record;
+        });
+
+        CHECK(std::count(results.begin(), results.end(), 1) == int(results.size()));
+    }
+
+    void test_dictionary_stream()
+    {
+        std::vector<uint8> dictionary = train_records(records(2000, 8), 4096);
+        zstd::CompressDictionary cdict(test::memory(dictionary), 6);
+        zstd::DecompressDictionary ddict(test::memory(dictionary));
+
+        std::vector<std::vector<uint8>> messages = records(50, 9);
+
+        // the messages are encoded one at a time and refer to the dictionary and to each other
+        std::unique_ptr<StreamEncoder> zstd_encoder(zstd::createStreamEncoder(cdict));
+        std::unique_ptr<StreamDecoder> zstd_decoder(zstd::createStreamDecoder(ddict));
+        std::unique_ptr<StreamEncoder> lz4_encoder(lz4::createStreamEncoder(1, test::memory(dictionary)));
+        std::unique_ptr<StreamDecoder> lz4_decoder(lz4::createStreamDecoder(test::memory(dictionary)));
+
+        for (auto& message : messages)
+        {
+            for (int codec = 0; codec < 2; ++codec)
+            {
+                StreamEncoder& encoder = codec ? *lz4_encoder : *zstd_encoder;
+                StreamDecoder& decoder = codec ? *lz4_decoder : *zstd_decoder;
+
+                std::vector<uint8> encoded(encoder.bound(message.size()));
+                encoded.resize(encoder.encode(test::memory(encoded), test::memory(message)));
+
+                std::vector<uint8> decoded(message.size());
+                decoder.decode(test::memory(decoded), test::memory(encoded));
+                CHECK(decoded == message);
+            }
+        }
+
+        // the Compressor / Decompressor with the dictionary
+        std::vector<uint8> data;
+        for (auto& message : messages)
+        {
+            data.insert(data.end(), message.begin(), message.end());
+        }
+
+        std::unique_ptr<Compressor> compressor(zstd::createCompressor(cdict));
+        std::vector<uint8> compressed = compress_chunks(*compressor, data, 500, 300);
+
+        std::unique_ptr<Decompressor> decompressor(zstd::createDecompressor(ddict));
+        std::vector<uint8> decompressed;
+        CHECK(decompress_chunks(*decompressor, decompressed, compressed, 200, 700));
+        CHECK(decompressed == data);
+    }
+
+#endif
+
+} // namespace
+
+int main()
+{
+    test::run("compressor", test_compressor);
+    test::run("compressor flush", test_compressor_flush);
+    test::run("compress stream", test_compress_stream);
+    test::run("compress parallel", test_compress_parallel);
+    test::run("compress parallel deterministic", test_compress_parallel_deterministic);
+    test::run("compress parallel pool", test_compress_parallel_pool);
+    test::run("compress auto", test_compress_auto);
+    test::run("compress auto select", test_compress_auto_select);
+    test::run("compress auto errors", test_compress_auto_errors);
+#ifdef MANGO_ENABLE_LICENSE_BSD
+    test::run("dictionary train", test_dictionary_train);
+    test::run("dictionary compress", test_dictionary_compress);
+    test::run("dictionary threads", test_dictionary_threads);
+    test::run("dictionary stream", test_dictionary_stream);
+#endif
+    return test::result();
+}
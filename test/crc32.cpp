@@ -0,0 +1,107 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <vector>
+#include <mango/core/crc32.hpp>
+#include "test.hpp"
+
+using namespace mango;
+
+namespace
+{
+
+    // bit at a time reference
+    uint32 reference_crc(uint32 crc, Memory memory, uint32 polynomial)
+    {
+        crc = ~crc;
+
+        for (size_t i = 0; i < memory.size; ++i)
+        {
+            crc ^= memory.address[i];
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc >> 1) ^ (polynomial & (0 - (crc & 1)));
+            }
+        }
+
+        return ~crc;
+    }
+
+    // ----------------------------------------------------------------------------
+    // crc32 / crc32c
+    // ----------------------------------------------------------------------------
+
+    void test_crc32()
+    {
+        CHECK(crc32(0, test::memory("123456789")) == 0xcbf43926);
+        CHECK(crc32c(0, test::memory("123456789")) == 0xe3069283);
+        CHECK(crc32(0, Memory()) == 0);
+        CHECK(crc32c(0, Memory()) == 0);
+
+        // the running crc continues from the previous chunk
+        CHECK(crc32(crc32(0, test::memory("1234")), test::memory("56789")) == 0xcbf43926);
+        CHECK(crc32c(crc32c(0, test::memory("1234")), test::memory("56789")) == 0xe3069283);
+    }
+
+    void test_crc32_combine()
+    {
+        std::vector<uint8> data = test::random_data(100000, 1);
+        const size_t splits[] = { 0, 1, 7, 4096, 50000, 99999, 100000 };
+
+        const uint32 expected32 = crc32(0, test::memory(data));
+        const uint32 expected32c = crc32c(0, test::memory(data));
+
+        for (size_t split : splits)
+        {
+            Memory first(data.data(), split);
+            Memory second(data.data() + split, data.size() - split);
+
+            CHECK(crc32_combine(crc32(0, first), crc32(0, second), second.size) == expected32);
+            CHECK(crc32c_combine(crc32c(0, first), crc32c(0, second), second.size) == expected32c);
+        }
+    }
+
+    void test_crc32_reference()
+    {
+        // the sizes and offsets cover the unaligned heads and tails around the
+        // folded lanes and the interleaved 4 KB streams
+        std::vector<uint8> data = test::random_data(3 * 4096 * 2 + 300, 2);
+        const size_t sizes[] = { 1, 15, 16, 17, 63, 64, 65, 127, 128, 255, 256, 257, 1000,
+                                 4095, 4096, 4097, 3 * 4096 - 1, 3 * 4096, 3 * 4096 + 1, 3 * 4096 * 2 + 200 };
+
+        for (size_t size : sizes)
+        {
+            for (size_t offset = 0; offset < 16; offset += 5)
+            {
+                Memory memory(data.data() + offset, size);
+                CHECK(crc32(0x12345678, memory) == reference_crc(0x12345678, memory, 0xedb88320));
+                CHECK(crc32c(0x12345678, memory) == reference_crc(0x12345678, memory, 0x82f63b78));
+            }
+        }
+    }
+
+    void test_crc32_parallel()
+    {
+        // the small buffers are processed serially, the large ones in segments
+        std::vector<uint8> data = test::random_data(9 * 1024 * 1024 + 333, 3);
+        const size_t sizes[] = { 0, 1000, 4 * 1024 * 1024 - 1, 4 * 1024 * 1024, data.size() };
+
+        for (size_t size : sizes)
+        {
+            Memory memory(data.data(), size);
+            CHECK(crc32_parallel(0xabcdef01, memory) == crc32(0xabcdef01, memory));
+            CHECK(crc32c_parallel(0xabcdef01, memory) == crc32c(0xabcdef01, memory));
+        }
+    }
+
+} // namespace
+
+int main()
+{
+    test::run("crc32", test_crc32);
+    test::run("crc32 combine", test_crc32_combine);
+    test::run("crc32 reference", test_crc32_reference);
+    test::run("crc32 parallel", test_crc32_parallel);
+    return test::result();
+}
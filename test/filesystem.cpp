@@ -0,0 +1,628 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+#include <mango/core/buffer.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/parallel.hpp>
+#include <mango/filesystem/filesystem.hpp>
+#include "test.hpp"
+
+using namespace mango;
+
+namespace
+{
+
+    template <typename F>
+    bool throws(F func)
+    {
+        try
+        {
+            func();
+        }
+        catch (const Exception&)
+        {
+            return true;
+        }
+        return false;
+    }
+
+    // the content of the text entries in the test archives
+    std::vector<uint8> fox_text(int count)
+    {
+        std::string text;
+        for (int i = 0; i < count; ++i)
+        {
+            text += "The quick brown fox jumps over the lazy dog. ";
+        }
+        return std::vector<uint8>(text.begin(), text.end());
+    }
+
+    std::vector<uint8> read_file(const Path& path, const std::string& filename)
+    {
+        File file(path, filename);
+        Memory memory = file;
+        return std::vector<uint8>(memory.address, memory.address + memory.size);
+    }
+
+    // ----------------------------------------------------------------------------
+    // ZIP encryption
+    // ----------------------------------------------------------------------------
+
+    // WinZip AES archive with the password "mango", written by a reference
+    // encoder (PBKDF2-HMAC-SHA1 from the Python standard library and AES from
+    // OpenSSL):
+    // aes256.txt: AE-2, AES-256, deflated
+    // aes128.bin: AE-1, AES-128, stored; bytes 0..255 twice
+    // aes192.txt: AE-2, AES-192, deflated
+    const char* g_zip_aes =
+        "504b0304330001006300006021500000000053000000840300000a000b006165"
+        "733235362e7478740199070002004145030800000102030405060708090a0b0c"
+        "0d0e0feda44def0c74a4affc929f7a00c29f217b6f6c7960fdfbd1ae25a4b52e"
+        "74f30eb2cb55abf5889962e7016c840dcf8d2ce3fa50be8979782089519dadd0"
+        "2e92d20dbf7a504b0304330001006300006021507635611c1402000000020000"
+        "0a000b006165733132382e62696e019907000100414501000010111213141516"
+        "178f6dae122226c0bb0f1747f9b876df3a7dbdf7a435d6a5bc09d67c8ccca5da"
+        "d86b70159f4c08c95fc590d61aa7cca3df6c55eeb111589715bac9738c934444"
+        "a59b243a306d4ddbdf4f6a1976dbb8dc80ac3d8f3975fdb900713adee37c1e09"
+        "96b03b31feba5d4584e125847c22a587cdbb3a3b5c5864ce6a58278b92892db9"
+        "85cd62590c7492b81a54cf95b86d57149e383ed1ee6cc595c7f0472eebc818e0"
+        "8b2dbed2c3bb48cfe6cb0b84f9dbe6fd7e5a7a0237633d3c51afb21f30506ab8"
+        "d1aefd719b30cd8391d07615c69e4f11de7cde36eb2ff32ccfe29c1ef27de27f"
+        "d41701c17e5ad952c2a96871e601e20827ebc58425a10deac8583cda5b5a0a44"
+        "98b1bb6f0be6610773e2e3400c8632fd568991daa7f4100260bffea567916314"
+        "1de905e68e0ce82dda915cdaf9eb5c30ef7e185ca024e33da7b84669a2a79d22"
+        "f113a173603df7c5cb88260c8ed0a602e0df23a02b62a7d8d4fc18de0a1ded05"
+        "8e559f9315401c85603f1684964d21a8047250638f197309d670e8c4fcc4e612"
+        "fc6b3dd15fe0c9ff8b6bdf1823359b4189d5683d34015b31e7d426c5b207569b"
+        "a8f61e596fb512b555056e61c97017a047d48c36b24a3031a44a1ad3d1d321b1"
+        "3bcf3454ca825626a45f2e32f1a84b7277c5a46084759efa3cb488bf7f0c00bc"
+        "1494e677e5e631fc632e2161253786988e65393abb8a64cc77b260e0cf02c098"
+        "43a7c337d369744e47001464c1504b030433000100630000602150000000004f"
+        "000000840300000a000b006165733139322e7478740199070002004145020800"
+        "202122232425262728292a2b2f816f1ff4aa5cd339286374f64e653e0492420b"
+        "301d827ef5be23eddfd63443e320b514b40171619c3f62abbe9ca585f27bb379"
+        "9b41a7718c99386892f4e24e0ba2da504b01023f003300010063000060215000"
+        "00000053000000840300000a000b000000000000000000000000000000616573"
+        "3235362e7478740199070002004145030800504b01023f003300010063000060"
+        "21507635611c14020000000200000a000b000000000000000000000086000000"
+        "6165733132382e62696e0199070001004145010000504b01023f003300010063"
+        "0000602150000000004f000000840300000a000b0000000000000000000000cd"
+        "0200006165733139322e7478740199070002004145020800504b050600000000"
+        "03000300c90000004f0300000000";
+
+    // ZipCrypto archives of crypto.txt written by Info-ZIP with the password
+    // "mango"; the second has the crc in a data descriptor (zip -fd)
+    const char* g_zip_crypto =
+        "504b030414000900080000602150e64a66b043000000840300000a0000006372"
+        "7970746f2e747874377de7466edae8f90c442bbbbc1833de85593f8c5476f4e9"
+        "20fc62b5369a8dde8f53059154274e1a75896fdc95e90547663fe9f52b0c5fb7"
+        "300c23598a6235983aca3c504b0708e64a66b04300000084030000504b01021e"
+        "0314000900080000602150e64a66b043000000840300000a0000000000000001"
+        "000000a4810000000063727970746f2e747874504b0506000000000100010038"
+        "0000007b0000000000";
+
+    const char* g_zip_crypto_descriptor =
+        "504b0304140009000800006021500000006000000000840300000a0000006372"
+        "7970746f2e74787474aa322d44681f573bb1b27f6f48629d21492d9bf6621dca"
+        "c4aea71228fbc74217529147592e84a65dcc5f7e7bd780a34dc96d47819daa16"
+        "cb9de51f0bf4ddea3c614d504b0708e64a66b04300000084030000504b01021e"
+        "0314000900080000602150e64a66b043000000840300000a0000000000000001"
+        "000000a4810000000063727970746f2e747874504b0506000000000100010038"
+        "0000007b0000000000";
+
+    void test_zip_aes()
+    {
+        std::vector<uint8> archive = test::hex(g_zip_aes);
+        std::vector<uint8> text = fox_text(20);
+
+        std::vector<uint8> binary;
+        for (int i = 0; i < 512; ++i)
+        {
+            binary.push_back(uint8(i));
+        }
+
+        Path path(test::memory(archive), ".zip", "mango");
+        CHECK(path.size() == 3);
+        CHECK(read_file(path, "aes256.txt") == text);
+        CHECK(read_file(path, "aes128.bin") == binary);
+        CHECK(read_file(path, "aes192.txt") == text);
+
+        // the entries are decrypted again for every mapping
+        CHECK(read_file(path, "aes256.txt") == text);
+    }
+
+    void test_zip_aes_errors()
+    {
+        std::vector<uint8> archive = test::hex(g_zip_aes);
+
+        Path wrong(test::memory(archive), ".zip", "papaya");
+        CHECK(throws([&] { read_file(wrong, "aes256.txt"); }));
+        CHECK(throws([&] { read_file(wrong, "aes128.bin"); }));
+
+        Path missing(test::memory(archive), ".zip");
+        CHECK(throws([&] { read_file(missing, "aes192.txt"); }));
+
+        // the encrypted data of the first entry follows the local header,
+        // the 16 byte salt and the 2 byte password verifier
+        const size_t header = 30 + uload16le(&archive[26]) + uload16le(&archive[28]);
+        archive[header + 16 + 2 + 5] ^= 1;
+
+        Path damaged(test::memory(archive), ".zip", "mango");
+        CHECK(throws([&] { read_file(damaged, "aes256.txt"); }));
+        CHECK(read_file(damaged, "aes128.bin").size() == 512);
+    }
+
+    void test_zip_crypto()
+    {
+        std::vector<uint8> text = fox_text(20);
+
+        const char* archives[] = { g_zip_crypto, g_zip_crypto_descriptor };
+
+        for (const char* hex : archives)
+        {
+            std::vector<uint8> archive = test::hex(hex);
+
+            Path path(test::memory(archive), ".zip", "mango");
+            CHECK(read_file(path, "crypto.txt") == text);
+
+            Path wrong(test::memory(archive), ".zip", "papaya");
+            CHECK(throws([&] { read_file(wrong, "crypto.txt"); }));
+
+            // the compressed size in the central directory can't hold the
+            // 12 byte encryption header
+            const uint8 signature[] = { 'P', 'K', 1, 2 };
+            auto central = std::search(archive.begin(), archive.end(), signature, signature + 4);
+            ustore32le(&*central + 20, 11);
+
+            Path damaged(test::memory(archive), ".zip", "mango");
+            CHECK(throws([&] { read_file(damaged, "crypto.txt"); }));
+        }
+    }
+
+    // deflated archive written by the Python zipfile module:
+    // large.txt: the fox text 10000 times, deflated
+    // small.txt: the fox text 20 times, deflated
+    // stored.txt: the fox text 20 times, stored
+    const char* g_zip_deflate =
+        "504b0304140000000800006021508d7767ef58050000d0dd0600090000006c61"
+        "7267652e747874edcae10142600005c055de04a6b140844af58928a6af41eef7"
+        "5d7de9f25aafed98662e9f67faf2cd6d7d4c4bcad6cd79fff97e3af69ccb50a5"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "5996655996655996655996655996655996655996655996655996655996655996"
+        "6559966559966559966559966559966559966559966559966559966559966559"
+        "9665599665599665599665599665599665599665599665599665599665599665"
+        "59966559966559966559966559966559966559966559966559966559aef20350"
+        "4b030414000000080000602150e64a66b0370000008403000009000000736d61"
+        "6c6c2e7478740bc94855282ccd4cce56482aca2fcf5348cbaf50c82acd2d2856"
+        "c82f4b2d5228014ae72456552aa4e4a7eb29848c2a1e553caa98da8a01504b03"
+        "0414000000000000602150e64a66b084030000840300000a00000073746f7265"
+        "642e74787454686520717569636b2062726f776e20666f78206a756d7073206f"
+        "76657220746865206c617a7920646f672e2054686520717569636b2062726f77"
+        "6e20666f78206a756d7073206f76657220746865206c617a7920646f672e2054"
+        "686520717569636b2062726f776e20666f78206a756d7073206f766572207468"
+        "65206c617a7920646f672e2054686520717569636b2062726f776e20666f7820"
+        "6a756d7073206f76657220746865206c617a7920646f672e2054686520717569"
+        "636b2062726f776e20666f78206a756d7073206f76657220746865206c617a79"
+        "20646f672e2054686520717569636b2062726f776e20666f78206a756d707320"
+        "6f76657220746865206c617a7920646f672e2054686520717569636b2062726f"
+        "776e20666f78206a756d7073206f76657220746865206c617a7920646f672e20"
+        "54686520717569636b2062726f776e20666f78206a756d7073206f7665722074"
+        "6865206c617a7920646f672e2054686520717569636b2062726f776e20666f78"
+        "206a756d7073206f76657220746865206c617a7920646f672e20546865207175"
+        "69636b2062726f776e20666f78206a756d7073206f76657220746865206c617a"
+        "7920646f672e2054686520717569636b2062726f776e20666f78206a756d7073"
+        "206f76657220746865206c617a7920646f672e2054686520717569636b206272"
+        "6f776e20666f78206a756d7073206f76657220746865206c617a7920646f672e"
+        "2054686520717569636b2062726f776e20666f78206a756d7073206f76657220"
+        "746865206c617a7920646f672e2054686520717569636b2062726f776e20666f"
+        "78206a756d7073206f76657220746865206c617a7920646f672e205468652071"
+        "7569636b2062726f776e20666f78206a756d7073206f76657220746865206c61"
+        "7a7920646f672e2054686520717569636b2062726f776e20666f78206a756d70"
+        "73206f76657220746865206c617a7920646f672e2054686520717569636b2062"
+        "726f776e20666f78206a756d7073206f76657220746865206c617a7920646f67"
+        "2e2054686520717569636b2062726f776e20666f78206a756d7073206f766572"
+        "20746865206c617a7920646f672e2054686520717569636b2062726f776e2066"
+        "6f78206a756d7073206f76657220746865206c617a7920646f672e2054686520"
+        "717569636b2062726f776e20666f78206a756d7073206f76657220746865206c"
+        "617a7920646f672e20504b01021403140000000800006021508d7767ef580500"
+        "00d0dd06000900000000000000000000008001000000006c617267652e747874"
+        "504b0102140314000000080000602150e64a66b0370000008403000009000000"
+        "000000000000000080017f050000736d616c6c2e747874504b01021403140000"
+        "00000000602150e64a66b084030000840300000a000000000000000000000080"
+        "01dd05000073746f7265642e747874504b05060000000003000300a600000089"
+        "0900000000";
+
+    void test_zip_stream()
+    {
+        std::vector<uint8> archive = test::hex(g_zip_deflate);
+        std::vector<uint8> large = fox_text(10000);
+        std::vector<uint8> small = fox_text(20);
+
+        Path path(test::memory(archive), ".zip");
+        CHECK(read_file(path, "large.txt") == large);
+
+        // the reads cross the 64 KB chunks and go backwards
+        MapperStream stream(path, "large.txt");
+        CHECK(stream.size() == large.size());
+
+        const size_t offsets[] = { 0, 65000, 200000, 100, 400000, 0 };
+
+        for (size_t offset : offsets)
+        {
+            std::vector<uint8> data(10000);
+            stream.seek(offset, Stream::BEGIN);
+            stream.read(data.data(), data.size());
+            CHECK(std::equal(data.begin(), data.end(), large.begin() + offset));
+        }
+
+        std::vector<uint8> tail(large.size() - 440000);
+        stream.seek(tail.size(), Stream::END);
+        stream.read(tail.data(), tail.size());
+        CHECK(std::equal(tail.begin(), tail.end(), large.begin() + 440000));
+
+        uint8 value;
+        CHECK(throws([&] { stream.read(&value, 1); }));
+
+        // the small and the stored entries
+        const char* filenames[] = { "small.txt", "stored.txt" };
+
+        for (const char* filename : filenames)
+        {
+            MapperStream stream(path, filename);
+            std::vector<uint8> data(small.size());
+            stream.read(data.data(), data.size());
+            CHECK(data == small);
+        }
+    }
+
+    void test_zip_stream_crc()
+    {
+        std::vector<uint8> archive = test::hex(g_zip_deflate);
+
+        // the crc of large.txt in the first central directory header
+        const uint8 signature[] = { 'P', 'K', 1, 2 };
+        auto central = std::search(archive.begin(), archive.end(), signature, signature + 4);
+        CHECK(central != archive.end());
+        central[16] ^= 1;
+
+        Path path(test::memory(archive), ".zip");
+
+        // the crc is checked when the end of the entry is decompressed; reading
+        // the header doesn't decompress the rest of the entry
+        MapperStream stream(path, "large.txt");
+        std::vector<uint8> header(64);
+        stream.read(header.data(), header.size());
+        CHECK(std::equal(header.begin(), header.end(), fox_text(2).begin()));
+
+        std::vector<uint8> rest(stream.size() - header.size());
+        CHECK(throws([&] { stream.read(rest.data(), rest.size()); }));
+    }
+
+    // ----------------------------------------------------------------------------
+    // container cache
+    // ----------------------------------------------------------------------------
+
+    void test_container_cache()
+    {
+        std::vector<uint8> archive = test::hex(g_zip_deflate);
+        std::vector<uint8> large = fox_text(10000);
+        std::vector<uint8> small = fox_text(20);
+
+        Path path(test::memory(archive), ".zip");
+
+        // disabled by default
+        CHECK(getContainerCacheBudget() == 0);
+        ContainerCacheStatistics before = getContainerCacheStatistics();
+        CHECK(read_file(path, "large.txt") == large);
+        CHECK(read_file(path, "large.txt") == large);
+        ContainerCacheStatistics after = getContainerCacheStatistics();
+        CHECK(after.hits == before.hits && after.misses == before.misses && after.entries == 0);
+
+        setContainerCacheBudget(1024 * 1024);
+
+        before = getContainerCacheStatistics();
+        CHECK(read_file(path, "large.txt") == large);
+        CHECK(read_file(path, "large.txt") == large);
+        CHECK(read_file(path, "small.txt") == small);
+        after = getContainerCacheStatistics();
+        CHECK(after.misses - before.misses == 2);
+        CHECK(after.hits - before.hits == 1);
+        CHECK(after.entries == 2);
+        CHECK(after.bytes == large.size() + small.size());
+
+        // the stored entries are mapped from the container and not cached
+        before = after;
+        CHECK(read_file(path, "stored.txt") == small);
+        after = getContainerCacheStatistics();
+        CHECK(after.misses == before.misses && after.hits == before.hits && after.entries == 2);
+
+        // the encrypted entries are not cached so the password is checked every time
+        std::vector<uint8> encrypted = test::hex(g_zip_aes);
+        Path aes(test::memory(encrypted), ".zip", "mango");
+        CHECK(read_file(aes, "aes256.txt") == small);
+        CHECK(getContainerCacheStatistics().entries == 2);
+
+        Path wrong(test::memory(encrypted), ".zip", "papaya");
+        CHECK(throws([&] { read_file(wrong, "aes256.txt"); }));
+
+        setContainerCacheBudget(0);
+        CHECK(getContainerCacheStatistics().entries == 0);
+    }
+
+    void test_container_cache_eviction()
+    {
+        std::vector<uint8> archive = test::hex(g_zip_deflate);
+        std::vector<uint8> large = fox_text(10000);
+        std::vector<uint8> small = fox_text(20);
+
+        Path path(test::memory(archive), ".zip");
+
+        setContainerCacheBudget(large.size() + small.size());
+
+        // the view of an evicted entry remains valid
+        File view(path, "large.txt");
+        read_file(path, "small.txt");
+        CHECK(getContainerCacheStatistics().entries == 2);
+
+        // the least recently used entry is evicted first
+        ContainerCacheStatistics before = getContainerCacheStatistics();
+        setContainerCacheBudget(large.size());
+        ContainerCacheStatistics after = getContainerCacheStatistics();
+        CHECK(after.evictions - before.evictions == 1);
+        CHECK(after.entries == 1 && after.bytes == small.size());
+
+        read_file(path, "small.txt");
+        CHECK(getContainerCacheStatistics().hits - after.hits == 1);
+
+        clearContainerCache();
+        CHECK(getContainerCacheStatistics().entries == 0);
+
+        Memory memory = view;
+        CHECK(test::equal(memory, test::memory(large)));
+
+        // the entries larger than the budget are not cached
+        setContainerCacheBudget(large.size() - 1);
+        CHECK(read_file(path, "large.txt") == large);
+        CHECK(getContainerCacheStatistics().entries == 0);
+
+        setContainerCacheBudget(0);
+    }
+
+    void test_container_cache_threads()
+    {
+        std::vector<uint8> archive = test::hex(g_zip_deflate);
+        std::vector<uint8> large = fox_text(10000);
+        std::vector<uint8> small = fox_text(20);
+
+        Path path(test::memory(archive), ".zip");
+
+        setContainerCacheBudget(1024 * 1024);
+        ContainerCacheStatistics before = getContainerCacheStatistics();
+
+        // every lookup is either a hit or a miss and the views are correct
+        const int count = 64;
+        std::vector<int> results(count, 0);
+
+        parallel_each(count, [&] (size_t index)
+        {
+            if (index & 1)
+            {
+                results[index] = read_file(path, "large.txt") == large;
+            }
+            else
+            {
+                results[index] = read_file(path, "small.txt") == small;
+            }
+        });
+
+        ContainerCacheStatistics after = getContainerCacheStatistics();
+        CHECK(std::count(results.begin(), results.end(), 1) == count);
+        CHECK((after.hits - before.hits) + (after.misses - before.misses) == count);
+        CHECK(after.entries == 2);
+
+        setContainerCacheBudget(0);
+    }
+
+    // ----------------------------------------------------------------------------
+    // MGX
+    // ----------------------------------------------------------------------------
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    struct EntryMGX
+    {
+        std::string filename;
+        std::vector<uint8> data;
+        WriterMGX::Compression compression;
+    };
+
+    std::vector<EntryMGX> mgx_entries()
+    {
+        // text compresses; the noise is stored in blocks which don't compress
+        std::vector<EntryMGX> entries;
+        entries.push_back({ "text.txt", test::text_data(300000, 1), WriterMGX::LZ4 });
+        entries.push_back({ "noise.bin", test::random_data(200000, 2), WriterMGX::LZ4 });
+        entries.push_back({ "empty.bin", std::vector<uint8>(), WriterMGX::LZ4 });
+        entries.push_back({ "data/zstd.txt", test::text_data(150000, 3), WriterMGX::ZSTD });
+        entries.push_back({ "data/stored.txt", test::text_data(100000, 4), WriterMGX::NONE });
+        entries.push_back({ "data/deep/small.txt", test::text_data(100, 5), WriterMGX::LZ4 });
+        return entries;
+    }
+
+    std::vector<uint8> write_mgx(std::vector<EntryMGX>& entries, uint32 block_size, bool checksum = true)
+    {
+        Buffer buffer;
+        WriterMGX writer(buffer, WriterMGX::LZ4, 6, block_size, checksum);
+
+        for (EntryMGX& entry : entries)
+        {
+            writer.add(entry.filename, test::memory(entry.data), entry.compression);
+        }
+
+        writer.finish();
+
+        Memory memory = buffer;
+        return std::vector<uint8>(memory.address, memory.address + memory.size);
+    }
+
+    void test_mgx()
+    {
+        std::vector<EntryMGX> entries = mgx_entries();
+        std::vector<uint8> archive = write_mgx(entries, 64 * 1024);
+
+        Path path(test::memory(archive), ".mgx");
+
+        // the folders are implied by the filenames
+        std::set<std::string> names;
+        for (const FileInfo& info : path)
+        {
+            names.insert(info.name);
+        }
+        CHECK(names == std::set<std::string>({ "text.txt", "noise.bin", "empty.bin", "data/" }));
+
+        Path folder(path, "data/");
+        CHECK(folder.size() == 3);
+
+        for (EntryMGX& entry : entries)
+        {
+            CHECK(read_file(path, entry.filename) == entry.data);
+        }
+    }
+
+    void test_mgx_stream()
+    {
+        // the reads cross the 4 KB blocks and go backwards
+        std::vector<EntryMGX> entries = mgx_entries();
+        std::vector<uint8> archive = write_mgx(entries, 4096);
+
+        Path path(test::memory(archive), ".mgx");
+
+        for (EntryMGX& entry : entries)
+        {
+            MapperStream stream(path, entry.filename);
+            CHECK(stream.size() == entry.data.size());
+
+            if (entry.data.size() < 20000)
+                continue;
+
+            const size_t offsets[] = { 0, 4000, 4096, 10000, 5, 15000 };
+
+            for (size_t offset : offsets)
+            {
+                std::vector<uint8> data(5000);
+                stream.seek(offset, Stream::BEGIN);
+                stream.read(data.data(), data.size());
+                CHECK(std::equal(data.begin(), data.end(), entry.data.begin() + offset));
+                CHECK(stream.offset() == offset + data.size());
+            }
+
+            uint8 value;
+            stream.seek(0, Stream::END);
+            CHECK(throws([&] { stream.read(&value, 1); }));
+        }
+    }
+
+    void test_mgx_errors()
+    {
+        std::vector<EntryMGX> entries = mgx_entries();
+
+        {
+            Buffer buffer;
+            WriterMGX writer(buffer);
+            writer.add("a.txt", test::memory(entries[0].data));
+            CHECK(throws([&] { writer.add("a.txt", test::memory(entries[0].data)); }));
+            writer.finish();
+            CHECK(throws([&] { writer.add("b.txt", test::memory(entries[0].data)); }));
+        }
+
+        std::vector<uint8> archive = write_mgx(entries, 64 * 1024);
+
+        Path path(test::memory(archive), ".mgx");
+        CHECK(throws([&] { read_file(path, "missing.txt"); }));
+
+        // the first block of text.txt follows the 16 byte archive header; the
+        // damaged data doesn't match the checksum
+        std::vector<uint8> damaged = archive;
+        damaged[16 + 100] ^= 0x55;
+
+        Path damaged_path(test::memory(damaged), ".mgx");
+        CHECK(throws([&] { read_file(damaged_path, "text.txt"); }));
+        CHECK(read_file(damaged_path, "noise.bin") == entries[1].data);
+
+        std::vector<uint8> truncated(archive.begin(), archive.end() - 1);
+        CHECK(throws([&] { Path truncated_path(test::memory(truncated), ".mgx"); }));
+
+        // without the checksums the lz4 decoder must catch the damage: a single
+        // literal run of the whole 64 KB block reads past the compressed block
+        std::vector<uint8> unchecked = write_mgx(entries, 64 * 1024, false);
+        unchecked[16] = 0xf0;
+        std::fill(unchecked.begin() + 17, unchecked.begin() + 17 + 256, 0xff);
+        unchecked[17 + 256] = uint8(64 * 1024 - 15 - 256 * 255);
+
+        Path unchecked_path(test::memory(unchecked), ".mgx");
+        CHECK(throws([&] { read_file(unchecked_path, "text.txt"); }));
+        CHECK(read_file(unchecked_path, "noise.bin") == entries[1].data);
+    }
+
+#endif
+
+} // namespace
+
+int main()
+{
+    test::run("zip aes", test_zip_aes);
+    test::run("zip aes errors", test_zip_aes_errors);
+    test::run("zip crypto", test_zip_crypto);
+    test::run("zip stream", test_zip_stream);
+    test::run("zip stream crc", test_zip_stream_crc);
+    test::run("container cache", test_container_cache);
+    test::run("container cache eviction", test_container_cache_eviction);
+    test::run("container cache threads", test_container_cache_threads);
+#ifdef MANGO_ENABLE_LICENSE_BSD
+    test::run("mgx", test_mgx);
+    test::run("mgx stream", test_mgx_stream);
+    test::run("mgx errors", test_mgx_errors);
+#endif
+    return test::result();
+}
@@ -0,0 +1,269 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <string>
+#include <vector>
+#include <mango/core/hash.hpp>
+#include "test.hpp"
+
+using namespace mango;
+
+namespace
+{
+
+    // the hash words are stored so that their bytes in memory are the digest
+    std::vector<uint8> digest(const uint32* hash, int count)
+    {
+        const uint8* data = reinterpret_cast<const uint8*>(hash);
+        return std::vector<uint8>(data, data + count * 4);
+    }
+
+    std::vector<uint8> md5_digest(Memory memory)
+    {
+        uint32 hash[4];
+        md5(hash, memory);
+        return digest(hash, 4);
+    }
+
+    std::vector<uint8> sha1_digest(Memory memory)
+    {
+        uint32 hash[5];
+        sha1(hash, memory);
+        return digest(hash, 5);
+    }
+
+    std::vector<uint8> sha2_digest(Memory memory)
+    {
+        uint32 hash[8];
+        sha2(hash, memory);
+        return digest(hash, 8);
+    }
+
+    // bytes which are not periodic in the 64 byte blocks
+    std::vector<uint8> pattern_data(size_t size)
+    {
+        std::vector<uint8> data(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            data[i] = uint8(i * 31 + (i >> 7));
+        }
+        return data;
+    }
+
+    // ----------------------------------------------------------------------------
+    // md5 / sha1 / sha2
+    // ----------------------------------------------------------------------------
+
+    struct Vector
+    {
+        std::string message;
+        const char* md5;
+        const char* sha1;
+        const char* sha2;
+    };
+
+    void test_hash_vectors()
+    {
+        const Vector vectors[] =
+        {
+            { "",
+              "d41d8cd98f00b204e9800998ecf8427e",
+              "da39a3ee5e6b4b0d3255bfef95601890afd80709",
+              "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+            { "abc",
+              "900150983cd24fb0d6963f7d28e17f72",
+              "a9993e364706816aba3e25717850c26c9cd0d89d",
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+            { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+              "8215ef0796a20bcaaae116d3876c664a",
+              "84983e441c3bd26ebaae4aa1f95129e5e54670f1",
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+            { std::string(1000000, 'a'),
+              "7707d6ae4e027c70eea2a935c2296f21",
+              "34aa973cd4c4daa4f61eeb2bdbad27316534016f",
+              "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+        };
+
+        for (const Vector& vector : vectors)
+        {
+            Memory memory = test::memory(vector.message.c_str());
+            CHECK(md5_digest(memory) == test::hex(vector.md5));
+            CHECK(sha1_digest(memory) == test::hex(vector.sha1));
+            CHECK(sha2_digest(memory) == test::hex(vector.sha2));
+
+            // the same message in chunks which don't line up with the blocks
+            MD5Context md5_context;
+            SHA1Context sha1_context;
+            SHA2Context sha2_context;
+
+            for (size_t offset = 0; offset < memory.size; offset += 1000)
+            {
+                const size_t bytes = std::min(memory.size - offset, size_t(1000));
+                Memory chunk(memory.address + offset, bytes);
+                md5_context.update(chunk);
+                sha1_context.update(chunk);
+                sha2_context.update(chunk);
+            }
+
+            uint32 hash[8];
+            md5_context.final(hash);
+            CHECK(digest(hash, 4) == test::hex(vector.md5));
+            sha1_context.final(hash);
+            CHECK(digest(hash, 5) == test::hex(vector.sha1));
+            sha2_context.final(hash);
+            CHECK(digest(hash, 8) == test::hex(vector.sha2));
+        }
+    }
+
+    void test_hash_context()
+    {
+        // every message size around the padding boundaries with every chunk size
+        std::vector<uint8> data = pattern_data(300);
+        const size_t chunks[] = { 1, 3, 63, 64, 65, 200 };
+
+        for (size_t size = 0; size <= data.size(); ++size)
+        {
+            Memory memory(data.data(), size);
+            const std::vector<uint8> md5_expected = md5_digest(memory);
+            const std::vector<uint8> sha1_expected = sha1_digest(memory);
+            const std::vector<uint8> sha2_expected = sha2_digest(memory);
+
+            for (size_t chunk : chunks)
+            {
+                MD5Context md5_context;
+                SHA1Context sha1_context;
+                SHA2Context sha2_context;
+
+                for (size_t offset = 0; offset < size; offset += chunk)
+                {
+                    Memory part(data.data() + offset, std::min(chunk, size - offset));
+                    md5_context.update(part);
+                    sha1_context.update(part);
+                    sha2_context.update(part);
+                }
+
+                uint32 hash[8];
+                md5_context.final(hash);
+                CHECK(digest(hash, 4) == md5_expected);
+                sha1_context.final(hash);
+                CHECK(digest(hash, 5) == sha1_expected);
+                sha2_context.final(hash);
+                CHECK(digest(hash, 8) == sha2_expected);
+            }
+        }
+    }
+
+    void test_hash_reset()
+    {
+        std::vector<uint8> data = pattern_data(1000);
+
+        MD5Context md5_context;
+        SHA2Context sha2_context;
+        uint32 hash[8];
+
+        // a different message before the reset doesn't affect the result
+        md5_context.update(test::memory(data));
+        md5_context.final(hash);
+        md5_context.reset();
+        md5_context.update(test::memory("abc"));
+        md5_context.final(hash);
+        CHECK(digest(hash, 4) == test::hex("900150983cd24fb0d6963f7d28e17f72"));
+
+        sha2_context.update(Memory(data.data(), 77));
+        sha2_context.reset();
+        sha2_context.update(test::memory("abc"));
+        sha2_context.final(hash);
+        CHECK(digest(hash, 8) == test::hex("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    }
+
+    // ----------------------------------------------------------------------------
+    // xxhash
+    // ----------------------------------------------------------------------------
+
+    void test_xxhash_context()
+    {
+        CHECK(xxhash32(Memory()) == 0x02cc5d05);
+        CHECK(xxhash64(Memory()) == 0xef46db3751d8e999ull);
+
+        std::vector<uint8> data = pattern_data(5000);
+        const size_t sizes[] = { 0, 1, 15, 16, 31, 32, 33, 100, 5000 };
+
+        for (size_t size : sizes)
+        {
+            Memory memory(data.data(), size);
+
+            XXHash32Context context32;
+            XXHash64Context context64;
+
+            for (size_t offset = 0; offset < size; offset += 7)
+            {
+                Memory part(data.data() + offset, std::min(size_t(7), size - offset));
+                context32.update(part);
+                context64.update(part);
+            }
+
+            CHECK(context32.final() == xxhash32(memory));
+            CHECK(context64.final() == xxhash64(memory));
+
+            // the seed changes the hash and reset() starts over with the new seed
+            context32.reset(1);
+            context64.reset(1);
+            context32.update(memory);
+            context64.update(memory);
+            CHECK(context32.final() != xxhash32(memory));
+            CHECK(context64.final() != xxhash64(memory));
+
+            context32.reset();
+            context32.update(memory);
+            CHECK(context32.final() == xxhash32(memory));
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // batch
+    // ----------------------------------------------------------------------------
+
+    void test_hash_batch()
+    {
+        // the sizes cover empty messages, the padding boundaries, messages much
+        // longer than the others and the large messages hashed with SHA extensions
+        std::vector<uint8> data = pattern_data(20000);
+        std::vector<Memory> messages;
+
+        for (size_t i = 0; i < 150; ++i)
+        {
+            const size_t size = i < 130 ? i : (i - 129) * 997;
+            messages.emplace_back(data.data() + i, size);
+        }
+
+        // every count up to a few full rounds of lanes, and all of the messages
+        const size_t counts[] = { 0, 1, 2, 3, 4, 5, 8, 9, 16, 17, 33, messages.size() };
+
+        for (size_t count : counts)
+        {
+            std::vector<uint32> md5_hash(count * 4, 0);
+            std::vector<uint32> sha2_hash(count * 8, 0);
+
+            md5_batch(reinterpret_cast<uint32 (*)[4]>(md5_hash.data()), messages.data(), count);
+            sha2_batch(reinterpret_cast<uint32 (*)[8]>(sha2_hash.data()), messages.data(), count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                CHECK(digest(&md5_hash[i * 4], 4) == md5_digest(messages[i]));
+                CHECK(digest(&sha2_hash[i * 8], 8) == sha2_digest(messages[i]));
+            }
+        }
+    }
+
+} // namespace
+
+int main()
+{
+    test::run("hash vectors", test_hash_vectors);
+    test::run("hash context", test_hash_context);
+    test::run("hash reset", test_hash_reset);
+    test::run("xxhash context", test_xxhash_context);
+    test::run("hash batch", test_hash_batch);
+    return test::result();
+}
@@ -0,0 +1,146 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstdio>
+#include <mango/core/memory.hpp>
+#include <mango/image/image.hpp>
+#include "test.hpp"
+
+using namespace mango;
+
+namespace
+{
+
+    void fill(Surface& surface)
+    {
+        for (int y = 0; y < surface.height; ++y)
+        {
+            uint32* scan = surface.address<uint32>(0, y);
+            for (int x = 0; x < surface.width; ++x)
+            {
+                scan[x] = uint32(y * surface.width + x);
+            }
+        }
+    }
+
+    bool verify(const Surface& surface)
+    {
+        for (int y = 0; y < surface.height; ++y)
+        {
+            const uint32* scan = surface.address<uint32>(0, y);
+            for (int x = 0; x < surface.width; ++x)
+            {
+                if (scan[x] != uint32(y * surface.width + x))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // ----------------------------------------------------------------------------
+    // allocation policy
+    // ----------------------------------------------------------------------------
+
+    void test_bitmap_policy()
+    {
+        AllocationPolicy policy;
+        policy.pages = AllocationPolicy::PAGES_TRANSPARENT;
+        policy.threshold = 1024 * 1024;
+
+        // large enough for the huge page mapping and one which stays on the heap
+        for (int size : { 16, 1024 })
+        {
+            Bitmap bitmap(size, size, FORMAT_R8G8B8A8, policy);
+            CHECK(bitmap.image != nullptr);
+            CHECK(bitmap.stride >= size * 4);
+            fill(bitmap);
+            CHECK(verify(bitmap));
+
+            // the storage moves with the bitmap
+            uint8* image = bitmap.image;
+            Bitmap moved(std::move(bitmap));
+            CHECK(moved.image == image);
+            CHECK(verify(moved));
+        }
+
+        // explicit stride
+        Bitmap padded(100, 10, FORMAT_R8G8B8A8, policy, 512);
+        CHECK(padded.stride == 512);
+        fill(padded);
+        CHECK(verify(padded));
+    }
+
+    // ----------------------------------------------------------------------------
+    // BitmapPool
+    // ----------------------------------------------------------------------------
+
+    void test_bitmap_pool()
+    {
+        BitmapPool pool(1024 * 1024, 64);
+
+        const int stride = pool.getStride(100, FORMAT_R8G8B8A8);
+        CHECK(stride == 448);
+
+        uint8* image;
+        {
+            Bitmap bitmap(pool, 100, 50, FORMAT_R8G8B8A8);
+            CHECK(bitmap.stride == stride);
+            fill(bitmap);
+            image = bitmap.image;
+            CHECK(pool.size() == 0);
+        }
+
+        // the storage returns to the pool and is reused for the same dimensions
+        CHECK(pool.size() == size_t(stride) * 50);
+        {
+            Bitmap bitmap(pool, 100, 50, FORMAT_R8G8B8A8);
+            CHECK(bitmap.image == image);
+            CHECK(pool.size() == 0);
+
+            Bitmap other(pool, 100, 51, FORMAT_R8G8B8A8);
+            CHECK(other.image != image);
+
+            // the storage moves with the bitmap and is released once
+            Bitmap moved(std::move(other));
+        }
+        CHECK(pool.size() == size_t(stride) * (50 + 51));
+
+        // the pool stays within the budget by freeing the oldest storage
+        pool.setBudget(size_t(stride) * 120);
+        {
+            Bitmap a(pool, 100, 60, FORMAT_R8G8B8A8);
+            Bitmap b(pool, 100, 70, FORMAT_R8G8B8A8);
+        }
+        CHECK(pool.size() <= size_t(stride) * 120);
+
+        pool.trim();
+        CHECK(pool.size() == 0);
+
+        // the decoded images use the pooled storage
+        const std::string filename = "mango-test-pool.png";
+        {
+            Bitmap source(32, 16, FORMAT_R8G8B8A8);
+            fill(source);
+            source.save(filename);
+        }
+
+        {
+            Bitmap bitmap(pool, filename, FORMAT_R8G8B8A8);
+            CHECK(bitmap.width == 32 && bitmap.height == 16);
+            CHECK(bitmap.stride == pool.getStride(32, FORMAT_R8G8B8A8));
+            CHECK(verify(bitmap));
+        }
+        CHECK(pool.size() == size_t(pool.getStride(32, FORMAT_R8G8B8A8)) * 16);
+
+        std::remove(filename.c_str());
+    }
+
+} // namespace
+
+int main()
+{
+    test::run("bitmap policy", test_bitmap_policy);
+    test::run("bitmap pool", test_bitmap_pool);
+    return test::result();
+}
@@ -0,0 +1,355 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <atomic>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+#include <mango/core/memory.hpp>
+#include <mango/core/object_pool.hpp>
+#include "test.hpp"
+
+using namespace mango;
+
+namespace
+{
+
+    // ----------------------------------------------------------------------------
+    // ObjectPool
+    // ----------------------------------------------------------------------------
+
+    std::atomic<int> g_constructed { 0 };
+    std::atomic<int> g_destroyed { 0 };
+
+    struct Object
+    {
+        std::atomic<int> owner { 0 };
+        int value { 0 };
+
+        Object()
+        {
+            ++g_constructed;
+        }
+
+        ~Object()
+        {
+            ++g_destroyed;
+        }
+    };
+
+    void test_object_pool()
+    {
+        g_constructed = 0;
+        g_destroyed = 0;
+
+        {
+            ObjectPool<Object> pool(64);
+
+            // the objects are unique and constructed in blocks
+            std::set<Object*> objects;
+            for (int i = 0; i < 1000; ++i)
+            {
+                objects.insert(pool.acquire());
+            }
+
+            CHECK(objects.size() == 1000);
+            CHECK(g_constructed % 64 == 0);
+
+            for (Object* object : objects)
+            {
+                pool.discard(object);
+            }
+
+            // the discarded objects are recycled as they were
+            const int constructed = g_constructed;
+            std::set<Object*> recycled;
+            for (int i = 0; i < 1000; ++i)
+            {
+                recycled.insert(pool.acquire());
+            }
+
+            CHECK(g_constructed == constructed);
+            CHECK(recycled == objects);
+
+            for (Object* object : recycled)
+            {
+                pool.discard(object);
+            }
+
+            Object* object = pool.acquire();
+            object->value = 7;
+            pool.discard(object);
+            Object* again = pool.acquire();
+            CHECK(again == object && again->value == 7);
+            pool.discard(again);
+        }
+
+        // the objects are destroyed with the pool
+        CHECK(g_constructed == g_destroyed);
+    }
+
+    void test_object_pool_threads()
+    {
+        ObjectPool<Object> pool(16);
+        std::atomic<int> shared { 0 };
+
+        // an object is never handed out twice, including the objects which
+        // are discarded on a different thread than where they were acquired
+        std::vector<Object*> handoff[4];
+        std::vector<std::thread> threads;
+
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&pool, &shared, &handoff, t] {
+                std::vector<Object*> objects;
+
+                for (int pass = 0; pass < 200; ++pass)
+                {
+                    for (int i = 0; i < 50; ++i)
+                    {
+                        Object* object = pool.acquire();
+                        if (object->owner.exchange(1))
+                            ++shared;
+                        objects.push_back(object);
+                    }
+
+                    for (Object* object : objects)
+                    {
+                        object->owner = 0;
+                        pool.discard(object);
+                    }
+
+                    objects.clear();
+                }
+
+                for (int i = 0; i < 100; ++i)
+                {
+                    Object* object = pool.acquire();
+                    if (object->owner.exchange(1))
+                        ++shared;
+                    handoff[t].push_back(object);
+                }
+
+                pool.flush();
+            });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        CHECK(shared == 0);
+
+        std::set<Object*> objects;
+        for (auto& list : handoff)
+        {
+            for (Object* object : list)
+            {
+                objects.insert(object);
+                object->owner = 0;
+                pool.discard(object);
+            }
+        }
+
+        CHECK(objects.size() == 400);
+    }
+
+    // ----------------------------------------------------------------------------
+    // Arena
+    // ----------------------------------------------------------------------------
+
+    bool aligned(const void* pointer, size_t alignment)
+    {
+        return (reinterpret_cast<uintptr_t>(pointer) & (alignment - 1)) == 0;
+    }
+
+    void test_arena()
+    {
+        Arena arena(4096);
+
+        // aligned allocations which don't overlap
+        uint8* a = reinterpret_cast<uint8*>(arena.allocate(100));
+        uint8* b = reinterpret_cast<uint8*>(arena.allocate(100, 64));
+        double* c = arena.allocate<double>(10);
+        CHECK(aligned(a, MANGO_DEFAULT_ALIGNMENT));
+        CHECK(aligned(b, 64));
+        CHECK(aligned(c, MANGO_DEFAULT_ALIGNMENT));
+        CHECK(b >= a + 100);
+        CHECK(reinterpret_cast<uint8*>(c) >= b + 100);
+
+        // the allocations larger than the chunk get a chunk of their own
+        uint8* large = reinterpret_cast<uint8*>(arena.allocate(10000));
+        std::memset(large, 0xff, 10000);
+        CHECK(arena.capacity() >= 4096 + 10000);
+
+        // rewind gives the memory after the marker back
+        Arena::Marker marker = arena.marker();
+        void* first = arena.allocate(256);
+        arena.rewind(marker);
+        CHECK(arena.allocate(256) == first);
+
+        {
+            ArenaScope scope(arena);
+            arena.allocate(1000);
+        }
+        CHECK(arena.allocate(256) != first);
+
+        // reset keeps the chunks
+        const size_t capacity = arena.capacity();
+        arena.reset();
+        CHECK(arena.capacity() == capacity);
+        CHECK(arena.allocate(100) == a);
+
+        // STL containers in the arena
+        std::vector<int, ArenaAllocator<int>> values { ArenaAllocator<int>(arena) };
+        for (int i = 0; i < 1000; ++i)
+        {
+            values.push_back(i);
+        }
+        CHECK(values[999] == 999);
+    }
+
+    void test_arena_threads()
+    {
+        Arena arena(1024);
+
+        // concurrent allocations don't overlap; every thread fills its
+        // allocations with its own pattern and checks them afterwards
+        std::atomic<int> corrupted { 0 };
+        std::vector<std::thread> threads;
+
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&arena, &corrupted, t] {
+                std::vector<std::pair<uint8*, size_t>> blocks;
+
+                for (int i = 0; i < 500; ++i)
+                {
+                    const size_t size = 1 + (i * 37) % 300;
+                    uint8* block = reinterpret_cast<uint8*>(arena.allocate(size));
+                    std::memset(block, t + 1, size);
+                    blocks.emplace_back(block, size);
+                }
+
+                for (auto& block : blocks)
+                {
+                    for (size_t i = 0; i < block.second; ++i)
+                    {
+                        if (block.first[i] != t + 1)
+                        {
+                            ++corrupted;
+                            break;
+                        }
+                    }
+                }
+            });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        CHECK(corrupted == 0);
+    }
+
+    void test_arena_cache()
+    {
+        const size_t limit = getArenaCacheLimit();
+
+        setArenaCacheLimit(1024 * 1024);
+        CHECK(getArenaCacheLimit() == 1024 * 1024);
+
+        // the chunks of a destroyed arena are reused by the next one
+        for (int i = 0; i < 10; ++i)
+        {
+            Arena arena(64 * 1024);
+            for (int j = 0; j < 8; ++j)
+            {
+                std::memset(arena.allocate(32 * 1024), j, 32 * 1024);
+            }
+            CHECK(arena.capacity() >= 256 * 1024);
+        }
+
+        trimArenaCache();
+        setArenaCacheLimit(limit);
+    }
+
+    // ----------------------------------------------------------------------------
+    // AllocationPolicy
+    // ----------------------------------------------------------------------------
+
+    void test_allocation_policy()
+    {
+        const AllocationPolicy::Pages pages[] =
+        {
+            AllocationPolicy::PAGES_DEFAULT,
+            AllocationPolicy::PAGES_TRANSPARENT,
+            AllocationPolicy::PAGES_HUGE
+        };
+
+        // the huge pages fall back to normal pages and the node binding is
+        // ignored when the system doesn't have them
+        for (auto page : pages)
+        {
+            for (int node : { -1, 0 })
+            {
+                AllocationPolicy policy;
+                policy.pages = page;
+                policy.node = node;
+                policy.threshold = 64 * 1024;
+
+                for (size_t size : { size_t(100), size_t(64 * 1024), size_t(5 * 1024 * 1024 + 1) })
+                {
+                    uint8* address = reinterpret_cast<uint8*>(aligned_malloc(size, 64, policy));
+                    CHECK(address != nullptr);
+                    CHECK(aligned(address, 64));
+                    std::memset(address, 0x5a, size);
+                    CHECK(address[0] == 0x5a && address[size - 1] == 0x5a);
+                    aligned_free(address);
+                }
+            }
+        }
+
+        // the global policy is used by aligned_malloc() without a policy
+        const AllocationPolicy previous = getAllocationPolicy();
+
+        AllocationPolicy policy;
+        policy.pages = AllocationPolicy::PAGES_TRANSPARENT;
+        policy.threshold = 1024 * 1024;
+        setAllocationPolicy(policy);
+
+        AllocationPolicy current = getAllocationPolicy();
+        CHECK(current.pages == AllocationPolicy::PAGES_TRANSPARENT);
+        CHECK(current.node == -1);
+        CHECK(current.threshold == 1024 * 1024);
+
+        void* small = aligned_malloc(1000);
+        void* large = aligned_malloc(4 * 1024 * 1024, 256);
+        CHECK(small && large);
+        CHECK(aligned(large, 256));
+        std::memset(large, 0, 4 * 1024 * 1024);
+        aligned_free(small);
+        aligned_free(large);
+
+        setAllocationPolicy(previous);
+        CHECK(getAllocationPolicy().pages == previous.pages);
+
+        aligned_free(nullptr);
+    }
+
+} // namespace
+
+int main()
+{
+    test::run("object pool", test_object_pool);
+    test::run("object pool threads", test_object_pool_threads);
+    test::run("arena", test_arena);
+    test::run("arena threads", test_arena_threads);
+    test::run("arena cache", test_arena_cache);
+    test::run("allocation policy", test_allocation_policy);
+    return test::result();
+}
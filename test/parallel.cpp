@@ -0,0 +1,312 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <mango/core/parallel.hpp>
+#include <mango/core/thread.hpp>
+#include "test.hpp"
+
+using namespace mango;
+
+namespace
+{
+
+    // ----------------------------------------------------------------------------
+    // parallel_for
+    // ----------------------------------------------------------------------------
+
+    void test_parallel_for()
+    {
+        const int count = 100000;
+        std::vector<std::atomic<int>> visits(count);
+        for (auto& visit : visits)
+        {
+            visit = 0;
+        }
+
+        parallel_for(BlockRange(0, count, 1000), [&] (const BlockRange& range)
+        {
+            for (int i = range.begin; i < range.end; ++i)
+            {
+                ++visits[i];
+            }
+        });
+
+        CHECK(std::all_of(visits.begin(), visits.end(), [] (const std::atomic<int>& visit) { return visit == 1; }));
+
+        // the empty range and the range which can't be split
+        int calls = 0;
+        parallel_for(BlockRange(5, 5), [&] (const BlockRange& range) { calls += range.size() + 1; });
+        parallel_for(BlockRange(0, 1), [&] (const BlockRange& range) { calls += range.size() + 1; });
+        CHECK(calls == 3);
+
+        // the first block is processed on the calling thread; its exception is
+        // rethrown after the queued blocks have been processed
+        ThreadPool pool(4);
+        std::atomic<int> processed { 0 };
+        int first = 0;
+        bool thrown = false;
+
+        try
+        {
+            parallel_for(pool, BlockRange(0, count, 1000), [&] (const BlockRange& range)
+            {
+                if (range.begin == 0)
+                {
+                    first = range.size();
+                    throw std::runtime_error("first block");
+                }
+
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                processed += range.size();
+            });
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+
+        CHECK(thrown);
+        CHECK(processed == count - first);
+    }
+
+    void test_parallel_for_2d()
+    {
+        const int width = 300;
+        const int height = 200;
+        std::vector<std::atomic<int>> visits(width * height);
+        for (auto& visit : visits)
+        {
+            visit = 0;
+        }
+
+        BlockRange2D range(BlockRange(0, height), BlockRange(0, width, 16));
+
+        parallel_for(range, [&] (const BlockRange2D& block)
+        {
+            for (int y = block.rows.begin; y < block.rows.end; ++y)
+            {
+                for (int x = block.cols.begin; x < block.cols.end; ++x)
+                {
+                    ++visits[y * width + x];
+                }
+            }
+        });
+
+        CHECK(std::all_of(visits.begin(), visits.end(), [] (const std::atomic<int>& visit) { return visit == 1; }));
+    }
+
+    void test_parallel_for_queue()
+    {
+        std::atomic<long long> sum { 0 };
+
+        ConcurrentQueue queue;
+        auto func = [&] (const BlockRange& range)
+        {
+            long long value = 0;
+            for (int i = range.begin; i < range.end; ++i)
+            {
+                value += i;
+            }
+            sum += value;
+        };
+
+        parallel_for(queue, BlockRange(0, 100000), func);
+        queue.wait();
+
+        CHECK(sum == 100000LL * 99999 / 2);
+
+        // the tasks own a copy of func which can go away before the wait
+        std::atomic<int> rows { 0 };
+        {
+            auto counter = std::make_shared<int>(1);
+            auto count = [&rows, counter] (const BlockRange& range)
+            {
+                rows += range.size() * *counter;
+            };
+
+            parallel_for(queue, BlockRange(0, 1000, 10), count);
+        }
+
+        queue.wait();
+        CHECK(rows == 1000);
+    }
+
+    // ----------------------------------------------------------------------------
+    // parallel_each
+    // ----------------------------------------------------------------------------
+
+    void test_parallel_each()
+    {
+        std::vector<std::atomic<int>> visits(1000);
+        for (auto& visit : visits)
+        {
+            visit = 0;
+        }
+
+        parallel_each(visits.size(), [&] (size_t index)
+        {
+            ++visits[index];
+        });
+
+        CHECK(std::all_of(visits.begin(), visits.end(), [] (const std::atomic<int>& visit) { return visit == 1; }));
+
+        // the exception is rethrown after all of the indices have been processed
+        std::atomic<int> processed { 0 };
+        bool thrown = false;
+
+        try
+        {
+            parallel_each(100, [&] (size_t index)
+            {
+                ++processed;
+                if (index == 50)
+                    throw std::runtime_error("index 50");
+            });
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+
+        CHECK(thrown);
+        CHECK(processed == 100);
+    }
+
+    // ----------------------------------------------------------------------------
+    // parallel_reduce
+    // ----------------------------------------------------------------------------
+
+    void test_parallel_reduce()
+    {
+        const int count = 1000000;
+
+        long long sum = parallel_reduce(BlockRange(0, count), 0LL,
+            [] (const BlockRange& range, long long identity)
+            {
+                long long value = identity;
+                for (int i = range.begin; i < range.end; ++i)
+                {
+                    value += i;
+                }
+                return value;
+            },
+            [] (long long a, long long b)
+            {
+                return a + b;
+            });
+
+        CHECK(sum == (long long)(count) * (count - 1) / 2);
+
+        // the blocks are combined in range order, so a reduction which is
+        // associative but not commutative gives the serial result
+        std::string text = parallel_reduce(BlockRange(0, 26, 1), std::string(),
+            [] (const BlockRange& range, const std::string& identity)
+            {
+                std::string value = identity;
+                for (int i = range.begin; i < range.end; ++i)
+                {
+                    value += char('a' + i);
+                }
+                return value;
+            },
+            [] (const std::string& a, const std::string& b)
+            {
+                return a + b;
+            });
+
+        CHECK(text == "abcdefghijklmnopqrstuvwxyz");
+
+        // the results of the blocks are written concurrently to their own slots
+        for (int pass = 0; pass < 20; ++pass)
+        {
+            const int found = 77777 + pass;
+
+            bool any = parallel_reduce(BlockRange(0, 100000, 1), false,
+                [=] (const BlockRange& range, bool identity)
+                {
+                    bool value = identity;
+                    for (int i = range.begin; i < range.end; ++i)
+                    {
+                        value |= i == found;
+                    }
+                    return value;
+                },
+                [] (bool a, bool b)
+                {
+                    return a || b;
+                });
+
+            CHECK(any);
+        }
+
+        int cells = parallel_reduce(BlockRange2D(BlockRange(0, 300, 8), BlockRange(0, 200, 16)), 0,
+            [] (const BlockRange2D& range, int identity)
+            {
+                return identity + range.rows.size() * range.cols.size();
+            },
+            [] (int a, int b)
+            {
+                return a + b;
+            });
+
+        CHECK(cells == 300 * 200);
+
+        // the empty range is the identity
+        int empty = parallel_reduce(BlockRange(0, 0), 42,
+            [] (const BlockRange& range, int identity) { return identity + range.size(); },
+            [] (int a, int b) { return a + b; });
+
+        CHECK(empty == 42);
+    }
+
+    void test_parallel_reduce_pool()
+    {
+        // a pool of its own; the results don't depend on the number of workers
+        for (size_t threads : { 1, 2, 7 })
+        {
+            ThreadPool pool(threads);
+
+            double sum = parallel_reduce(pool, BlockRange(0, 4096), 0.0,
+                [] (const BlockRange& range, double identity)
+                {
+                    double value = identity;
+                    for (int i = range.begin; i < range.end; ++i)
+                    {
+                        value += 1.0 / (i + 1);
+                    }
+                    return value;
+                },
+                [] (double a, double b)
+                {
+                    return a + b;
+                });
+
+            double expected = 0.0;
+            for (int i = 0; i < 4096; ++i)
+            {
+                expected += 1.0 / (i + 1);
+            }
+
+            CHECK(std::abs(sum - expected) < 1e-9);
+        }
+    }
+
+} // namespace
+
+int main()
+{
+    test::run("parallel for", test_parallel_for);
+    test::run("parallel for 2d", test_parallel_for_2d);
+    test::run("parallel for queue", test_parallel_for_queue);
+    test::run("parallel each", test_parallel_each);
+    test::run("parallel reduce", test_parallel_reduce);
+    test::run("parallel reduce pool", test_parallel_reduce_pool);
+    return test::result();
+}
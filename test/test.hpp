@@ -0,0 +1,137 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+// A minimal test harness: every test program runs its test cases in main()
+// and returns non-zero when any check failed, which is what ctest expects.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <random>
+#include <string>
+#include <vector>
+#include <mango/core/configure.hpp>
+#include <mango/core/memory.hpp>
+
+namespace test
+{
+
+    inline int& failures()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    inline void check(bool result, const char* expression, const char* filename, int line)
+    {
+        if (!result)
+        {
+            std::printf("%s(%d): check failed: %s\n", filename, line, expression);
+            ++failures();
+        }
+    }
+
+    // runs a test case; an exception fails the case
+    template <typename Function>
+    void run(const char* name, Function function)
+    {
+        const int count = failures();
+
+        try
+        {
+            function();
+        }
+        catch (const std::exception& e)
+        {
+            std::printf("%s: exception: %s\n", name, e.what());
+            ++failures();
+        }
+
+        std::printf("[%s] %s\n", failures() == count ? "  OK  " : "FAILED", name);
+    }
+
+    inline int result()
+    {
+        return failures() ? 1 : 0;
+    }
+
+    // ----------------------------------------------------------------------------
+    // test data
+    // ----------------------------------------------------------------------------
+
+    // random bytes; the same seed gives the same data on every platform
+    inline std::vector<mango::uint8> random_data(size_t size, mango::uint32 seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<mango::uint8> data(size);
+
+        for (auto& value : data)
+        {
+            value = mango::uint8(rng());
+        }
+
+        return data;
+    }
+
+    // text-like data which compresses well but not trivially
+    inline std::vector<mango::uint8> text_data(size_t size, mango::uint32 seed)
+    {
+        static const char* words[] =
+        {
+            "mango ", "multimedia ", "development ", "platform ", "image ",
+            "decoder ", "thread ", "pool ", "block ", "compress ", "stream ",
+            "\n", ", ", "the ", "of ", "and "
+        };
+
+        std::mt19937 rng(seed);
+        std::vector<mango::uint8> data;
+        data.reserve(size + 16);
+
+        while (data.size() < size)
+        {
+            const char* word = words[rng() % 16];
+            data.insert(data.end(), word, word + std::strlen(word));
+        }
+
+        data.resize(size);
+        return data;
+    }
+
+    inline mango::Memory memory(std::vector<mango::uint8>& data)
+    {
+        return mango::Memory(data.data(), data.size());
+    }
+
+    inline mango::Memory memory(const char* text)
+    {
+        return mango::Memory(reinterpret_cast<mango::uint8*>(const_cast<char*>(text)), std::strlen(text));
+    }
+
+    inline bool equal(mango::Memory a, mango::Memory b)
+    {
+        return a.size == b.size && (!a.size || !std::memcmp(a.address, b.address, a.size));
+    }
+
+    // decodes hex text into bytes
+    inline std::vector<mango::uint8> hex(const char* text)
+    {
+        std::vector<mango::uint8> data;
+
+        for (size_t i = 0; text[i] && text[i + 1]; i += 2)
+        {
+            char temp[3] = { text[i], text[i + 1], 0 };
+            data.push_back(mango::uint8(std::strtoul(temp, nullptr, 16)));
+        }
+
+        return data;
+    }
+
+} // namespace test
+
+#define CHECK(expression) \
+    test::check(bool(expression), #expression, __FILE__, __LINE__)
@@ -0,0 +1,717 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2018 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <mango/core/thread.hpp>
+#include "test.hpp"
+
+using namespace mango;
+
+// the allocations made by the calling thread
+static thread_local size_t g_allocations = 0;
+
+void* operator new (std::size_t size)
+{
+    ++g_allocations;
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete (void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete (void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+
+    // ----------------------------------------------------------------------------
+    // work stealing
+    // ----------------------------------------------------------------------------
+
+    void test_work_stealing()
+    {
+        ThreadPool pool(4);
+        ConcurrentQueue queue(pool, "test.stealing");
+
+        const std::thread::id caller = std::this_thread::get_id();
+        std::mutex mutex;
+        std::set<std::thread::id> threads;
+        std::atomic<int> count { 0 };
+
+        // the tasks are submitted from a worker into its own deque; the other
+        // workers can run them only by stealing
+        queue.enqueue([&] {
+            for (int i = 0; i < 64; ++i)
+            {
+                queue.enqueue([&] {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+                    if (std::this_thread::get_id() != caller)
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        threads.insert(std::this_thread::get_id());
+                    }
+
+                    ++count;
+                });
+            }
+        });
+
+        queue.wait();
+
+        CHECK(count == 64);
+        CHECK(threads.size() > 1);
+    }
+
+    void fork(ConcurrentQueue& queue, std::atomic<int>& count, int depth)
+    {
+        ++count;
+
+        if (depth > 0)
+        {
+            queue.enqueue([&queue, &count, depth] { fork(queue, count, depth - 1); });
+            queue.enqueue([&queue, &count, depth] { fork(queue, count, depth - 1); });
+        }
+    }
+
+    void test_nested_tasks()
+    {
+        ThreadPool pool(4);
+        ConcurrentQueue queue(pool, "test.fork");
+
+        // a binary tree of tasks which enqueue their children
+        std::atomic<int> count { 0 };
+        queue.enqueue([&] { fork(queue, count, 12); });
+        queue.wait();
+
+        CHECK(count == (1 << 13) - 1);
+    }
+
+    void test_external_submit()
+    {
+        ThreadPool pool(4);
+        ConcurrentQueue queue(pool, "test.external");
+
+        // the threads which are not workers submit concurrently
+        std::atomic<int> count { 0 };
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            threads.emplace_back([&] {
+                for (int j = 0; j < 1000; ++j)
+                {
+                    queue.enqueue([&] { ++count; });
+                }
+            });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        queue.wait();
+
+        CHECK(count == 4000);
+    }
+
+    void test_external_submit_allocations()
+    {
+        ThreadPool pool(4);
+        ConcurrentQueue queue(pool, "test.allocations");
+        std::atomic<int> count { 0 };
+
+        // the first tasks grow the task pool and register the thread caches
+        for (int i = 0; i < 4096; ++i)
+        {
+            queue.enqueue([&] { ++count; });
+        }
+        queue.wait();
+
+        const size_t allocations = g_allocations;
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            queue.enqueue([&] { ++count; });
+        }
+
+        CHECK(g_allocations == allocations);
+
+        queue.wait();
+        CHECK(count == 5096);
+    }
+
+    // ----------------------------------------------------------------------------
+    // TaskFunction
+    // ----------------------------------------------------------------------------
+
+    struct alignas(128) Aligned
+    {
+        int* result;
+
+        void operator () ()
+        {
+            *result = (reinterpret_cast<uintptr_t>(this) & 127) == 0 ? 1 : -1;
+        }
+    };
+
+    void test_task_function()
+    {
+        int result = 0;
+
+        // small callables are stored inline
+        TaskFunction small([&result] { result = 1; });
+        CHECK(bool(small));
+        small();
+        CHECK(result == 1);
+
+        // move-only callables
+        std::unique_ptr<int> pointer(new int(2));
+        TaskFunction moveonly([&result, pointer = std::move(pointer)] { result = *pointer; });
+        TaskFunction moved(std::move(moveonly));
+        CHECK(!moveonly);
+        moved();
+        CHECK(result == 2);
+
+        // callables which don't fit into the inline storage
+        char large[TaskFunction::CAPACITY * 4] = { 3 };
+        TaskFunction external([&result, large] { result = large[0]; });
+        TaskFunction assigned;
+        assigned = std::move(external);
+        assigned();
+        CHECK(result == 3);
+
+        // over-aligned callables keep their alignment
+        TaskFunction aligned(Aligned { &result });
+        aligned();
+        CHECK(result == 1);
+
+        // the callable is destroyed when the function is destroyed or reset
+        auto shared = std::make_shared<int>(4);
+        {
+            TaskFunction inline_owner([shared] {});
+            TaskFunction external_owner([shared, large] {});
+            CHECK(shared.use_count() == 3);
+            external_owner.reset();
+            CHECK(shared.use_count() == 2);
+        }
+        CHECK(shared.use_count() == 1);
+    }
+
+    void test_task_arguments()
+    {
+        ThreadPool pool(2);
+        ConcurrentQueue queue(pool, "test.arguments");
+
+        // the arguments are stored by value, the move-only ones included
+        std::atomic<int> sum { 0 };
+        std::unique_ptr<int> pointer(new int(5));
+
+        queue.enqueue([&sum] (int a, int b) { sum += a + b; }, 1, 2);
+        queue.enqueue([&sum] (std::unique_ptr<int>& p) { sum += *p; }, std::move(pointer));
+        queue.enqueue([&sum, p = std::unique_ptr<int>(new int(7))] { sum += *p; });
+        queue.wait();
+
+        CHECK(sum == 15);
+    }
+
+    // ----------------------------------------------------------------------------
+    // Future
+    // ----------------------------------------------------------------------------
+
+    void test_future()
+    {
+        ThreadPool pool(4);
+
+        FutureTask<int> task(pool, [] { return 20; });
+        Future<int> doubled = task.then([] (int value) { return value * 2; });
+        Future<std::string> text = doubled.then([] (int value) { return std::to_string(value + 2); });
+        CHECK(text.get() == "42");
+        CHECK(task.ready());
+
+        // the arguments and the callable can be move-only
+        FutureTask<int> moveonly(pool, [p = std::unique_ptr<int>(new int(3))] (std::unique_ptr<int>& q) { return *p + *q; },
+                                 std::unique_ptr<int>(new int(4)));
+        CHECK(moveonly.get() == 7);
+
+        // the exception skips the continuation and reaches the last future
+        std::atomic<bool> called { false };
+        FutureTask<int> failing(pool, [] () -> int { throw std::runtime_error("failed"); });
+        Future<void> next = failing.then([&called] (int) { called = true; });
+
+        bool thrown = false;
+        try
+        {
+            next.get();
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+
+        CHECK(thrown);
+        CHECK(!called);
+    }
+
+    void test_when_all()
+    {
+        ThreadPool pool(4);
+
+        std::atomic<int> sum { 0 };
+        std::vector<Future<void>> futures;
+
+        for (int i = 1; i <= 100; ++i)
+        {
+            futures.push_back(FutureTask<void>(pool, [&sum, i] {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                sum += i;
+            }));
+        }
+
+        when_all(futures).wait();
+        CHECK(sum == 5050);
+
+        FutureTask<int> a(pool, [] { return 1; });
+        FutureTask<std::string> b(pool, [] { return std::string("b"); });
+        when_all(a, b).wait();
+        CHECK(a.ready() && b.ready());
+
+        // the first exception of the inputs is passed on
+        FutureTask<void> c(pool, [] { throw std::runtime_error("c"); });
+        bool thrown = false;
+        try
+        {
+            when_all(a, c).get();
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    void test_task_graph()
+    {
+        ThreadPool pool(4);
+        TaskGraph graph(pool, "test.graph");
+
+        // diamond: a -> (b, c) -> d
+        std::mutex mutex;
+        std::vector<char> order;
+        auto record = [&] (char name) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(name);
+        };
+
+        TaskGraph::Node a = graph.add(record, 'a');
+        TaskGraph::Node b = graph.add(record, 'b');
+        TaskGraph::Node c = graph.add(record, 'c');
+        TaskGraph::Node d = graph.add(record, 'd');
+        graph.precede(a, b);
+        graph.precede(a, c);
+        graph.precede(b, d);
+        graph.precede(c, d);
+
+        // the graph can be run again
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            order.clear();
+            graph.run();
+            graph.wait();
+
+            CHECK(order.size() == 4);
+            CHECK(order.front() == 'a');
+            CHECK(order.back() == 'd');
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // barriers
+    // ----------------------------------------------------------------------------
+
+    void test_barrier()
+    {
+        ThreadPool pool(4);
+        ConcurrentQueue queue(pool, "test.barrier");
+
+        // the tasks after a barrier start after the tasks before it have completed
+        std::atomic<int> completed { 0 };
+        std::atomic<int> early { 0 };
+
+        for (int stage = 0; stage < 4; ++stage)
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                queue.enqueue([&completed, &early, stage] {
+                    if (completed < stage * 16)
+                        ++early;
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    ++completed;
+                });
+            }
+
+            queue.barrier();
+        }
+
+        queue.wait();
+
+        CHECK(completed == 64);
+        CHECK(early == 0);
+    }
+
+    void test_serial_queue()
+    {
+        ThreadPool pool(4);
+        SerialQueue queue(pool, "test.serial");
+
+        // one task at a time in the order of enqueue
+        std::atomic<int> running { 0 };
+        std::atomic<int> overlaps { 0 };
+        std::vector<int> order;
+
+        for (int i = 0; i < 200; ++i)
+        {
+            queue.enqueue([&, i] {
+                if (running++)
+                    ++overlaps;
+                order.push_back(i);
+                --running;
+            });
+        }
+
+        queue.wait();
+
+        CHECK(overlaps == 0);
+        CHECK(order.size() == 200);
+
+        bool ordered = true;
+        for (int i = 0; i < int(order.size()); ++i)
+        {
+            ordered &= order[i] == i;
+        }
+        CHECK(ordered);
+
+        // a long task of the serial queue blocks only its successors; the other
+        // queues make progress meanwhile on the other workers
+        ConcurrentQueue other(pool, "test.other");
+        std::atomic<int> others { 0 };
+        std::atomic<int> done { 0 };
+        std::atomic<bool> progressed { false };
+
+        queue.enqueue([&] {
+            auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (others < 100 && std::chrono::steady_clock::now() < timeout)
+            {
+                std::this_thread::yield();
+            }
+            progressed = others == 100 && done == 0;
+        });
+
+        for (int i = 0; i < 10; ++i)
+        {
+            queue.enqueue([&] { ++done; });
+        }
+
+        for (int i = 0; i < 100; ++i)
+        {
+            other.enqueue([&] { ++others; });
+        }
+
+        other.wait();
+        queue.wait();
+
+        CHECK(progressed);
+        CHECK(done == 10);
+    }
+
+    // ----------------------------------------------------------------------------
+    // parking
+    // ----------------------------------------------------------------------------
+
+    void test_event_count()
+    {
+        EventCount event;
+        std::atomic<bool> ready { false };
+        std::atomic<int> woken { 0 };
+        std::vector<std::thread> threads;
+
+        // the waiters re-check the condition between prepareWait() and wait()
+        for (int i = 0; i < 4; ++i)
+        {
+            threads.emplace_back([&] {
+                while (!ready)
+                {
+                    EventCount::Key key = event.prepareWait();
+                    if (ready)
+                    {
+                        event.cancelWait();
+                        break;
+                    }
+                    event.wait(key);
+                }
+                ++woken;
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CHECK(woken == 0);
+
+        ready = true;
+        event.notifyAll();
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        CHECK(woken == 4);
+
+        // a notify between prepareWait() and wait() is not lost
+        EventCount::Key key = event.prepareWait();
+        event.notify();
+        event.wait(key);
+    }
+
+    void test_wakeup()
+    {
+        ThreadPool pool(4);
+        pool.setSpinBudget(10);
+        CHECK(pool.getSpinBudget() == 10);
+
+        ConcurrentQueue queue(pool, "test.wakeup");
+
+        // the workers park after the spin budget and wake up for new work
+        for (int pass = 0; pass < 3; ++pass)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+            std::atomic<int> count { 0 };
+            for (int i = 0; i < 100; ++i)
+            {
+                queue.enqueue([&count] { ++count; });
+            }
+
+            queue.wait();
+            CHECK(count == 100);
+        }
+
+        // the tasks complete without anyone helping in wait()
+        std::atomic<int> count { 0 };
+        for (int i = 0; i < 16; ++i)
+        {
+            queue.enqueue([&count] { ++count; });
+        }
+
+        auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (count < 16 && std::chrono::steady_clock::now() < timeout)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        CHECK(count == 16);
+        queue.wait();
+    }
+
+    // ----------------------------------------------------------------------------
+    // configuration
+    // ----------------------------------------------------------------------------
+
+    void test_config()
+    {
+        ThreadPoolConfig config;
+        config.threads = 3;
+        config.processors = { 0 };
+        config.affinity = true;
+        config.spin = 20;
+        config.statistics = false;
+
+        ThreadPool pool(config);
+        CHECK(pool.size() == 3);
+        CHECK(pool.getSpinBudget() == 20);
+
+        // the pools are independent of each other and of the instance
+        ThreadPool other(2);
+        CHECK(other.size() == 2);
+
+        ConcurrentQueue a(pool, "test.a");
+        ConcurrentQueue b(other, "test.b");
+        std::atomic<int> count { 0 };
+
+        for (int i = 0; i < 100; ++i)
+        {
+            a.enqueue([&count] { ++count; });
+            b.enqueue([&count] { count += 2; });
+        }
+
+        a.wait();
+        b.wait();
+        CHECK(count == 300);
+    }
+
+    void test_config_environment()
+    {
+#if !defined(MANGO_PLATFORM_WINDOWS)
+        // ctest runs the tests with MANGO_THREADPOOL_SIZE=4
+        if (const char* size = std::getenv("MANGO_THREADPOOL_SIZE"))
+        {
+            CHECK(ThreadPool::getInstanceSize() == std::atoi(size));
+        }
+
+        setenv("MANGO_THREADPOOL_SIZE", "5", 1);
+        setenv("MANGO_THREADPOOL_CPUS", "0", 1);
+        setenv("MANGO_THREADPOOL_AFFINITY", "1", 1);
+        setenv("MANGO_THREADPOOL_SPIN", "7", 1);
+        setenv("MANGO_THREADPOOL_STATISTICS", "0", 1);
+
+        ThreadPoolConfig config = ThreadPoolConfig::fromEnvironment();
+        CHECK(config.threads == 5);
+        CHECK(config.processors == std::vector<int>({ 0 }));
+        CHECK(config.affinity);
+        CHECK(config.spin == 7);
+        CHECK(!config.statistics);
+
+        ThreadPool pool(config);
+        CHECK(pool.size() == 5);
+#endif
+
+        // the instance can't be configured after it has been created
+        ThreadPool::getInstance();
+
+        bool thrown = false;
+        try
+        {
+            ThreadPool::configureInstance(ThreadPoolConfig());
+        }
+        catch (const std::exception&)
+        {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    // ----------------------------------------------------------------------------
+    // statistics
+    // ----------------------------------------------------------------------------
+
+    const ThreadPoolStatistics::Queue* find_queue(const ThreadPoolStatistics& statistics, const char* name)
+    {
+        for (auto& queue : statistics.queues)
+        {
+            if (queue.name == name)
+                return &queue;
+        }
+        return nullptr;
+    }
+
+    void test_statistics()
+    {
+        ThreadPool pool(2);
+
+        {
+            // the queues with the same name are aggregated
+            ConcurrentQueue a(pool, "test.counted");
+            ConcurrentQueue b(pool, "test.counted");
+            ConcurrentQueue slow(pool, "test.slow");
+
+            for (int i = 0; i < 50; ++i)
+            {
+                a.enqueue([] {});
+                b.enqueue([] {});
+            }
+
+            for (int i = 0; i < 10; ++i)
+            {
+                slow.enqueue([] { std::this_thread::sleep_for(std::chrono::milliseconds(2)); });
+            }
+
+            a.wait();
+            b.wait();
+            slow.wait();
+        }
+
+        ThreadPoolStatistics statistics = pool.getStatistics();
+
+        const ThreadPoolStatistics::Queue* counted = find_queue(statistics, "test.counted");
+        CHECK(counted != nullptr);
+        if (counted)
+        {
+            CHECK(counted->enqueued == 100);
+            CHECK(counted->completed == 100);
+            CHECK(counted->depth == 0);
+            CHECK(counted->latency.total() == 100);
+            CHECK(counted->runtime.total() == 100);
+        }
+
+        const ThreadPoolStatistics::Queue* slow = find_queue(statistics, "test.slow");
+        CHECK(slow != nullptr);
+        if (slow)
+        {
+            CHECK(slow->completed == 10);
+            CHECK(slow->runtime.percentile(0.5) >= 2048);
+        }
+
+        // every task was run by a worker or by the thread waiting for it
+        CHECK(statistics.workers.size() == 2);
+
+        uint64 tasks = statistics.external.tasks;
+        uint64 busy = statistics.external.busy;
+        for (auto& worker : statistics.workers)
+        {
+            tasks += worker.tasks;
+            busy += worker.busy;
+        }
+
+        CHECK(tasks == 110);
+        CHECK(busy >= 10 * 2000);
+
+        ThreadPoolStatistics::Histogram histogram = {};
+        CHECK(histogram.percentile(0.5) == 0);
+        histogram.count[0] = 1;
+        histogram.count[3] = 2;
+        histogram.count[10] = 1;
+        CHECK(histogram.total() == 4);
+        CHECK(histogram.percentile(0.25) == 1);
+        CHECK(histogram.percentile(0.5) == 8);
+        CHECK(histogram.percentile(1.0) == 1024);
+    }
+
+} // namespace
+
+int main()
+{
+    test::run("work stealing", test_work_stealing);
+    test::run("nested tasks", test_nested_tasks);
+    test::run("external submit", test_external_submit);
+    test::run("external submit allocations", test_external_submit_allocations);
+    test::run("task function", test_task_function);
+    test::run("task arguments", test_task_arguments);
+    test::run("future", test_future);
+    test::run("when all", test_when_all);
+    test::run("task graph", test_task_graph);
+    test::run("barrier", test_barrier);
+    test::run("serial queue", test_serial_queue);
+    test::run("event count", test_event_count);
+    test::run("wakeup", test_wakeup);
+    test::run("config", test_config);
+    test::run("config environment", test_config_environment);
+    test::run("statistics", test_statistics);
+    return test::result();
+}